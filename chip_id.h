@@ -34,5 +34,11 @@
 
 #define AMD																0x01
 	#define AM29F040B													0xA4
+	// Micron's M29F160 parts report AMD's manufacturer ID
+	#define M29F160FT													0xD2
+	#define M29F160FB													0xD8
+
+#define MACRONIX														0xC2
+	#define MX29F040													0xA4
 
 #endif /* CHIP_ID_H_ */
@@ -54,6 +54,10 @@
 #define MCP23S17_OLATA						0x14
 #define MCP23S17_OLATB						0x15
 
+/// IOCON bits. SEQOP disables address incrementing; with BANK = 0 the address
+/// pointer toggles between the A and B registers of a pair instead.
+#define MCP23S17_IOCON_SEQOP				0x20
+
 /// Struct representing a single MCP23S17 device
 typedef struct MCP23S17
 {
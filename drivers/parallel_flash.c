@@ -22,27 +22,141 @@
  */
 
 #include "parallel_flash.h"
+#include "parallel_flash_chips.h"
+#include "parallel_flash_cfi.h"
+#include "../health.h"
+#include "../stats.h"
+#include "../trace.h"
 #include "../util.h"
+#include <stddef.h>
+
+/// Largest write buffer we can fill in one go (the count is a single byte)
+#define MAX_WRITE_BUFFER_SIZE			256
+
+/// Status bits read from busy chips, repeated for every byte lane. DQ6 toggles
+/// while busy. During buffered programming, DQ5 means the chip exceeded its
+/// time limit and DQ1 means it aborted the write to buffer.
+#define STATUS_TOGGLE					0x40404040UL
+#define STATUS_TIMEOUT					0x20202020UL
+#define STATUS_BUFFER_ABORT				0x02020202UL
 
 /// Erasable sector size in SST39SF040
 #define SECTOR_SIZE_SST39SF040			(4*1024UL)
 /// Erasable sector size in M29F160FB5AN6E2, 8-bit mode
 #define SECTOR_SIZE_M29F160FB5AN6E2_8	(64*1024UL)
 
+/// The different ways of programming data into the chips
+typedef enum ParallelFlashWriteAlgorithm
+{
+	/// Full unlock + program command for every byte
+	WriteAlgorithmStandard,
+	/// Unlock bypass mode, 2-cycle program command for every byte
+	WriteAlgorithmUnlockBypass,
+	/// Write buffer programming, a page at a time
+	WriteAlgorithmBuffered,
+	/// The number of algorithms
+	NUM_WRITE_ALGORITHMS
+} ParallelFlashWriteAlgorithm;
+
+/// A write algorithm specialized for a particular unlock scheme and chip mask
+/// mode. Returns the 32-bit mask of chips that failed to program.
+typedef uint32_t (*ParallelFlashWriteEngine)(uint32_t startAddress, uint32_t const *buf, uint16_t len, uint32_t mask);
+
 static uint32_t ParallelFlash_MaskForChips(uint8_t chips);
-static ALWAYS_INLINE void ParallelFlash_WaitForCompletion(void);
+static uint8_t ParallelFlash_ChipsForMask(uint32_t mask);
+static uint32_t ParallelFlash_Lanes(uint32_t bits);
+static ALWAYS_INLINE void ParallelFlash_WaitForCompletion(uint32_t mask);
+static ALWAYS_INLINE uint32_t ParallelFlash_WaitForBufferedProgram(uint32_t mask);
+static void ParallelFlash_LeaveUnlockBypass(void);
 static ALWAYS_INLINE uint32_t ParallelFlash_UnlockAddress1(void);
+static ALWAYS_INLINE uint8_t ParallelFlash_UnlockScheme(void);
+static ALWAYS_INLINE bool ParallelFlash_UseUnlockBypass(void);
+static ALWAYS_INLINE bool ParallelFlash_UseMultiSectorErase(void);
+static ALWAYS_INLINE bool ParallelFlash_UseWriteBuffer(void);
+static void ParallelFlash_ReadChipIDs(ParallelFlashChipID *chips);
+static void ParallelFlash_IdentifyCFI(ParallelFlashChipID *chips, ParallelFlashChipType type, uint8_t *unknownChips);
+static void ParallelFlash_UpdateGroups(void);
+static uint8_t ParallelFlash_GroupChips(uint8_t *groups, bool (*compatible)(uint8_t, uint8_t));
+static bool ParallelFlash_WriteCompatible(uint8_t chip1, uint8_t chip2);
+static bool ParallelFlash_EraseCompatible(uint8_t chip1, uint8_t chip2);
+static uint16_t ParallelFlash_WriteMode(void);
+static void ParallelFlash_SelectChips(uint8_t chipsMask);
+static ParallelFlashWriteEngine ParallelFlash_WriteEngine(bool allChips);
+static bool ParallelFlash_FindSectors(uint32_t address, uint32_t length, uint8_t numEraseSectorGroups, ParallelFlashEraseSectorGroup const *eraseSectorGroups, uint8_t *firstSectorGroup, uint32_t *firstSectorInGroup);
+static void ParallelFlash_DefaultSectors(uint8_t *numEraseSectorGroups, ParallelFlashEraseSectorGroup const **eraseSectorGroups);
 
-/// The type/arrangement of parallel flash chips we are talking to
+/// The type/arrangement of parallel flash chips the host told us we are
+/// talking to. This is used for any chips we weren't able to identify.
+static ParallelFlashChipType chipType = ParallelFlash_SST39SF040_x4;
+/// The unlock scheme used by each chip, indexed by bit number in a chip mask
+static ParallelFlashChipType chipTypes[PARALLEL_FLASH_NUM_CHIPS];
+/// Info about each identified chip, or NULL if we don't know what it is
+static ParallelFlashChipInfo const *chipInfos[PARALLEL_FLASH_NUM_CHIPS];
+/// Masks of chips that can be written at the same time, and how many there are
+static uint8_t writeGroups[PARALLEL_FLASH_NUM_CHIPS] = {ALL_CHIPS};
+static uint8_t numWriteGroups = 1;
+/// Masks of chips that can be erased at the same time, and how many there are
+static uint8_t eraseGroups[PARALLEL_FLASH_NUM_CHIPS] = {ALL_CHIPS};
+static uint8_t numEraseGroups = 1;
+/// The unlock scheme of the chips we are currently sending commands to
 static ParallelFlashChipType curChipType = ParallelFlash_SST39SF040_x4;
+/// Info about the chips we are currently sending commands to, or NULL
+static ParallelFlashChipInfo const *curChipInfo = NULL;
+/// True if a write session started by ParallelFlash_BeginWrite lets the
+/// chips stay in unlock bypass mode between writes
+static bool writeSessionOpen = false;
+/// The 32-bit mask of the chips that are in unlock bypass mode
+static uint32_t unlockBypassLanes = 0;
+
+// Command sequences, one for each unlock scheme (see ParallelFlash_UnlockScheme).
+// The first two cycles of each are the unlock sequence.
+
+/// "Program" command: unlock, then 0xA0. The data cycle comes after it.
+static const ParallelBusCycle programSequences[2][3] = {
+	{{0x55555555UL, 0xAAAAAAAAUL}, {0xAAAAAAAAUL, 0x55555555UL}, {0x55555555UL, 0xA0A0A0A0UL}},
+	{{0xAAAAAAAAUL, 0xAAAAAAAAUL}, {0x55555555UL, 0x55555555UL}, {0xAAAAAAAAUL, 0xA0A0A0A0UL}},
+};
+/// "Unlock bypass" command: unlock, then 0x20
+static const ParallelBusCycle unlockBypassSequences[2][3] = {
+	{{0x55555555UL, 0xAAAAAAAAUL}, {0xAAAAAAAAUL, 0x55555555UL}, {0x55555555UL, 0x20202020UL}},
+	{{0xAAAAAAAAUL, 0xAAAAAAAAUL}, {0x55555555UL, 0x55555555UL}, {0xAAAAAAAAUL, 0x20202020UL}},
+};
+/// "Chip erase" command: unlock, 0x80, unlock, 0x10. The first 5 cycles are
+/// also how a sector erase starts, before the sector addresses are given.
+static const ParallelBusCycle eraseSequences[2][6] = {
+	{{0x55555555UL, 0xAAAAAAAAUL}, {0xAAAAAAAAUL, 0x55555555UL}, {0x55555555UL, 0x80808080UL},
+	 {0x55555555UL, 0xAAAAAAAAUL}, {0xAAAAAAAAUL, 0x55555555UL}, {0x55555555UL, 0x10101010UL}},
+	{{0xAAAAAAAAUL, 0xAAAAAAAAUL}, {0x55555555UL, 0x55555555UL}, {0xAAAAAAAAUL, 0x80808080UL},
+	 {0xAAAAAAAAUL, 0xAAAAAAAAUL}, {0x55555555UL, 0x55555555UL}, {0xAAAAAAAAUL, 0x10101010UL}},
+};
+/// "Write to buffer abort reset" command: unlock, then 0xF0
+static const ParallelBusCycle abortResetSequences[2][3] = {
+	{{0x55555555UL, 0xAAAAAAAAUL}, {0xAAAAAAAAUL, 0x55555555UL}, {0x55555555UL, 0xF0F0F0F0UL}},
+	{{0xAAAAAAAAUL, 0xAAAAAAAAUL}, {0x55555555UL, 0x55555555UL}, {0xAAAAAAAAUL, 0xF0F0F0F0UL}},
+};
+/// "Unlock bypass reset" command, the same for both unlock schemes
+static const ParallelBusCycle unlockBypassResetSequence[2] = {
+	{0, 0x90909090UL}, {0, 0x00000000UL}
+};
 
 /** Sets the type/arrangement of parallel flash chips we are talking to
  *
  * @param type The type/arrangement of flash chips
+ *
+ * The host's choice wins over anything we found out by identifying the chips,
+ * which may not even be the same chips anymore if the SIMM was swapped. So
+ * every chip goes back to using this unlock scheme and the host's sector map,
+ * until ParallelFlash_IdentifyChips is called again.
  */
 void ParallelFlash_SetChipType(ParallelFlashChipType type)
 {
-	curChipType = type;
+	chipType = type;
+	for (int8_t i = 0; i < PARALLEL_FLASH_NUM_CHIPS; i++)
+	{
+		chipTypes[i] = type;
+		chipInfos[i] = NULL;
+	}
+	ParallelFlash_UpdateGroups();
 }
 
 /** Gets the type/arrangement of parallel flash chips we are talking to
@@ -51,7 +165,17 @@ void ParallelFlash_SetChipType(ParallelFlashChipType type)
  */
 ParallelFlashChipType ParallelFlash_ChipType(void)
 {
-	return curChipType;
+	return chipType;
+}
+
+/** Gets info about a chip found during the last identification
+ *
+ * @param chip The index of the chip, in the same order as ParallelFlash_IdentifyChips
+ * @return Info about the chip, or NULL if it wasn't recognized
+ */
+ParallelFlashChipInfo const *ParallelFlash_ChipInfo(uint8_t chip)
+{
+	return chipInfos[PARALLEL_FLASH_NUM_CHIPS - chip - 1];
 }
 
 /** Reads data from the flash chip
@@ -63,8 +187,61 @@ ParallelFlashChipType ParallelFlash_ChipType(void)
 void ParallelFlash_Read(uint32_t startAddress, uint32_t *buf, uint16_t len)
 {
 	// Just forward this request directly onto the parallel bus. Nothing
-	// special is required for reading a chunk of data.
+	// special is required for reading a chunk of data, as long as the chips
+	// aren't in unlock bypass mode.
+	ParallelFlash_LeaveUnlockBypass();
+	STATS_BEGIN(readStart);
 	ParallelBus_Read(startAddress, buf, len);
+	STATS_END(StatsTimerBusRead, readStart);
+}
+
+/** Starts reading data from the flash chip, in the background if possible
+ *
+ * @param startAddress The address for reading
+ * @param buf The buffer to read to
+ * @param len The number of bytes to read
+ *
+ * Nothing else may be done with the flash chips until
+ * ParallelFlash_FinishRead is called. The buffer isn't filled until then.
+ */
+void ParallelFlash_StartRead(uint32_t startAddress, uint32_t *buf, uint16_t len)
+{
+	ParallelFlash_LeaveUnlockBypass();
+	STATS_BEGIN(readStart);
+	ParallelBus_StartRead(startAddress, buf, len);
+	STATS_END(StatsTimerBusRead, readStart);
+}
+
+/** Waits for a read started by ParallelFlash_StartRead to finish
+ *
+ */
+void ParallelFlash_FinishRead(void)
+{
+	// The read was already counted when it started, so just add the time we
+	// had to wait for it to finish
+	STATS_BEGIN(readStart);
+	ParallelBus_FinishRead();
+	STATS_END_N(StatsTimerBusRead, readStart, 0);
+}
+
+/** Reads data from only some of the flash chips
+ *
+ * @param startAddress The address for reading
+ * @param buf The buffer to read to
+ * @param len The number of bytes to read
+ * @param chipsMask The mask of which chips we care about
+ *
+ * The bytes belonging to the other chips may come back as garbage. Skipping
+ * them can make the read faster on hardware with slower data lanes.
+ */
+void ParallelFlash_ReadSomeChips(uint32_t startAddress, uint32_t *buf, uint16_t len, uint8_t chipsMask)
+{
+	ParallelFlash_LeaveUnlockBypass();
+	STATS_BEGIN(readStart);
+	ParallelBus_SetActiveLanes(ParallelFlash_MaskForChips(chipsMask));
+	ParallelBus_Read(startAddress, buf, len);
+	ParallelBus_SetActiveLanes(0xFFFFFFFFUL);
+	STATS_END(StatsTimerBusRead, readStart);
 }
 
 /** Unlocks the flash chips using the special write sequence
@@ -73,26 +250,121 @@ void ParallelFlash_Read(uint32_t startAddress, uint32_t *buf, uint16_t len)
  */
 void ParallelFlash_UnlockChips(uint8_t chipsMask)
 {
-	// Use a mask so we don't unlock chips we don't want to talk with
-	uint32_t mask = ParallelFlash_MaskForChips(chipsMask);
-	uint32_t unlockAddress = ParallelFlash_UnlockAddress1();
-
+	// Use a mask so we don't unlock chips we don't want to talk with.
 	// First part of unlock sequence:
 	// Write 0x55555555 to the address bus and 0xAA to the data bus
 	// (Some datasheets may only say 0x555 or 0x5555, but they ignore
 	// the upper bits, so writing the alternating pattern to all address lines
 	// should make it compatible with larger chips).
-	ParallelBus_WriteCycle(unlockAddress, 0xAAAAAAAAUL & mask);
-
 	// Second part of unlock sequence is the same thing, but reversed.
-	ParallelBus_WriteCycle(~unlockAddress, 0x55555555UL & mask);
+	ParallelBus_WriteSequence(programSequences[ParallelFlash_UnlockScheme()], 2,
+			ParallelFlash_MaskForChips(chipsMask));
 }
 
-/** Reads the ID of the chips
+/** Reads the ID of the chips, and configures the driver for the ones it knows
  *
  * @param Pointer to variable for storing ID info about each chip
+ *
+ * The unlock scheme selected by the host is tried first. Any chips that don't
+ * give us an ID we know about are probed with the other unlock scheme too.
+ * Each chip we recognize is set up with its own unlock scheme, write method
+ * and sector map, so the host doesn't have to tell us which kind of SIMM it
+ * is, and SIMMs built out of a mix of chips work too. Chips we don't know
+ * about are asked to describe themselves with a CFI query instead.
  */
 void ParallelFlash_IdentifyChips(ParallelFlashChipID *chips)
+{
+	ParallelFlashChipType const otherType = (chipType == ParallelFlash_SST39SF040_x4) ?
+			ParallelFlash_M29F160FB5AN6E2_x4 : ParallelFlash_SST39SF040_x4;
+	ParallelFlashChipID otherChips[PARALLEL_FLASH_NUM_CHIPS];
+	uint8_t unknownChips = 0;
+
+	curChipType = chipType;
+	ParallelFlash_ReadChipIDs(chips);
+	for (int8_t i = 0; i < PARALLEL_FLASH_NUM_CHIPS; i++)
+	{
+		ParallelFlashChipID const *id = &chips[PARALLEL_FLASH_NUM_CHIPS - i - 1];
+		chipTypes[i] = chipType;
+		chipInfos[i] = ParallelFlashChips_Find(id->manufacturer, id->device);
+		if (!chipInfos[i])
+		{
+			unknownChips |= (1 << i);
+		}
+	}
+
+	// Try the other unlock scheme on anything we didn't recognize. If it
+	// works, report the ID we got that way instead.
+	if (unknownChips)
+	{
+		curChipType = otherType;
+		ParallelFlash_ReadChipIDs(otherChips);
+		for (int8_t i = 0; i < PARALLEL_FLASH_NUM_CHIPS; i++)
+		{
+			ParallelFlashChipID const *id = &otherChips[PARALLEL_FLASH_NUM_CHIPS - i - 1];
+			ParallelFlashChipInfo const *info = ParallelFlashChips_Find(id->manufacturer, id->device);
+			if ((unknownChips & (1 << i)) && info)
+			{
+				chips[PARALLEL_FLASH_NUM_CHIPS - i - 1] = *id;
+				chipTypes[i] = otherType;
+				chipInfos[i] = info;
+				unknownChips &= ~(1 << i);
+			}
+		}
+	}
+
+	// If some chips aren't in our database, maybe they support CFI and can
+	// tell us their sector layout themselves. There's only room to remember
+	// one kind of CFI chip, so stop once we find one.
+	if (unknownChips)
+	{
+		uint8_t const unknownBefore = unknownChips;
+		ParallelFlash_IdentifyCFI(chips, chipType, &unknownChips);
+		if (unknownChips == unknownBefore)
+		{
+			ParallelFlash_IdentifyCFI(otherChips, otherType, &unknownChips);
+			for (int8_t i = 0; i < PARALLEL_FLASH_NUM_CHIPS; i++)
+			{
+				if ((unknownBefore & ~unknownChips) & (1 << i))
+				{
+					chips[PARALLEL_FLASH_NUM_CHIPS - i - 1] = otherChips[PARALLEL_FLASH_NUM_CHIPS - i - 1];
+				}
+			}
+		}
+	}
+
+	ParallelFlash_UpdateGroups();
+}
+
+/** Asks chips we couldn't identify to describe themselves using CFI
+ *
+ * @param chips The IDs read from the chips using this unlock scheme
+ * @param type The unlock scheme to try
+ * @param unknownChips The mask of chips we don't know about yet. Chips that
+ *                     answer the CFI query are removed from the mask.
+ */
+static void ParallelFlash_IdentifyCFI(ParallelFlashChipID *chips, ParallelFlashChipType type, uint8_t *unknownChips)
+{
+	uint8_t answered = *unknownChips;
+	ParallelFlashChipInfo const *info = ParallelFlashCFI_Query(type, chips, &answered);
+	if (info)
+	{
+		for (int8_t i = 0; i < PARALLEL_FLASH_NUM_CHIPS; i++)
+		{
+			if (answered & (1 << i))
+			{
+				chipTypes[i] = type;
+				chipInfos[i] = info;
+			}
+		}
+		*unknownChips &= ~answered;
+	}
+}
+
+/** Reads the raw ID of the chips using the current unlock scheme
+ *
+ * @param Pointer to variable for storing ID info about each chip
+ */
+static void ParallelFlash_ReadChipIDs(ParallelFlashChipID *chips)
 {
 	// Start by writing the unlock sequence to ALL chips
 	ParallelFlash_UnlockChips(ALL_CHIPS);
@@ -127,12 +399,29 @@ void ParallelFlash_IdentifyChips(ParallelFlashChipID *chips)
  */
 void ParallelFlash_EraseChips(uint8_t chipsMask)
 {
-	uint32_t unlockAddress = ParallelFlash_UnlockAddress1();
-	ParallelFlash_UnlockChips(chipsMask);
-	ParallelBus_WriteCycle(unlockAddress, 0x80808080UL);
-	ParallelFlash_UnlockChips(chipsMask);
-	ParallelBus_WriteCycle(unlockAddress, 0x10101010UL);
-	ParallelFlash_WaitForCompletion();
+	// Chips with different unlock schemes need their own erase commands, but
+	// once a chip starts erasing it ignores the commands meant for the others.
+	// So all of them can erase at the same time.
+	uint32_t erasingMask = 0;
+	STATS_BEGIN(eraseStart);
+	TRACE(TraceEraseChipsStart, chipsMask, 0);
+	ParallelBus_SetActiveLanes(ParallelFlash_MaskForChips(chipsMask));
+	for (uint8_t i = 0; i < numEraseGroups; i++)
+	{
+		uint8_t const groupMask = eraseGroups[i] & chipsMask;
+		if (groupMask)
+		{
+			uint32_t const mask = ParallelFlash_MaskForChips(groupMask);
+			ParallelFlash_SelectChips(groupMask);
+			ParallelBus_WriteSequence(eraseSequences[ParallelFlash_UnlockScheme()], 6, mask);
+			erasingMask |= mask;
+		}
+	}
+	ParallelFlash_WaitForCompletion(erasingMask);
+	HEALTH_ERASE_CHIPS(erasingMask);
+	ParallelBus_SetActiveLanes(0xFFFFFFFFUL);
+	TRACE(TraceEraseChipsEnd, chipsMask, 0);
+	STATS_END(StatsTimerEraseChips, eraseStart);
 }
 
 /** Erases only the range of sectors specified in the specified chips
@@ -143,8 +432,165 @@ void ParallelFlash_EraseChips(uint8_t chipsMask)
  * @param numEraseSectorGroups The number of erase sector groups we know about
  * @param eraseSectorGroups The erase sector groups
  * @return True on success, false on failure
+ *
+ * Chips we identified are erased using their own sector map, and the rest use
+ * the host's map. If the host sent a map, the range also has to line up with
+ * it for the identified chips. Otherwise the chips would erase a different
+ * area from the one the host asked for, so the erase fails instead. Groups of
+ * chips with different erase commands or sector maps are erased one after
+ * another. The range is checked against every group before anything is
+ * erased.
  */
 bool ParallelFlash_EraseSectors(uint32_t address, uint32_t length, uint8_t chipsMask, uint8_t numEraseSectorGroups, ParallelFlashEraseSectorGroup const *eraseSectorGroups)
+{
+	uint8_t firstSectorGroup;
+	uint32_t firstSectorInGroup;
+
+	// Make sure the range lines up with the sectors of every chip first
+	for (uint8_t i = 0; i < numEraseGroups; i++)
+	{
+		uint8_t const groupMask = eraseGroups[i] & chipsMask;
+		uint8_t numGroupSectorGroups = numEraseSectorGroups;
+		ParallelFlashEraseSectorGroup const *groupSectorGroups = eraseSectorGroups;
+		if (groupMask)
+		{
+			ParallelFlash_SelectChips(groupMask);
+			ParallelFlash_DefaultSectors(&numGroupSectorGroups, &groupSectorGroups);
+			if (!ParallelFlash_FindSectors(address, length, numGroupSectorGroups, groupSectorGroups,
+					&firstSectorGroup, &firstSectorInGroup))
+			{
+				return false;
+			}
+
+			// The host's map has to agree with the chips' own map
+			if (groupSectorGroups != eraseSectorGroups && numEraseSectorGroups &&
+				!ParallelFlash_FindSectors(address, length, numEraseSectorGroups, eraseSectorGroups,
+					&firstSectorGroup, &firstSectorInGroup))
+			{
+				return false;
+			}
+		}
+	}
+
+	// Only the selected chips' lanes need to be read while polling for completion
+	ParallelBus_SetActiveLanes(ParallelFlash_MaskForChips(chipsMask));
+	for (uint8_t i = 0; i < numEraseGroups; i++)
+	{
+		uint8_t const groupMask = eraseGroups[i] & chipsMask;
+		uint8_t numGroupSectorGroups = numEraseSectorGroups;
+		ParallelFlashEraseSectorGroup const *groupSectorGroups = eraseSectorGroups;
+		if (!groupMask)
+		{
+			continue;
+		}
+
+		ParallelFlash_SelectChips(groupMask);
+		ParallelFlash_DefaultSectors(&numGroupSectorGroups, &groupSectorGroups);
+		ParallelFlash_FindSectors(address, length, numGroupSectorGroups, groupSectorGroups,
+				&firstSectorGroup, &firstSectorInGroup);
+
+		uint32_t const mask = ParallelFlash_MaskForChips(groupMask);
+		uint32_t curAddress = address;
+		uint32_t curLength = length;
+		uint8_t curSectorGroup = firstSectorGroup;
+		uint32_t curSectorInGroup = firstSectorInGroup;
+
+#ifdef HEALTH_ENABLED
+		// The health map numbers sectors from the start of the chip
+		uint16_t sectorNumber = (uint16_t)firstSectorInGroup;
+		for (uint8_t g = 0; g < firstSectorGroup; g++)
+		{
+			sectorNumber += groupSectorGroups[g].count;
+		}
+#endif
+
+		// We're good to go. Let's do it. The process varies based on the chip type
+		if (!ParallelFlash_UseMultiSectorErase())
+		{
+			// This chip sucks because you have to erase each sector with its own
+			// complete erase unlock command, which can take a while. At least
+			// individual erase operations are much faster on this chip...
+			while (curLength)
+			{
+				// Start the erase command
+				STATS_BEGIN(eraseStart);
+				TRACE(TraceEraseSectorStart, groupMask, (uint16_t)(curAddress >> 8));
+				ParallelBus_WriteSequence(eraseSequences[ParallelFlash_UnlockScheme()], 5, mask);
+
+				// Now provide a sector address, but only one. Then the whole
+				// unlock sequence has to be done again after this sector is done.
+				ParallelBus_WriteCycle(curAddress, 0x30303030UL & mask);
+
+				// Move our counters in preparation for the next sector
+				curAddress += groupSectorGroups[curSectorGroup].size;
+				curLength -= groupSectorGroups[curSectorGroup].size;
+				curSectorInGroup++;
+				if (curSectorInGroup >= groupSectorGroups[curSectorGroup].count)
+				{
+					curSectorGroup++;
+					curSectorInGroup = 0;
+				}
+
+				// Wait for completion of this individual erase operation before
+				// we can start a new erase operation.
+				ParallelFlash_WaitForCompletion(mask);
+#ifdef HEALTH_ENABLED
+				Health_AddEraseSectors(sectorNumber++, 1, mask);
+#endif
+				TRACE(TraceEraseSectorEnd, groupMask, 1);
+				STATS_END(StatsTimerEraseSector, eraseStart);
+			}
+		}
+		else
+		{
+			// This chip is nicer because it can take all the sector addresses at
+			// once and then do the final erase operation in one fell swoop.
+			// Start the erase command
+			STATS_COUNTER(numSectors);
+			STATS_BEGIN(eraseStart);
+			TRACE(TraceEraseSectorStart, groupMask, (uint16_t)(curAddress >> 8));
+			ParallelBus_WriteSequence(eraseSequences[ParallelFlash_UnlockScheme()], 5, mask);
+
+			while (curLength)
+			{
+				ParallelBus_WriteCycle(curAddress, 0x30303030UL & mask);
+				STATS_COUNT(numSectors);
+
+				// Move our counters in preparation for the next sector
+				curAddress += groupSectorGroups[curSectorGroup].size;
+				curLength -= groupSectorGroups[curSectorGroup].size;
+				curSectorInGroup++;
+				if (curSectorInGroup >= groupSectorGroups[curSectorGroup].count)
+				{
+					curSectorGroup++;
+					curSectorInGroup = 0;
+				}
+			}
+
+			// Wait for completion of the entire erase operation
+			ParallelFlash_WaitForCompletion(mask);
+			HEALTH_ERASE_SECTORS(sectorNumber, (uint16_t)numSectors, mask);
+			TRACE(TraceEraseSectorEnd, groupMask, (uint16_t)numSectors);
+			STATS_END_N(StatsTimerEraseSector, eraseStart, numSectors);
+		}
+	}
+
+	ParallelBus_SetActiveLanes(0xFFFFFFFFUL);
+	return true;
+}
+
+/** Finds the sector map to use for the selected chips
+ *
+ * @param numEraseSectorGroups The number of erase sector groups from the host, updated if needed
+ * @param eraseSectorGroups The erase sector groups from the host, updated if needed
+ *
+ * Chips we identified know their own sector map, which is what they really
+ * erase, so it's used instead of the host's. The host's map is for the chips
+ * we didn't recognize, so a SIMM with a mix of known and unknown chips gets the
+ * right map for each of them. ParallelFlash_EraseSectors makes sure the two
+ * maps agree about the range being erased.
+ */
+static void ParallelFlash_DefaultSectors(uint8_t *numEraseSectorGroups, ParallelFlashEraseSectorGroup const **eraseSectorGroups)
 {
 	// Choose a default sector group if we don't have the info
 	static const ParallelFlashEraseSectorGroup defaultSST39SF040Sectors[] = {
@@ -158,35 +604,49 @@ bool ParallelFlash_EraseSectors(uint32_t address, uint32_t length, uint8_t chips
 		{0xFFFFFFFFUL, SECTOR_SIZE_M29F160FB5AN6E2_8}
 	};
 
-	// If we don't know the sector info (older programmer or unknown chips)
+	// If we identified the chips, use their sector map
+	if (curChipInfo)
+	{
+		*eraseSectorGroups = curChipInfo->eraseSectorGroups;
+		*numEraseSectorGroups = curChipInfo->numEraseSectorGroups;
+	}
+
+	// If the host didn't tell us the sector info either (older programmer software)
 	// then fall back to the previous hardcoded sector maps.
 	// Note that "chip type" isn't really accurate anymore; this is more about
 	// whether or not it has shifted unlock addresses. But these are the hardcoded
 	// defaults that seemed to work okay for people previously.
-	if (numEraseSectorGroups == 0)
+	if (*numEraseSectorGroups == 0)
 	{
 		switch (curChipType)
 		{
 		case ParallelFlash_SST39SF040_x4:
 		default:
-			eraseSectorGroups = defaultSST39SF040Sectors;
-			numEraseSectorGroups = sizeof(defaultSST39SF040Sectors)/sizeof(defaultSST39SF040Sectors[0]);
+			*eraseSectorGroups = defaultSST39SF040Sectors;
+			*numEraseSectorGroups = sizeof(defaultSST39SF040Sectors)/sizeof(defaultSST39SF040Sectors[0]);
 			break;
 		case ParallelFlash_M29F160FB5AN6E2_x4:
-			eraseSectorGroups = defaultM29F160FBSectors;
-			numEraseSectorGroups = sizeof(defaultM29F160FBSectors)/sizeof(defaultM29F160FBSectors[0]);
+			*eraseSectorGroups = defaultM29F160FBSectors;
+			*numEraseSectorGroups = sizeof(defaultM29F160FBSectors)/sizeof(defaultM29F160FBSectors[0]);
 			break;
 		}
 	}
+}
 
-	bool result = false;
-
-	// The first sector group and index in that group to erase
-	uint32_t firstSectorGroup = 0;
-	uint32_t firstSectorInGroup = 0;
-
+/** Locates the first sector of an erase range, and checks the range is valid
+ *
+ * @param address The start address to erase
+ * @param length The number of bytes to erase
+ * @param numEraseSectorGroups The number of erase sector groups
+ * @param eraseSectorGroups The erase sector groups
+ * @param firstSectorGroup Output for the index of the first sector group to erase
+ * @param firstSectorInGroup Output for the index of the first sector in that group
+ * @return True if the range starts and ends on sector boundaries
+ */
+static bool ParallelFlash_FindSectors(uint32_t address, uint32_t length, uint8_t numEraseSectorGroups, ParallelFlashEraseSectorGroup const *eraseSectorGroups, uint8_t *firstSectorGroup, uint32_t *firstSectorInGroup)
+{
 	// Temporary counters for matching up sector locations
-	uint32_t curSectorGroup = 0;
+	uint8_t curSectorGroup = 0;
 	uint32_t curSectorInGroup = 0;
 
 	// Find the first sector we need to erase. Keep searching until we've
@@ -212,8 +672,8 @@ bool ParallelFlash_EraseSectors(uint32_t address, uint32_t length, uint8_t chips
 	}
 
 	// OK, we've found our first sector to erase.
-	firstSectorGroup = curSectorGroup;
-	firstSectorInGroup = curSectorInGroup;
+	*firstSectorGroup = curSectorGroup;
+	*firstSectorInGroup = curSectorInGroup;
 
 	// Now, locate our last sector to erase.
 	uint32_t curLength = 0;
@@ -236,194 +696,445 @@ bool ParallelFlash_EraseSectors(uint32_t address, uint32_t length, uint8_t chips
 	}
 
 	// If the length wasn't on a sector boundary, bail
-	if (curLength != length)
-	{
-		return false;
-	}
+	return curLength == length;
+}
 
-	// We've now verified that everything is on a sector boundary, so we can
-	// go ahead with the erase operation!
-	curSectorGroup = firstSectorGroup;
-	curSectorInGroup = firstSectorInGroup;
+/** Writes a buffer of data to all 4 chips simultaneously
+ *
+ * @param startAddress The starting address to write in flash
+ * @param buf The buffer to write
+ * @param len The length of data to write
+ * @return The mask of chips that reported a program failure, or 0
+ *
+ * The API may look silly to have broken into different functions like this, but
+ * it's a performance optimization. It means we don't have to check during every
+ * byte write to see the chip unlock mask. It saves a bunch of time.
+ */
+RAMFUNC uint8_t ParallelFlash_WriteAllChips(uint32_t startAddress, uint32_t const *buf, uint16_t len)
+{
+	uint32_t failed = 0;
+	STATS_BEGIN(programStart);
+	TRACE(TraceProgramStart, ALL_CHIPS, (uint16_t)(startAddress >> 8));
 
-	// We're good to go. Let's do it. The process varies based on the chip type
-	if (curChipType == ParallelFlash_SST39SF040_x4)
+	// All of the chips program the same way, so we can use the fast path
+	if (numWriteGroups == 1)
+	{
+		ParallelFlash_SelectChips(ALL_CHIPS);
+		failed = ParallelFlash_WriteEngine(true)(startAddress, buf, len, 0xFFFFFFFFUL);
+	}
+	// Mixed chips; write each group of compatible chips separately
+	else
 	{
-		// This chip sucks because you have to erase each sector with its own
-		// complete erase unlock command, which can take a while. At least
-		// individual erase operations are much faster on this chip...
-		while (length)
+		for (uint8_t i = 0; i < numWriteGroups; i++)
 		{
-			// Start the erase command
-			ParallelFlash_UnlockChips(chipsMask);
-			ParallelBus_WriteCycle(ParallelFlash_UnlockAddress1(), 0x80808080UL);
-			ParallelFlash_UnlockChips(chipsMask);
-
-			// Now provide a sector address, but only one. Then the whole
-			// unlock sequence has to be done again after this sector is done.
-			ParallelBus_WriteCycle(address, 0x30303030UL);
+			ParallelFlash_SelectChips(writeGroups[i]);
+			failed |= ParallelFlash_WriteEngine(false)(startAddress, buf, len,
+					ParallelFlash_MaskForChips(writeGroups[i]));
+		}
+	}
 
-			// Move our counters in preparation for the next sector
-			address += eraseSectorGroups[curSectorGroup].size;
-			length -= eraseSectorGroups[curSectorGroup].size;
-			curSectorInGroup++;
-			if (curSectorInGroup >= eraseSectorGroups[curSectorGroup].count)
-			{
-				curSectorGroup++;
-				curSectorInGroup = 0;
-			}
+	TRACE(TraceProgramEnd, ALL_CHIPS, 0);
+	STATS_END(StatsTimerProgram, programStart);
+	return failed ? ParallelFlash_ChipsForMask(failed) : 0;
+}
 
-			// Wait for completion of this individual erase operation before
-			// we can start a new erase operation.
-			ParallelFlash_WaitForCompletion();
-		}
+/** Writes a buffer of data to the specified chips simultaneously
+ *
+ * @param startAddress The starting address to write in flash
+ * @param buf The buffer to write
+ * @param len The length of data to write
+ * @param chipsMask The mask of which chips to write
+ * @return The mask of chips that reported a program failure, or 0
+ */
+uint8_t ParallelFlash_WriteSomeChips(uint32_t startAddress, uint32_t const *buf, uint16_t len, uint8_t chipsMask)
+{
+	uint32_t failed = 0;
 
-		result = true;
-	}
-	else if (curChipType == ParallelFlash_M29F160FB5AN6E2_x4)
+	// Let the bus skip the data lanes of chips we aren't touching
+	STATS_BEGIN(programStart);
+	TRACE(TraceProgramStart, chipsMask, (uint16_t)(startAddress >> 8));
+	ParallelBus_SetActiveLanes(ParallelFlash_MaskForChips(chipsMask));
+	for (uint8_t i = 0; i < numWriteGroups; i++)
 	{
-		// This chip is nicer because it can take all the sector addresses at
-		// once and then do the final erase operation in one fell swoop.
-		// Start the erase command
-		ParallelFlash_UnlockChips(chipsMask);
-		ParallelBus_WriteCycle(ParallelFlash_UnlockAddress1(), 0x80808080UL);
-		ParallelFlash_UnlockChips(chipsMask);
-
-		while (length)
+		uint8_t const groupMask = writeGroups[i] & chipsMask;
+		if (groupMask)
 		{
-			ParallelBus_WriteCycle(address, 0x30303030UL);
-
-			// Move our counters in preparation for the next sector
-			address += eraseSectorGroups[curSectorGroup].size;
-			length -= eraseSectorGroups[curSectorGroup].size;
-			curSectorInGroup++;
-			if (curSectorInGroup >= eraseSectorGroups[curSectorGroup].count)
-			{
-				curSectorGroup++;
-				curSectorInGroup = 0;
-			}
+			ParallelFlash_SelectChips(groupMask);
+			failed |= ParallelFlash_WriteEngine(false)(startAddress, buf, len,
+					ParallelFlash_MaskForChips(groupMask));
 		}
+	}
+	ParallelBus_SetActiveLanes(0xFFFFFFFFUL);
+	TRACE(TraceProgramEnd, chipsMask, 0);
+	STATS_END(StatsTimerProgram, programStart);
+	return failed ? ParallelFlash_ChipsForMask(failed) : 0;
+}
 
-		// Wait for completion of the entire erase operation
-		ParallelFlash_WaitForCompletion();
+/** Writes bytes one at a time with the standard 4-cycle program command
+ *
+ * @param startAddress The starting address to write in flash
+ * @param buf The buffer to write
+ * @param len The length of data to write
+ * @param mask The 32-bit mask of which chips to write
+ * @param scheme The unlock scheme of the chips
+ * @return 0, since failures are only found by verifying
+ *
+ * This is a template for the write engines; it's always inlined with constant
+ * arguments so the compiler can specialize it.
+ */
+static ALWAYS_INLINE uint32_t ParallelFlash_WriteStandard(uint32_t startAddress, uint32_t const *buf, uint16_t len, uint32_t mask, uint8_t scheme)
+{
+	// Normal write process used by most parallel flashes
+	while (len--)
+	{
+		// Write this byte.
+		ParallelBus_WriteSequence(programSequences[scheme], 3, mask);
+		ParallelBus_WriteCycle(startAddress, *buf);
+		ParallelFlash_WaitForCompletion(mask);
+		HEALTH_PROGRAM(mask, 1);
 
-		result = true;
+		startAddress++;
+		buf++;
 	}
 
-	return result;
+	return 0;
 }
 
-/** Writes a buffer of data to all 4 chips simultaneously
+/** Writes bytes one at a time with the unlock bypass program command
  *
  * @param startAddress The starting address to write in flash
  * @param buf The buffer to write
  * @param len The length of data to write
+ * @param mask The 32-bit mask of which chips to write
+ * @param scheme The unlock scheme of the chips
+ * @return 0, since failures are only found by verifying
  *
- * The API may look silly to have broken into different functions like this, but
- * it's a performance optimization. It means we don't have to check during every
- * byte write to see the chip unlock mask. It saves a bunch of time.
+ * This is a template for the write engines; it's always inlined with constant
+ * arguments so the compiler can specialize it.
  */
-void ParallelFlash_WriteAllChips(uint32_t startAddress, uint32_t const *buf, uint16_t len)
+static ALWAYS_INLINE uint32_t ParallelFlash_WriteUnlockBypass(uint32_t startAddress, uint32_t const *buf, uint16_t len, uint32_t mask, uint8_t scheme)
 {
-	uint32_t unlockAddress = ParallelFlash_UnlockAddress1();
+	// Optimized write process available on the M29F160FB5AN6E2 and other chips
+	// with unlock bypass, requires fewer write cycles per byte if you know
+	// you're writing multiple bytes.
 
-	// Normal write process used by most parallel flashes
-	if (curChipType != ParallelFlash_M29F160FB5AN6E2_x4)
+	// Do an unlock bypass command so that we can write bytes faster.
+	// Writes will only require 2 write cycles instead of 4. If a write
+	// session is open, the chips may still be in unlock bypass mode from
+	// the last write.
+	if ((unlockBypassLanes & mask) != mask)
 	{
-		while (len--)
-		{
-			// Write this byte.
-			// Unlock...and don't use the unlock function because this one
-			// is more efficient knowing the mask is 0xFFFFFFFF
-			ParallelBus_WriteCycle(unlockAddress, 0xAAAAAAAAUL);
-			ParallelBus_WriteCycle(~unlockAddress, 0x55555555UL);
-			ParallelBus_WriteCycle(unlockAddress, 0xA0A0A0A0UL);
-			ParallelBus_WriteCycle(startAddress, *buf);
-			ParallelFlash_WaitForCompletion();
-
-			startAddress++;
-			buf++;
-		}
+		ParallelFlash_LeaveUnlockBypass();
+		ParallelBus_WriteSequence(unlockBypassSequences[scheme], 3, mask);
+		unlockBypassLanes = mask;
 	}
-	// Optimized write process available on the M29F160FB5AN6E2, requires
-	// fewer write cycles per byte if you know you're writing multiple bytes.
-	else
-	{
-		// Do an unlock bypass command so that we can write bytes faster.
-		// Writes will only require 2 write cycles instead of 4
-		ParallelBus_WriteCycle(unlockAddress, 0xAAAAAAAAUL);
-		ParallelBus_WriteCycle(~unlockAddress, 0x55555555UL);
-		ParallelBus_WriteCycle(unlockAddress, 0x20202020UL);
 
-		while (len--)
-		{
-			// Write this byte.
-			ParallelBus_WriteCycle(0, 0xA0A0A0A0UL);
-			ParallelBus_WriteCycle(startAddress, *buf);
-			ParallelFlash_WaitForCompletion();
+	while (len--)
+	{
+		// Write this byte.
+		ParallelBus_WriteCycle(0, 0xA0A0A0A0UL);
+		ParallelBus_WriteCycle(startAddress, *buf);
+		ParallelFlash_WaitForCompletion(mask);
+		HEALTH_PROGRAM(mask, 1);
 
-			startAddress++;
-			buf++;
-		}
+		startAddress++;
+		buf++;
+	}
 
-		// When we're all done, do "unlock bypass reset" to exit from
-		// programming mode
-		ParallelBus_WriteCycle(0, 0x90909090UL);
-		ParallelBus_WriteCycle(0, 0x00000000UL);
+	// When we're all done, do "unlock bypass reset" to exit from
+	// programming mode, unless the write session is still going
+	if (!writeSessionOpen)
+	{
+		ParallelFlash_LeaveUnlockBypass();
 	}
+
+	return 0;
 }
 
-/** Writes a buffer of data to the specified chips simultaneously
+/** Writes a buffer of data to the chips using their write buffers
  *
  * @param startAddress The starting address to write in flash
  * @param buf The buffer to write
  * @param len The length of data to write
- * @param chipsMask The mask of which chips to write
+ * @param mask The 32-bit mask of which chips to write
+ * @param scheme The unlock scheme of the chips
+ * @return The 32-bit mask of chips that failed to program, or 0
+ *
+ * Each write buffer page takes 5 bus cycles of overhead plus one per byte,
+ * and only one completion wait, instead of 2-4 cycles and a completion wait
+ * for every single byte. If a chip aborts or times out, it's reset and we
+ * stop, since the rest of the chunk is going to be rejected anyway. This is a
+ * template for the write engines; it's always inlined with constant arguments
+ * so the compiler can specialize it.
  */
-void ParallelFlash_WriteSomeChips(uint32_t startAddress, uint32_t const *buf, uint16_t len, uint8_t chipsMask)
+static ALWAYS_INLINE uint32_t ParallelFlash_WriteBuffered(uint32_t startAddress, uint32_t const *buf, uint16_t len, uint32_t mask, uint8_t scheme)
 {
-	uint32_t unlockAddress = ParallelFlash_UnlockAddress1();
+	uint16_t const bufferSize = curChipInfo->writeBufferSize;
 
-	// Normal write process used by most parallel flashes
-	if (curChipType != ParallelFlash_M29F160FB5AN6E2_x4)
+	while (len)
 	{
-		while (len--)
+		// A buffered write can't cross a write buffer page boundary
+		uint32_t const pageAddress = startAddress;
+		uint16_t count = bufferSize - (uint16_t)(startAddress & (bufferSize - 1));
+		if (count > len)
 		{
-			// Write this byte.
-			ParallelFlash_UnlockChips(chipsMask);
-			ParallelBus_WriteCycle(unlockAddress, 0xA0A0A0A0UL);
-			ParallelBus_WriteCycle(startAddress, *buf);
-			ParallelFlash_WaitForCompletion();
-
-			startAddress++;
-			buf++;
+			count = len;
 		}
+		len -= count;
+
+		// Unlock, then "write to buffer" and the number of bytes - 1, both
+		// to the sector we're writing
+		ParallelBus_WriteSequence(programSequences[scheme], 2, mask);
+		ParallelBus_WriteCycle(pageAddress, 0x25252525UL & mask);
+		ParallelBus_WriteCycle(pageAddress, ((count - 1) * 0x01010101UL) & mask);
+
+		// Load up the buffer
+		ParallelBus_Write(startAddress, buf, count);
+		startAddress += count;
+		buf += count;
+
+		// Now tell the chips to program it all at once
+		ParallelBus_WriteCycle(pageAddress, 0x29292929UL & mask);
+		uint32_t const failed = ParallelFlash_WaitForBufferedProgram(mask);
+		if (failed)
+		{
+			// A chip that aborted or timed out ignores everything else until
+			// it gets a "write to buffer abort reset", which also resets a
+			// timeout. Only the chips that failed get it.
+			ParallelBus_WriteSequence(abortResetSequences[scheme], 3, failed);
+			return failed;
+		}
+		HEALTH_PROGRAM(mask, count);
+	}
+
+	return 0;
+}
+
+/// Defines a write engine: a write algorithm specialized for one unlock
+/// scheme, and either all chips (the mask is ignored) or a mask of chips.
+/// The engines are where the time goes while programming, so they (and the
+/// completion polling inlined into them) are allowed to run from RAM.
+#define WRITE_ENGINE(name, algorithm, scheme, allChips) \
+	static RAMFUNC uint32_t name(uint32_t startAddress, uint32_t const *buf, uint16_t len, uint32_t mask) \
+	{ \
+		return algorithm(startAddress, buf, len, (allChips) ? 0xFFFFFFFFUL : mask, scheme); \
+	}
+
+WRITE_ENGINE(ParallelFlash_WriteStandard0All, ParallelFlash_WriteStandard, 0, true)
+WRITE_ENGINE(ParallelFlash_WriteStandard0Some, ParallelFlash_WriteStandard, 0, false)
+WRITE_ENGINE(ParallelFlash_WriteStandard1All, ParallelFlash_WriteStandard, 1, true)
+WRITE_ENGINE(ParallelFlash_WriteStandard1Some, ParallelFlash_WriteStandard, 1, false)
+WRITE_ENGINE(ParallelFlash_WriteUnlockBypass0All, ParallelFlash_WriteUnlockBypass, 0, true)
+WRITE_ENGINE(ParallelFlash_WriteUnlockBypass0Some, ParallelFlash_WriteUnlockBypass, 0, false)
+WRITE_ENGINE(ParallelFlash_WriteUnlockBypass1All, ParallelFlash_WriteUnlockBypass, 1, true)
+WRITE_ENGINE(ParallelFlash_WriteUnlockBypass1Some, ParallelFlash_WriteUnlockBypass, 1, false)
+WRITE_ENGINE(ParallelFlash_WriteBuffered0All, ParallelFlash_WriteBuffered, 0, true)
+WRITE_ENGINE(ParallelFlash_WriteBuffered0Some, ParallelFlash_WriteBuffered, 0, false)
+WRITE_ENGINE(ParallelFlash_WriteBuffered1All, ParallelFlash_WriteBuffered, 1, true)
+WRITE_ENGINE(ParallelFlash_WriteBuffered1Some, ParallelFlash_WriteBuffered, 1, false)
+
+/// All of the write engines, indexed by [algorithm][unlock scheme][0 = some chips, 1 = all chips]
+static const ParallelFlashWriteEngine writeEngines[NUM_WRITE_ALGORITHMS][2][2] = {
+	[WriteAlgorithmStandard] = {
+		{ParallelFlash_WriteStandard0Some, ParallelFlash_WriteStandard0All},
+		{ParallelFlash_WriteStandard1Some, ParallelFlash_WriteStandard1All},
+	},
+	[WriteAlgorithmUnlockBypass] = {
+		{ParallelFlash_WriteUnlockBypass0Some, ParallelFlash_WriteUnlockBypass0All},
+		{ParallelFlash_WriteUnlockBypass1Some, ParallelFlash_WriteUnlockBypass1All},
+	},
+	[WriteAlgorithmBuffered] = {
+		{ParallelFlash_WriteBuffered0Some, ParallelFlash_WriteBuffered0All},
+		{ParallelFlash_WriteBuffered1Some, ParallelFlash_WriteBuffered1All},
+	},
+};
+
+/** Picks the write engine to use for the selected chips
+ *
+ * @param allChips True if all 4 chips are being written, false if only some
+ * @return The specialized write engine
+ *
+ * All of the decisions about how to write are made once here, so the engine's
+ * inner loop doesn't have to make any of them for each byte.
+ */
+static ParallelFlashWriteEngine ParallelFlash_WriteEngine(bool allChips)
+{
+	ParallelFlashWriteAlgorithm algorithm;
+	if (ParallelFlash_UseWriteBuffer())
+	{
+		algorithm = WriteAlgorithmBuffered;
+	}
+	else if (ParallelFlash_UseUnlockBypass())
+	{
+		algorithm = WriteAlgorithmUnlockBypass;
 	}
-	// Optimized write process available on the M29F160FB5AN6E2, requires
-	// fewer write cycles per byte if you know you're writing multiple bytes.
 	else
 	{
-		// Do an unlock bypass command so that we can write bytes faster.
-		// Writes will only require 2 write cycles instead of 4
-		ParallelFlash_UnlockChips(chipsMask);
-		ParallelBus_WriteCycle(unlockAddress, 0x20202020UL);
+		algorithm = WriteAlgorithmStandard;
+	}
 
-		while (len--)
-		{
-			// Write this byte.
-			ParallelBus_WriteCycle(0, 0xA0A0A0A0UL);
-			ParallelBus_WriteCycle(startAddress, *buf);
-			ParallelFlash_WaitForCompletion();
+	return writeEngines[algorithm][ParallelFlash_UnlockScheme()][allChips ? 1 : 0];
+}
 
-			startAddress++;
-			buf++;
+/** Starts a write session spanning several calls to the write functions
+ *
+ * On chips that support unlock bypass, the first write of the session puts
+ * them into unlock bypass mode, and they are left in it afterward, instead of
+ * entering and leaving it (5 write cycles) in every call to
+ * ParallelFlash_WriteAllChips/WriteSomeChips. The datasheets only allow unlock
+ * bypass program and unlock bypass reset commands in unlock bypass mode, and
+ * don't promise that reads return array data, so reading takes the chips out
+ * of it first. That means verifying each chunk as we go costs the same as not
+ * having a session. Nothing but the write functions and reads may be used
+ * until the session is ended with ParallelFlash_EndWrite.
+ *
+ * SIMMs with a mix of chips that program differently don't get a session,
+ * because a chip left in unlock bypass mode would treat the commands meant
+ * for the other chips as its own program commands.
+ */
+void ParallelFlash_BeginWrite(void)
+{
+	ParallelFlash_SelectChips(ALL_CHIPS);
+	writeSessionOpen = numWriteGroups == 1 &&
+			!ParallelFlash_UseWriteBuffer() && ParallelFlash_UseUnlockBypass();
+}
+
+/** Ends a write session started with ParallelFlash_BeginWrite
+ *
+ * Takes the chips back out of unlock bypass mode if they are in it. It's safe
+ * to call this even if no session was started.
+ */
+void ParallelFlash_EndWrite(void)
+{
+	writeSessionOpen = false;
+	ParallelFlash_LeaveUnlockBypass();
+}
+
+/** Takes the chips out of unlock bypass mode if they are in it
+ *
+ */
+static void ParallelFlash_LeaveUnlockBypass(void)
+{
+	if (unlockBypassLanes)
+	{
+		// Unlock bypass reset
+		ParallelBus_WriteSequence(unlockBypassResetSequence, 2, unlockBypassLanes);
+		unlockBypassLanes = 0;
+	}
+}
+
+/** Recalculates which chips can be erased and written together
+ *
+ * Called whenever the chip types/info change.
+ */
+static void ParallelFlash_UpdateGroups(void)
+{
+	numWriteGroups = ParallelFlash_GroupChips(writeGroups, ParallelFlash_WriteCompatible);
+	numEraseGroups = ParallelFlash_GroupChips(eraseGroups, ParallelFlash_EraseCompatible);
+}
+
+/** Splits the chips up into groups that can be sent the same commands
+ *
+ * @param groups Output for the chip mask of each group
+ * @param compatible Function that tells us if two chips (bit numbers) are compatible
+ * @return The number of groups
+ */
+static uint8_t ParallelFlash_GroupChips(uint8_t *groups, bool (*compatible)(uint8_t, uint8_t))
+{
+	uint8_t numGroups = 0;
+	uint8_t remaining = ALL_CHIPS;
+
+	for (uint8_t i = 0; i < PARALLEL_FLASH_NUM_CHIPS; i++)
+	{
+		if (remaining & (1 << i))
+		{
+			// Start a new group with this chip, and pull in everything
+			// after it that's compatible with it
+			uint8_t group = 0;
+			for (uint8_t j = i; j < PARALLEL_FLASH_NUM_CHIPS; j++)
+			{
+				if ((remaining & (1 << j)) && compatible(i, j))
+				{
+					group |= (1 << j);
+				}
+			}
+			remaining &= ~group;
+			groups[numGroups++] = group;
 		}
+	}
+
+	return numGroups;
+}
+
+/** Determines if two chips can be written with the same commands
+ *
+ * @param chip1 The bit number of the first chip in a chip mask
+ * @param chip2 The bit number of the second chip in a chip mask
+ * @return True if they use the same unlock scheme and write method
+ */
+static bool ParallelFlash_WriteCompatible(uint8_t chip1, uint8_t chip2)
+{
+	ParallelFlash_SelectChips(1 << chip1);
+	uint16_t const mode1 = ParallelFlash_WriteMode();
+	ParallelFlash_SelectChips(1 << chip2);
+	uint16_t const mode2 = ParallelFlash_WriteMode();
+
+	return chipTypes[chip1] == chipTypes[chip2] && mode1 == mode2;
+}
+
+/** Determines if two chips can be erased with the same commands
+ *
+ * @param chip1 The bit number of the first chip in a chip mask
+ * @param chip2 The bit number of the second chip in a chip mask
+ * @return True if they use the same unlock scheme, erase method and sector map
+ */
+static bool ParallelFlash_EraseCompatible(uint8_t chip1, uint8_t chip2)
+{
+	ParallelFlash_SelectChips(1 << chip1);
+	bool const multi1 = ParallelFlash_UseMultiSectorErase();
+	ParallelFlash_SelectChips(1 << chip2);
+	bool const multi2 = ParallelFlash_UseMultiSectorErase();
+
+	ParallelFlashEraseSectorGroup const *sectors1 =
+			chipInfos[chip1] ? chipInfos[chip1]->eraseSectorGroups : NULL;
+	ParallelFlashEraseSectorGroup const *sectors2 =
+			chipInfos[chip2] ? chipInfos[chip2]->eraseSectorGroups : NULL;
+
+	return chipTypes[chip1] == chipTypes[chip2] && multi1 == multi2 &&
+			sectors1 == sectors2;
+}
+
+/** Describes the write method used by the selected chips
+ *
+ * @return The write buffer size if buffered writes are used, 1 for unlock bypass, or 0
+ */
+static uint16_t ParallelFlash_WriteMode(void)
+{
+	if (ParallelFlash_UseWriteBuffer())
+	{
+		return curChipInfo->writeBufferSize;
+	}
+	else
+	{
+		return ParallelFlash_UseUnlockBypass() ? 1 : 0;
+	}
+}
 
-		// When we're all done, do "unlock bypass reset" to exit from
-		// programming mode
-		ParallelBus_WriteCycle(0, 0x90909090UL);
-		ParallelBus_WriteCycle(0, 0x00000000UL);
+/** Selects which chips we are about to send commands to
+ *
+ * @param chipsMask The mask of chips. They must all be in the same group.
+ *
+ * This sets up the unlock scheme and chip info used by the rest of the driver.
+ */
+static void ParallelFlash_SelectChips(uint8_t chipsMask)
+{
+	int8_t i = 0;
+	while (i < PARALLEL_FLASH_NUM_CHIPS - 1 && !(chipsMask & (1 << i)))
+	{
+		i++;
 	}
+	curChipType = chipTypes[i];
+	curChipInfo = chipInfos[i];
 }
 
 /** Calculates a 32-bit mask to use with the unlock process when unlocking chips
@@ -468,20 +1179,176 @@ static uint32_t ParallelFlash_MaskForChips(uint8_t chips)
 	return mask;
 }
 
+/** Calculates the mask of chips from a 32-bit mask on the data bus
+ *
+ * @param mask A 32-bit mask with 1 byte per chip
+ * @return The mask of chips with any bits set in the 32-bit mask
+ */
+static uint8_t ParallelFlash_ChipsForMask(uint32_t mask)
+{
+	uint8_t chips = 0;
+	for (uint8_t i = 0; i < PARALLEL_FLASH_NUM_CHIPS; i++)
+	{
+		if (mask & (0xFFUL << (i * 8)))
+		{
+			chips |= (1 << i);
+		}
+	}
+	return chips;
+}
+
+/** Widens bits on the data bus to cover their whole byte lanes
+ *
+ * @param bits Bits read from the data bus
+ * @return A 32-bit mask with 0xFF in every lane that had any bits set
+ */
+static uint32_t ParallelFlash_Lanes(uint32_t bits)
+{
+	return ParallelFlash_MaskForChips(ParallelFlash_ChipsForMask(bits));
+}
+
+#ifdef HEALTH_ENABLED
+/** Finds the chips that just finished an erase or write operation, and tells
+ *  the health map how long they took
+ *
+ * @param busy The 32-bit mask of the chips that were still busy
+ * @param changed The bits that changed between the last two reads
+ * @param startTime When we started waiting, from Stats_Now
+ * @return The 32-bit mask of the chips that are still busy
+ */
+static ALWAYS_INLINE uint32_t ParallelFlash_LanesDone(uint32_t busy, uint32_t changed, uint32_t startTime)
+{
+	for (uint8_t lane = 0; lane < PARALLEL_FLASH_NUM_CHIPS; lane++)
+	{
+		uint32_t const laneMask = 0xFFUL << (lane * 8);
+		// A chip is done once its toggle bit stops toggling
+		if ((busy & laneMask) && !(changed & laneMask))
+		{
+			Health_LaneDone(lane, Stats_Now() - startTime);
+			busy &= ~laneMask;
+		}
+	}
+	return busy;
+}
+#endif
+
 /** Waits for an erase or write operation on the flash chip to complete.
+ *
+ * @param mask The 32-bit mask of the chips that are busy
  *
  * We know we're done when the value we read from the chip stops changing. There
  * is a "toggle" status bit that will stop toggling when the op is complete.
+ *
+ * Some hardware can read part of the data bus a lot faster than the rest (the
+ * AVR has to go through the MCP23S17 for the upper lanes), so we spin on the
+ * fast lanes first, then confirm the slow lanes. Lanes outside the mask
+ * aren't doing anything, so they are ignored.
+ *
+ * With the health map, each chip is watched separately instead, so we know
+ * when each one finished. That reads every lane on every poll, even the slow
+ * ones, but it takes the same number of bus cycles as waiting for all of them.
  */
-static ALWAYS_INLINE void ParallelFlash_WaitForCompletion(void)
+static ALWAYS_INLINE void ParallelFlash_WaitForCompletion(uint32_t mask)
 {
-	uint32_t readback = ParallelBus_ReadCycle(0);
-	uint32_t next = ParallelBus_ReadCycle(0);
-	while (next != readback)
+	uint32_t readback;
+	uint32_t next;
+	STATS_BEGIN(waitStart);
+	STATS_COUNTER(polls);
+
+#ifdef HEALTH_ENABLED
+	uint32_t const healthStart = Stats_Now();
+	uint32_t busy;
+
+	readback = ParallelBus_ReadCycle(0);
+	next = ParallelBus_ReadCycle(0);
+	busy = ParallelFlash_LanesDone(mask, next ^ readback, healthStart);
+	while (busy)
 	{
 		readback = next;
 		next = ParallelBus_ReadCycle(0);
+		busy = ParallelFlash_LanesDone(busy, next ^ readback, healthStart);
+		STATS_POLL(polls);
+	}
+#else
+	uint32_t const nativeMask = mask & PARALLEL_BUS_NATIVE_LANES;
+
+	if (nativeMask)
+	{
+		readback = ParallelBus_ReadCycleNative(0) & nativeMask;
+		next = ParallelBus_ReadCycleNative(0) & nativeMask;
+		while (next != readback)
+		{
+			readback = next;
+			next = ParallelBus_ReadCycleNative(0) & nativeMask;
+			STATS_POLL(polls);
+		}
 	}
+
+	if (mask & ~PARALLEL_BUS_NATIVE_LANES)
+	{
+		readback = ParallelBus_ReadCycle(0) & mask;
+		next = ParallelBus_ReadCycle(0) & mask;
+		while (next != readback)
+		{
+			readback = next;
+			next = ParallelBus_ReadCycle(0) & mask;
+			STATS_POLL(polls);
+		}
+	}
+#endif
+
+	STATS_ADD_POLLS(polls);
+	STATS_END(StatsTimerWaitForCompletion, waitStart);
+}
+
+/** Waits for a buffered program operation to complete, and checks for failures
+ *
+ * @param mask The 32-bit mask of the chips that are programming
+ * @return The 32-bit mask of the chips that failed
+ *
+ * A chip is done when DQ6 stops toggling, like in ParallelFlash_WaitForCompletion.
+ * But a chip that exceeded its time limit (DQ5) or aborted the write to buffer
+ * (DQ1) keeps toggling DQ6 until it's reset, so we'd wait forever. Those bits
+ * are only trusted if DQ6 is still toggling on the next two reads, because
+ * the chip could have finished right as they were read.
+ */
+static ALWAYS_INLINE uint32_t ParallelFlash_WaitForBufferedProgram(uint32_t mask)
+{
+	uint32_t busy = mask;
+	uint32_t failed = 0;
+	uint32_t readback;
+	STATS_BEGIN(waitStart);
+	STATS_COUNTER(polls);
+#ifdef HEALTH_ENABLED
+	uint32_t const healthStart = Stats_Now();
+#endif
+
+	readback = ParallelBus_ReadCycle(0);
+
+	while (busy)
+	{
+		uint32_t next = ParallelBus_ReadCycle(0);
+#ifdef HEALTH_ENABLED
+		busy = ParallelFlash_LanesDone(busy, (readback ^ next) & STATUS_TOGGLE, healthStart);
+#else
+		busy &= ParallelFlash_Lanes((readback ^ next) & STATUS_TOGGLE);
+#endif
+
+		uint32_t const errors = busy & ParallelFlash_Lanes(next & (STATUS_TIMEOUT | STATUS_BUFFER_ABORT));
+		if (errors)
+		{
+			readback = ParallelBus_ReadCycle(0);
+			next = ParallelBus_ReadCycle(0);
+			failed |= errors & ParallelFlash_Lanes((readback ^ next) & STATUS_TOGGLE);
+			busy &= ~errors;
+		}
+		readback = next;
+		STATS_POLL(polls);
+	}
+
+	STATS_ADD_POLLS(polls);
+	STATS_END(StatsTimerWaitForCompletion, waitStart);
+	return failed;
 }
 
 /** Gets the first unlock address to use when unlocking writes on this chip
@@ -506,3 +1373,60 @@ static ALWAYS_INLINE uint32_t ParallelFlash_UnlockAddress1(void)
 		return 0xAAAAAAAAUL;
 	}
 }
+
+/** Gets which unlock scheme the selected chips use
+ *
+ * @return 0 for the normal scheme, 1 for the M29F160FB5AN6E2's shifted scheme
+ *
+ * Used as an index into the command sequence tables.
+ */
+static ALWAYS_INLINE uint8_t ParallelFlash_UnlockScheme(void)
+{
+	return (curChipType == ParallelFlash_M29F160FB5AN6E2_x4) ? 1 : 0;
+}
+
+/** Determines whether to use the unlock bypass program command when writing
+ *
+ * @return True if the chips support unlock bypass
+ */
+static ALWAYS_INLINE bool ParallelFlash_UseUnlockBypass(void)
+{
+	// If we don't know exactly what the chips are, go by the chip type
+	if (curChipInfo)
+	{
+		return curChipInfo->unlockBypass;
+	}
+	else
+	{
+		return curChipType == ParallelFlash_M29F160FB5AN6E2_x4;
+	}
+}
+
+/** Determines whether to erase several sectors with a single erase command
+ *
+ * @return True if the chips accept multiple sector addresses per erase command
+ */
+static ALWAYS_INLINE bool ParallelFlash_UseMultiSectorErase(void)
+{
+	// If we don't know exactly what the chips are, go by the chip type
+	if (curChipInfo)
+	{
+		return curChipInfo->multiSectorErase;
+	}
+	else
+	{
+		return curChipType == ParallelFlash_M29F160FB5AN6E2_x4;
+	}
+}
+
+/** Determines whether to use buffered programming when writing
+ *
+ * @return True if the identified chips have a write buffer we can use
+ */
+static ALWAYS_INLINE bool ParallelFlash_UseWriteBuffer(void)
+{
+	// Only chips we identified can tell us about their write buffer
+	return curChipInfo &&
+			curChipInfo->writeBufferSize > 1 &&
+			curChipInfo->writeBufferSize <= MAX_WRITE_BUFFER_SIZE;
+}
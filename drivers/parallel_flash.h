@@ -45,7 +45,9 @@ typedef struct ParallelFlashChipID
 	uint8_t device;
 } ParallelFlashChipID;
 
-/// Type/layout of chips currently being addressed
+/// Type/layout of chips currently being addressed. Really this determines which
+/// unlock address scheme is used: the plain 8-bit one, or the shifted one used
+/// by 8-/16-bit chips running in 8-bit mode.
 typedef enum ParallelFlashChipType
 {
 	/// Four SST39SF040 chips, 512 KB each, for a total of 2 MB
@@ -61,29 +63,62 @@ typedef struct ParallelFlashEraseSectorGroup
 	uint32_t size;
 } ParallelFlashEraseSectorGroup;
 
+/// Capabilities of a flash chip we know how to talk to, looked up by JEDEC ID
+typedef struct ParallelFlashChipInfo
+{
+	/// The manufacturer ID
+	uint8_t manufacturer;
+	/// The device ID
+	uint8_t device;
+	/// True if the chip supports the unlock bypass program command
+	bool unlockBypass;
+	/// True if the chip accepts several sector addresses in one erase command
+	bool multiSectorErase;
+	/// Size of the write buffer in bytes, or 0 if there isn't one
+	uint16_t writeBufferSize;
+	/// The number of erase sector groups in the chip's sector map
+	uint8_t numEraseSectorGroups;
+	/// The chip's sector map
+	ParallelFlashEraseSectorGroup const *eraseSectorGroups;
+} ParallelFlashChipInfo;
+
 // Tells which type of flash chip we are communicating with
 void ParallelFlash_SetChipType(ParallelFlashChipType type);
 ParallelFlashChipType ParallelFlash_ChipType(void);
 
+// Info about the identified chips, or NULL if they weren't recognized
+ParallelFlashChipInfo const *ParallelFlash_ChipInfo(uint8_t chip);
+
 // Reads a set of data from all 4 chips simultaneously
 void ParallelFlash_Read(uint32_t startAddress, uint32_t *buf, uint16_t len);
 
+// Reads a set of data from all 4 chips, in the background if the hardware can
+void ParallelFlash_StartRead(uint32_t startAddress, uint32_t *buf, uint16_t len);
+void ParallelFlash_FinishRead(void);
+
+// Reads a set of data, only caring about the data from the requested chips
+void ParallelFlash_ReadSomeChips(uint32_t startAddress, uint32_t *buf, uint16_t len, uint8_t chipsMask);
+
 // Does an unlock sequence on the chips requested
 void ParallelFlash_UnlockChips(uint8_t chipsMask);
 
-// Identifies all four chips
+// Identifies all four chips, and configures the driver for each one that is known
 void ParallelFlash_IdentifyChips(ParallelFlashChipID *chips);
 
 // Erases the chips/sectors requested
 void ParallelFlash_EraseChips(uint8_t chipsMask);
 bool ParallelFlash_EraseSectors(uint32_t address, uint32_t length, uint8_t chipsMask, uint8_t numEraseSectorGroups, ParallelFlashEraseSectorGroup const *eraseSectorGroups);
 
+// Brackets a series of writes, so chip modes only have to be set up once
+void ParallelFlash_BeginWrite(void);
+void ParallelFlash_EndWrite(void);
+
 // Writes a buffer to all 4 chips simultaneously (each uint32_t contains an 8-bit portion for each chip).
 // Optimized variant of this function if we know we're writing to all 4 chips simultaneously.
 // Allows us to bypass a lot of operations involving "chipsMask".
-void ParallelFlash_WriteAllChips(uint32_t startAddress, uint32_t const *buf, uint16_t len);
+uint8_t ParallelFlash_WriteAllChips(uint32_t startAddress, uint32_t const *buf, uint16_t len);
 
 // Writes a buffer to a mask of requested chips (each uint32_t contains an 8-bit portion for each chip).
-void ParallelFlash_WriteSomeChips(uint32_t startAddress, uint32_t const *buf, uint16_t len, uint8_t chipsMask);
+uint8_t ParallelFlash_WriteSomeChips(uint32_t startAddress, uint32_t const *buf, uint16_t len, uint8_t chipsMask);
 
 #endif /* DRIVERS_PARALLEL_FLASH_H_ */
@@ -0,0 +1,229 @@
+/*
+ * parallel_flash_cfi.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: SIMM Programmer contributors
+ *
+ * Copyright (C) 2026 SIMM Programmer contributors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * -----------------------------------------------------------------------------
+ *
+ * Reads the Common Flash Interface (CFI) tables out of the chips, so we can
+ * figure out the sector layout and write buffer size of chips that aren't in
+ * our database. All four chips are queried at the same time.
+ */
+
+#include "parallel_flash_cfi.h"
+#include <stddef.h>
+
+/// Most chips have at most 4 erase block regions; we don't support more
+#define CFI_MAX_ERASE_REGIONS				4
+
+/// Offsets of the fields we care about in the CFI query table
+#define CFI_QUERY_STRING					0x10
+#define CFI_PRIMARY_COMMAND_SET				0x13
+#define CFI_PRIMARY_EXTENDED_TABLE			0x15
+#define CFI_DEVICE_SIZE						0x27
+#define CFI_WRITE_BUFFER_SIZE				0x2A
+#define CFI_NUM_ERASE_REGIONS				0x2C
+#define CFI_ERASE_REGION_INFO				0x2D
+
+/// Offsets of the fields we care about in the AMD extended query table
+#define CFI_PRI_MAJOR_VERSION				0x03
+#define CFI_PRI_MINOR_VERSION				0x04
+#define CFI_PRI_BOOT_FLAG					0x0F
+
+/// Boot flag value in the extended query table for top boot block chips
+#define CFI_PRI_BOOT_FLAG_TOP				3
+
+/// The AMD/Fujitsu standard command set, which supports multi-sector erase
+#define CFI_COMMAND_SET_AMD_STANDARD		0x0002
+
+static uint8_t ParallelFlashCFI_Byte(uint8_t offset);
+static uint16_t ParallelFlashCFI_Word(uint8_t offset);
+static uint16_t ParallelFlashCFI_Power2(uint8_t exponent);
+
+/// Info about the chips, filled in from their CFI tables
+static ParallelFlashChipInfo cfiChipInfo;
+/// Sector map of the chips, filled in from their CFI tables
+static ParallelFlashEraseSectorGroup cfiSectorGroups[CFI_MAX_ERASE_REGIONS];
+
+/// How far to shift a CFI offset to get the address on our bus
+static uint8_t addressShift;
+/// Mask of the data bus lanes that answered the CFI query
+static uint32_t laneMask;
+/// Shift to get the first lane that answered the CFI query
+static uint8_t firstLaneShift;
+/// Bits of the data bus where a chip gave a different answer than the first one
+static uint32_t mismatchBits;
+
+/** Reads the CFI tables out of the chips
+ *
+ * @param type The unlock address scheme the chips are using
+ * @param chips The IDs read from the chips, for filling in the info
+ * @param chipsMask On input, the mask of chips to look at. On output, the mask
+ *                  of chips that the returned info applies to.
+ * @return Info about the chips, or NULL if none of them gave a valid answer
+ *
+ * The chips that answer the query are treated as a single set described by
+ * the first one of them. Chips that answer differently than the first one are
+ * left out of the returned mask. There is only one set of storage for the
+ * result, so it's overwritten by the next successful query.
+ */
+ParallelFlashChipInfo const *ParallelFlashCFI_Query(ParallelFlashChipType type, ParallelFlashChipID const *chips, uint8_t *chipsMask)
+{
+	ParallelFlashChipInfo const *result = NULL;
+
+	// The query command goes to address 0x55 in the chip's native width. The
+	// M29F160-style 8-/16-bit chips in 8-bit mode use our A0 as their A-1, so
+	// the command address and every table offset are doubled for them.
+	addressShift = (type == ParallelFlash_M29F160FB5AN6E2_x4) ? 1 : 0;
+	ParallelBus_WriteCycle(0x55UL << addressShift, 0x98989898UL);
+
+	// Find out which chips answered with "QRY"
+	uint32_t const q = ParallelBus_ReadCycle((uint32_t)(CFI_QUERY_STRING + 0) << addressShift);
+	uint32_t const r = ParallelBus_ReadCycle((uint32_t)(CFI_QUERY_STRING + 1) << addressShift);
+	uint32_t const y = ParallelBus_ReadCycle((uint32_t)(CFI_QUERY_STRING + 2) << addressShift);
+	laneMask = 0;
+	firstLaneShift = 0;
+	for (int8_t i = PARALLEL_FLASH_NUM_CHIPS - 1; i >= 0; i--)
+	{
+		uint8_t const shift = 8 * i;
+		if ((*chipsMask & (1 << i)) &&
+			(uint8_t)(q >> shift) == 'Q' &&
+			(uint8_t)(r >> shift) == 'R' &&
+			(uint8_t)(y >> shift) == 'Y')
+		{
+			laneMask |= 0xFFUL << shift;
+			firstLaneShift = shift;
+		}
+	}
+
+	if (laneMask)
+	{
+		mismatchBits = 0;
+
+		uint16_t const commandSet = ParallelFlashCFI_Word(CFI_PRIMARY_COMMAND_SET);
+		uint8_t const deviceSize = ParallelFlashCFI_Byte(CFI_DEVICE_SIZE);
+		uint8_t const writeBuffer = ParallelFlashCFI_Byte(CFI_WRITE_BUFFER_SIZE);
+		uint8_t const numRegions = ParallelFlashCFI_Byte(CFI_NUM_ERASE_REGIONS);
+
+		// Read the erase block regions. Each one is a count - 1 followed by
+		// the block size in units of 256 bytes (0 means 128 bytes).
+		uint32_t totalSize = 0;
+		if (numRegions > 0 && numRegions <= CFI_MAX_ERASE_REGIONS)
+		{
+			for (uint8_t i = 0; i < numRegions; i++)
+			{
+				uint8_t const offset = CFI_ERASE_REGION_INFO + 4 * i;
+				uint16_t const count = ParallelFlashCFI_Word(offset);
+				uint16_t const size = ParallelFlashCFI_Word(offset + 2);
+				cfiSectorGroups[i].count = (uint32_t)count + 1;
+				cfiSectorGroups[i].size = size ? (uint32_t)size * 256 : 128;
+				totalSize += cfiSectorGroups[i].count * cfiSectorGroups[i].size;
+			}
+		}
+
+		// Top boot block chips with AMD's extended table may list their
+		// regions starting from the top, so flip them around if needed.
+		uint16_t const pri = ParallelFlashCFI_Word(CFI_PRIMARY_EXTENDED_TABLE);
+		if (commandSet == CFI_COMMAND_SET_AMD_STANDARD && pri && pri < 0xF0 &&
+			ParallelFlashCFI_Byte(pri + 0) == 'P' &&
+			ParallelFlashCFI_Byte(pri + 1) == 'R' &&
+			ParallelFlashCFI_Byte(pri + 2) == 'I' &&
+			ParallelFlashCFI_Byte(pri + CFI_PRI_MAJOR_VERSION) >= '1' &&
+			ParallelFlashCFI_Byte(pri + CFI_PRI_MINOR_VERSION) >= '1' &&
+			ParallelFlashCFI_Byte(pri + CFI_PRI_BOOT_FLAG) == CFI_PRI_BOOT_FLAG_TOP)
+		{
+			for (uint8_t i = 0; i < numRegions / 2; i++)
+			{
+				ParallelFlashEraseSectorGroup const tmp = cfiSectorGroups[i];
+				cfiSectorGroups[i] = cfiSectorGroups[numRegions - i - 1];
+				cfiSectorGroups[numRegions - i - 1] = tmp;
+			}
+		}
+
+		// Leave out any chips that didn't give the same answers
+		uint8_t answered = 0;
+		for (int8_t i = 0; i < PARALLEL_FLASH_NUM_CHIPS; i++)
+		{
+			if ((laneMask & (0xFFUL << (8 * i))) &&
+				!(mismatchBits & (0xFFUL << (8 * i))))
+			{
+				answered |= (1 << i);
+			}
+		}
+
+		// Make sure the whole thing made sense before we trust it
+		if (totalSize != 0 &&
+			deviceSize < 32 && totalSize == (1UL << deviceSize))
+		{
+			ParallelFlashChipID const *id = &chips[PARALLEL_FLASH_NUM_CHIPS - 1 - firstLaneShift / 8];
+			cfiChipInfo.manufacturer = id->manufacturer;
+			cfiChipInfo.device = id->device;
+			// Unlock bypass support can't be discovered through CFI
+			cfiChipInfo.unlockBypass = false;
+			cfiChipInfo.multiSectorErase = commandSet == CFI_COMMAND_SET_AMD_STANDARD;
+			cfiChipInfo.writeBufferSize = writeBuffer ? ParallelFlashCFI_Power2(writeBuffer) : 0;
+			cfiChipInfo.numEraseSectorGroups = numRegions;
+			cfiChipInfo.eraseSectorGroups = cfiSectorGroups;
+			result = &cfiChipInfo;
+			*chipsMask = answered;
+		}
+	}
+
+	// Exit CFI query mode
+	ParallelBus_WriteCycle(0, 0xF0F0F0F0UL);
+
+	return result;
+}
+
+/** Reads a byte from the CFI table of the chips that answered the query
+ *
+ * @param offset The offset in the CFI table
+ * @return The value read from the first chip that answered
+ *
+ * Chips that answered the query but don't have the same value are flagged in
+ * the mismatch bits.
+ */
+static uint8_t ParallelFlashCFI_Byte(uint8_t offset)
+{
+	uint32_t const value = ParallelBus_ReadCycle((uint32_t)offset << addressShift) & laneMask;
+	uint8_t const b = (uint8_t)(value >> firstLaneShift);
+	mismatchBits |= value ^ ((b * 0x01010101UL) & laneMask);
+	return b;
+}
+
+/** Reads a little-endian 16-bit value from the CFI table
+ *
+ * @param offset The offset in the CFI table of the low byte
+ * @return The value read from the first chip that answered
+ */
+static uint16_t ParallelFlashCFI_Word(uint8_t offset)
+{
+	return ParallelFlashCFI_Byte(offset) |
+			((uint16_t)ParallelFlashCFI_Byte(offset + 1) << 8);
+}
+
+/** Calculates 2^N, as used by CFI for sizes
+ *
+ * @param exponent N
+ * @return 2^N, clamped to fit in 16 bits
+ */
+static uint16_t ParallelFlashCFI_Power2(uint8_t exponent)
+{
+	return exponent < 16 ? (uint16_t)(1U << exponent) : 0xFFFF;
+}
@@ -0,0 +1,101 @@
+/*
+ * parallel_flash_chips.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: SIMM Programmer contributors
+ *
+ * Copyright (C) 2026 SIMM Programmer contributors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * -----------------------------------------------------------------------------
+ *
+ * Database of flash chips we know about, keyed by JEDEC manufacturer/device ID.
+ * Sector maps are in 8-bit mode, since that's how every chip on a SIMM is
+ * wired.
+ */
+
+#include "parallel_flash_chips.h"
+#include "../chip_id.h"
+#include <stddef.h>
+
+/// Shorthand for the number of elements in a sector map
+#define NUM_GROUPS(groups)		(sizeof(groups)/sizeof((groups)[0]))
+
+/// SST39SF010A: 32 uniform 4 KB sectors
+static const ParallelFlashEraseSectorGroup sst39sf010aSectors[] = {
+	{32, 4*1024UL}
+};
+
+/// SST39SF020A: 64 uniform 4 KB sectors
+static const ParallelFlashEraseSectorGroup sst39sf020aSectors[] = {
+	{64, 4*1024UL}
+};
+
+/// SST39SF040: 128 uniform 4 KB sectors
+static const ParallelFlashEraseSectorGroup sst39sf040Sectors[] = {
+	{128, 4*1024UL}
+};
+
+/// AM29F040B and MX29F040: 8 uniform 64 KB sectors
+static const ParallelFlashEraseSectorGroup uniform64KBx8Sectors[] = {
+	{8, 64*1024UL}
+};
+
+/// M29F160FB (bottom boot block) in 8-bit mode
+static const ParallelFlashEraseSectorGroup m29f160fbSectors[] = {
+	{1, 16*1024UL},
+	{2, 8*1024UL},
+	{1, 32*1024UL},
+	{31, 64*1024UL}
+};
+
+/// M29F160FT (top boot block) in 8-bit mode
+static const ParallelFlashEraseSectorGroup m29f160ftSectors[] = {
+	{31, 64*1024UL},
+	{1, 32*1024UL},
+	{2, 8*1024UL},
+	{1, 16*1024UL}
+};
+
+/// Every chip we know about
+static const ParallelFlashChipInfo knownChips[] = {
+	{SST_GREENLIANT, SST39SF010A, false, false, 0, NUM_GROUPS(sst39sf010aSectors), sst39sf010aSectors},
+	{SST_GREENLIANT, SST39SF020A, false, false, 0, NUM_GROUPS(sst39sf020aSectors), sst39sf020aSectors},
+	{SST_GREENLIANT, SST39SF040, false, false, 0, NUM_GROUPS(sst39sf040Sectors), sst39sf040Sectors},
+	{AMD, AM29F040B, false, true, 0, NUM_GROUPS(uniform64KBx8Sectors), uniform64KBx8Sectors},
+	{MACRONIX, MX29F040, false, true, 0, NUM_GROUPS(uniform64KBx8Sectors), uniform64KBx8Sectors},
+	{AMD, M29F160FB, true, true, 0, NUM_GROUPS(m29f160fbSectors), m29f160fbSectors},
+	{AMD, M29F160FT, true, true, 0, NUM_GROUPS(m29f160ftSectors), m29f160ftSectors},
+};
+
+/** Looks up a chip in the database of chips we know about
+ *
+ * @param manufacturer The JEDEC manufacturer ID read from the chip
+ * @param device The JEDEC device ID read from the chip
+ * @return Info about the chip, or NULL if we don't know about it
+ */
+ParallelFlashChipInfo const *ParallelFlashChips_Find(uint8_t manufacturer, uint8_t device)
+{
+	for (uint8_t i = 0; i < sizeof(knownChips)/sizeof(knownChips[0]); i++)
+	{
+		if (knownChips[i].manufacturer == manufacturer &&
+			knownChips[i].device == device)
+		{
+			return &knownChips[i];
+		}
+	}
+
+	return NULL;
+}
@@ -0,0 +1,31 @@
+/*
+ * parallel_flash_chips.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: SIMM Programmer contributors
+ *
+ * Copyright (C) 2026 SIMM Programmer contributors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef DRIVERS_PARALLEL_FLASH_CHIPS_H_
+#define DRIVERS_PARALLEL_FLASH_CHIPS_H_
+
+#include "parallel_flash.h"
+
+ParallelFlashChipInfo const *ParallelFlashChips_Find(uint8_t manufacturer, uint8_t device);
+
+#endif /* DRIVERS_PARALLEL_FLASH_CHIPS_H_ */
@@ -63,6 +63,7 @@ set(HWSOURCES
 	hal/at90usb646/hardware.h
 	hal/at90usb646/LUFAConfig.h
 	hal/at90usb646/parallel_bus.c
+	hal/at90usb646/parallel_bus_hw.h
 	hal/at90usb646/spi.c
 	hal/at90usb646/spi_private.h
 	hal/at90usb646/usbcdc.c
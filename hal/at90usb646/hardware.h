@@ -74,4 +74,31 @@ static inline bool IsAT90USB128x(void)
 	return boot_signature_byte_get(0x0002) == 0x97;
 }
 
+/// Timer 1 is 16 bits wide, and counts every 4 microseconds (clk/64)
+#define STATS_TIMER_MASK		0xFFFFUL
+#define STATS_TIMER_TICK_US		4
+
+/** Starts the free-running timer used for statistics
+ *
+ */
+static inline void StatsTimer_Init(void)
+{
+	TCCR1A = 0;
+	TCCR1B = (1 << CS11) | (1 << CS10);
+}
+
+/** Reads the free-running timer used for statistics
+ *
+ * @return The current count
+ */
+static inline uint32_t StatsTimer_Ticks(void)
+{
+	return TCNT1;
+}
+
+/// Most of our RAM is used for read/write chunks, so only keep a short trace
+/// and the erase times of the first few sectors
+#define TRACE_NUM_EVENTS		32
+#define HEALTH_NUM_SECTORS		32
+
 #endif /* HAL_AT90USB646_HARDWARE_H_ */
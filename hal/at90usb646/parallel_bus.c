@@ -57,6 +57,8 @@ static ALWAYS_INLINE uint8_t SPITransfer(uint8_t byte);
 static ALWAYS_INLINE void SPITransferNoRead(uint8_t byte);
 static ALWAYS_INLINE void AssertControl(uint8_t pin);
 static ALWAYS_INLINE void DeassertControl(uint8_t pin);
+static ALWAYS_INLINE void SetDataInputs(void);
+static ALWAYS_INLINE void SetDataOutputs(uint8_t upperA, uint8_t upperB);
 
 /// The MCP23S17 device
 static MCP23S17 mcp23s17 = {
@@ -73,8 +75,16 @@ static const GPIOPin flashWEPin = {GPIOB, FLASH_WE_PIN};
 static const GPIOPin flashOEPin = {GPIOB, FLASH_OE_PIN};
 /// The /CS pin for the flash chip
 static const GPIOPin flashCSPin = {GPIOB, FLASH_CS_PIN};
-/// Whether or not data pins are outputs
+/// Whether or not data pins on the AVR are outputs
 static bool dataIsOutput;
+/// Whether or not data pins on the MCP23S17 are outputs
+static bool mcpIsOutput;
+/// Whether or not read/write cycles need to access the MCP23S17's data lanes
+static bool mcpIsActive = true;
+/// Last values written to the MCP23S17's OLATA/OLATB registers (D31-D16).
+/// Starts out matching the MCP23S17's reset value.
+static uint8_t mcpOutputLatchA = 0;
+static uint8_t mcpOutputLatchB = 0;
 
 /** Initializes the 32-bit data/21-bit address parallel bus.
  *
@@ -102,6 +112,7 @@ void ParallelBus_Init(void)
 	ParallelBus_SetDataDir(0);
 	ParallelBus_SetDataPullups(0xFFFFFFFFUL);
 	dataIsOutput = false;
+	mcpIsOutput = false;
 	// Note: During normal operation of read/write cycles, the pullups in the
 	// MCP23S17 will remember they are enabled, so we can do an optimization
 	// when using ParallelBus_ReadCycle/WriteCycle and assume they are already
@@ -171,6 +182,8 @@ void ParallelBus_SetData(uint32_t data)
 
 	// D0-D15 are part of the MCP23S17
 	MCP23S17_SetOutputs(&mcp23s17, u.dataShorts[1]);
+	mcpOutputLatchA = u.dataBytes[3];
+	mcpOutputLatchB = u.dataBytes[2];
 }
 
 /** Sets the output value of the CS pin
@@ -252,11 +265,13 @@ void ParallelBus_SetDataDir(uint32_t outputs)
 	if (outputs == 0)
 	{
 		dataIsOutput = false;
+		mcpIsOutput = false;
 	}
 	// If all of the pins are outputs, ensure dataIsOutput is true
 	else if (outputs == 0xFFFFFFFFUL)
 	{
 		dataIsOutput = true;
+		mcpIsOutput = true;
 	}
 }
 
@@ -534,31 +549,13 @@ void ParallelBus_WriteCycle(uint32_t address, uint32_t data)
 	u.bytes[2] = (u.bytes[2] & 0x03) | (uint8_t)((u.bytes[2] & 0x1C) << 2) | (PORTD & 0x8C);
 	PORTD = u.bytes[2];
 
-	// If the data port is not already set as outputs, set it to be outputs now
-	if (!dataIsOutput)
-	{
-		// Set data as outputs. Bypass the SPI/GPIO drivers for this for efficiency.
-		DDRE = 0xFF;
-		DDRF = 0xFF;
-		AssertControl(MCP_CS_PIN);
-		SPITransferNoRead(MCP23S17_CONTROL_WRITE(0));
-		SPITransferNoRead(MCP23S17_IODIRA);
-		SPITransferNoRead(0);
-		SPITransferNoRead(0);
-		DeassertControl(MCP_CS_PIN);
-		dataIsOutput = true;
-	}
-
 	// Set data. Bypass the SPI/GPIO drivers again...
 	u.word = data;
 	PORTE = u.bytes[1];
 	PORTF = u.bytes[0];
-	AssertControl(MCP_CS_PIN);
-	SPITransferNoRead(MCP23S17_CONTROL_WRITE(0));
-	SPITransferNoRead(MCP23S17_GPIOA);
-	SPITransferNoRead(u.bytes[3]);
-	SPITransferNoRead(u.bytes[2]);
-	DeassertControl(MCP_CS_PIN);
+
+	// Make sure all of the data pins are outputs, and load the MCP23S17's part
+	SetDataOutputs(u.bytes[3], u.bytes[2]);
 
 	// Assert and then deassert WE to actually do the write cycle.
 	AssertControl(FLASH_WE_PIN);
@@ -567,6 +564,99 @@ void ParallelBus_WriteCycle(uint32_t address, uint32_t data)
 	// Control lines are left as "CS asserted, OE/WE not asserted" here.
 }
 
+/** Performs a series of write cycles on the parallel bus.
+ *
+ * @param cycles The address/data of each write cycle
+ * @param count The number of write cycles
+ * @param mask Mask applied to the data of every cycle
+ *
+ * This is the same as calling ParallelBus_WriteCycle for each cycle, but it's
+ * all inlined into one loop, which saves a lot of call overhead on the AVR
+ * when sending flash command sequences. The AVR's own ports are cheaper to
+ * write than to compare, so they're always written; the MCP23S17 is only
+ * talked to when its part of the data actually changes.
+ */
+void ParallelBus_WriteSequence(ParallelBusCycle const *cycles, uint8_t count, uint32_t mask)
+{
+	// Using this union surprisingly speeds things up when assembling or
+	// interpreting a uint32_t on the AVR.
+	union {
+		uint32_t word;
+		uint8_t bytes[4];
+	} u;
+
+	// We should currently be in a state of "CS is asserted, OE/WE not asserted".
+	// As an optimization, operate under that assumption.
+
+	while (count--)
+	{
+		// Set address
+		u.word = cycles->address;
+		PORTA = u.bytes[0];
+		PORTC = u.bytes[1];
+		u.bytes[2] = (u.bytes[2] & 0x03) | (uint8_t)((u.bytes[2] & 0x1C) << 2) | (PORTD & 0x8C);
+		PORTD = u.bytes[2];
+
+		// Set data
+		u.word = cycles->data & mask;
+		PORTE = u.bytes[1];
+		PORTF = u.bytes[0];
+		SetDataOutputs(u.bytes[3], u.bytes[2]);
+
+		// Do the write cycle
+		AssertControl(FLASH_WE_PIN);
+		DeassertControl(FLASH_WE_PIN);
+
+		cycles++;
+	}
+
+	// Control lines are left as "CS asserted, OE/WE not asserted" here.
+}
+
+/** Performs a write cycle to each of a bunch of consecutive addresses
+ *
+ * @param startAddress The address to start writing to
+ * @param buf The data to write
+ * @param len The number of 32-bit words to write
+ *
+ * This is the same as calling ParallelBus_WriteCycle for each word, but it's
+ * all inlined into one loop to save on call overhead.
+ */
+void ParallelBus_Write(uint32_t startAddress, uint32_t const *buf, uint16_t len)
+{
+	// Using this union surprisingly speeds things up when assembling or
+	// interpreting a uint32_t on the AVR.
+	union {
+		uint32_t word;
+		uint8_t bytes[4];
+	} u;
+
+	// We should currently be in a state of "CS is asserted, OE/WE not asserted".
+	// As an optimization, operate under that assumption.
+
+	while (len--)
+	{
+		// Set address
+		u.word = startAddress++;
+		PORTA = u.bytes[0];
+		PORTC = u.bytes[1];
+		u.bytes[2] = (u.bytes[2] & 0x03) | (uint8_t)((u.bytes[2] & 0x1C) << 2) | (PORTD & 0x8C);
+		PORTD = u.bytes[2];
+
+		// Set data
+		u.word = *buf++;
+		PORTE = u.bytes[1];
+		PORTF = u.bytes[0];
+		SetDataOutputs(u.bytes[3], u.bytes[2]);
+
+		// Do the write cycle
+		AssertControl(FLASH_WE_PIN);
+		DeassertControl(FLASH_WE_PIN);
+	}
+
+	// Control lines are left as "CS asserted, OE/WE not asserted" here.
+}
+
 /** Performs a read cycle on the parallel bus.
  *
  * @param address The address to read from
@@ -585,31 +675,17 @@ uint32_t ParallelBus_ReadCycle(uint32_t address)
 		uint8_t bytes[4];
 	} u;
 
+	// Don't bother with the MCP23S17 if nobody cares about its lanes
+	if (!mcpIsActive)
+	{
+		return ParallelBus_ReadCycleNative(address);
+	}
+
 	// We should currently be in a state of "CS is asserted, OE/WE not asserted".
 	// As an optimization, operate under that assumption.
 
 	// If the data pins are set as outputs, change them to inputs
-	if (dataIsOutput)
-	{
-		// Set data as inputs. Bypass the SPI/GPIO drivers for this for efficiency.
-		DDRE = 0;
-		DDRF = 0;
-		AssertControl(MCP_CS_PIN);
-		SPITransferNoRead(MCP23S17_CONTROL_WRITE(0));
-		SPITransferNoRead(MCP23S17_IODIRA);
-		SPITransferNoRead(0xFF);
-		SPITransferNoRead(0xFF);
-		DeassertControl(MCP_CS_PIN);
-
-		// Set pull-ups on the AVR data pins so we get a default value if a chip
-		// isn't responding. We can assume the MCP23S17 has already been configured
-		// to have its inputs pulled up. On the AVR we can't assume because its
-		// pull-up state is shared by the same register used for data output.
-		PORTE = 0xFF;
-		PORTF = 0xFF;
-
-		dataIsOutput = false;
-	}
+	SetDataInputs();
 
 	// Assert OE so we start reading from the chip. Safe to do now that
 	// the data pins have been set as inputs.
@@ -646,6 +722,81 @@ uint32_t ParallelBus_ReadCycle(uint32_t address)
 	return u.word;
 }
 
+/** Performs a read cycle on the parallel bus, only reading the native lanes
+ *
+ * @param address The address to read from
+ * @return The data read from the lanes in PARALLEL_BUS_NATIVE_LANES. The
+ *         other lanes come back as zero.
+ *
+ * Skips the MCP23S17 entirely, which makes it much faster than a normal read
+ * cycle. Useful for polling chips that are busy programming or erasing.
+ */
+uint32_t ParallelBus_ReadCycleNative(uint32_t address)
+{
+	// Using this union surprisingly speeds things up when assembling or
+	// interpreting a uint32_t on the AVR.
+	union {
+		uint32_t word;
+		uint8_t bytes[4];
+	} u;
+
+	// We should currently be in a state of "CS is asserted, OE/WE not asserted".
+	// As an optimization, operate under that assumption.
+
+	// If the data pins are set as outputs, change them to inputs. The MCP23S17
+	// has to be switched too, or it would fight the chips once OE is asserted.
+	SetDataInputs();
+
+	// Set the address and assert OE
+	u.word = address;
+	PORTA = u.bytes[0];
+	PORTC = u.bytes[1];
+	u.bytes[2] = (u.bytes[2] & 0x03) | (uint8_t)((u.bytes[2] & 0x1C) << 2) | (PORTD & 0x8C);
+	PORTD = u.bytes[2];
+	AssertControl(FLASH_OE_PIN);
+
+	// There's no SPI preparation to hide the flash's access time behind here,
+	// so wait a few cycles before reading the data bus.
+	__asm__ __volatile__ ("nop\nnop\nnop\nnop\n");
+
+	u.word = 0;
+	u.bytes[1] = PINE;
+	u.bytes[0] = PINF;
+
+	// Deassert OE, and we're done.
+	DeassertControl(FLASH_OE_PIN);
+
+	return u.word;
+}
+
+/** Tells the parallel bus which data lanes we actually care about
+ *
+ * @param lanes Mask of the data bits that read/write cycles need to handle
+ *
+ * If none of the MCP23S17's lanes are needed, read and write cycles skip it
+ * entirely, which makes them run at the speed of the AVR's own ports. Data
+ * read from the skipped lanes comes back as zero, and those pins are left as
+ * pulled-up inputs during writes.
+ */
+void ParallelBus_SetActiveLanes(uint32_t lanes)
+{
+	bool const active = (lanes & ~PARALLEL_BUS_NATIVE_LANES) != 0;
+
+	// Don't leave the MCP23S17 driving stale data onto chips we're ignoring
+	if (!active && mcpIsOutput)
+	{
+		AssertControl(MCP_CS_PIN);
+		SPITransferNoRead(MCP23S17_CONTROL_WRITE(0));
+		SPITransferNoRead(MCP23S17_IODIRA);
+		SPITransferNoRead(0xFF);
+		SPITransferNoRead(0xFF);
+		DeassertControl(MCP_CS_PIN);
+		mcpIsOutput = false;
+	}
+
+	mcpIsActive = active;
+}
+
 /** Reads a bunch of consecutive data from the parallel bus
  *
  * @param startAddress The address to start reading from
@@ -665,63 +816,108 @@ void ParallelBus_Read(uint32_t startAddress, uint32_t *buf, uint16_t len)
 	union {
 		uint32_t word;
 		uint8_t bytes[4];
-	} u;
+	} u, d;
 
 	// If the data pins are set as outputs, change them to inputs
-	if (dataIsOutput)
-	{
-		// Set data as inputs. Bypass the SPI/GPIO drivers for this for efficiency.
-		DDRE = 0;
-		DDRF = 0;
-		AssertControl(MCP_CS_PIN);
-		SPITransferNoRead(MCP23S17_CONTROL_WRITE(0));
-		SPITransferNoRead(MCP23S17_IODIRA);
-		SPITransferNoRead(0xFF);
-		SPITransferNoRead(0xFF);
-		DeassertControl(MCP_CS_PIN);
+	SetDataInputs();
 
-		// Set pull-ups on the AVR data pins so we get a default value if a chip
-		// isn't responding. We can assume the MCP23S17 has already been configured
-		// to have its inputs pulled up. On the AVR we can't assume because its
-		// pull-up state is shared by the same register used for data output.
-		PORTE = 0xFF;
-		PORTF = 0xFF;
+	// Nothing to do; don't bother setting up the MCP23S17
+	if (len == 0)
+	{
+		return;
+	}
 
-		dataIsOutput = false;
+	// If nobody cares about the MCP23S17's lanes, only read the AVR's own
+	// data pins. The MCP23S17 lanes come back as zero.
+	if (!mcpIsActive)
+	{
+		AssertControl(FLASH_OE_PIN);
+		d.word = 0;
+		while (len--)
+		{
+			u.word = startAddress++;
+			PORTA = u.bytes[0];
+			PORTC = u.bytes[1];
+			u.bytes[2] = (u.bytes[2] & 0x03) | (uint8_t)((u.bytes[2] & 0x1C) << 2) | (PORTD & 0x8C);
+			PORTD = u.bytes[2];
+
+			// Give the flash time to respond to the new address
+			__asm__ __volatile__ ("nop\nnop\nnop\nnop\n");
+
+			d.bytes[1] = PINE;
+			d.bytes[0] = PINF;
+			*buf++ = d.word;
+		}
+		DeassertControl(FLASH_OE_PIN);
+		return;
 	}
 
+	// Put the MCP23S17 into byte mode. Its register pointer will keep toggling
+	// between GPIOA and GPIOB, so we can hold its CS low for the whole read
+	// and clock out only the 2 data bytes for each address instead of 4 bytes.
+	AssertControl(MCP_CS_PIN);
+	SPITransferNoRead(MCP23S17_CONTROL_WRITE(0));
+	SPITransferNoRead(MCP23S17_IOCON);
+	SPITransferNoRead(MCP23S17_IOCON_SEQOP);
+	DeassertControl(MCP_CS_PIN);
+
 	// Assert OE, now the chip will start spitting out data.
 	AssertControl(FLASH_OE_PIN);
 
+	// Set the first address. This is basically the exact same code as
+	// ParallelBus_SetAddress, but repeated in here so we don't have any
+	// function call overhead.
+	u.word = startAddress++;
+	PORTA = u.bytes[0];
+	PORTC = u.bytes[1];
+	u.bytes[2] = (u.bytes[2] & 0x03) | (uint8_t)((u.bytes[2] & 0x1C) << 2) | (PORTD & 0x8C);
+	PORTD = u.bytes[2];
+
+	// Start the SPI read. The MCP23S17 grabs the GPIOA value when the register
+	// address byte finishes, and the address has settled by then.
+	AssertControl(MCP_CS_PIN);
+	SPITransferNoRead(MCP23S17_CONTROL_READ(0));
+	SPITransferNoRead(MCP23S17_GPIOA);
+
 	while (len--)
 	{
-		// Set address. This is basically the exact same code as ParallelBus_SetAddress,
-		// but repeated in here so we don't have any function call overhead.
+		// Read data. Bypass the GPIO/SPI drivers again...
+		d.bytes[1] = PINE;
+		d.bytes[0] = PINF;
+		d.bytes[3] = SPITransfer(0);
+
+		// The MCP23S17 loads each byte it sends when the previous byte finishes.
+		// GPIOB for this address was grabbed at the end of the GPIOA byte, so
+		// while GPIOB is being clocked out, we can already move on to the next
+		// address. The next GPIOA will be grabbed at the end of this byte, long
+		// after the new address has settled. (Past the end, the extra address
+		// change and read are harmless.)
+		// The address code's timing is up to the compiler, so actually wait
+		// for the transfer to finish here. Reading SPSR before writing SPDR
+		// clears the stale SPIF left over from the previous transfers.
+		(void)SPSR;
+		SPDR = 0;
 		u.word = startAddress++;
 		PORTA = u.bytes[0];
 		PORTC = u.bytes[1];
 		u.bytes[2] = (u.bytes[2] & 0x03) | (uint8_t)((u.bytes[2] & 0x1C) << 2) | (PORTD & 0x8C);
 		PORTD = u.bytes[2];
-
-		// Start the SPI read. Each clock cycle at 16 MHz is 62.5 nanoseconds. We don't want to
-		// immediately read back the data bus until the address has settled, so do some SPI
-		// preparation in the meantime.
-		AssertControl(MCP_CS_PIN);
-		SPITransferNoRead(MCP23S17_CONTROL_READ(0));
-		SPITransferNoRead(MCP23S17_GPIOA);
-
-		// Read data. Bypass the GPIO/SPI drivers again...
-		u.bytes[1] = PINE;
-		u.bytes[0] = PINF;
-		u.bytes[3] = SPITransfer(0);
-		u.bytes[2] = SPITransfer(0);
-		DeassertControl(MCP_CS_PIN);
-		*buf++ = u.word;
+		while (!(SPSR & (1 << SPIF)));
+		d.bytes[2] = SPDR;
+		*buf++ = d.word;
 	}
+	DeassertControl(MCP_CS_PIN);
 
 	// Deassert OE once we are done
 	DeassertControl(FLASH_OE_PIN);
 
+	// Put the MCP23S17 back into its normal sequential mode
+	AssertControl(MCP_CS_PIN);
+	SPITransferNoRead(MCP23S17_CONTROL_WRITE(0));
+	SPITransferNoRead(MCP23S17_IOCON);
+	SPITransferNoRead(0);
+	DeassertControl(MCP_CS_PIN);
+
 	// Control lines are left as "CS asserted, OE/WE not asserted" here.
 }
 
@@ -762,6 +958,109 @@ static ALWAYS_INLINE void SPITransferNoRead(uint8_t byte)
 	//while (!(SPSR & (1 << SPIF)));
 }
 
+/** Switches the data bus pins to outputs, and sets the MCP23S17's output latch
+ *
+ * @param upperA The data for D31-D24 (the MCP23S17's port A)
+ * @param upperB The data for D23-D16 (the MCP23S17's port B)
+ *
+ * The AVR's own data pins need to be loaded by the caller beforehand. Bypasses
+ * the SPI/GPIO drivers for efficiency.
+ */
+static ALWAYS_INLINE void SetDataOutputs(uint8_t upperA, uint8_t upperB)
+{
+	// If the data port is not already set as outputs, set it to be outputs now
+	if (!dataIsOutput)
+	{
+		DDRE = 0xFF;
+		DDRF = 0xFF;
+		dataIsOutput = true;
+	}
+
+	// If the upper lanes are masked out, leave the MCP23S17 alone entirely.
+	// Its pins stay as pulled-up inputs.
+	if (mcpIsActive)
+	{
+		// Command sequences write the same upper data bytes over and over, so
+		// we remember what's in the MCP23S17's output latch and only update it
+		// if it needs to change.
+		bool const latchChanged = (upperA != mcpOutputLatchA) ||
+				(upperB != mcpOutputLatchB);
+
+		// If the MCP23S17's data pins are not already set as outputs, set
+		// them to be outputs now
+		if (!mcpIsOutput)
+		{
+			// Bypass the SPI/GPIO drivers for this for efficiency.
+			AssertControl(MCP_CS_PIN);
+			SPITransferNoRead(MCP23S17_CONTROL_WRITE(0));
+			if (latchChanged)
+			{
+				// Write OLATA/OLATB first, then let the register address roll
+				// over from the last register (OLATB) to IODIRA/IODIRB. One
+				// 6-byte burst instead of two separate 4-byte transfers, and
+				// the new values are already latched when the pins turn into
+				// outputs.
+				SPITransferNoRead(MCP23S17_OLATA);
+				SPITransferNoRead(upperA);
+				SPITransferNoRead(upperB);
+			}
+			else
+			{
+				SPITransferNoRead(MCP23S17_IODIRA);
+			}
+			SPITransferNoRead(0);
+			SPITransferNoRead(0);
+			DeassertControl(MCP_CS_PIN);
+			mcpIsOutput = true;
+		}
+		else if (latchChanged)
+		{
+			AssertControl(MCP_CS_PIN);
+			SPITransferNoRead(MCP23S17_CONTROL_WRITE(0));
+			SPITransferNoRead(MCP23S17_OLATA);
+			SPITransferNoRead(upperA);
+			SPITransferNoRead(upperB);
+			DeassertControl(MCP_CS_PIN);
+		}
+		mcpOutputLatchA = upperA;
+		mcpOutputLatchB = upperB;
+	}
+}
+
+/** Switches the data bus pins to inputs, if they aren't already
+ *
+ * Bypasses the SPI/GPIO drivers for efficiency. The MCP23S17 is always switched
+ * even if its lanes are inactive, so it never fights the chips during a read.
+ */
+static ALWAYS_INLINE void SetDataInputs(void)
+{
+	if (dataIsOutput)
+	{
+		DDRE = 0;
+		DDRF = 0;
+
+		// Set pull-ups on the AVR data pins so we get a default value if a chip
+		// isn't responding. We can assume the MCP23S17 has already been configured
+		// to have its inputs pulled up. On the AVR we can't assume because its
+		// pull-up state is shared by the same register used for data output.
+		PORTE = 0xFF;
+		PORTF = 0xFF;
+
+		dataIsOutput = false;
+	}
+
+	if (mcpIsOutput)
+	{
+		AssertControl(MCP_CS_PIN);
+		SPITransferNoRead(MCP23S17_CONTROL_WRITE(0));
+		SPITransferNoRead(MCP23S17_IODIRA);
+		SPITransferNoRead(0xFF);
+		SPITransferNoRead(0xFF);
+		DeassertControl(MCP_CS_PIN);
+		mcpIsOutput = false;
+	}
+}
+
 /** Asserts a control pin
  *
  * @param pin Pin number of the control pin to assert
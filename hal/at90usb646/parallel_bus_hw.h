@@ -0,0 +1,57 @@
+/*
+ * parallel_bus_hw.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: SIMM Programmer contributors
+ *
+ * Copyright (C) 2026 SIMM Programmer contributors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HAL_AT90USB646_PARALLEL_BUS_HW_H_
+#define HAL_AT90USB646_PARALLEL_BUS_HW_H_
+
+#include <stdint.h>
+
+/// Data bus bits that are wired directly to AVR ports (PORTE/PORTF). The rest
+/// are on the MCP23S17, so accessing them requires slow SPI transfers.
+#define PARALLEL_BUS_NATIVE_LANES		0x0000FFFFUL
+
+uint32_t ParallelBus_ReadCycleNative(uint32_t address);
+void ParallelBus_SetActiveLanes(uint32_t lanes);
+
+/** Reads a bunch of consecutive data from the parallel bus
+ *
+ * @param startAddress The address to start reading from
+ * @param buf Buffer to store the readback
+ * @param len The number of 32-bit words to read
+ *
+ * There's no DMA on the AVR, so the read is done right away.
+ */
+static inline void ParallelBus_StartRead(uint32_t startAddress, uint32_t *buf, uint16_t len)
+{
+	ParallelBus_Read(startAddress, buf, len);
+}
+
+/** Waits for a read started by ParallelBus_StartRead to finish
+ *
+ * There's no DMA on the AVR, so there's nothing to wait for.
+ */
+static inline void ParallelBus_FinishRead(void)
+{
+}
+
+#endif /* HAL_AT90USB646_PARALLEL_BUS_HW_H_ */
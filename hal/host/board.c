@@ -0,0 +1,58 @@
+/*
+ * board.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: SIMM Programmer contributors
+ *
+ * Copyright (C) 2026 SIMM Programmer contributors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "board_hw.h"
+#include <stdio.h>
+
+/** Initializes any board hardware-specific stuff
+ *
+ * On the host, this sets up the simulated SIMM. The SIMM_SIM_CHIPS environment
+ * variable chooses the chips on it (see FlashSim_Init). If SIMM_SIM_STATS_FD
+ * is set, the simulation's statistics are kept in that shared memory file so a
+ * benchmark can read them while we run.
+ */
+void Board_Init(void)
+{
+	if (!FlashSim_Init(getenv("SIMM_SIM_CHIPS")))
+	{
+		fprintf(stderr, "Invalid SIMM_SIM_CHIPS, expected e.g. sst39sf040 or "
+				"m29f160fb,m29f160fb,none,sst39sf040\n");
+		exit(1);
+	}
+
+	char const *statsFd = getenv("SIMM_SIM_STATS_FD");
+	if (statsFd && !FlashSim_ShareStats(atoi(statsFd)))
+	{
+		perror("Unable to share simulation statistics");
+		exit(1);
+	}
+}
+
+/** Determines if a brownout was detected at startup
+ *
+ * @return True if a brownout was detected
+ */
+bool Board_BrownoutDetected(void)
+{
+	return false;
+}
@@ -0,0 +1,56 @@
+/*
+ * board_hw.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: SIMM Programmer contributors
+ *
+ * Copyright (C) 2026 SIMM Programmer contributors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HAL_HOST_BOARD_HW_H_
+#define HAL_HOST_BOARD_HW_H_
+
+#include "gpio_hw.h"
+#include "../gpio.h"
+#include "hardware.h"
+#include "../usbcdc.h"
+#include <stdlib.h>
+
+#define BOARD_LED_INVERTED false
+#define BOARD_SUPPORTS_PULLDOWNS true
+
+/** Gets the GPIO pin on the board that controls the status LED
+ *
+ * @return The status LED pin
+ */
+static inline GPIOPin Board_LEDPin(void)
+{
+	return GPIO_PIN(GPIOA, 0);
+}
+
+/** Jumps to the bootloader
+ *
+ * There's no bootloader on the host, so the simulated programmer just goes
+ * away, like a real one disappearing from USB when it reboots.
+ */
+static inline void Board_EnterBootloader(void)
+{
+	USBCDC_Disable();
+	exit(0);
+}
+
+#endif /* HAL_HOST_BOARD_HW_H_ */
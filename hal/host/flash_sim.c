@@ -0,0 +1,870 @@
+/*
+ * flash_sim.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: SIMM Programmer contributors
+ *
+ * Copyright (C) 2026 SIMM Programmer contributors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * -----------------------------------------------------------------------------
+ *
+ * Simulates the four 8-bit JEDEC NOR flash chips on a SIMM, one on each byte
+ * lane of the data bus. Each chip runs its own command state machine, so it
+ * only does something when it sees the exact unlock addresses and commands
+ * that the real chip would need. Program and erase operations take time on a
+ * virtual clock, and while they're running the chip answers reads with its
+ * status bits (DQ7 data polling, DQ6 toggle, DQ3 sector erase timer and DQ2
+ * erase toggle) instead of the array data, just like the real thing. Chips
+ * that support CFI answer the query command with their CFI tables. Chips with
+ * a write buffer accept buffered programming, and abort it (DQ1) when it's
+ * used wrong. Faults can be injected into a buffered program operation to
+ * make a chip abort or time out (DQ5) on purpose.
+ *
+ * This is deliberately written from the chips' datasheets rather than from
+ * the driver, so it can catch the driver doing something the chips wouldn't
+ * accept.
+ */
+
+#include "flash_sim.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+/// The most sectors any simulated chip has
+#define FLASH_SIM_MAX_SECTORS			128
+/// The biggest write buffer any simulated chip has
+#define FLASH_SIM_MAX_WRITE_BUFFER		256
+/// How long the M29F160 waits for more sector addresses after each one
+#define SECTOR_ERASE_TIMEOUT_NS			50000ULL
+
+/// Status bits returned while a chip is busy
+#define STATUS_DQ7						(1 << 7)
+#define STATUS_DQ6						(1 << 6)
+#define STATUS_DQ5						(1 << 5)
+#define STATUS_DQ3						(1 << 3)
+#define STATUS_DQ2						(1 << 2)
+#define STATUS_DQ1						(1 << 1)
+
+/// A group of identical erase sectors in a chip's sector map
+typedef struct FlashSimSectorGroup
+{
+	uint32_t count;
+	uint32_t size;
+} FlashSimSectorGroup;
+
+/// Everything that's different between the kinds of chips we simulate
+typedef struct FlashSimModel
+{
+	/// Name used to pick this chip in the configuration string
+	char const *name;
+	/// The JEDEC IDs reported in autoselect mode
+	uint8_t manufacturer;
+	uint8_t device;
+	/// Size of the chip in bytes
+	uint32_t size;
+	/// Address bits the chip looks at when decoding commands, and the two
+	/// unlock addresses it expects
+	uint32_t commandMask;
+	uint32_t unlockAddress1;
+	uint32_t unlockAddress2;
+	/// Shift from our bus address to the chip's autoselect address. 8-/16-bit
+	/// chips in 8-bit mode use our A0 as their A-1, which autoselect ignores.
+	uint8_t idShift;
+	/// True if the chip supports the unlock bypass commands
+	bool unlockBypass;
+	/// True if the chip collects several sector addresses per erase command
+	bool multiSectorErase;
+	/// Typical time to program a byte, erase a sector and erase the whole chip.
+	/// A chip erase time of 0 means it takes as long as erasing every sector.
+	uint32_t programTimeNS;
+	uint32_t sectorEraseTimeNS;
+	uint32_t chipEraseTimeNS;
+	/// Size of the write buffer in bytes (0 if there isn't one), and the
+	/// typical time to program a full buffer
+	uint16_t writeBufferSize;
+	uint32_t bufferProgramTimeNS;
+	/// The chip's sector map
+	uint8_t numSectorGroups;
+	FlashSimSectorGroup const *sectorGroups;
+	/// The chip's CFI query table starting from offset 0x10, or NULL if it
+	/// doesn't support CFI
+	uint8_t const *cfi;
+	uint8_t cfiSize;
+} FlashSimModel;
+
+/// The command state of a chip
+typedef enum FlashSimState
+{
+	FlashSimRead,             //!< Reading array data
+	FlashSimUnlocked1,        //!< Got the first unlock cycle
+	FlashSimUnlocked2,        //!< Got both unlock cycles, waiting for a command
+	FlashSimProgram,          //!< Waiting for the address/data to program
+	FlashSimEraseSetup,       //!< Got the erase setup command
+	FlashSimEraseUnlocked1,   //!< Got the first unlock cycle of an erase
+	FlashSimEraseUnlocked2,   //!< Got both unlock cycles of an erase
+	FlashSimSectorEraseWait,  //!< Collecting sector addresses to erase
+	FlashSimAutoselect,       //!< Reading IDs
+	FlashSimCFIQuery,         //!< Reading the CFI tables
+	FlashSimBypassProgram,    //!< Unlock bypass: waiting for the address/data to program
+	FlashSimBypassReset,      //!< Unlock bypass: got the first reset cycle
+	FlashSimBufferCount,      //!< Write to buffer: waiting for the number of bytes
+	FlashSimBufferLoad,       //!< Write to buffer: loading bytes into the buffer
+	FlashSimBufferConfirm,    //!< Write to buffer: waiting for the program confirm command
+	FlashSimBufferAbort,      //!< Write to buffer aborted, waiting for the abort reset
+	FlashSimAbortUnlocked1,   //!< Write to buffer aborted, got the first unlock cycle of the reset
+	FlashSimAbortUnlocked2,   //!< Write to buffer aborted, got both unlock cycles of the reset
+	FlashSimProgramTimeout,   //!< Buffered program failed, waiting for a reset
+	FlashSimBusy              //!< Programming or erasing
+} FlashSimState;
+
+/// A simulated chip
+typedef struct FlashSimChip
+{
+	/// What kind of chip it is, or NULL if the socket is empty
+	FlashSimModel const *model;
+	/// The contents of the chip
+	uint8_t *memory;
+	/// The command state
+	FlashSimState state;
+	/// True if the chip is in unlock bypass mode
+	bool bypass;
+	/// True if the operation in progress is an erase
+	bool erasing;
+	/// The current state of the DQ6/DQ2 toggle bits
+	uint8_t toggle;
+	/// The byte being programmed, for DQ7 data polling
+	uint8_t programData;
+	/// When the sector erase timeout or operation in progress is over
+	uint64_t busyUntil;
+	/// Sectors waiting to be erased
+	bool eraseSectors[FLASH_SIM_MAX_SECTORS];
+	/// Write to buffer: the sector it was started in, the first address of
+	/// the page being loaded (or -1 before the first byte), how many bytes are
+	/// left to load, and the bytes loaded so far
+	int bufferSector;
+	int64_t bufferPage;
+	uint16_t bufferRemaining;
+	bool bufferLoaded[FLASH_SIM_MAX_WRITE_BUFFER];
+	uint8_t bufferData[FLASH_SIM_MAX_WRITE_BUFFER];
+	/// A failure to cause in the next buffered program operation
+	FlashSimFault fault;
+	/// True if the operation in progress is going to time out
+	bool timingOut;
+} FlashSimChip;
+
+static void FlashSim_ChipWrite(FlashSimChip *chip, uint32_t address, uint8_t data);
+static uint8_t FlashSim_ChipRead(FlashSimChip *chip, uint32_t address);
+static void FlashSim_Update(FlashSimChip *chip);
+static void FlashSim_StartErase(FlashSimChip *chip, uint64_t startTime);
+static void FlashSim_ProgramBuffer(FlashSimChip *chip);
+static bool FlashSim_Failed(FlashSimChip const *chip);
+static int FlashSim_SectorIndex(FlashSimModel const *model, uint32_t address, uint32_t *start, uint32_t *size);
+static FlashSimModel const *FlashSim_FindModel(char const *name, size_t len, bool *found);
+
+/// SST39SF010A/020A/040: uniform 4 KB sectors
+static const FlashSimSectorGroup sst39sf010aSectors[] = {{32, 4*1024UL}};
+static const FlashSimSectorGroup sst39sf020aSectors[] = {{64, 4*1024UL}};
+static const FlashSimSectorGroup sst39sf040Sectors[] = {{128, 4*1024UL}};
+
+/// M29F160FB/FT in 8-bit mode: bottom and top boot blocks
+static const FlashSimSectorGroup m29f160fbSectors[] = {
+	{1, 16*1024UL}, {2, 8*1024UL}, {1, 32*1024UL}, {31, 64*1024UL}
+};
+static const FlashSimSectorGroup m29f160ftSectors[] = {
+	{31, 64*1024UL}, {1, 32*1024UL}, {2, 8*1024UL}, {1, 16*1024UL}
+};
+
+/// CFI table of the Am29LV160DB/DT from offset 0x10, in 8-bit mode. Both list
+/// their erase block regions from the bottom up, so the top boot chip's boot
+/// flag (3 instead of 2) is the only way to tell that its regions are flipped.
+#define AM29LV160D_CFI(bootFlag) { \
+	/* 0x10 */ 'Q', 'R', 'Y', 0x02, 0x00, 0x40, 0x00, 0x00, 0x00, 0x00, 0x00, 0x27, 0x36, 0x00, 0x00, 0x04, \
+	/* 0x20 */ 0x00, 0x0A, 0x00, 0x05, 0x00, 0x04, 0x00, 0x15, 0x02, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x40, \
+	/* 0x30 */ 0x00, 0x01, 0x00, 0x20, 0x00, 0x00, 0x00, 0x80, 0x00, 0x1E, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, \
+	/* 0x40 */ 'P', 'R', 'I', '1', '1', 0x00, 0x02, 0x01, 0x01, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, (bootFlag) \
+}
+static const uint8_t am29lv160dbCFI[] = AM29LV160D_CFI(0x02);
+static const uint8_t am29lv160dtCFI[] = AM29LV160D_CFI(0x03);
+
+/// S29GL032N model 04: uniform 64 KB sectors
+static const FlashSimSectorGroup s29gl032nSectors[] = {{64, 64*1024UL}};
+
+/// CFI table of the S29GL032N model 04 from offset 0x10, in 8-bit mode. It has
+/// one erase block region and a 32 byte write buffer.
+static const uint8_t s29gl032nCFI[] = {
+	/* 0x10 */ 'Q', 'R', 'Y', 0x02, 0x00, 0x40, 0x00, 0x00, 0x00, 0x00, 0x00, 0x27, 0x36, 0x00, 0x00, 0x06,
+	/* 0x20 */ 0x06, 0x09, 0x00, 0x03, 0x05, 0x04, 0x00, 0x16, 0x02, 0x00, 0x05, 0x00, 0x01, 0x3F, 0x00, 0x00,
+	/* 0x30 */ 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	/* 0x40 */ 'P', 'R', 'I', '1', '3', 0x10, 0x02, 0x01, 0x00, 0x08, 0x00, 0x00, 0x02, 0xB5, 0xC5, 0x04
+};
+
+/// Every kind of chip we can simulate. Timings are typical datasheet values.
+static const FlashSimModel models[] = {
+	{"sst39sf010a", 0xBF, 0xB5, 128*1024UL, 0x7FFF, 0x5555, 0x2AAA, 0, false, false,
+			14000, 18000000, 70000000, 0, 0, 1, sst39sf010aSectors, NULL, 0},
+	{"sst39sf020a", 0xBF, 0xB6, 256*1024UL, 0x7FFF, 0x5555, 0x2AAA, 0, false, false,
+			14000, 18000000, 70000000, 0, 0, 1, sst39sf020aSectors, NULL, 0},
+	{"sst39sf040", 0xBF, 0xB7, 512*1024UL, 0x7FFF, 0x5555, 0x2AAA, 0, false, false,
+			14000, 18000000, 70000000, 0, 0, 1, sst39sf040Sectors, NULL, 0},
+	{"m29f160fb", 0x01, 0xD8, 2048*1024UL, 0xFFF, 0xAAA, 0x555, 1, true, true,
+			10000, 800000000, 0, 0, 0, 4, m29f160fbSectors, NULL, 0},
+	{"m29f160ft", 0x01, 0xD2, 2048*1024UL, 0xFFF, 0xAAA, 0x555, 1, true, true,
+			10000, 800000000, 0, 0, 0, 4, m29f160ftSectors, NULL, 0},
+	{"am29lv160db", 0x01, 0x49, 2048*1024UL, 0xFFF, 0xAAA, 0x555, 1, true, true,
+			9000, 700000000, 0, 0, 0, 4, m29f160fbSectors, am29lv160dbCFI, sizeof(am29lv160dbCFI)},
+	{"am29lv160dt", 0x01, 0xC4, 2048*1024UL, 0xFFF, 0xAAA, 0x555, 1, true, true,
+			9000, 700000000, 0, 0, 0, 4, m29f160ftSectors, am29lv160dtCFI, sizeof(am29lv160dtCFI)},
+	{"s29gl032n", 0x01, 0x7E, 4096*1024UL, 0xFFF, 0xAAA, 0x555, 1, true, true,
+			60000, 500000000, 0, 32, 240000, 1, s29gl032nSectors, s29gl032nCFI, sizeof(s29gl032nCFI)},
+};
+
+/// The chips, indexed by byte lane (lane 0 = IC4, lane 3 = IC1)
+static FlashSimChip chips[FLASH_SIM_NUM_CHIPS];
+/// Statistics, which may be shared with a benchmark program. This includes
+/// the virtual clock.
+static FlashSimStats localStats;
+static FlashSimStats *stats = &localStats;
+
+/** Sets up the simulated chips
+ *
+ * @param config Which chips are in the sockets: either one chip name used for
+ *               all four, or four comma-separated names in IC1, IC2, IC3, IC4
+ *               order. "none" leaves a socket empty. NULL means four SST39SF040s.
+ * @return True on success, false if the configuration didn't make sense
+ */
+bool FlashSim_Init(char const *config)
+{
+	FlashSimModel const *configModels[FLASH_SIM_NUM_CHIPS];
+	uint8_t numModels = 0;
+	char const *p = config ? config : "sst39sf040";
+
+	while (numModels < FLASH_SIM_NUM_CHIPS)
+	{
+		bool found;
+		size_t const len = strcspn(p, ",");
+		configModels[numModels++] = FlashSim_FindModel(p, len, &found);
+		if (!found)
+		{
+			fprintf(stderr, "Unknown simulated flash chip: %.*s\n", (int)len, p);
+			return false;
+		}
+
+		p += len;
+		if (*p == '\0')
+		{
+			break;
+		}
+		p++;
+	}
+
+	if (*p != '\0' || (numModels != 1 && numModels != FLASH_SIM_NUM_CHIPS))
+	{
+		fprintf(stderr, "Expected 1 or %d simulated flash chips\n", FLASH_SIM_NUM_CHIPS);
+		return false;
+	}
+
+	for (uint8_t i = 0; i < FLASH_SIM_NUM_CHIPS; i++)
+	{
+		FlashSimChip *chip = &chips[FLASH_SIM_NUM_CHIPS - i - 1];
+		free(chip->memory);
+		memset(chip, 0, sizeof(*chip));
+		chip->model = configModels[numModels == 1 ? 0 : i];
+		if (chip->model)
+		{
+			// Chips come from the factory erased
+			chip->memory = malloc(chip->model->size);
+			if (!chip->memory)
+			{
+				return false;
+			}
+			memset(chip->memory, 0xFF, chip->model->size);
+		}
+	}
+
+	memset(stats, 0, sizeof(*stats));
+	return true;
+}
+
+/** Keeps the statistics in shared memory, so another program can watch them
+ *
+ * @param fd A file descriptor for the shared memory, at least as big as FlashSimStats
+ * @return True on success, false on failure
+ */
+bool FlashSim_ShareStats(int fd)
+{
+	void *shared = mmap(NULL, sizeof(FlashSimStats), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (shared == MAP_FAILED)
+	{
+		return false;
+	}
+
+	memcpy(shared, stats, sizeof(FlashSimStats));
+	stats = shared;
+	return true;
+}
+
+/** Gets the statistics, so the rest of the simulation can add to them
+ *
+ * @return The statistics
+ */
+FlashSimStats *FlashSim_Stats(void)
+{
+	return stats;
+}
+
+/** Performs a write cycle on the simulated chips
+ *
+ * @param address The address on the bus
+ * @param data The 32-bit data on the bus, one byte per chip
+ */
+void FlashSim_Write(uint32_t address, uint32_t data)
+{
+	stats->writeCycles++;
+	for (uint8_t i = 0; i < FLASH_SIM_NUM_CHIPS; i++)
+	{
+		FlashSim_ChipWrite(&chips[i], address, (uint8_t)(data >> (8 * i)));
+	}
+}
+
+/** Performs a read cycle on the simulated chips
+ *
+ * @param address The address on the bus
+ * @return The 32-bit data the chips put on the bus, one byte per chip
+ */
+uint32_t FlashSim_Read(uint32_t address)
+{
+	uint32_t data = 0;
+	stats->readCycles++;
+	for (uint8_t i = 0; i < FLASH_SIM_NUM_CHIPS; i++)
+	{
+		data |= (uint32_t)FlashSim_ChipRead(&chips[i], address) << (8 * i);
+	}
+
+	// Count the reads where some chip answered with its status, which are the
+	// driver polling for an operation to finish
+	for (uint8_t i = 0; i < FLASH_SIM_NUM_CHIPS; i++)
+	{
+		if (chips[i].state == FlashSimBusy || chips[i].state == FlashSimSectorEraseWait ||
+			FlashSim_Failed(&chips[i]))
+		{
+			stats->statusReads++;
+			break;
+		}
+	}
+	return data;
+}
+
+/** Makes the next buffered program operation on a chip fail
+ *
+ * @param lane The chip's byte lane (0 = IC4, 3 = IC1)
+ * @param fault How it should fail
+ */
+void FlashSim_InjectFault(uint8_t lane, FlashSimFault fault)
+{
+	if (lane < FLASH_SIM_NUM_CHIPS)
+	{
+		chips[lane].fault = fault;
+	}
+}
+
+/** Gets the current time on the virtual clock
+ *
+ * @return The number of nanoseconds since the simulation started
+ */
+uint64_t FlashSim_Now(void)
+{
+	return stats->timeNS;
+}
+
+/** Moves the virtual clock forward
+ *
+ * @param ns The number of nanoseconds that passed
+ */
+void FlashSim_Delay(uint64_t ns)
+{
+	// Count the part of the delay that some chip spent busy
+	uint64_t busyUntil = stats->timeNS;
+	for (uint8_t i = 0; i < FLASH_SIM_NUM_CHIPS; i++)
+	{
+		if ((chips[i].state == FlashSimBusy || chips[i].state == FlashSimSectorEraseWait) &&
+			chips[i].busyUntil > busyUntil)
+		{
+			busyUntil = chips[i].busyUntil;
+		}
+	}
+	stats->busyNS += (busyUntil - stats->timeNS < ns) ? busyUntil - stats->timeNS : ns;
+
+	stats->timeNS += ns;
+}
+
+/** Handles a write cycle to one chip
+ *
+ * @param chip The chip
+ * @param address The address on the bus
+ * @param data The byte on the chip's lane of the data bus
+ */
+static void FlashSim_ChipWrite(FlashSimChip *chip, uint32_t address, uint8_t data)
+{
+	FlashSimModel const *model = chip->model;
+	if (!model)
+	{
+		return;
+	}
+
+	FlashSim_Update(chip);
+
+	uint32_t const command = address & model->commandMask;
+	uint32_t const offset = address & (model->size - 1);
+	uint32_t start, size;
+	int sector;
+
+	switch (chip->state)
+	{
+	case FlashSimRead:
+	case FlashSimAutoselect:
+		if (data == 0xF0)
+		{
+			chip->state = FlashSimRead;
+		}
+		else if (chip->bypass && chip->state == FlashSimRead && data == 0xA0)
+		{
+			chip->state = FlashSimBypassProgram;
+		}
+		else if (chip->bypass && chip->state == FlashSimRead && data == 0x90)
+		{
+			chip->state = FlashSimBypassReset;
+		}
+		else if (!chip->bypass && command == model->unlockAddress1 && data == 0xAA)
+		{
+			chip->state = FlashSimUnlocked1;
+		}
+		else if (!chip->bypass && model->cfi && command == (0x55UL << model->idShift) && data == 0x98)
+		{
+			chip->state = FlashSimCFIQuery;
+		}
+		break;
+	case FlashSimCFIQuery:
+		if (data == 0xF0)
+		{
+			chip->state = FlashSimRead;
+		}
+		break;
+	case FlashSimUnlocked1:
+		chip->state = (command == model->unlockAddress2 && data == 0x55) ?
+				FlashSimUnlocked2 : FlashSimRead;
+		break;
+	case FlashSimUnlocked2:
+		chip->state = FlashSimRead;
+		if (data == 0x25 && model->writeBufferSize)
+		{
+			// Write to buffer goes to the sector being programmed instead
+			// of an unlock address
+			chip->bufferSector = FlashSim_SectorIndex(model, offset, &start, &size);
+			chip->state = FlashSimBufferCount;
+			break;
+		}
+		if (command != model->unlockAddress1)
+		{
+			break;
+		}
+
+		if (data == 0xA0)
+		{
+			chip->state = FlashSimProgram;
+		}
+		else if (data == 0x80)
+		{
+			chip->state = FlashSimEraseSetup;
+		}
+		else if (data == 0x90)
+		{
+			chip->state = FlashSimAutoselect;
+		}
+		else if (data == 0x20 && model->unlockBypass)
+		{
+			chip->bypass = true;
+		}
+		break;
+	case FlashSimProgram:
+	case FlashSimBypassProgram:
+		// Programming can only clear bits
+		chip->memory[offset] &= data;
+		chip->programData = data;
+		chip->erasing = false;
+		chip->busyUntil = stats->timeNS + model->programTimeNS;
+		chip->state = FlashSimBusy;
+		break;
+	case FlashSimBypassReset:
+		if (data == 0x00)
+		{
+			chip->bypass = false;
+		}
+		chip->state = FlashSimRead;
+		break;
+	case FlashSimBufferCount:
+		// The count has to go to the same sector, and fit in the buffer
+		if (FlashSim_SectorIndex(model, offset, &start, &size) != chip->bufferSector ||
+			data >= model->writeBufferSize)
+		{
+			chip->state = FlashSimBufferAbort;
+			break;
+		}
+		chip->bufferPage = -1;
+		chip->bufferRemaining = data + 1;
+		memset(chip->bufferLoaded, 0, sizeof(chip->bufferLoaded));
+		chip->state = FlashSimBufferLoad;
+		break;
+	case FlashSimBufferLoad:
+		// Every byte has to be in the same write buffer page as the first one
+		if (chip->bufferPage < 0)
+		{
+			chip->bufferPage = offset & ~(uint32_t)(model->writeBufferSize - 1);
+		}
+		if ((offset & ~(uint32_t)(model->writeBufferSize - 1)) != chip->bufferPage)
+		{
+			chip->state = FlashSimBufferAbort;
+			break;
+		}
+		chip->bufferData[offset & (model->writeBufferSize - 1)] = data;
+		chip->bufferLoaded[offset & (model->writeBufferSize - 1)] = true;
+		chip->programData = data;
+		if (--chip->bufferRemaining == 0)
+		{
+			chip->state = FlashSimBufferConfirm;
+		}
+		break;
+	case FlashSimBufferConfirm:
+		if (data != 0x29 || chip->fault == FlashSimFaultBufferAbort ||
+			FlashSim_SectorIndex(model, offset, &start, &size) != chip->bufferSector)
+		{
+			chip->fault = FlashSimFaultNone;
+			chip->state = FlashSimBufferAbort;
+			break;
+		}
+		FlashSim_ProgramBuffer(chip);
+		break;
+	case FlashSimBufferAbort:
+		if (command == model->unlockAddress1 && data == 0xAA)
+		{
+			chip->state = FlashSimAbortUnlocked1;
+		}
+		break;
+	case FlashSimAbortUnlocked1:
+		chip->state = (command == model->unlockAddress2 && data == 0x55) ?
+				FlashSimAbortUnlocked2 : FlashSimBufferAbort;
+		break;
+	case FlashSimAbortUnlocked2:
+		// Only the whole "write to buffer abort reset" gets the chip going again
+		chip->state = (command == model->unlockAddress1 && data == 0xF0) ?
+				FlashSimRead : FlashSimBufferAbort;
+		break;
+	case FlashSimProgramTimeout:
+		if (data == 0xF0)
+		{
+			chip->state = FlashSimRead;
+		}
+		break;
+	case FlashSimEraseSetup:
+		chip->state = (command == model->unlockAddress1 && data == 0xAA) ?
+				FlashSimEraseUnlocked1 : FlashSimRead;
+		break;
+	case FlashSimEraseUnlocked1:
+		chip->state = (command == model->unlockAddress2 && data == 0x55) ?
+				FlashSimEraseUnlocked2 : FlashSimRead;
+		break;
+	case FlashSimEraseUnlocked2:
+		if (command == model->unlockAddress1 && data == 0x10)
+		{
+			// Chip erase
+			uint64_t eraseTime = model->chipEraseTimeNS;
+			if (eraseTime == 0)
+			{
+				for (uint8_t i = 0; i < model->numSectorGroups; i++)
+				{
+					eraseTime += (uint64_t)model->sectorGroups[i].count * model->sectorEraseTimeNS;
+				}
+			}
+			memset(chip->memory, 0xFF, model->size);
+			chip->erasing = true;
+			chip->busyUntil = stats->timeNS + eraseTime;
+			chip->state = FlashSimBusy;
+		}
+		else if (data == 0x30)
+		{
+			sector = FlashSim_SectorIndex(model, offset, &start, &size);
+			chip->eraseSectors[sector] = true;
+			chip->erasing = true;
+			if (model->multiSectorErase)
+			{
+				// Wait for more sectors before starting
+				chip->busyUntil = stats->timeNS + SECTOR_ERASE_TIMEOUT_NS;
+				chip->state = FlashSimSectorEraseWait;
+			}
+			else
+			{
+				FlashSim_StartErase(chip, stats->timeNS);
+			}
+		}
+		else
+		{
+			chip->state = FlashSimRead;
+		}
+		break;
+	case FlashSimSectorEraseWait:
+		if (data == 0x30)
+		{
+			// Another sector; the timeout starts over
+			sector = FlashSim_SectorIndex(model, offset, &start, &size);
+			chip->eraseSectors[sector] = true;
+			chip->busyUntil = stats->timeNS + SECTOR_ERASE_TIMEOUT_NS;
+		}
+		else
+		{
+			// Anything else during the timeout aborts the erase
+			memset(chip->eraseSectors, 0, sizeof(chip->eraseSectors));
+			chip->state = FlashSimRead;
+		}
+		break;
+	case FlashSimBusy:
+		// Everything is ignored while the chip is busy
+		break;
+	}
+}
+
+/** Handles a read cycle from one chip
+ *
+ * @param chip The chip
+ * @param address The address on the bus
+ * @return The byte the chip puts on its lane of the data bus
+ */
+static uint8_t FlashSim_ChipRead(FlashSimChip *chip, uint32_t address)
+{
+	FlashSimModel const *model = chip->model;
+	if (!model)
+	{
+		// Nothing is driving this lane, so it's pulled up
+		return 0xFF;
+	}
+
+	FlashSim_Update(chip);
+
+	if (FlashSim_Failed(chip))
+	{
+		// A failed buffered program toggles DQ6 until it's reset, with DQ7
+		// the complement of the last byte loaded. DQ1 means it was aborted,
+		// and DQ5 means it ran out of time.
+		uint8_t status = chip->toggle | (~chip->programData & STATUS_DQ7);
+		chip->toggle ^= STATUS_DQ6;
+		return status | ((chip->state == FlashSimProgramTimeout) ? STATUS_DQ5 : STATUS_DQ1);
+	}
+	else if (chip->state == FlashSimBusy || chip->state == FlashSimSectorEraseWait)
+	{
+		// While busy, DQ7 is the complement of the data being programmed (0
+		// when erasing), and DQ6 toggles on every read. DQ2 also toggles while
+		// erasing, and DQ3 goes high once the sector erase timeout is over.
+		uint8_t status = chip->toggle;
+		chip->toggle ^= STATUS_DQ6 | (chip->erasing ? STATUS_DQ2 : 0);
+		if (chip->erasing)
+		{
+			if (chip->state == FlashSimBusy)
+			{
+				status |= STATUS_DQ3;
+			}
+		}
+		else
+		{
+			status |= ~chip->programData & STATUS_DQ7;
+		}
+		return status;
+	}
+	else if (chip->state == FlashSimAutoselect)
+	{
+		switch ((address >> model->idShift) & 0xFF)
+		{
+		case 0:
+			return model->manufacturer;
+		case 1:
+			return model->device;
+		default:
+			return 0;
+		}
+	}
+	else if (chip->state == FlashSimCFIQuery)
+	{
+		uint32_t const offset = (address >> model->idShift) & 0xFF;
+		if (offset >= 0x10 && offset - 0x10 < model->cfiSize)
+		{
+			return model->cfi[offset - 0x10];
+		}
+		return 0;
+	}
+	else
+	{
+		return chip->memory[address & (model->size - 1)];
+	}
+}
+
+/** Finishes anything in progress on a chip that should be done by now
+ *
+ * @param chip The chip
+ */
+static void FlashSim_Update(FlashSimChip *chip)
+{
+	if (chip->state == FlashSimSectorEraseWait && stats->timeNS >= chip->busyUntil)
+	{
+		FlashSim_StartErase(chip, chip->busyUntil);
+	}
+
+	if (chip->state == FlashSimBusy && stats->timeNS >= chip->busyUntil)
+	{
+		chip->state = chip->timingOut ? FlashSimProgramTimeout : FlashSimRead;
+		chip->timingOut = false;
+		if (chip->state == FlashSimRead)
+		{
+			chip->toggle = 0;
+		}
+	}
+}
+
+/** Starts programming the bytes loaded into a chip's write buffer
+ *
+ * @param chip The chip
+ */
+static void FlashSim_ProgramBuffer(FlashSimChip *chip)
+{
+	FlashSimModel const *model = chip->model;
+
+	// A chip that's going to time out doesn't manage to program anything
+	chip->timingOut = (chip->fault == FlashSimFaultProgramTimeout);
+	chip->fault = FlashSimFaultNone;
+	if (!chip->timingOut)
+	{
+		for (uint16_t i = 0; i < model->writeBufferSize; i++)
+		{
+			if (chip->bufferLoaded[i])
+			{
+				// Programming can only clear bits
+				chip->memory[chip->bufferPage + i] &= chip->bufferData[i];
+			}
+		}
+	}
+
+	chip->erasing = false;
+	chip->busyUntil = stats->timeNS + model->bufferProgramTimeNS;
+	chip->state = FlashSimBusy;
+}
+
+/** Determines whether a chip is stuck after a failed buffered program
+ *
+ * @param chip The chip
+ * @return True if the chip is waiting to be reset
+ */
+static bool FlashSim_Failed(FlashSimChip const *chip)
+{
+	return chip->state == FlashSimBufferAbort ||
+			chip->state == FlashSimAbortUnlocked1 ||
+			chip->state == FlashSimAbortUnlocked2 ||
+			chip->state == FlashSimProgramTimeout;
+}
+
+/** Starts erasing the sectors that were given to a chip
+ *
+ * @param chip The chip
+ * @param startTime The time the erase started
+ */
+static void FlashSim_StartErase(FlashSimChip *chip, uint64_t startTime)
+{
+	FlashSimModel const *model = chip->model;
+	uint32_t start = 0;
+	int sector = 0;
+
+	chip->busyUntil = startTime;
+	for (uint8_t i = 0; i < model->numSectorGroups; i++)
+	{
+		for (uint32_t j = 0; j < model->sectorGroups[i].count; j++)
+		{
+			uint32_t const size = model->sectorGroups[i].size;
+			if (chip->eraseSectors[sector])
+			{
+				memset(chip->memory + start, 0xFF, size);
+				chip->busyUntil += model->sectorEraseTimeNS;
+				chip->eraseSectors[sector] = false;
+			}
+			start += size;
+			sector++;
+		}
+	}
+
+	chip->state = FlashSimBusy;
+}
+
+/** Finds the sector an address is in
+ *
+ * @param model The kind of chip
+ * @param address The address in the chip
+ * @param start Output for the first address of the sector
+ * @param size Output for the size of the sector
+ * @return The index of the sector
+ */
+static int FlashSim_SectorIndex(FlashSimModel const *model, uint32_t address, uint32_t *start, uint32_t *size)
+{
+	int sector = 0;
+	*start = 0;
+	for (uint8_t i = 0; i < model->numSectorGroups; i++)
+	{
+		*size = model->sectorGroups[i].size;
+		for (uint32_t j = 0; j < model->sectorGroups[i].count; j++)
+		{
+			if (address < *start + *size)
+			{
+				return sector;
+			}
+			*start += *size;
+			sector++;
+		}
+	}
+
+	// Addresses are always masked to the size of the chip, so we can't get here
+	return sector - 1;
+}
+
+/** Looks up a kind of chip by name
+ *
+ * @param name The name (not necessarily null-terminated)
+ * @param len The length of the name
+ * @param found Output for whether the name was valid
+ * @return The chip model, or NULL for an empty socket
+ */
+static FlashSimModel const *FlashSim_FindModel(char const *name, size_t len, bool *found)
+{
+	*found = true;
+	if (len == 4 && !strncmp(name, "none", len))
+	{
+		return NULL;
+	}
+
+	for (size_t i = 0; i < sizeof(models)/sizeof(models[0]); i++)
+	{
+		if (strlen(models[i].name) == len && !strncmp(name, models[i].name, len))
+		{
+			return &models[i];
+		}
+	}
+
+	*found = false;
+	return NULL;
+}
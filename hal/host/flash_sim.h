@@ -0,0 +1,67 @@
+/*
+ * flash_sim.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: SIMM Programmer contributors
+ *
+ * Copyright (C) 2026 SIMM Programmer contributors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HAL_HOST_FLASH_SIM_H_
+#define HAL_HOST_FLASH_SIM_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/// The number of simulated chips, one per byte lane of the data bus
+#define FLASH_SIM_NUM_CHIPS			4
+
+/// Running totals kept by the simulation, for benchmarking
+typedef struct FlashSimStats
+{
+	/// The virtual clock, in nanoseconds
+	uint64_t timeNS;
+	/// Virtual time spent while at least one chip was programming or erasing
+	uint64_t busyNS;
+	/// Read and write cycles seen by the chips
+	uint64_t readCycles;
+	uint64_t writeCycles;
+	/// Read cycles that got status bits back from a busy chip instead of data
+	uint64_t statusReads;
+	/// Number of times the data bus switched between input and output
+	uint64_t directionChanges;
+} FlashSimStats;
+
+/// Ways a buffered program operation can be made to fail
+typedef enum FlashSimFault
+{
+	FlashSimFaultNone,           //!< Program normally
+	FlashSimFaultBufferAbort,    //!< Abort the write to buffer, as if it was used wrong
+	FlashSimFaultProgramTimeout  //!< Run out of time without programming anything
+} FlashSimFault;
+
+bool FlashSim_Init(char const *chips);
+bool FlashSim_ShareStats(int fd);
+FlashSimStats *FlashSim_Stats(void);
+void FlashSim_Write(uint32_t address, uint32_t data);
+uint32_t FlashSim_Read(uint32_t address);
+void FlashSim_InjectFault(uint8_t lane, FlashSimFault fault);
+
+uint64_t FlashSim_Now(void);
+void FlashSim_Delay(uint64_t ns);
+
+#endif /* HAL_HOST_FLASH_SIM_H_ */
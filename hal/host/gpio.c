@@ -0,0 +1,138 @@
+/*
+ * gpio.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: SIMM Programmer contributors
+ *
+ * Copyright (C) 2026 SIMM Programmer contributors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "../gpio.h"
+#include "gpio_hw.h"
+
+/// The state of a simulated GPIO port
+typedef struct GPIOPort
+{
+	/// Pins that are outputs
+	uint32_t outputs;
+	/// Pins with pullups or pulldowns enabled
+	uint32_t pullups;
+	uint32_t pulldowns;
+	/// The output value of each pin
+	uint32_t dout;
+} GPIOPort;
+
+/// The simulated GPIO ports
+static GPIOPort ports[GPIOA + 1];
+
+/** Sets the direction of a GPIO pin.
+ *
+ * @param pin The pin
+ * @param output True if it should be an output, false if it should be an input
+ */
+void GPIO_SetDirection(GPIOPin pin, bool output)
+{
+	if (output)
+	{
+		ports[pin.port].outputs |= (1UL << pin.pin);
+	}
+	else
+	{
+		ports[pin.port].outputs &= ~(1UL << pin.pin);
+	}
+}
+
+/** Sets whether an input GPIO pin is pulled up
+ *
+ * @param pin The pin
+ * @param pullup True if it should be pulled up, false if not
+ */
+void GPIO_SetPullup(GPIOPin pin, bool pullup)
+{
+	if (pullup)
+	{
+		ports[pin.port].pullups |= (1UL << pin.pin);
+	}
+	else
+	{
+		ports[pin.port].pullups &= ~(1UL << pin.pin);
+	}
+}
+
+/** Sets whether an input GPIO pin is pulled down
+ *
+ * @param pin The pin
+ * @param pulldown True if it should be pulled down, false if not
+ */
+void GPIO_SetPulldown(GPIOPin pin, bool pulldown)
+{
+	if (pulldown)
+	{
+		ports[pin.port].pulldowns |= (1UL << pin.pin);
+	}
+	else
+	{
+		ports[pin.port].pulldowns &= ~(1UL << pin.pin);
+	}
+}
+
+/** Turns a GPIO pin on (sets it high)
+ *
+ * @param pin The pin
+ */
+void GPIO_SetOn(GPIOPin pin)
+{
+	ports[pin.port].dout |= (1UL << pin.pin);
+}
+
+/** Turns a GPIO pin off (sets it low)
+ *
+ * @param pin The pin
+ */
+void GPIO_SetOff(GPIOPin pin)
+{
+	ports[pin.port].dout &= ~(1UL << pin.pin);
+}
+
+/** Toggles a GPIO pin
+ *
+ * @param pin The pin
+ */
+void GPIO_Toggle(GPIOPin pin)
+{
+	ports[pin.port].dout ^= (1UL << pin.pin);
+}
+
+/** Reads the input status of a GPIO pin
+ *
+ * @param pin The pin
+ * @return True if it's high, false if it's low
+ *
+ * Nothing is connected to the simulated pins, so inputs read back whatever
+ * their pullup or pulldown says, and float high without either.
+ */
+bool GPIO_Read(GPIOPin pin)
+{
+	GPIOPort const *port = &ports[pin.port];
+	uint32_t const mask = 1UL << pin.pin;
+
+	if (port->outputs & mask)
+	{
+		return port->dout & mask;
+	}
+	return !(port->pulldowns & mask);
+}
@@ -0,0 +1,33 @@
+/*
+ * gpio_hw.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: SIMM Programmer contributors
+ *
+ * Copyright (C) 2026 SIMM Programmer contributors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HAL_HOST_GPIO_HW_H_
+#define HAL_HOST_GPIO_HW_H_
+
+/// Enum representing the GPIO ports simulated on the host. There's only one,
+/// with the status LED on it. Used with the GPIOPin struct.
+enum {
+	GPIOA
+};
+
+#endif /* HAL_HOST_GPIO_HW_H_ */
@@ -0,0 +1,90 @@
+/*
+ * hardware.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: SIMM Programmer contributors
+ *
+ * Copyright (C) 2026 SIMM Programmer contributors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HAL_HOST_HARDWARE_H_
+#define HAL_HOST_HARDWARE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "flash_sim.h"
+
+/** Disables interrupts
+ *
+ * There are no interrupts on the host.
+ */
+static inline void DisableInterrupts(void)
+{
+}
+
+/** Enables interrupts
+ *
+ * There are no interrupts on the host.
+ */
+static inline void EnableInterrupts(void)
+{
+}
+
+/** Blocks for the specified number of microseconds
+ *
+ * @param us The number of microseconds to wait
+ *
+ * Only the virtual clock moves; no real time is spent waiting.
+ */
+static inline void DelayUS(uint32_t us)
+{
+	FlashSim_Delay(us * 1000ULL);
+}
+
+/** Blocks for the specified number of milliseconds
+ *
+ * @param ms The number of milliseconds to wait
+ */
+static inline void DelayMS(uint32_t ms)
+{
+	DelayUS(ms * 1000UL);
+}
+
+/// The statistics use the virtual clock, in microseconds
+#define STATS_TIMER_MASK		0xFFFFFFFFUL
+#define STATS_TIMER_TICK_US		1
+
+/** Starts the free-running timer used for statistics
+ *
+ */
+static inline void StatsTimer_Init(void)
+{
+}
+
+/** Reads the free-running timer used for statistics
+ *
+ * @return The current count
+ */
+static inline uint32_t StatsTimer_Ticks(void)
+{
+	return (uint32_t)(FlashSim_Now() / 1000);
+}
+
+/// There's plenty of memory here, so keep a trace of a whole job
+#define TRACE_NUM_EVENTS		65536
+
+#endif /* HAL_HOST_HARDWARE_H_ */
@@ -0,0 +1,10 @@
+# Host-specific include paths
+target_include_directories(SIMMProgrammer.elf PRIVATE
+	hal/host
+)
+
+# Host-specific compiler definitions. The virtual serial port needs the POSIX
+# pseudo-terminal functions.
+target_compile_definitions(SIMMProgrammer.elf PRIVATE
+	_GNU_SOURCE
+)
@@ -0,0 +1,15 @@
+set(HWSOURCES
+	hal/host/board.c
+	hal/host/board_hw.h
+	hal/host/flash_sim.c
+	hal/host/flash_sim.h
+	hal/host/gpio.c
+	hal/host/gpio_hw.h
+	hal/host/hardware.h
+	hal/host/parallel_bus.c
+	hal/host/parallel_bus_hw.h
+	hal/host/spi.c
+	hal/host/spi_private.h
+	hal/host/usbcdc.c
+	hal/host/usbcdc_hw.h
+)
@@ -0,0 +1,571 @@
+/*
+ * parallel_bus.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: SIMM Programmer contributors
+ *
+ * Copyright (C) 2026 SIMM Programmer contributors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * -----------------------------------------------------------------------------
+ *
+ * Simulated parallel bus. Every pin is modeled with its direction, output value
+ * and pullup/pulldown, so the electrical test sees a SIMM with no shorts. The
+ * simulated flash chips see a write when CS and WE are both low and one of
+ * them goes high, and drive the data bus whenever CS and OE are low, just like
+ * the real chips. The read/write cycle functions are built on top of the same
+ * pin-level functions, so they can't take shortcuts the hardware couldn't.
+ */
+
+#include "../parallel_bus.h"
+#include "flash_sim.h"
+
+/// The index of the highest address line on the parallel bus
+#define PARALLEL_BUS_HIGHEST_ADDRESS_LINE	20
+/// Mask of every address line
+#define PARALLEL_BUS_ADDRESS_MASK			((1UL << (PARALLEL_BUS_HIGHEST_ADDRESS_LINE + 1)) - 1)
+
+/// Virtual time taken by each read or write cycle the chips see. This is
+/// roughly what a cycle costs on the M258KE.
+#define BUS_CYCLE_NS						250
+
+/// The state of a simulated control pin
+typedef struct ControlPin
+{
+	bool output;
+	bool high;
+	bool pullup;
+	bool pulldown;
+} ControlPin;
+
+static void ParallelBus_SetControl(ControlPin *pin, ControlPin newState);
+static bool ParallelBus_ControlLevel(ControlPin const *pin);
+static bool ParallelBus_Writing(void);
+static bool ParallelBus_ChipsDriving(void);
+static uint32_t ParallelBus_PinLevels(uint32_t outputs, uint32_t out, uint32_t pulldowns);
+
+/// Address bus pin state
+static uint32_t addressOutputs;
+static uint32_t addressOut;
+static uint32_t addressPullups;
+static uint32_t addressPulldowns;
+/// Data bus pin state
+static uint32_t dataOutputs;
+static uint32_t dataOut;
+static uint32_t dataPullups;
+static uint32_t dataPulldowns;
+/// Control pin state
+static ControlPin cs;
+static ControlPin oe;
+static ControlPin we;
+
+/** Initializes the 32-bit data/21-bit address parallel bus.
+ *
+ */
+void ParallelBus_Init(void)
+{
+	// Configure all address lines as outputs, outputting address 0
+	ParallelBus_SetAddressDir(PARALLEL_BUS_ADDRESS_MASK);
+	ParallelBus_SetAddress(0);
+	ParallelBus_SetAddressPullups(0);
+	ParallelBus_SetAddressPulldowns(0);
+
+	// Set all data lines to pulled-up inputs
+	ParallelBus_SetDataDir(0);
+	ParallelBus_SetDataPullups(0xFFFFFFFFUL);
+	ParallelBus_SetDataPulldowns(0);
+
+	// Control lines
+	ParallelBus_SetCSDir(true);
+	ParallelBus_SetCSPullup(false);
+	ParallelBus_SetCSPulldown(false);
+	ParallelBus_SetOEDir(true);
+	ParallelBus_SetOEPullup(false);
+	ParallelBus_SetOEPulldown(false);
+	ParallelBus_SetWEDir(true);
+	ParallelBus_SetWEPullup(false);
+	ParallelBus_SetWEPulldown(false);
+
+	// Default to only CS asserted
+	ParallelBus_SetWE(true);
+	ParallelBus_SetOE(true);
+	ParallelBus_SetCS(false);
+}
+
+/** Sets the address being output on the 21-bit address bus
+ *
+ * @param address The address
+ */
+void ParallelBus_SetAddress(uint32_t address)
+{
+	addressOut = address & PARALLEL_BUS_ADDRESS_MASK;
+}
+
+/** Sets the output data on the 32-bit data bus
+ *
+ * @param data The data
+ */
+void ParallelBus_SetData(uint32_t data)
+{
+	dataOut = data;
+}
+
+/** Sets the output value of the CS pin
+ *
+ * @param high True if it should be high, false if low
+ */
+void ParallelBus_SetCS(bool high)
+{
+	ControlPin pin = cs;
+	pin.high = high;
+	ParallelBus_SetControl(&cs, pin);
+}
+
+/** Sets the output value of the OE pin
+ *
+ * @param high True if it should be high, false if low
+ */
+void ParallelBus_SetOE(bool high)
+{
+	ControlPin pin = oe;
+	pin.high = high;
+	ParallelBus_SetControl(&oe, pin);
+}
+
+/** Sets the output value of the WE pin
+ *
+ * @param high True if it should be high, false if low
+ */
+void ParallelBus_SetWE(bool high)
+{
+	ControlPin pin = we;
+	pin.high = high;
+	ParallelBus_SetControl(&we, pin);
+}
+
+/** Sets which pins on the 21-bit address bus should be outputs
+ *
+ * @param outputs Mask of pins that should be outputs. 1 = output, 0 = input
+ *
+ * Typically the address pins will be outputs. This flexibility is provided in
+ * case we want to do electrical testing.
+ */
+void ParallelBus_SetAddressDir(uint32_t outputs)
+{
+	addressOutputs = outputs & PARALLEL_BUS_ADDRESS_MASK;
+}
+
+/** Sets which pins on the 32-bit data bus should be outputs
+ *
+ * @param outputs Mask of pins that should be outputs. 1 = output, 0 = input
+ *
+ * Typically all pins would be set as inputs or outputs, and it's automatically
+ * handled by the read/write cycle functions. This function exists mainly for
+ * test purposes.
+ */
+void ParallelBus_SetDataDir(uint32_t outputs)
+{
+	if (outputs != dataOutputs)
+	{
+		FlashSim_Stats()->directionChanges++;
+	}
+	dataOutputs = outputs;
+}
+
+/** Sets the direction of the CS pin
+ *
+ * @param output True if it's an output, false if it's an input
+ *
+ * Typically this pin will be an output. This flexibility is provided in case
+ * we want to do electrical testing.
+ */
+void ParallelBus_SetCSDir(bool output)
+{
+	ControlPin pin = cs;
+	pin.output = output;
+	ParallelBus_SetControl(&cs, pin);
+}
+
+/** Sets the direction of the OE pin
+ *
+ * @param output True if it's an output, false if it's an input
+ *
+ * Typically this pin will be an output. This flexibility is provided in case
+ * we want to do electrical testing.
+ */
+void ParallelBus_SetOEDir(bool output)
+{
+	ControlPin pin = oe;
+	pin.output = output;
+	ParallelBus_SetControl(&oe, pin);
+}
+
+/** Sets the direction of the WE pin
+ *
+ * @param output True if it's an output, false if it's an input
+ *
+ * Typically this pin will be an output. This flexibility is provided in case
+ * we want to do electrical testing.
+ */
+void ParallelBus_SetWEDir(bool output)
+{
+	ControlPin pin = we;
+	pin.output = output;
+	ParallelBus_SetControl(&we, pin);
+}
+
+/** Sets which pins on the 21-bit address bus should be pulled up (if inputs)
+ *
+ * @param pullups Mask of pins that should be pullups.
+ *
+ * This would typically only be used for testing. Under normal operation, the
+ * address bus will be outputting, so the pullups are irrelevant.
+ */
+void ParallelBus_SetAddressPullups(uint32_t pullups)
+{
+	addressPullups = pullups & PARALLEL_BUS_ADDRESS_MASK;
+}
+
+/** Sets which pins on the 21-bit address bus should be pulled down (if inputs)
+ *
+ * @param pulldowns Mask of pins that should be pulldowns.
+ *
+ * This would typically only be used for testing. Under normal operation, the
+ * address bus will be outputting, so the pulldowns are irrelevant.
+ */
+void ParallelBus_SetAddressPulldowns(uint32_t pulldowns)
+{
+	addressPulldowns = pulldowns & PARALLEL_BUS_ADDRESS_MASK;
+}
+
+/** Sets which pins on the 32-bit data bus should be pulled up (if inputs)
+ *
+ * @param pullups Mask of pins that should be pullups.
+ *
+ * Typically these will be enabled in order to provide a default value if a
+ * chip isn't responding properly. Sometimes it's useful to customize it during
+ * testing though.
+ */
+void ParallelBus_SetDataPullups(uint32_t pullups)
+{
+	dataPullups = pullups;
+}
+
+/** Sets which pins on the 32-bit data bus should be pulled down (if inputs)
+ *
+ * @param pulldowns Mask of pins that should be pulldowns.
+ *
+ * Typically these will be enabled in order to provide a default value if a
+ * chip isn't responding properly. Sometimes it's useful to customize it during
+ * testing though.
+ */
+void ParallelBus_SetDataPulldowns(uint32_t pulldowns)
+{
+	dataPulldowns = pulldowns;
+}
+
+/** Sets whether the CS pin is pulled up, if it's an input.
+ *
+ * @param pullup True if the CS pin should be pulled up, false if not
+ *
+ * This would typically only be used for testing. Under normal operation, this
+ * pin will be set as an output, so the pullup state is irrelevant.
+ */
+void ParallelBus_SetCSPullup(bool pullup)
+{
+	ControlPin pin = cs;
+	pin.pullup = pullup;
+	ParallelBus_SetControl(&cs, pin);
+}
+
+/** Sets whether the CS pin is pulled down, if it's an input.
+ *
+ * @param pulldown True if the CS pin should be pulled down, false if not
+ *
+ * This would typically only be used for testing. Under normal operation, this
+ * pin will be set as an output, so the pulldown state is irrelevant.
+ */
+void ParallelBus_SetCSPulldown(bool pulldown)
+{
+	ControlPin pin = cs;
+	pin.pulldown = pulldown;
+	ParallelBus_SetControl(&cs, pin);
+}
+
+/** Sets whether the OE pin is pulled up, if it's an input.
+ *
+ * @param pullup True if the OE pin should be pulled up, false if not
+ *
+ * This would typically only be used for testing. Under normal operation, this
+ * pin will be set as an output, so the pullup state is irrelevant.
+ */
+void ParallelBus_SetOEPullup(bool pullup)
+{
+	ControlPin pin = oe;
+	pin.pullup = pullup;
+	ParallelBus_SetControl(&oe, pin);
+}
+
+/** Sets whether the OE pin is pulled down, if it's an input.
+ *
+ * @param pulldown True if the OE pin should be pulled down, false if not
+ *
+ * This would typically only be used for testing. Under normal operation, this
+ * pin will be set as an output, so the pulldown state is irrelevant.
+ */
+void ParallelBus_SetOEPulldown(bool pulldown)
+{
+	ControlPin pin = oe;
+	pin.pulldown = pulldown;
+	ParallelBus_SetControl(&oe, pin);
+}
+
+/** Sets whether the WE pin is pulled up, if it's an input.
+ *
+ * @param pullup True if the WE pin should be pulled up, false if not
+ *
+ * This would typically only be used for testing. Under normal operation, this
+ * pin will be set as an output, so the pullup state is irrelevant.
+ */
+void ParallelBus_SetWEPullup(bool pullup)
+{
+	ControlPin pin = we;
+	pin.pullup = pullup;
+	ParallelBus_SetControl(&we, pin);
+}
+
+/** Sets whether the WE pin is pulled down, if it's an input.
+ *
+ * @param pulldown True if the WE pin should be pulled down, false if not
+ *
+ * This would typically only be used for testing. Under normal operation, this
+ * pin will be set as an output, so the pulldown state is irrelevant.
+ */
+void ParallelBus_SetWEPulldown(bool pulldown)
+{
+	ControlPin pin = we;
+	pin.pulldown = pulldown;
+	ParallelBus_SetControl(&we, pin);
+}
+
+/** Reads the current data on the address bus.
+ *
+ * @return The address bus readback
+ *
+ * This would typically only be used for testing. Under normal operation, the
+ * address bus will be outputting, so the readback is irrelevant.
+ */
+uint32_t ParallelBus_ReadAddress(void)
+{
+	return ParallelBus_PinLevels(addressOutputs, addressOut, addressPulldowns) &
+			PARALLEL_BUS_ADDRESS_MASK;
+}
+
+/** Reads the current data on the 32-bit data bus.
+ *
+ * @return The 32-bit data readback
+ */
+uint32_t ParallelBus_ReadData(void)
+{
+	uint32_t inputs = ParallelBus_PinLevels(0, 0, dataPulldowns);
+	if (ParallelBus_ChipsDriving())
+	{
+		FlashSim_Delay(BUS_CYCLE_NS);
+		inputs = FlashSim_Read(ParallelBus_ReadAddress());
+	}
+
+	return (dataOut & dataOutputs) | (inputs & ~dataOutputs);
+}
+
+/** Reads the status of the CS pin, if it's set as an input.
+ *
+ * @return True if the CS pin is high, false if it's low
+ *
+ * This would typically only be used for testing. Under normal operation, this
+ * pin will be set as an output, so the readback is irrelevant.
+ */
+bool ParallelBus_ReadCS(void)
+{
+	return ParallelBus_ControlLevel(&cs);
+}
+
+/** Reads the status of the OE pin, if it's set as an input.
+ *
+ * @return True if the OE pin is high, false if it's low
+ *
+ * This would typically only be used for testing. Under normal operation, this
+ * pin will be set as an output, so the readback is irrelevant.
+ */
+bool ParallelBus_ReadOE(void)
+{
+	return ParallelBus_ControlLevel(&oe);
+}
+
+/** Reads the status of the WE pin, if it's set as an input.
+ *
+ * @return True if the WE pin is high, false if it's low
+ *
+ * This would typically only be used for testing. Under normal operation, this
+ * pin will be set as an output, so the readback is irrelevant.
+ */
+bool ParallelBus_ReadWE(void)
+{
+	return ParallelBus_ControlLevel(&we);
+}
+
+/** Performs a write cycle on the parallel bus.
+ *
+ * @param address The address to write to
+ * @param data The 32-bit data to write to the bus
+ */
+void ParallelBus_WriteCycle(uint32_t address, uint32_t data)
+{
+	// We should currently be in a state of "CS is asserted, OE/WE not asserted".
+	ParallelBus_SetAddress(address);
+	ParallelBus_SetDataDir(0xFFFFFFFFUL);
+	ParallelBus_SetData(data);
+
+	// Assert and then deassert WE to actually do the write cycle.
+	ParallelBus_SetWE(false);
+	ParallelBus_SetWE(true);
+}
+
+/** Performs a series of write cycles on the parallel bus.
+ *
+ * @param cycles The address/data of each write cycle
+ * @param count The number of write cycles
+ * @param mask Mask applied to the data of every cycle
+ */
+void ParallelBus_WriteSequence(ParallelBusCycle const *cycles, uint8_t count, uint32_t mask)
+{
+	while (count--)
+	{
+		ParallelBus_WriteCycle(cycles->address, cycles->data & mask);
+		cycles++;
+	}
+}
+
+/** Performs a write cycle to each of a bunch of consecutive addresses
+ *
+ * @param startAddress The address to start writing to
+ * @param buf The data to write
+ * @param len The number of 32-bit words to write
+ */
+void ParallelBus_Write(uint32_t startAddress, uint32_t const *buf, uint16_t len)
+{
+	while (len--)
+	{
+		ParallelBus_WriteCycle(startAddress++, *buf++);
+	}
+}
+
+/** Performs a read cycle on the parallel bus.
+ *
+ * @param address The address to read from
+ * @return The returned 32-bit data
+ */
+uint32_t ParallelBus_ReadCycle(uint32_t address)
+{
+	uint32_t ret;
+
+	// We should currently be in a state of "CS is asserted, OE/WE not asserted".
+	// Make the data pins inputs before the chips start driving them.
+	ParallelBus_SetDataDir(0);
+	ParallelBus_SetAddress(address);
+
+	ParallelBus_SetOE(false);
+	ret = ParallelBus_ReadData();
+	ParallelBus_SetOE(true);
+
+	return ret;
+}
+
+/** Reads a bunch of consecutive data from the parallel bus
+ *
+ * @param startAddress The address to start reading from
+ * @param buf Buffer to store the readback
+ * @param len The number of 32-bit words to read
+ */
+void ParallelBus_Read(uint32_t startAddress, uint32_t *buf, uint16_t len)
+{
+	while (len--)
+	{
+		*buf++ = ParallelBus_ReadCycle(startAddress++);
+	}
+}
+
+/** Changes the state of a control pin, and lets the chips see any write
+ *
+ * @param pin The control pin
+ * @param newState Its new state
+ *
+ * The chips latch a write on whichever of CS and WE goes high first.
+ */
+static void ParallelBus_SetControl(ControlPin *pin, ControlPin newState)
+{
+	bool const wasWriting = ParallelBus_Writing();
+	*pin = newState;
+	if (wasWriting && !ParallelBus_Writing())
+	{
+		FlashSim_Delay(BUS_CYCLE_NS);
+		FlashSim_Write(ParallelBus_ReadAddress(),
+				ParallelBus_PinLevels(dataOutputs, dataOut, dataPulldowns));
+	}
+}
+
+/** Gets the level of a control pin
+ *
+ * @param pin The control pin
+ * @return True if it's high, false if it's low
+ */
+static bool ParallelBus_ControlLevel(ControlPin const *pin)
+{
+	if (pin->output)
+	{
+		return pin->high;
+	}
+	return !pin->pulldown;
+}
+
+/** Determines if the chips are in the middle of a write cycle
+ *
+ * @return True if CS and WE are both low
+ */
+static bool ParallelBus_Writing(void)
+{
+	return !ParallelBus_ControlLevel(&cs) && !ParallelBus_ControlLevel(&we);
+}
+
+/** Determines if the chips are driving the data bus
+ *
+ * @return True if CS and OE are low, and WE is high
+ */
+static bool ParallelBus_ChipsDriving(void)
+{
+	return !ParallelBus_ControlLevel(&cs) && !ParallelBus_ControlLevel(&oe) &&
+			ParallelBus_ControlLevel(&we);
+}
+
+/** Gets the levels of a group of pins that nothing else is driving
+ *
+ * @param outputs Mask of the pins that are outputs
+ * @param out The output value of the pins
+ * @param pulldowns Mask of the pins that are pulled down
+ * @return The levels of the pins. Inputs float high unless pulled down.
+ */
+static uint32_t ParallelBus_PinLevels(uint32_t outputs, uint32_t out, uint32_t pulldowns)
+{
+	return (out & outputs) | (~pulldowns & ~outputs);
+}
@@ -0,0 +1,76 @@
+/*
+ * parallel_bus_hw.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: SIMM Programmer contributors
+ *
+ * Copyright (C) 2026 SIMM Programmer contributors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HAL_HOST_PARALLEL_BUS_HW_H_
+#define HAL_HOST_PARALLEL_BUS_HW_H_
+
+#include <stdint.h>
+
+/// All of the simulated data bus bits are the same speed
+#define PARALLEL_BUS_NATIVE_LANES		0xFFFFFFFFUL
+
+/** Performs a read cycle on the parallel bus, only reading the native lanes
+ *
+ * @param address The address to read from
+ * @return The returned 32-bit data
+ *
+ * Every lane is native on the simulated bus, so this is a normal read cycle.
+ */
+static inline uint32_t ParallelBus_ReadCycleNative(uint32_t address)
+{
+	return ParallelBus_ReadCycle(address);
+}
+
+/** Tells the parallel bus which data lanes we actually care about
+ *
+ * @param lanes Mask of the data bits that read/write cycles need to handle
+ *
+ * All lanes cost the same on the simulated bus, so there's nothing to optimize.
+ */
+static inline void ParallelBus_SetActiveLanes(uint32_t lanes)
+{
+	(void)lanes;
+}
+
+/** Reads a bunch of consecutive data from the parallel bus
+ *
+ * @param startAddress The address to start reading from
+ * @param buf Buffer to store the readback
+ * @param len The number of 32-bit words to read
+ *
+ * There's no background read engine on the host, so the read is done right away.
+ */
+static inline void ParallelBus_StartRead(uint32_t startAddress, uint32_t *buf, uint16_t len)
+{
+	ParallelBus_Read(startAddress, buf, len);
+}
+
+/** Waits for a read started by ParallelBus_StartRead to finish
+ *
+ * There's nothing to wait for on the host.
+ */
+static inline void ParallelBus_FinishRead(void)
+{
+}
+
+#endif /* HAL_HOST_PARALLEL_BUS_HW_H_ */
@@ -0,0 +1,250 @@
+/*
+ * usbcdc.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: SIMM Programmer contributors
+ *
+ * Copyright (C) 2026 SIMM Programmer contributors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * -----------------------------------------------------------------------------
+ *
+ * Virtual CDC serial port for the simulated programmer. By default it's a
+ * pseudo-terminal, so the normal control software can open it like the real
+ * programmer's serial port. Its name is printed at startup, and a symlink to it
+ * is made at $SIMM_SIM_PTY_LINK if that's set. Test harnesses can instead pass
+ * one end of a socketpair in $SIMM_SIM_FD; closing the other end makes the
+ * simulated programmer exit, like unplugging it.
+ */
+
+#include "usbcdc_hw.h"
+#include "../../trace.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <termios.h>
+#include <unistd.h>
+
+/// Size of a USB full-speed bulk packet, which we buffer data in just like
+/// the real hardware does
+#define CDC_PACKET_SIZE			64
+/// How long to wait for data when there's nothing to read, so an idle main
+/// loop doesn't use a whole CPU core
+#define CDC_IDLE_WAIT_MS		1
+
+static void USBCDC_SendDataInBuffer(void);
+
+/// The file descriptor of our end of the virtual serial port
+static int cdcFd = -1;
+/// Our own handle to the pty's other end, which keeps it from hanging up
+/// whenever the control software closes it
+static int cdcSlaveFd = -1;
+
+/// Buffer to send to the CDC serial port
+static uint8_t cdcTxBuf[CDC_PACKET_SIZE];
+/// Current position in the TX buffer
+static uint32_t cdcTxBufPos = 0;
+/// Buffer we read into
+static uint8_t cdcRxBuf[CDC_PACKET_SIZE];
+/// Current length of RX buffer
+static uint32_t cdcRxLen = 0;
+/// Current position into RX buffer
+static uint32_t cdcRxPos = 0;
+
+/** Initializes the USB CDC serial port
+ *
+ */
+void USBCDC_Init(void)
+{
+	char const *fdString = getenv("SIMM_SIM_FD");
+
+	// A closed socket should be handled like an unplug, not a crash
+	signal(SIGPIPE, SIG_IGN);
+
+	if (fdString)
+	{
+		cdcFd = atoi(fdString);
+	}
+	else
+	{
+		cdcFd = posix_openpt(O_RDWR | O_NOCTTY);
+		if (cdcFd < 0 || grantpt(cdcFd) < 0 || unlockpt(cdcFd) < 0)
+		{
+			perror("Unable to create virtual serial port");
+			exit(1);
+		}
+
+		// Make the serial port raw, just like a real CDC device
+		char const *name = ptsname(cdcFd);
+		struct termios tio;
+		cdcSlaveFd = open(name, O_RDWR | O_NOCTTY);
+		if (cdcSlaveFd < 0 || tcgetattr(cdcSlaveFd, &tio) < 0)
+		{
+			perror("Unable to open virtual serial port");
+			exit(1);
+		}
+		cfmakeraw(&tio);
+		tcsetattr(cdcSlaveFd, TCSANOW, &tio);
+
+		char const *link = getenv("SIMM_SIM_PTY_LINK");
+		if (link)
+		{
+			unlink(link);
+			if (symlink(name, link) < 0)
+			{
+				perror("Unable to link to virtual serial port");
+			}
+		}
+		fprintf(stderr, "Simulated SIMM programmer is on %s\n", name);
+	}
+
+	fcntl(cdcFd, F_SETFL, fcntl(cdcFd, F_GETFL) | O_NONBLOCK);
+}
+
+/** Disconnects the USB CDC device from the host
+ *
+ */
+void USBCDC_Disable(void)
+{
+	if (cdcFd >= 0)
+	{
+		USBCDC_Flush();
+		close(cdcFd);
+		cdcFd = -1;
+	}
+	if (cdcSlaveFd >= 0)
+	{
+		close(cdcSlaveFd);
+		cdcSlaveFd = -1;
+	}
+}
+
+/** Performs any necessary periodic tasks for the USB CDC serial port
+ *
+ */
+void USBCDC_Check(void)
+{
+	// Flush the USB CDC port every main loop just like LUFA does
+	USBCDC_Flush();
+}
+
+/** Sends a byte out the USB serial port
+ *
+ * @param b The byte
+ */
+void USBCDC_SendByte(uint8_t b)
+{
+	// Fill up our buffer to send out the USB serial port
+	cdcTxBuf[cdcTxBufPos++] = b;
+	if (cdcTxBufPos == CDC_PACKET_SIZE)
+	{
+		// If we reached a full packet size, send the data in the buffer
+		USBCDC_SendDataInBuffer();
+	}
+}
+
+/** Reads a byte from the USB serial port, if available
+ *
+ * @return The byte, or -1 if there is nothing available
+ */
+int16_t USBCDC_ReadByte(void)
+{
+	// Assume not ready
+	int16_t ret = -1;
+
+	if (cdcRxLen == 0)
+	{
+		// Anything we're about to wait for is probably a reply to what we
+		// sent, so make sure it all went out first
+		USBCDC_Flush();
+
+		struct pollfd pfd = {cdcFd, POLLIN, 0};
+		if (poll(&pfd, 1, CDC_IDLE_WAIT_MS) > 0)
+		{
+			ssize_t const len = read(cdcFd, cdcRxBuf, sizeof(cdcRxBuf));
+			if (len > 0)
+			{
+				cdcRxPos = 0;
+				cdcRxLen = (uint32_t)len;
+				TRACE(TraceUSBPacketIn, 0, (uint16_t)len);
+			}
+			else if (len == 0 || (errno != EAGAIN && errno != EINTR))
+			{
+				// The other end went away
+				exit(0);
+			}
+		}
+	}
+
+	// If we have something left in our buffer since the last read, use it
+	if (cdcRxLen > 0)
+	{
+		ret = cdcRxBuf[cdcRxPos++];
+
+		// If we finished reading from the buffer, mark it as finished.
+		if (cdcRxPos == cdcRxLen)
+		{
+			cdcRxPos = 0;
+			cdcRxLen = 0;
+		}
+	}
+
+	return ret;
+}
+
+/** Sends out any remaining data in the TX buffer
+ *
+ */
+void USBCDC_Flush(void)
+{
+	if (cdcTxBufPos > 0)
+	{
+		USBCDC_SendDataInBuffer();
+	}
+}
+
+/** Sends the data in the TX buffer to the host
+ *
+ * Waits for room if the host isn't keeping up, like a real USB device would.
+ */
+static void USBCDC_SendDataInBuffer(void)
+{
+	uint32_t pos = 0;
+	while (pos < cdcTxBufPos)
+	{
+		ssize_t const len = write(cdcFd, cdcTxBuf + pos, cdcTxBufPos - pos);
+		if (len > 0)
+		{
+			pos += (uint32_t)len;
+		}
+		else if (len < 0 && (errno == EAGAIN || errno == EINTR))
+		{
+			struct pollfd pfd = {cdcFd, POLLOUT, 0};
+			poll(&pfd, 1, -1);
+		}
+		else
+		{
+			// The other end went away
+			exit(0);
+		}
+	}
+	TRACE(TraceUSBPacketOut, 0, (uint16_t)cdcTxBufPos);
+
+	// Reset our buffer position; we've given all the data to the host
+	cdcTxBufPos = 0;
+}
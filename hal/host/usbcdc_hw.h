@@ -0,0 +1,92 @@
+/*
+ * usbcdc_hw.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: SIMM Programmer contributors
+ *
+ * Copyright (C) 2026 SIMM Programmer contributors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HAL_HOST_USBCDC_HW_H_
+#define HAL_HOST_USBCDC_HW_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/** Initializes the USB CDC serial port
+ *
+ */
+void USBCDC_Init(void);
+
+/** Disconnects the USB CDC device from the host
+ *
+ */
+void USBCDC_Disable(void);
+
+/** Performs any necessary periodic tasks for the USB CDC serial port
+ *
+ */
+void USBCDC_Check(void);
+
+/** Sends a byte out the USB serial port
+ *
+ * @param b The byte
+ */
+void USBCDC_SendByte(uint8_t b);
+
+/** Sends a block of data over the USB CDC serial port
+ *
+ * @param data The data to send
+ * @param len The number of bytes
+ * @return True on success, false on failure
+ */
+static inline bool USBCDC_SendData(uint8_t const *data, uint16_t len)
+{
+	while (len--)
+	{
+		USBCDC_SendByte(*data++);
+	}
+
+	return true;
+}
+
+/** Reads a byte from the USB serial port, if available
+ *
+ * @return The byte, or -1 if there is nothing available
+ */
+int16_t USBCDC_ReadByte(void);
+
+/** Reads a byte from the USB CDC serial port. Blocks until one is available.
+ *
+ * @return The byte read
+ */
+static inline uint8_t USBCDC_ReadByteBlocking(void)
+{
+	int16_t b;
+	do
+	{
+		b = USBCDC_ReadByte();
+	} while (b < 0);
+	return (uint8_t)b;
+}
+
+/** Flushes remaining data out to the USB serial port
+ *
+ */
+void USBCDC_Flush(void);
+
+#endif /* HAL_HOST_USBCDC_HW_H_ */
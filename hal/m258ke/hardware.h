@@ -67,4 +67,25 @@ static inline void DelayMS(uint32_t ms)
 	DelayUS(ms * 1000UL);
 }
 
+/// TIMER0 is 24 bits wide and counts once per microsecond
+#define STATS_TIMER_MASK		0xFFFFFFUL
+#define STATS_TIMER_TICK_US		1
+
+/** Starts the free-running timer used for statistics
+ *
+ * TIMER0 is already running for DelayUS, so there's nothing to do.
+ */
+static inline void StatsTimer_Init(void)
+{
+}
+
+/** Reads the free-running timer used for statistics
+ *
+ * @return The current count
+ */
+static inline uint32_t StatsTimer_Ticks(void)
+{
+	return TIMER0->CNT;
+}
+
 #endif /* HAL_M258KE_HARDWARE_H_ */
@@ -3,8 +3,26 @@ target_include_directories(SIMMProgrammer.elf PRIVATE
 	hal/m258ke
 )
 
+# Whether to run the hot bus/flash loops from SRAM, which has no wait states.
+# Off by default until it has been measured against running them from flash.
+option(M258KE_RAMFUNC "Run time-critical functions from SRAM" OFF)
+
+# Whether chunks are read by the PDMA controller in the background, so the
+# previous chunk can be sent over USB at the same time. Experimental: it hasn't
+# been measured or checked on hardware yet. The self benchmark's
+# background_read_1k test times it against read_1k, and its scratch test checks
+# that it reads back the same data.
+option(M258KE_PDMA_READ "Use PDMA for background block reads" OFF)
+
+# The slowest address-to-data access time of the flash chips, in ns. Reads
+# wait this long after changing only A0-A11. Faster SIMMs can lower it.
+set(M258KE_FLASH_ACCESS_NS 120 CACHE STRING "Slowest flash access time (tACC) in ns")
+
 # M258KE-specific compiler definitions
 target_compile_definitions(SIMMProgrammer.elf PRIVATE
+	PARALLEL_BUS_ACCESS_NS=${M258KE_FLASH_ACCESS_NS}
+	$<$<BOOL:${M258KE_RAMFUNC}>:RAMFUNC_ENABLED>
+	$<$<BOOL:${M258KE_PDMA_READ}>:PARALLEL_BUS_PDMA_READ>
 )
 
 # M258KE-specific compiler options
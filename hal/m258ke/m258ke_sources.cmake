@@ -53,6 +53,7 @@ set(HWSOURCES
 	hal/m258ke/gpio_hw.h
 	hal/m258ke/hardware.h
 	hal/m258ke/parallel_bus.c
+	hal/m258ke/parallel_bus_hw.h
 	hal/m258ke/spi.c
 	hal/m258ke/spi_private.h
 	hal/m258ke/usbcdc.c
@@ -33,6 +33,28 @@
 #define PC11						GPIO_PIN_DATA(2, 11)
 #define PC12						GPIO_PIN_DATA(2, 12)
 
+/// HCLK in MHz, which runs from the 48 MHz HIRC (see board.c)
+#define PARALLEL_BUS_HCLK_MHZ		48
+/// The slowest address-to-data access time (tACC) of the flash, in ns. The
+/// build sets it; 120 ns covers the slowest speed grades of the supported chips.
+#ifndef PARALLEL_BUS_ACCESS_NS
+#define PARALLEL_BUS_ACCESS_NS		120
+#endif
+/// HCLK cycles in the access time, rounded up: 6 at 48 MHz and 120 ns
+#define ADDRESS_SETTLE_CYCLES		((PARALLEL_BUS_ACCESS_NS * PARALLEL_BUS_HCLK_MHZ + 999) / 1000)
+
+/// Gives the flash time to respond after only A0-A11 change. Updating them
+/// used to take a read-modify-write of PA and PC, which provided this delay.
+/// The store to PA->DOUT and the loads of the data pins aren't counted, so
+/// they only add margin.
+#define ADDRESS_SETTLE_DELAY()		do { \
+										_Pragma("GCC unroll 32") \
+										for (uint32_t settle = 0; settle < ADDRESS_SETTLE_CYCLES; settle++) \
+										{ \
+											__NOP(); \
+										} \
+									} while (0)
+
 /// Defines for speedier toggle of these pins
 #define FLASH_WE_PIN				PC12
 #define FLASH_OE_PIN				PC11
@@ -53,6 +75,8 @@
 
 static inline void ParallelBus_SetDataAllInput(void);
 static inline void ParallelBus_SetDataAllOutput(void);
+static ALWAYS_INLINE void ParallelBus_SetLowerAddress(uint32_t address);
+static ALWAYS_INLINE void ParallelBus_SetUpperAddress(uint32_t address);
 
 /// The /WE pin for the parallel bus
 static const GPIOPin flashWEPin = {GPIOC, 12};
@@ -60,6 +84,53 @@ static const GPIOPin flashWEPin = {GPIOC, 12};
 static const GPIOPin flashOEPin = {GPIOC, 11};
 /// The /CS pin for the flash chip
 static const GPIOPin flashCSPin = {GPIOC, 10};
+/// Mask of data pins that are currently outputs. ParallelBus_Init switches
+/// them all to inputs, so start out assuming they're outputs.
+static uint32_t dataOutputs = 0xFFFFFFFFUL;
+/// A12-A20 as currently output on PC0-PC8. Nothing else is allowed to touch
+/// these bits of PC->DOUT, so we don't have to read them back to compare.
+static uint32_t upperAddress = 0xFFFFFFFFUL;
+
+#ifdef PARALLEL_BUS_PDMA_READ
+/// The most words a background read can do at once
+#define PDMA_READ_MAX_WORDS			256
+/// Timer counts (at 48 MHz) per word in a background read. This is how long
+/// the flash gets to respond to each address, less a few cycles of PDMA
+/// latency, so it has to stay well above PARALLEL_BUS_ACCESS_NS.
+#define PDMA_READ_PERIOD			16
+/// PDMA channels used by background reads
+#define PDMA_CH_ADDRESS				0
+#define PDMA_CH_DATA_HIGH			1
+#define PDMA_CH_DATA_LOW			2
+#define PDMA_CH_DATA_MASK			((1UL << PDMA_CH_DATA_HIGH) | (1UL << PDMA_CH_DATA_LOW))
+#define PDMA_CH_MASK				((1UL << PDMA_CH_ADDRESS) | PDMA_CH_DATA_MASK)
+/// PDMA request sources for timer 1-3 time-outs, from the REQSRC table of
+/// PDMA_REQSEL0_3 in the M251/M252/M254/M256/M258 TRM (see nuvoton/pdma_reg.h)
+#define PDMA_REQSRC_TMR1			47UL
+#define PDMA_REQSRC_TMR2			48UL
+#define PDMA_REQSRC_TMR3			49UL
+/// PDMA descriptor control fields
+#define PDMA_OP_BASIC				(1UL << PDMA_DSCT_CTL_OPMODE_Pos)
+#define PDMA_WIDTH_32				(2UL << PDMA_DSCT_CTL_TXWIDTH_Pos)
+#define PDMA_SAR_INC				(0UL << PDMA_DSCT_CTL_SAINC_Pos)
+#define PDMA_SAR_FIX				(3UL << PDMA_DSCT_CTL_SAINC_Pos)
+#define PDMA_DAR_INC				(0UL << PDMA_DSCT_CTL_DAINC_Pos)
+#define PDMA_DAR_FIX				(3UL << PDMA_DSCT_CTL_DAINC_Pos)
+
+static void ParallelBus_InitPDMA(void);
+
+/// Values for the address channel to write into PA->DOUT
+static uint32_t pdmaAddresses[PDMA_READ_MAX_WORDS];
+/// Samples of PB->PIN and PE->PIN from the data channels. These are whole
+/// 32-bit register reads, the same as ParallelBus_ReadData does, because the
+/// TRM only describes 32-bit access to the GPIO registers.
+static uint32_t pdmaDataHigh[PDMA_READ_MAX_WORDS];
+static uint32_t pdmaDataLow[PDMA_READ_MAX_WORDS];
+/// Where the background read in progress goes, or NULL if there isn't one
+static uint32_t *pdmaReadBuf = NULL;
+/// Length of the background read in progress
+static uint16_t pdmaReadLen;
+#endif
 
 // Macros for asserting and deasserting pins
 #define AssertControl(p) p = 0
@@ -96,6 +167,10 @@ void ParallelBus_Init(void)
 	DeassertControl(FLASH_WE_PIN);
 	DeassertControl(FLASH_OE_PIN);
 	AssertControl(FLASH_CS_PIN);
+
+#ifdef PARALLEL_BUS_PDMA_READ
+	ParallelBus_InitPDMA();
+#endif
 }
 
 /** Sets the address being output on the 21-bit address bus
@@ -121,6 +196,7 @@ void ParallelBus_SetAddress(uint32_t address)
 	tmpC |= addrC;
 	PA->DOUT = tmpA;
 	PC->DOUT = tmpC;
+	upperAddress = addrC;
 }
 
 /** Sets the output data on the 32-bit data bus
@@ -259,6 +335,7 @@ void ParallelBus_SetDataDir(uint32_t outputs)
 
 	PB->MODE = regB;
 	PE->MODE = regE;
+	dataOutputs = outputs;
 }
 
 /**
@@ -268,8 +345,13 @@ void ParallelBus_SetDataDir(uint32_t outputs)
  */
 static inline void ParallelBus_SetDataAllInput(void)
 {
-	PB->MODE = 0;
-	PE->MODE = 0;
+	// Only touch the MODE registers if the direction is really changing
+	if (dataOutputs != 0)
+	{
+		PB->MODE = 0;
+		PE->MODE = 0;
+		dataOutputs = 0;
+	}
 }
 
 /**
@@ -279,8 +361,44 @@ static inline void ParallelBus_SetDataAllInput(void)
  */
 static inline void ParallelBus_SetDataAllOutput(void)
 {
-	PB->MODE = 0x55555555UL;
-	PE->MODE = 0x55555555UL;
+	// Only touch the MODE registers if the direction is really changing
+	if (dataOutputs != 0xFFFFFFFFUL)
+	{
+		PB->MODE = 0x55555555UL;
+		PE->MODE = 0x55555555UL;
+		dataOutputs = 0xFFFFFFFFUL;
+	}
+}
+
+/**
+ * @brief Sets A0-A11 of the address bus
+ * @param address The address. Only the lowest 12 bits are used.
+ *
+ * This is an optimized version for the read/write cycle functions
+ */
+static ALWAYS_INLINE void ParallelBus_SetLowerAddress(uint32_t address)
+{
+	const uint32_t addrMaskA = 0xFFFUL;
+	PA->DOUT = (PA->DOUT & ~addrMaskA) | (address & addrMaskA);
+}
+
+/**
+ * @brief Sets A12-A20 of the address bus, if they changed
+ * @param address The address
+ *
+ * This is an optimized version for the read/write cycle functions. Sequential
+ * accesses only change these bits every 4096 words, so most of the time this
+ * doesn't touch the hardware at all.
+ */
+static ALWAYS_INLINE void ParallelBus_SetUpperAddress(uint32_t address)
+{
+	const uint32_t addrMaskC = 0x1FFUL;
+	const uint32_t addrC = (address >> 12) & addrMaskC;
+	if (addrC != upperAddress)
+	{
+		PC->DOUT = (PC->DOUT & ~addrMaskC) | addrC;
+		upperAddress = addrC;
+	}
 }
 
 /** Sets the direction of the CS pin
@@ -628,13 +746,14 @@ bool ParallelBus_ReadWE(void)
  * @param address The address to write to
  * @param data The 32-bit data to write to the bus
  */
-void ParallelBus_WriteCycle(uint32_t address, uint32_t data)
+RAMFUNC void ParallelBus_WriteCycle(uint32_t address, uint32_t data)
 {
 	// We should currently be in a state of "CS is asserted, OE/WE not asserted".
 	// As an optimization, operate under that assumption.
 
 	// Set address
-	ParallelBus_SetAddress(address);
+	ParallelBus_SetLowerAddress(address);
+	ParallelBus_SetUpperAddress(address);
 
 	// Ensure the data pins are all outputs
 	ParallelBus_SetDataAllOutput();
@@ -649,12 +768,149 @@ void ParallelBus_WriteCycle(uint32_t address, uint32_t data)
 	// Control lines are left as "CS asserted, OE/WE not asserted" here.
 }
 
+/** Performs a series of write cycles on the parallel bus.
+ *
+ * @param cycles The address/data of each write cycle
+ * @param count The number of write cycles
+ * @param mask Mask applied to the data of every cycle
+ *
+ * This is the same as calling ParallelBus_WriteCycle for each cycle, but only
+ * the GPIO ports whose value changed from the previous cycle are written.
+ */
+RAMFUNC void ParallelBus_WriteSequence(ParallelBusCycle const *cycles, uint8_t count, uint32_t mask)
+{
+	const uint32_t addrMaskA = 0xFFFUL;
+
+	// We should currently be in a state of "CS is asserted, OE/WE not asserted".
+	// As an optimization, operate under that assumption.
+
+	if (count == 0)
+	{
+		return;
+	}
+
+	// Ensure the data pins are all outputs
+	ParallelBus_SetDataAllOutput();
+
+	// Start out with the current state of the ports, so the first cycle only
+	// writes what it needs to
+	uint32_t doutA = PA->DOUT;
+	uint32_t doutB = PB->DOUT;
+	uint32_t doutE = PE->DOUT;
+
+	while (count--)
+	{
+		// Set address
+		const uint32_t newA = (doutA & ~addrMaskA) | (cycles->address & addrMaskA);
+		if (newA != doutA)
+		{
+			PA->DOUT = newA;
+			doutA = newA;
+		}
+		ParallelBus_SetUpperAddress(cycles->address);
+
+		// Set data
+		const uint32_t data = cycles->data & mask;
+		const uint32_t newB = (data >> 16) & 0xFFFFUL;
+		const uint32_t newE = (data >> 0) & 0xFFFFUL;
+		if (newB != doutB)
+		{
+			PB->DOUT = newB;
+			doutB = newB;
+		}
+		if (newE != doutE)
+		{
+			PE->DOUT = newE;
+			doutE = newE;
+		}
+
+		// Assert and then deassert WE to actually do the write cycle.
+		AssertControl(FLASH_WE_PIN);
+		DeassertControl(FLASH_WE_PIN);
+
+		cycles++;
+	}
+
+	// Control lines are left as "CS asserted, OE/WE not asserted" here.
+}
+
+/** Performs a write cycle to each of a bunch of consecutive addresses
+ *
+ * @param startAddress The address to start writing to
+ * @param buf The data to write
+ * @param len The number of 32-bit words to write
+ *
+ * This is the write counterpart to ParallelBus_Read, used for filling a flash
+ * chip's write buffer. See ParallelBus_Read for how the burst works.
+ */
+RAMFUNC void ParallelBus_Write(uint32_t startAddress, uint32_t const *buf, uint16_t len)
+{
+	// We should currently be in a state of "CS is asserted, OE/WE not asserted".
+	// As an optimization, operate under that assumption.
+
+	// Ensure the data pins are all outputs
+	ParallelBus_SetDataAllOutput();
+
+	// Only allow A0-A11 to be written in PA->DOUT, so we can write the address
+	// straight in without a read-modify-write
+	const uint32_t addrMaskA = 0xFFFUL;
+	const uint32_t oldMaskA = PA->DATMSK;
+	PA->DATMSK = ~addrMaskA;
+
+	while (len)
+	{
+		// Do as much as we can before A12-A20 have to change
+		ParallelBus_SetUpperAddress(startAddress);
+		uint16_t n = 0x1000 - (startAddress & addrMaskA);
+		if (n > len)
+		{
+			n = len;
+		}
+		len -= n;
+
+		// Unrolled by 4 to cut down on loop overhead
+		while (n >= 4)
+		{
+			PA->DOUT = startAddress;
+			ParallelBus_SetData(buf[0]);
+			AssertControl(FLASH_WE_PIN);
+			DeassertControl(FLASH_WE_PIN);
+			PA->DOUT = startAddress + 1;
+			ParallelBus_SetData(buf[1]);
+			AssertControl(FLASH_WE_PIN);
+			DeassertControl(FLASH_WE_PIN);
+			PA->DOUT = startAddress + 2;
+			ParallelBus_SetData(buf[2]);
+			AssertControl(FLASH_WE_PIN);
+			DeassertControl(FLASH_WE_PIN);
+			PA->DOUT = startAddress + 3;
+			ParallelBus_SetData(buf[3]);
+			AssertControl(FLASH_WE_PIN);
+			DeassertControl(FLASH_WE_PIN);
+			startAddress += 4;
+			buf += 4;
+			n -= 4;
+		}
+		while (n--)
+		{
+			PA->DOUT = startAddress++;
+			ParallelBus_SetData(*buf++);
+			AssertControl(FLASH_WE_PIN);
+			DeassertControl(FLASH_WE_PIN);
+		}
+	}
+
+	PA->DATMSK = oldMaskA;
+
+	// Control lines are left as "CS asserted, OE/WE not asserted" here.
+}
+
 /** Performs a read cycle on the parallel bus.
  *
  * @param address The address to read from
  * @return The returned 32-bit data
  */
-uint32_t ParallelBus_ReadCycle(uint32_t address)
+RAMFUNC uint32_t ParallelBus_ReadCycle(uint32_t address)
 {
 	uint32_t ret;
 
@@ -669,7 +925,9 @@ uint32_t ParallelBus_ReadCycle(uint32_t address)
 	AssertControl(FLASH_OE_PIN);
 
 	// Set address
-	ParallelBus_SetAddress(address);
+	ParallelBus_SetUpperAddress(address);
+	ParallelBus_SetLowerAddress(address);
+	ADDRESS_SETTLE_DELAY();
 
 	// Read data
 	ret = ParallelBus_ReadData();
@@ -691,8 +949,11 @@ uint32_t ParallelBus_ReadCycle(uint32_t address)
  *
  * This function is just a time saver if we know we will be reading a big block
  * of data. It doesn't bother playing with the control lines between each byte.
+ * PA's DATMSK register protects everything but A0-A11 while it runs, so the
+ * address can be written without reading PA->DOUT first. A12-A20 on PC only
+ * have to be updated every 4096 words.
  */
-void ParallelBus_Read(uint32_t startAddress, uint32_t *buf, uint16_t len)
+RAMFUNC void ParallelBus_Read(uint32_t startAddress, uint32_t *buf, uint16_t len)
 {
 	// We should currently be in a state of "CS is asserted, OE/WE not asserted".
 	// As an optimization, operate under that assumption.
@@ -700,20 +961,209 @@ void ParallelBus_Read(uint32_t startAddress, uint32_t *buf, uint16_t len)
 	// Ensure the data pins are all inputs
 	ParallelBus_SetDataAllInput();
 
+	// Only allow A0-A11 to be written in PA->DOUT
+	const uint32_t addrMaskA = 0xFFFUL;
+	const uint32_t oldMaskA = PA->DATMSK;
+	PA->DATMSK = ~addrMaskA;
+
 	// Assert OE, now the chip will start spitting out data.
 	AssertControl(FLASH_OE_PIN);
 
-	while (len--)
+	while (len)
 	{
-		// Set address
-		ParallelBus_SetAddress(startAddress++);
-
-		// Read data
-		*buf++ = ParallelBus_ReadData();
+		// Do as much as we can before A12-A20 have to change
+		ParallelBus_SetUpperAddress(startAddress);
+		uint16_t n = 0x1000 - (startAddress & addrMaskA);
+		if (n > len)
+		{
+			n = len;
+		}
+		len -= n;
+
+		// Unrolled by 4 to cut down on loop overhead
+		while (n >= 4)
+		{
+			PA->DOUT = startAddress;
+			ADDRESS_SETTLE_DELAY();
+			buf[0] = ParallelBus_ReadData();
+			PA->DOUT = startAddress + 1;
+			ADDRESS_SETTLE_DELAY();
+			buf[1] = ParallelBus_ReadData();
+			PA->DOUT = startAddress + 2;
+			ADDRESS_SETTLE_DELAY();
+			buf[2] = ParallelBus_ReadData();
+			PA->DOUT = startAddress + 3;
+			ADDRESS_SETTLE_DELAY();
+			buf[3] = ParallelBus_ReadData();
+			startAddress += 4;
+			buf += 4;
+			n -= 4;
+		}
+		while (n--)
+		{
+			PA->DOUT = startAddress++;
+			ADDRESS_SETTLE_DELAY();
+			*buf++ = ParallelBus_ReadData();
+		}
 	}
 
 	// Deassert OE once we are done
 	DeassertControl(FLASH_OE_PIN);
 
+	PA->DATMSK = oldMaskA;
+
 	// Control lines are left as "CS asserted, OE/WE not asserted" here.
 }
+
+#ifdef PARALLEL_BUS_PDMA_READ
+
+/** Sets up the PDMA controller and timers used for background block reads
+ *
+ */
+static void ParallelBus_InitPDMA(void)
+{
+	// Clock the PDMA, and timers 1-3 from the 48 MHz HIRC
+	CLK->AHBCLK |= CLK_AHBCLK_PDMACKEN_Msk;
+	CLK->APBCLK0 |= CLK_APBCLK0_TMR1CKEN_Msk | CLK_APBCLK0_TMR2CKEN_Msk | CLK_APBCLK0_TMR3CKEN_Msk;
+	CLK->CLKSEL1 = (CLK->CLKSEL1 & ~(CLK_CLKSEL1_TMR1SEL_Msk | CLK_CLKSEL1_TMR2SEL_Msk | CLK_CLKSEL1_TMR3SEL_Msk)) |
+			(7UL << CLK_CLKSEL1_TMR1SEL_Pos) | (7UL << CLK_CLKSEL1_TMR2SEL_Pos) | (7UL << CLK_CLKSEL1_TMR3SEL_Pos);
+
+	// Each timer asks the PDMA for one transfer every time it times out.
+	// Timer 1 paces the address channel, timers 2 and 3 the data channels.
+	TIMER1->CMP = PDMA_READ_PERIOD;
+	TIMER2->CMP = PDMA_READ_PERIOD;
+	TIMER3->CMP = PDMA_READ_PERIOD;
+	TIMER1->TRGCTL = TIMER_TRGCTL_TRGPDMA_Msk;
+	TIMER2->TRGCTL = TIMER_TRGCTL_TRGPDMA_Msk;
+	TIMER3->TRGCTL = TIMER_TRGCTL_TRGPDMA_Msk;
+
+	// Hook the channels up to the timers
+	PDMA->REQSEL0_3 = (PDMA_REQSRC_TMR1 << PDMA_REQSEL0_3_REQSRC0_Pos) |
+			(PDMA_REQSRC_TMR2 << PDMA_REQSEL0_3_REQSRC1_Pos) |
+			(PDMA_REQSRC_TMR3 << PDMA_REQSEL0_3_REQSRC2_Pos);
+
+	// Fixed priority channels are served before round-robin ones, so when
+	// all three timers ask at once, the data is sampled before the address
+	// channel moves on to the next address
+	PDMA->PRISET = PDMA_CH_DATA_MASK;
+}
+
+/** Starts reading a block of consecutive data from the parallel bus in the background
+ *
+ * @param startAddress The address to start reading from
+ * @param buf Buffer to store the readback
+ * @param len The number of 32-bit words to read
+ *
+ * The PDMA controller does the reading. The CPU puts out the first address,
+ * then three timers that count the same clock are started together. On every
+ * time-out, two channels sample PB->PIN and PE->PIN, and then one channel
+ * writes the next address into PA->DOUT. The data channels have priority, so
+ * they always see the address from the previous period, which gives the flash
+ * a whole period to respond.
+ *
+ * The address channel writes all of PA->DOUT, with PA12-PA15 as they were when
+ * the read started, so PA->DATMSK doesn't need to be touched. Nothing but the
+ * address bus is on port A, and the caller must not touch the parallel bus
+ * until ParallelBus_FinishRead is called, so nothing else writes PA->DOUT in
+ * the meantime. The CPU is free to do other things, like send the previous
+ * chunk over USB.
+ *
+ * If the block is too small or too big, or crosses a change of A12-A20, it's
+ * just read with ParallelBus_Read instead.
+ */
+void ParallelBus_StartRead(uint32_t startAddress, uint32_t *buf, uint16_t len)
+{
+	const uint32_t addrMaskA = 0xFFFUL;
+
+	if (len < 2 || len > PDMA_READ_MAX_WORDS ||
+		(startAddress & ~addrMaskA) != ((startAddress + len - 1) & ~addrMaskA))
+	{
+		ParallelBus_Read(startAddress, buf, len);
+		return;
+	}
+
+	// Get the bus ready, exactly like ParallelBus_Read does, with the first
+	// address already out
+	ParallelBus_SetDataAllInput();
+	ParallelBus_SetAddress(startAddress);
+	AssertControl(FLASH_OE_PIN);
+
+	// The address channel can only copy whole values from memory, so keep
+	// the rest of port A the way it is
+	const uint32_t otherA = PA->DOUT & ~addrMaskA;
+	for (uint16_t i = 1; i < len; i++)
+	{
+		pdmaAddresses[i] = otherA | ((startAddress + i) & addrMaskA);
+	}
+
+	// Address channel: the second address onward, 32-bit memory -> PA->DOUT
+	PDMA->DSCT[PDMA_CH_ADDRESS].SA = (uint32_t)&pdmaAddresses[1];
+	PDMA->DSCT[PDMA_CH_ADDRESS].DA = (uint32_t)&PA->DOUT;
+	PDMA->DSCT[PDMA_CH_ADDRESS].CTL = ((uint32_t)(len - 2) << PDMA_DSCT_CTL_TXCNT_Pos) |
+			PDMA_WIDTH_32 | PDMA_SAR_INC | PDMA_DAR_FIX | PDMA_DSCT_CTL_TXTYPE_Msk | PDMA_OP_BASIC;
+
+	// Data channels: PB->PIN and PE->PIN -> 32-bit memory
+	PDMA->DSCT[PDMA_CH_DATA_HIGH].SA = (uint32_t)&PB->PIN;
+	PDMA->DSCT[PDMA_CH_DATA_HIGH].DA = (uint32_t)pdmaDataHigh;
+	PDMA->DSCT[PDMA_CH_DATA_HIGH].CTL = ((uint32_t)(len - 1) << PDMA_DSCT_CTL_TXCNT_Pos) |
+			PDMA_WIDTH_32 | PDMA_SAR_FIX | PDMA_DAR_INC | PDMA_DSCT_CTL_TXTYPE_Msk | PDMA_OP_BASIC;
+	PDMA->DSCT[PDMA_CH_DATA_LOW].SA = (uint32_t)&PE->PIN;
+	PDMA->DSCT[PDMA_CH_DATA_LOW].DA = (uint32_t)pdmaDataLow;
+	PDMA->DSCT[PDMA_CH_DATA_LOW].CTL = ((uint32_t)(len - 1) << PDMA_DSCT_CTL_TXCNT_Pos) |
+			PDMA_WIDTH_32 | PDMA_SAR_FIX | PDMA_DAR_INC | PDMA_DSCT_CTL_TXTYPE_Msk | PDMA_OP_BASIC;
+
+	PDMA->TDSTS = PDMA_CH_MASK;
+	PDMA->CHCTL |= PDMA_CH_MASK;
+
+	// Zero the counters, then start them all together. The data timers go
+	// first, so if the starts land on different clocks, the data is still
+	// sampled before the address changes.
+	TIMER1->CNT = 0;
+	TIMER2->CNT = 0;
+	TIMER3->CNT = 0;
+	while ((TIMER1->CNT | TIMER2->CNT | TIMER3->CNT) & TIMER_CNT_RSTACT_Msk);
+	TIMER2->CTL = TIMER_CTL_CNTEN_Msk | (1UL << TIMER_CTL_OPMODE_Pos);
+	TIMER3->CTL = TIMER_CTL_CNTEN_Msk | (1UL << TIMER_CTL_OPMODE_Pos);
+	TIMER1->CTL = TIMER_CTL_CNTEN_Msk | (1UL << TIMER_CTL_OPMODE_Pos);
+
+	pdmaReadBuf = buf;
+	pdmaReadLen = len;
+}
+
+/** Waits for a read started by ParallelBus_StartRead to finish
+ *
+ * Puts the readback into the buffer that was passed to ParallelBus_StartRead,
+ * and returns the bus to its normal state. Does nothing if no read is going.
+ */
+void ParallelBus_FinishRead(void)
+{
+	const uint32_t dataMaskB = 0xFFFFUL;
+	const uint32_t dataMaskE = 0xFFFFUL;
+
+	if (!pdmaReadBuf)
+	{
+		return;
+	}
+
+	// The data channels finish last
+	while ((PDMA->TDSTS & PDMA_CH_MASK) != PDMA_CH_MASK);
+
+	TIMER1->CTL = 0;
+	TIMER2->CTL = 0;
+	TIMER3->CTL = 0;
+	PDMA->CHCTL &= ~PDMA_CH_MASK;
+	PDMA->TDSTS = PDMA_CH_MASK;
+
+	DeassertControl(FLASH_OE_PIN);
+
+	// Put the halves back together the same way ParallelBus_ReadData does
+	for (uint16_t i = 0; i < pdmaReadLen; i++)
+	{
+		pdmaReadBuf[i] = ((pdmaDataHigh[i] & dataMaskB) << 16) | (pdmaDataLow[i] & dataMaskE);
+	}
+	pdmaReadBuf = NULL;
+
+	// Control lines are left as "CS asserted, OE/WE not asserted" here.
+}
+
+#endif
@@ -26,6 +26,9 @@
  */
 
 #include "usbcdc_hw.h"
+#include "../../stats.h"
+#include "../../trace.h"
+#include "../../util.h"
 #include <stdbool.h>
 
 // Undocumented register for HIRC trim from Nuvoton's samples
@@ -65,6 +68,7 @@ typedef struct
 static void USBCDC_SendDataInBuffer(void);
 static void USBCDC_InitEndpoints(void);
 static void USBCDC_ClassRequest(void);
+static void USBCDC_MemCopy(uint8_t *dest, uint8_t const *src, uint32_t size);
 
 /// Default HIRC trim value in case of errors
 static uint32_t trimInit;
@@ -76,13 +80,13 @@ static CDCLineCoding cdcLineCoding = {0, 0, 0, 0};
 static uint16_t cdcCtrlSignal;
 
 /// Buffer to send to the CDC serial port
-static uint8_t cdcTxBuf[EP3_MAX_PKT_SIZE];
+static uint8_t cdcTxBuf[EP3_MAX_PKT_SIZE] __attribute__((aligned(4)));
 /// Current position in the TX buffer
 static uint32_t cdcTxBufPos = 0;
 /// Flag that is true if a TX is currently active
 static volatile bool cdcTxActive = false;
 /// Buffer we read into
-static uint8_t cdcRxBuf[EP4_MAX_PKT_SIZE];
+static uint8_t cdcRxBuf[EP4_MAX_PKT_SIZE] __attribute__((aligned(4)));
 /// Current length of RX buffer
 static uint32_t cdcRxLen = 0;
 /// Current position into RX buffer
@@ -189,10 +193,11 @@ int16_t USBCDC_ReadByte(void)
 
 		// Read all of the data out from the USB controller
 		cdcRxLen = USBD_GET_PAYLOAD_LEN(EP4);
-		USBD_MemCopy(cdcRxBuf, (uint8_t *)(USBD_BUF_BASE + USBD_GET_EP_BUF_ADDR(EP4)), cdcRxLen);
+		USBCDC_MemCopy(cdcRxBuf, (uint8_t *)(USBD_BUF_BASE + USBD_GET_EP_BUF_ADDR(EP4)), cdcRxLen);
 
 		// We grabbed all of the packet data, so tell the USB controller we're done with it
 		USBD_SET_PAYLOAD_LEN(EP4, EP4_MAX_PKT_SIZE);
+		TRACE(TraceUSBPacketIn, 0, (uint16_t)cdcRxLen);
 	}
 
 	// If we have something left in our buffer since the last read, use it
@@ -237,17 +242,55 @@ void USBCDC_Flush(void)
 static void USBCDC_SendDataInBuffer(void)
 {
 	// Wait for any previous transmit to finish first
+	STATS_BEGIN(waitStart);
 	while (cdcTxActive);
+	STATS_END(StatsTimerUSBTxWait, waitStart);
 
 	// Send out the packet
-	USBD_MemCopy((uint8_t *)(USBD_BUF_BASE + USBD_GET_EP_BUF_ADDR(EP3)), cdcTxBuf, cdcTxBufPos);
+	USBCDC_MemCopy((uint8_t *)(USBD_BUF_BASE + USBD_GET_EP_BUF_ADDR(EP3)), cdcTxBuf, cdcTxBufPos);
 	cdcTxActive = true;
 	USBD_SET_PAYLOAD_LEN(EP3, cdcTxBufPos);
+	TRACE(TraceUSBPacketOut, 0, (uint16_t)cdcTxBufPos);
 
 	// Reset our buffer position; we've given all the data to the USB controller
 	cdcTxBufPos = 0;
 }
 
+/** Copies data between RAM and the USB controller's packet SRAM
+ *
+ * @param dest The destination
+ * @param src The source
+ * @param size The number of bytes to copy
+ *
+ * The Nuvoton BSP's USBD_MemCopy() moves one byte per loop iteration. Every
+ * endpoint buffer in USB SRAM starts on an 8-byte boundary and our packet
+ * buffers are word-aligned, so the bulk of each packet can be moved with
+ * 32-bit accesses instead -- 16 loads/stores for a full 64-byte packet.
+ */
+static RAMFUNC void USBCDC_MemCopy(uint8_t *dest, uint8_t const *src, uint32_t size)
+{
+	// Copy as many whole words as we can if both sides are aligned
+	if ((((uint32_t)dest | (uint32_t)src) & 3) == 0)
+	{
+		uint32_t *dest32 = (uint32_t *)dest;
+		uint32_t const *src32 = (uint32_t const *)src;
+		uint32_t words = size / 4;
+		while (words--)
+		{
+			*dest32++ = *src32++;
+		}
+		dest = (uint8_t *)dest32;
+		src = (uint8_t const *)src32;
+		size &= 3;
+	}
+
+	// Copy whatever is left (or everything, if misaligned) a byte at a time
+	while (size--)
+	{
+		*dest++ = *src++;
+	}
+}
+
 /** IRQ handler called when USB endpoint 3 is ready (CDC TX data finished transferring)
  *
  */
@@ -413,7 +456,7 @@ void USBCDC_ClassRequest(void)
 		case GET_LINE_CODE:
 			if (buf[4] == 0)
 			{
-				USBD_MemCopy((uint8_t *)(USBD_BUF_BASE + USBD_GET_EP_BUF_ADDR(EP0)), (uint8_t *)&cdcLineCoding, 7);
+				USBCDC_MemCopy((uint8_t *)(USBD_BUF_BASE + USBD_GET_EP_BUF_ADDR(EP0)), (uint8_t const *)&cdcLineCoding, 7);
 			}
 
 			// Data stage
@@ -27,6 +27,15 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+/// One write cycle in a sequence of write cycles
+typedef struct ParallelBusCycle
+{
+	/// The address to write to
+	uint32_t address;
+	/// The 32-bit data to write
+	uint32_t data;
+} ParallelBusCycle;
+
 void ParallelBus_Init(void);
 
 void ParallelBus_SetAddress(uint32_t address);
@@ -59,7 +68,12 @@ bool ParallelBus_ReadOE(void);
 bool ParallelBus_ReadWE(void);
 
 void ParallelBus_WriteCycle(uint32_t address, uint32_t data);
+void ParallelBus_WriteSequence(ParallelBusCycle const *cycles, uint8_t count, uint32_t mask);
 uint32_t ParallelBus_ReadCycle(uint32_t address);
 void ParallelBus_Read(uint32_t startAddress, uint32_t *buf, uint16_t len);
+void ParallelBus_Write(uint32_t startAddress, uint32_t const *buf, uint16_t len);
+
+// Hardware-specific lane info and fast paths
+#include "parallel_bus_hw.h"
 
 #endif /* HAL_PARALLEL_BUS_H_ */
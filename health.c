@@ -0,0 +1,181 @@
+/*
+ * health.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: SIMM Programmer contributors
+ *
+ * Copyright (C) 2026 SIMM Programmer contributors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * -----------------------------------------------------------------------------
+ *
+ * Per-chip health map for the GetHealthMap command. The flash driver watches
+ * each chip separately while it waits for an operation to complete, and tells
+ * us how long each one took. We keep totals for programming, and the last
+ * erase time of each sector, so a chip that's getting slow stands out.
+ */
+
+#include "health.h"
+
+#ifdef HEALTH_ENABLED
+
+#include "drivers/parallel_flash.h"
+#include "hardware.h"
+#include "util.h"
+#include <string.h>
+
+/// How many sectors per chip we keep erase times for. Boards that are short
+/// on RAM can pick a smaller number in their hardware.h. Sectors past the
+/// end of the map aren't recorded.
+#ifndef HEALTH_NUM_SECTORS
+#define HEALTH_NUM_SECTORS			128
+#endif
+
+/// Sector erase times are kept in units of this many microseconds
+#define SECTOR_ERASE_UNIT_US		100UL
+
+/// Program totals for each chip, in lane order
+static HealthChip chips[PARALLEL_FLASH_NUM_CHIPS];
+/// The last erase time of each sector on each chip, in lane order
+static uint16_t sectorErase[HEALTH_NUM_SECTORS][PARALLEL_FLASH_NUM_CHIPS];
+/// How long each chip took during the last completion wait
+static uint32_t laneUS[PARALLEL_FLASH_NUM_CHIPS];
+
+/** Notes how long a chip took to finish during a completion wait
+ *
+ * @param lane The chip's byte lane on the data bus
+ * @param elapsedUS How long it took
+ */
+RAMFUNC void Health_LaneDone(uint8_t lane, uint32_t elapsedUS)
+{
+	laneUS[lane] = elapsedUS;
+}
+
+/** Adds the last completion wait to the program times
+ *
+ * @param mask The 32-bit mask of the chips that were programmed
+ * @param bytes The number of bytes each chip programmed
+ */
+RAMFUNC void Health_AddProgram(uint32_t mask, uint16_t bytes)
+{
+	for (uint8_t lane = 0; lane < PARALLEL_FLASH_NUM_CHIPS; lane++)
+	{
+		if (mask & (0xFFUL << (lane * 8)))
+		{
+			HealthChip *c = &chips[lane];
+			c->programOps++;
+			c->programBytes += bytes;
+			c->programTotalUS += laneUS[lane];
+			if (laneUS[lane] > c->programMaxUS)
+			{
+				c->programMaxUS = laneUS[lane];
+			}
+		}
+	}
+}
+
+/** Saves the last completion wait as the whole-chip erase time
+ *
+ * @param mask The 32-bit mask of the chips that were erased
+ */
+void Health_AddEraseChips(uint32_t mask)
+{
+	for (uint8_t lane = 0; lane < PARALLEL_FLASH_NUM_CHIPS; lane++)
+	{
+		if (mask & (0xFFUL << (lane * 8)))
+		{
+			chips[lane].chipEraseUS = laneUS[lane];
+		}
+	}
+}
+
+/** Saves the last completion wait as the erase time of some sectors
+ *
+ * @param firstSector The number of the first sector, counting from the start of the chip
+ * @param numSectors The number of sectors erased. They each get the average time.
+ * @param mask The 32-bit mask of the chips that were erased
+ */
+void Health_AddEraseSectors(uint16_t firstSector, uint16_t numSectors, uint32_t mask)
+{
+	if (!numSectors)
+	{
+		return;
+	}
+
+	for (uint8_t lane = 0; lane < PARALLEL_FLASH_NUM_CHIPS; lane++)
+	{
+		if (!(mask & (0xFFUL << (lane * 8))))
+		{
+			continue;
+		}
+
+		// Never save 0; that means it wasn't erased
+		uint32_t units = laneUS[lane] / numSectors / SECTOR_ERASE_UNIT_US;
+		if (units == 0)
+		{
+			units = 1;
+		}
+		else if (units > 0xFFFF)
+		{
+			units = 0xFFFF;
+		}
+
+		for (uint16_t s = firstSector; s < firstSector + numSectors && s < HEALTH_NUM_SECTORS; s++)
+		{
+			sectorErase[s][lane] = (uint16_t)units;
+		}
+	}
+}
+
+/** Gets the program times of a chip
+ *
+ * @param lane The chip's byte lane on the data bus
+ * @return The program times
+ */
+HealthChip const *Health_Chip(uint8_t lane)
+{
+	return &chips[lane];
+}
+
+/** Gets the number of sectors in the map
+ *
+ * @return The number of sectors
+ */
+uint16_t Health_NumSectors(void)
+{
+	return HEALTH_NUM_SECTORS;
+}
+
+/** Gets the last erase time of a sector on a chip
+ *
+ * @param sector The sector number
+ * @param lane The chip's byte lane on the data bus
+ * @return The time in units of 100 microseconds, or 0 if it hasn't been erased
+ */
+uint16_t Health_SectorErase(uint16_t sector, uint8_t lane)
+{
+	return sectorErase[sector][lane];
+}
+
+/** Clears the map
+ *
+ */
+void Health_Reset(void)
+{
+	memset(chips, 0, sizeof(chips));
+	memset(sectorErase, 0, sizeof(sectorErase));
+}
+
+#endif
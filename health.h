@@ -0,0 +1,65 @@
+/*
+ * health.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: SIMM Programmer contributors
+ *
+ * Copyright (C) 2026 SIMM Programmer contributors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef HEALTH_H_
+#define HEALTH_H_
+
+#include <stdint.h>
+
+/// Program times for one chip
+typedef struct HealthChip
+{
+	uint32_t programOps;
+	uint32_t programBytes;
+	uint32_t programTotalUS;
+	uint32_t programMaxUS;
+	/// How long the last whole-chip erase took
+	uint32_t chipEraseUS;
+} HealthChip;
+
+#ifdef HEALTH_ENABLED
+
+void Health_LaneDone(uint8_t lane, uint32_t elapsedUS);
+void Health_AddProgram(uint32_t mask, uint16_t bytes);
+void Health_AddEraseChips(uint32_t mask);
+void Health_AddEraseSectors(uint16_t firstSector, uint16_t numSectors, uint32_t mask);
+HealthChip const *Health_Chip(uint8_t lane);
+uint16_t Health_NumSectors(void);
+uint16_t Health_SectorErase(uint16_t sector, uint8_t lane);
+void Health_Reset(void);
+
+// These macros are how the flash driver fills in the map after each
+// completion wait, so they disappear when the map is turned off.
+#define HEALTH_PROGRAM(mask, bytes)					Health_AddProgram(mask, bytes)
+#define HEALTH_ERASE_CHIPS(mask)					Health_AddEraseChips(mask)
+#define HEALTH_ERASE_SECTORS(first, count, mask)	Health_AddEraseSectors(first, count, mask)
+
+#else
+
+#define HEALTH_PROGRAM(mask, bytes)
+#define HEALTH_ERASE_CHIPS(mask)
+#define HEALTH_ERASE_SECTORS(first, count, mask)
+
+#endif
+
+#endif /* HEALTH_H_ */
@@ -48,7 +48,14 @@ typedef enum ProgrammerCommand
     ReadChipsAt,
 	SetChipsMask,
 	SetSectorLayout,
-	GetFirmwareVersion
+	GetFirmwareVersion,
+	GetStats,
+	ResetStats,
+	GetTrace,
+	ClearTrace,
+	GetHealthMap,
+	ResetHealthMap,
+	SelfBenchmark
 } ProgrammerCommand;
 
 // After a command is sent, the programmer will always respond with
@@ -197,4 +204,141 @@ typedef enum ProgrammerGetFWVersionReply
 	ProgrammerGetFWVersionDone
 } ProgrammerGetFWVersionReply;
 
+// -------------------------  STATISTICS PROTOCOL  -------------------------
+// Firmware built with statistics keeps track of how long it spends in each
+// of the places listed in ProgrammerStatsTimer. Otherwise, GetStats and
+// ResetStats reply with CommandReplyInvalid.
+// If the command is GetStats, the programmer will reply CommandReplyOK. Next,
+// it will send the number of timers, then three 4-byte little endian integers
+// for each timer: the number of times it ran, the total number of microseconds
+// and the longest single time in microseconds. After that come two more 4-byte
+// integers: the total number of times the programmer polled the chips while
+// waiting for them to finish programming/erasing, and the most polls during
+// a single wait. Finally, it will send ProgrammerGetStatsDone.
+// If the command is ResetStats, the programmer will set everything to zero and
+// reply CommandReplyOK.
+typedef enum ProgrammerGetStatsReply
+{
+	ProgrammerGetStatsDone
+} ProgrammerGetStatsReply;
+
+// The timers returned by GetStats, in order. Timers added in the future will
+// go at the end.
+typedef enum ProgrammerStatsTimer
+{
+	StatsTimerBusRead = 0,       // Reading data from the chips
+	StatsTimerProgram,           // Programming data, including waiting for the chips
+	StatsTimerWaitForCompletion, // Waiting for the chips to finish programming/erasing
+	StatsTimerEraseChips,        // Erasing entire chips
+	StatsTimerEraseSector,       // Erasing sectors, counted once per sector
+	StatsTimerUSBTxWait,         // Waiting for the host to accept data we sent
+	StatsTimerUSBRxWait,         // Waiting for the host to send us data
+	NumStatsTimers
+} ProgrammerStatsTimer;
+
+// -------------------------  TRACE PROTOCOL  -------------------------
+// Firmware built with tracing records the most recent events in a ring buffer.
+// Otherwise, GetTrace and ClearTrace reply with CommandReplyInvalid.
+// If the command is GetTrace, the programmer will reply CommandReplyOK. Next,
+// it will send the number of events it's about to send and the total number of
+// events recorded since the trace was cleared, each as a 4-byte little endian
+// integer. If the total is bigger, the oldest events were overwritten. Then it
+// sends the events, oldest first, 8 bytes each:
+//   4-byte little endian timestamp in microseconds (it wraps around)
+//   1-byte ProgrammerTraceEvent
+//   1-byte argument, usually a command or chip mask
+//   2-byte little endian argument, usually a chunk index or a chip address / 256
+// Finally, it will send ProgrammerGetTraceDone. The trace isn't changed, and
+// nothing is recorded while it's being sent.
+// If the command is ClearTrace, the programmer will empty the trace and reply
+// CommandReplyOK.
+typedef enum ProgrammerGetTraceReply
+{
+	ProgrammerGetTraceDone
+} ProgrammerGetTraceReply;
+
+// The events in the trace. Events added in the future will go at the end.
+typedef enum ProgrammerTraceEvent
+{
+	TraceCommandStart = 0,  // Got a command (arg8 = command)
+	TraceCommandEnd,        // Done with a command (arg8 = command)
+	TraceChunkReceived,     // Got a chunk of data to write (arg16 = chunk index)
+	TraceProgramStart,      // Started programming (arg8 = chips, arg16 = address / 256)
+	TraceProgramEnd,        // Done programming (arg8 = chips)
+	TraceEraseChipsStart,   // Started erasing entire chips (arg8 = chips)
+	TraceEraseChipsEnd,     // Done erasing entire chips (arg8 = chips)
+	TraceEraseSectorStart,  // Started erasing sectors (arg8 = chips, arg16 = address / 256)
+	TraceEraseSectorEnd,    // Done erasing sectors (arg8 = chips, arg16 = number of sectors)
+	TraceUSBPacketIn,       // Got a USB packet from the host (arg16 = length)
+	TraceUSBPacketOut,      // Sent a USB packet to the host (arg16 = length)
+	TraceVerifyFailure,     // A chunk didn't verify (arg8 = bad chips, arg16 = chunk index)
+	NumTraceEvents
+} ProgrammerTraceEvent;
+
+// ----------------------  HEALTH MAP PROTOCOL  -----------------------
+// Firmware built with the health map times every program and erase operation
+// separately for each chip, since worn out chips get slower. Otherwise,
+// GetHealthMap and ResetHealthMap reply with CommandReplyInvalid.
+// If the command is GetHealthMap, the programmer will reply CommandReplyOK.
+// Next, it will send the number of chips (1 byte) and the number of sectors
+// in the map (2 bytes, little endian). Then, for each chip in IC1-IC4 order,
+// it sends these as 4-byte little endian integers:
+//   number of program operations
+//   number of bytes programmed
+//   total time spent programming, in microseconds
+//   longest single program operation, in microseconds
+//   how long the last whole-chip erase took, in microseconds (0 = none)
+// Then, for each sector, starting from the first one in each chip, it sends
+// how long the last erase of the sector took on each chip in IC1-IC4 order,
+// as 2-byte little endian integers in units of 100 microseconds. 0 means the
+// sector hasn't been erased since the map was reset, and 0xFFFF means it took
+// 6.5 seconds or longer. Chips that erase several sectors with one command
+// can't tell us how long each one took, so each sector gets the average.
+// Finally, it will send ProgrammerGetHealthMapDone.
+// If the command is ResetHealthMap, the programmer will clear the map and
+// reply CommandReplyOK.
+typedef enum ProgrammerGetHealthMapReply
+{
+	ProgrammerGetHealthMapDone
+} ProgrammerGetHealthMapReply;
+
+// --------------------  SELF BENCHMARK PROTOCOL  ---------------------
+// Firmware built with the self benchmark can time its own bus, USB and flash
+// operations. Otherwise, SelfBenchmark replies with CommandReplyInvalid.
+// If the command is SelfBenchmark, the programmer will reply CommandReplyOK.
+// Next, the computer sends the scratch area for the flash tests: the 4-byte
+// start position and the 4-byte length, little endian, in bytes of the whole
+// SIMM just like ErasePortion. The scratch area will be erased, and the first
+// 1 KB of it will be programmed, on the chips in the current chips mask. So it
+// must line up with sector boundaries, and be at least 1 KB long. A length of
+// 0 skips the flash tests.
+// The programmer then runs the tests. During the USB test, it sends 4096
+// bytes that the computer should throw away. Then it sends the number of
+// tests (1 byte), and for each test, the number of times it was done and the
+// total time it took in microseconds, as 4-byte little endian integers. A
+// test that didn't run is sent as 0 times. Finally, it will send
+// ProgrammerSelfBenchmarkDone, or ProgrammerSelfBenchmarkScratchError if the
+// scratch area couldn't be erased, or didn't read back what was programmed
+// with either a normal or a background read.
+typedef enum ProgrammerSelfBenchmarkReply
+{
+	ProgrammerSelfBenchmarkDone,
+	ProgrammerSelfBenchmarkScratchError
+} ProgrammerSelfBenchmarkReply;
+
+// The tests that SelfBenchmark runs, in the order the results are sent
+typedef enum ProgrammerSelfBenchmarkTest
+{
+	SelfBenchmarkReadCycle = 0,  // Single read cycles
+	SelfBenchmarkWriteCycle,     // Single write cycles (of the read/reset command)
+	SelfBenchmarkRead1K,         // Reading 1 KB from the SIMM
+	SelfBenchmarkUSBSend1K,      // Sending 1 KB to the computer
+	SelfBenchmarkEraseScratch,   // Erasing the whole scratch area
+	SelfBenchmarkProgram,        // Programming the first 1 KB of the scratch area,
+	                             // counted as one program/poll cycle per byte per chip
+	SelfBenchmarkBackgroundRead1K, // Reading 1 KB with a background read (PDMA on the
+	                             // M258KE if it's built in, otherwise the same as Read1K)
+	NumSelfBenchmarkTests
+} ProgrammerSelfBenchmarkTest;
+
 #endif /* PROGRAMMER_PROTOCOL_H_ */
@@ -24,9 +24,13 @@
 #include "simm_programmer.h"
 #include "hal/usbcdc.h"
 #include "drivers/parallel_flash.h"
+#include "tests/self_benchmark.h"
 #include "tests/simm_electrical_test.h"
 #include "programmer_protocol.h"
 #include "led.h"
+#include "health.h"
+#include "stats.h"
+#include "trace.h"
 #include "hardware.h"
 #include <stdbool.h>
 #include <string.h>
@@ -66,6 +70,7 @@ typedef enum ProgrammerCommandState
 	WritingChipsReadingStartPos, //!< Reading the start position for writing data to the SIMM
 	ReadingChipsMask,            //!< Reading the bitmask of which chips should be programmed
 	ReadingSectorLayout,         //!< Reading the erase sector layout
+	SelfBenchmarkReadingScratch, //!< Reading the scratch area for the self benchmark
 } ProgrammerCommandState;
 static ProgrammerCommandState curCommandState = WaitingForCommand;
 
@@ -79,6 +84,12 @@ static bool verifyDuringWrite = false;
 static uint32_t erasePosition;
 static uint32_t eraseLength;
 static uint8_t chipsMask = ALL_CHIPS;
+#ifdef TRACE_ENABLED
+/// True if we've traced the start of a command but not its end yet
+static bool commandInProgress = false;
+/// The command we traced the start of
+static uint8_t tracedCommand;
+#endif
 
 /// Buffers we use to store incoming/outgoing data.
 static union
@@ -86,6 +97,9 @@ static union
 	uint32_t words[READ_WRITE_CHUNK_SIZE_BYTES / PARALLEL_FLASH_NUM_CHIPS];
 	uint8_t bytes[READ_WRITE_CHUNK_SIZE_BYTES];
 } writeChunks, readChunks;
+/// The next chunk to send while reading, if it was already read ahead of time.
+/// While reading, writeChunks is free, so the two buffers take turns.
+static uint32_t *readAheadChunk = NULL;
 
 // Private functions
 static void SIMMProgrammer_HandleWaitingForCommandByte(uint8_t byte);
@@ -99,12 +113,27 @@ static void SIMMProgrammer_HandleReadingChipsReadStartPosByte(uint8_t byte);
 static void SIMMProgrammer_HandleWritingChipsReadingStartPosByte(uint8_t byte);
 static void SIMMProgrammer_HandleReadingChipsMaskByte(uint8_t byte);
 static void SIMMProgrammer_HandleReadingSectorLayoutByte(uint8_t byte);
+#ifdef SELF_BENCHMARK_ENABLED
+static void SIMMProgrammer_HandleSelfBenchmarkReadingScratchByte(uint8_t byte);
+#endif
+#ifdef STATS_ENABLED
+static void SIMMProgrammer_SendStats(void);
+#endif
+#ifdef TRACE_ENABLED
+static void SIMMProgrammer_SendTrace(void);
+#endif
+#ifdef HEALTH_ENABLED
+static void SIMMProgrammer_SendHealthMap(void);
+#endif
 
 /** Initializes the SIMM programmer and prepares it for USB communication.
  *
  */
 void SIMMProgrammer_Init(void)
 {
+#ifdef STATS_CLOCK_ENABLED
+	Stats_Init();
+#endif
 	USBCDC_Init();
 }
 
@@ -119,6 +148,7 @@ void SIMMProgrammer_Check(void)
 	while ((result = USBCDC_ReadByte()) >= 0)
 	{
 		uint8_t recvByte = (uint8_t)result;
+		STATS_RECEIVED();
 
 		// Hand it off to the correct handler function based on the current state
 		switch (curCommandState)
@@ -150,8 +180,23 @@ void SIMMProgrammer_Check(void)
 		case ReadingSectorLayout:
 			SIMMProgrammer_HandleReadingSectorLayoutByte(recvByte);
 			break;
+		case SelfBenchmarkReadingScratch:
+#ifdef SELF_BENCHMARK_ENABLED
+			SIMMProgrammer_HandleSelfBenchmarkReadingScratchByte(recvByte);
+#endif
+			break;
 		}
+
+#ifdef TRACE_ENABLED
+		// Once we're back to waiting for a command, the last one is done
+		if (commandInProgress && curCommandState == WaitingForCommand)
+		{
+			TRACE(TraceCommandEnd, tracedCommand, 0);
+			commandInProgress = false;
+		}
+#endif
 	}
+	STATS_RECEIVE_IDLE();
 
 	// And do any periodic USB CDC tasks
 	USBCDC_Check();
@@ -163,6 +208,12 @@ void SIMMProgrammer_Check(void)
  */
 static void SIMMProgrammer_HandleWaitingForCommandByte(uint8_t byte)
 {
+#ifdef TRACE_ENABLED
+	TRACE(TraceCommandStart, byte, 0);
+	commandInProgress = true;
+	tracedCommand = byte;
+#endif
+
 	switch (byte)
 	{
 	// Asked to enter waiting mode -- we're already there, so say OK.
@@ -226,6 +277,7 @@ static void SIMMProgrammer_HandleWaitingForCommandByte(uint8_t byte)
 		curCommandState = WritingChips;
 		curWriteIndex = 0;
 		writePosInChunk = -1;
+		ParallelFlash_BeginWrite();
 		USBCDC_SendByte(CommandReplyOK);
 		break;
 	case WriteChipsAt:
@@ -294,6 +346,48 @@ static void SIMMProgrammer_HandleWaitingForCommandByte(uint8_t byte)
 		USBCDC_SendByte(0);
 		USBCDC_SendByte(ProgrammerGetFWVersionDone);
 		break;
+#ifdef STATS_ENABLED
+	case GetStats:
+		USBCDC_SendByte(CommandReplyOK);
+		SIMMProgrammer_SendStats();
+		USBCDC_SendByte(ProgrammerGetStatsDone);
+		break;
+	case ResetStats:
+		Stats_Reset();
+		USBCDC_SendByte(CommandReplyOK);
+		break;
+#endif
+#ifdef TRACE_ENABLED
+	case GetTrace:
+		USBCDC_SendByte(CommandReplyOK);
+		SIMMProgrammer_SendTrace();
+		USBCDC_SendByte(ProgrammerGetTraceDone);
+		break;
+	case ClearTrace:
+		Trace_Clear();
+		USBCDC_SendByte(CommandReplyOK);
+		break;
+#endif
+#ifdef HEALTH_ENABLED
+	case GetHealthMap:
+		USBCDC_SendByte(CommandReplyOK);
+		SIMMProgrammer_SendHealthMap();
+		USBCDC_SendByte(ProgrammerGetHealthMapDone);
+		break;
+	case ResetHealthMap:
+		Health_Reset();
+		USBCDC_SendByte(CommandReplyOK);
+		break;
+#endif
+#ifdef SELF_BENCHMARK_ENABLED
+	case SelfBenchmark:
+		readLengthByteIndex = 0;
+		eraseLength = 0;
+		erasePosition = 0;
+		curCommandState = SelfBenchmarkReadingScratch;
+		USBCDC_SendByte(CommandReplyOK);
+		break;
+#endif
 	// We don't know what this command is, so reply that it was invalid.
 	default:
 		USBCDC_SendByte(CommandReplyInvalid);
@@ -365,6 +459,7 @@ static void SIMMProgrammer_HandleReadingChipsReadLengthByte(uint8_t byte)
 			curReadIndex /= READ_WRITE_CHUNK_SIZE_BYTES;
 			curCommandState = ReadingChips;
 			USBCDC_SendByte(ProgrammerReadOK);
+			readAheadChunk = NULL;
 			SIMMProgrammer_SendReadDataChunk();
 		}
 	}
@@ -375,11 +470,35 @@ static void SIMMProgrammer_HandleReadingChipsReadLengthByte(uint8_t byte)
  */
 static void SIMMProgrammer_SendReadDataChunk(void)
 {
-	// Read the next chunk of data, send it over USB, and make sure
-	// we sent it correctly.
-	ParallelFlash_Read(curReadIndex * (READ_WRITE_CHUNK_SIZE_BYTES/PARALLEL_FLASH_NUM_CHIPS),
-			readChunks.words, READ_WRITE_CHUNK_SIZE_BYTES/PARALLEL_FLASH_NUM_CHIPS);
-	bool retVal = USBCDC_SendData(readChunks.bytes, READ_WRITE_CHUNK_SIZE_BYTES);
+	// Read the next chunk of data, unless it was already read while the
+	// previous chunk was being sent.
+	uint32_t *chunk = readAheadChunk;
+	if (!chunk)
+	{
+		chunk = readChunks.words;
+		ParallelFlash_Read(curReadIndex * (READ_WRITE_CHUNK_SIZE_BYTES/PARALLEL_FLASH_NUM_CHIPS),
+				chunk, READ_WRITE_CHUNK_SIZE_BYTES/PARALLEL_FLASH_NUM_CHIPS);
+	}
+
+	// If there's another chunk after this one, start reading it into the
+	// other buffer. On hardware that can read in the background, this happens
+	// while we send this chunk over USB.
+	uint32_t *nextChunk = (chunk == readChunks.words) ? writeChunks.words : readChunks.words;
+	bool const readAhead = curReadIndex + 1 < readLength;
+	if (readAhead)
+	{
+		ParallelFlash_StartRead((curReadIndex + 1) * (READ_WRITE_CHUNK_SIZE_BYTES/PARALLEL_FLASH_NUM_CHIPS),
+				nextChunk, READ_WRITE_CHUNK_SIZE_BYTES/PARALLEL_FLASH_NUM_CHIPS);
+	}
+
+	// Send it over USB, and make sure we sent it correctly.
+	bool retVal = USBCDC_SendData((uint8_t const *)chunk, READ_WRITE_CHUNK_SIZE_BYTES);
+
+	if (readAhead)
+	{
+		ParallelFlash_FinishRead();
+	}
+	readAheadChunk = readAhead ? nextChunk : NULL;
 
 	// If for some reason there was an error, mark it as such. Otherwise,
 	// increment our pointer so we know the next chunk of data to send.
@@ -416,6 +535,7 @@ static void SIMMProgrammer_HandleWritingChipsByte(uint8_t byte)
 			}
 			else
 			{
+				ParallelFlash_EndWrite();
 				LED_Off();
 				USBCDC_SendByte(ProgrammerWriteError);
 				curCommandState = WaitingForCommand;
@@ -423,12 +543,14 @@ static void SIMMProgrammer_HandleWritingChipsByte(uint8_t byte)
 			break;
 		// The computer said that it's done writing.
 		case ComputerWriteFinish:
+			ParallelFlash_EndWrite();
 			LED_Off();
 			USBCDC_SendByte(ProgrammerWriteOK);
 			curCommandState = WaitingForCommand;
 			break;
 		// The computer asked to cancel.
 		case ComputerWriteCancel:
+			ParallelFlash_EndWrite();
 			LED_Off();
 			USBCDC_SendByte(ProgrammerWriteConfirmCancel);
 			curCommandState = WaitingForCommand;
@@ -439,31 +561,44 @@ static void SIMMProgrammer_HandleWritingChipsByte(uint8_t byte)
 	{
 		// Save the byte. Then, block until we receive the rest of the data.
 		writeChunks.bytes[writePosInChunk++] = byte;
+		STATS_BEGIN(receiveStart);
 		while (writePosInChunk < READ_WRITE_CHUNK_SIZE_BYTES)
 		{
 			writeChunks.bytes[writePosInChunk++] = USBCDC_ReadByteBlocking();
 		}
+		STATS_END(StatsTimerUSBRxWait, receiveStart);
+		TRACE(TraceChunkReceived, 0, curWriteIndex);
 
 		// We filled up the chunk, write it out and confirm it, then wait
-		// for the next command from the computer!
+		// for the next command from the computer! Chips that reported a
+		// program failure count as failing verification, even if we weren't
+		// asked to verify.
+		uint8_t badVerifyChipsMask;
 		if (chipsMask == ALL_CHIPS)
 		{
-			ParallelFlash_WriteAllChips(curWriteIndex * (READ_WRITE_CHUNK_SIZE_BYTES/PARALLEL_FLASH_NUM_CHIPS),
+			badVerifyChipsMask = ParallelFlash_WriteAllChips(curWriteIndex * (READ_WRITE_CHUNK_SIZE_BYTES/PARALLEL_FLASH_NUM_CHIPS),
 										writeChunks.words, READ_WRITE_CHUNK_SIZE_BYTES/PARALLEL_FLASH_NUM_CHIPS);
 		}
 		else
 		{
-			ParallelFlash_WriteSomeChips(curWriteIndex * (READ_WRITE_CHUNK_SIZE_BYTES/PARALLEL_FLASH_NUM_CHIPS),
+			badVerifyChipsMask = ParallelFlash_WriteSomeChips(curWriteIndex * (READ_WRITE_CHUNK_SIZE_BYTES/PARALLEL_FLASH_NUM_CHIPS),
 										 writeChunks.words, READ_WRITE_CHUNK_SIZE_BYTES/PARALLEL_FLASH_NUM_CHIPS, chipsMask);
 		}
 
 		// Verify if we were asked to.
-		uint8_t badVerifyChipsMask = 0;
 		if (verifyDuringWrite)
 		{
-			// Read back a chunk
-			ParallelFlash_Read(curWriteIndex * (READ_WRITE_CHUNK_SIZE_BYTES/PARALLEL_FLASH_NUM_CHIPS),
-							   readChunks.words, READ_WRITE_CHUNK_SIZE_BYTES/PARALLEL_FLASH_NUM_CHIPS);
+			// Read back a chunk. Only the chips we wrote matter.
+			if (chipsMask == ALL_CHIPS)
+			{
+				ParallelFlash_Read(curWriteIndex * (READ_WRITE_CHUNK_SIZE_BYTES/PARALLEL_FLASH_NUM_CHIPS),
+								   readChunks.words, READ_WRITE_CHUNK_SIZE_BYTES/PARALLEL_FLASH_NUM_CHIPS);
+			}
+			else
+			{
+				ParallelFlash_ReadSomeChips(curWriteIndex * (READ_WRITE_CHUNK_SIZE_BYTES/PARALLEL_FLASH_NUM_CHIPS),
+											readChunks.words, READ_WRITE_CHUNK_SIZE_BYTES/PARALLEL_FLASH_NUM_CHIPS, chipsMask);
+			}
 
 			// Compare the readback to what we attempted to flash.
 			// Look at each chip
@@ -482,13 +617,16 @@ static void SIMMProgrammer_HandleWritingChipsByte(uint8_t byte)
 				}
 			}
 
-			// Filter out chips we didn't care about
-			badVerifyChipsMask &= chipsMask;
 		}
 
+		// Filter out chips we didn't care about
+		badVerifyChipsMask &= chipsMask;
+
 		// Bail if verification failed
 		if (badVerifyChipsMask != 0)
 		{
+			TRACE(TraceVerifyFailure, badVerifyChipsMask, curWriteIndex);
+
 			// Verification failed. The mask we calculated is actually
 			// backwards. We need to reverse it when we transmit the IC
 			// status back to the programmer software. This is kind of silly
@@ -504,6 +642,7 @@ static void SIMMProgrammer_HandleWritingChipsByte(uint8_t byte)
 			}
 
 			// Uh oh -- verification failure.
+			ParallelFlash_EndWrite();
 			LED_Off();
 			// Send the fail bit along with a mask of failed chips.
 			USBCDC_SendByte(ProgrammerWriteVerificationError | badVerifyChipsMask);
@@ -560,11 +699,11 @@ static void SIMMProgrammer_HandleErasePortionReadPosLengthByte(uint8_t byte)
 		if (((erasePosition % 4) == 0) &&
 			((eraseLength % 4) == 0))
 		{
-			uint32_t boundary = eraseLength + erasePosition;
-
 			// Ensure they are within the limits of our addressable length too.
-			// We can't address more than 8 MB of data at a time.
-			if (boundary <= (8 * 1024UL * 1024UL))
+			// We can't address more than 8 MB of data at a time. Compare this
+			// way around so a huge position or length can't wrap past the check.
+			if (eraseLength <= (8 * 1024UL * 1024UL) &&
+				erasePosition <= (8 * 1024UL * 1024UL) - eraseLength)
 			{
 				// OK! We're erasing certain sectors of a SIMM.
 				USBCDC_SendByte(ProgrammerErasePortionOK);
@@ -632,6 +771,7 @@ static void SIMMProgrammer_HandleWritingChipsReadingStartPosByte(uint8_t byte)
 		{
 			// Convert write size into an index appropriate for rest of code
 			curWriteIndex /= READ_WRITE_CHUNK_SIZE_BYTES;
+			ParallelFlash_BeginWrite();
 			USBCDC_SendByte(ProgrammerWriteOK);
 			curCommandState = WritingChips;
 		}
@@ -714,3 +854,156 @@ static void SIMMProgrammer_HandleReadingSectorLayoutByte(uint8_t byte)
 	USBCDC_SendByte(CommandReplyOK);
 	curCommandState = WaitingForCommand;
 }
+
+#if defined(STATS_ENABLED) || defined(TRACE_ENABLED) || defined(HEALTH_ENABLED) || \
+	defined(SELF_BENCHMARK_ENABLED)
+/** Sends a 32-bit value over the USB CDC serial port in little-endian order
+ *
+ * @param value The value
+ */
+static void SIMMProgrammer_SendLong(uint32_t value)
+{
+	for (uint8_t i = 0; i < 4; i++)
+	{
+		USBCDC_SendByte((uint8_t)value);
+		value >>= 8;
+	}
+}
+#endif
+
+#ifdef STATS_ENABLED
+/** Sends the statistics for the GetStats command
+ *
+ */
+static void SIMMProgrammer_SendStats(void)
+{
+	Stats stats;
+	Stats_Get(&stats);
+
+	USBCDC_SendByte(NumStatsTimers);
+	for (uint8_t i = 0; i < NumStatsTimers; i++)
+	{
+		SIMMProgrammer_SendLong(stats.timers[i].count);
+		SIMMProgrammer_SendLong(stats.timers[i].totalUS);
+		SIMMProgrammer_SendLong(stats.timers[i].maxUS);
+	}
+	SIMMProgrammer_SendLong(stats.totalPolls);
+	SIMMProgrammer_SendLong(stats.maxPolls);
+}
+#endif
+
+#ifdef TRACE_ENABLED
+/** Sends the event trace for the GetTrace command
+ *
+ */
+static void SIMMProgrammer_SendTrace(void)
+{
+	// Don't trace the USB packets we're about to send
+	Trace_Pause(true);
+
+	uint32_t const count = Trace_Count();
+	SIMMProgrammer_SendLong(count);
+	SIMMProgrammer_SendLong(Trace_Total());
+	for (uint32_t i = 0; i < count; i++)
+	{
+		TraceEvent event;
+		Trace_Get(i, &event);
+		SIMMProgrammer_SendLong(event.timeUS);
+		USBCDC_SendByte(event.event);
+		USBCDC_SendByte(event.arg8);
+		USBCDC_SendByte((uint8_t)event.arg16);
+		USBCDC_SendByte((uint8_t)(event.arg16 >> 8));
+	}
+
+	Trace_Pause(false);
+}
+#endif
+
+#ifdef HEALTH_ENABLED
+/** Sends the health map for the GetHealthMap command
+ *
+ * The map is kept in byte lane order, but it's sent in IC1-IC4 order like the
+ * chip IDs are.
+ */
+static void SIMMProgrammer_SendHealthMap(void)
+{
+	uint16_t const numSectors = Health_NumSectors();
+
+	USBCDC_SendByte(PARALLEL_FLASH_NUM_CHIPS);
+	USBCDC_SendByte((uint8_t)numSectors);
+	USBCDC_SendByte((uint8_t)(numSectors >> 8));
+	for (int8_t lane = PARALLEL_FLASH_NUM_CHIPS - 1; lane >= 0; lane--)
+	{
+		HealthChip const *chip = Health_Chip((uint8_t)lane);
+		SIMMProgrammer_SendLong(chip->programOps);
+		SIMMProgrammer_SendLong(chip->programBytes);
+		SIMMProgrammer_SendLong(chip->programTotalUS);
+		SIMMProgrammer_SendLong(chip->programMaxUS);
+		SIMMProgrammer_SendLong(chip->chipEraseUS);
+	}
+	for (uint16_t sector = 0; sector < numSectors; sector++)
+	{
+		for (int8_t lane = PARALLEL_FLASH_NUM_CHIPS - 1; lane >= 0; lane--)
+		{
+			uint16_t const units = Health_SectorErase(sector, (uint8_t)lane);
+			USBCDC_SendByte((uint8_t)units);
+			USBCDC_SendByte((uint8_t)(units >> 8));
+		}
+	}
+}
+#endif
+
+#ifdef SELF_BENCHMARK_ENABLED
+/** Handles a received byte when we are reading the self benchmark's scratch area
+ *
+ * @param byte The received byte
+ */
+static void SIMMProgrammer_HandleSelfBenchmarkReadingScratchByte(uint8_t byte)
+{
+	// Read in the position and length, just like ErasePortion
+	if (readLengthByteIndex < 4)
+	{
+		erasePosition |= (((uint32_t)byte) << (8*readLengthByteIndex));
+	}
+	else
+	{
+		eraseLength |= (((uint32_t)byte) << (8*(readLengthByteIndex - 4)));
+	}
+
+	if (++readLengthByteIndex >= 8)
+	{
+		SelfBenchmarkResult results[NumSelfBenchmarkTests];
+		SelfBenchmarkScratch const scratch = {
+			erasePosition / PARALLEL_FLASH_NUM_CHIPS,
+			eraseLength / PARALLEL_FLASH_NUM_CHIPS,
+			chipsMask,
+			numEraseSectorGroups,
+			eraseSectorGroups
+		};
+		bool ok = false;
+
+		// Don't let a bad scratch area erase something it shouldn't
+		if ((erasePosition % 4) == 0 && (eraseLength % 4) == 0 &&
+			eraseLength <= (8 * 1024UL * 1024UL) &&
+			erasePosition <= (8 * 1024UL * 1024UL) - eraseLength)
+		{
+			ok = SelfBenchmark_Run(results, &scratch, writeChunks.words, readChunks.words);
+		}
+		else
+		{
+			// Still run everything else, so the computer gets the data it expects
+			SelfBenchmarkScratch const noScratch = {0, 0, chipsMask, 0, NULL};
+			SelfBenchmark_Run(results, &noScratch, writeChunks.words, readChunks.words);
+		}
+
+		USBCDC_SendByte(NumSelfBenchmarkTests);
+		for (uint8_t i = 0; i < NumSelfBenchmarkTests; i++)
+		{
+			SIMMProgrammer_SendLong(results[i].iterations);
+			SIMMProgrammer_SendLong(results[i].totalUS);
+		}
+		USBCDC_SendByte(ok ? ProgrammerSelfBenchmarkDone : ProgrammerSelfBenchmarkScratchError);
+		curCommandState = WaitingForCommand;
+	}
+}
+#endif
@@ -0,0 +1,164 @@
+/*
+ * stats.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: SIMM Programmer contributors
+ *
+ * Copyright (C) 2026 SIMM Programmer contributors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * -----------------------------------------------------------------------------
+ *
+ * Timing statistics for the GetStats command. Each board provides a
+ * free-running timer (see StatsTimer_Ticks in its hardware.h), which is
+ * usually only 16 or 24 bits wide. We extend it to a 32-bit microsecond clock
+ * here, which works as long as Stats_Now is called at least once per timer
+ * rollover while something is being timed. The same clock timestamps the
+ * event trace (see trace.c), times the chips for the health map (see
+ * health.c) and times the self benchmark, so it's also built when only those
+ * are enabled.
+ */
+
+#include "stats.h"
+
+#ifdef STATS_CLOCK_ENABLED
+
+#include "hardware.h"
+#include "util.h"
+#include <stdbool.h>
+#include <string.h>
+
+/// The timer reading the last time we looked at it
+static uint32_t lastTicks;
+/// Our 32-bit microsecond clock
+static uint32_t nowUS;
+
+#ifdef STATS_ENABLED
+/// The statistics
+static Stats stats;
+/// When we started waiting for data from the host, if we're waiting
+static uint32_t receiveIdleStart;
+static bool receiveIdle = false;
+#endif
+
+/** Initializes the statistics
+ *
+ */
+void Stats_Init(void)
+{
+	StatsTimer_Init();
+	lastTicks = StatsTimer_Ticks();
+#ifdef STATS_ENABLED
+	Stats_Reset();
+#endif
+}
+
+/** Gets the current time
+ *
+ * @return The time in microseconds. It wraps around after about 71 minutes.
+ */
+RAMFUNC uint32_t Stats_Now(void)
+{
+	uint32_t const ticks = StatsTimer_Ticks();
+	nowUS += ((ticks - lastTicks) & STATS_TIMER_MASK) * STATS_TIMER_TICK_US;
+	lastTicks = ticks;
+	return nowUS;
+}
+
+#ifdef STATS_ENABLED
+
+/** Adds the time something took to a timer
+ *
+ * @param timer The timer
+ * @param startTime When it started, from Stats_Now
+ * @param count How many operations it was. The longest time is per operation.
+ */
+RAMFUNC void Stats_Add(ProgrammerStatsTimer timer, uint32_t startTime, uint32_t count)
+{
+	StatsTimerData *t = &stats.timers[timer];
+	uint32_t const elapsed = Stats_Now() - startTime;
+	uint32_t const each = count ? elapsed / count : elapsed;
+
+	t->count += count;
+	t->totalUS += elapsed;
+	if (each > t->maxUS)
+	{
+		t->maxUS = each;
+	}
+}
+
+/** Adds the number of polls from a wait for the chips to the totals
+ *
+ * @param polls The number of times the chips were polled
+ */
+RAMFUNC void Stats_AddPolls(uint32_t polls)
+{
+	stats.totalPolls += polls;
+	if (polls > stats.maxPolls)
+	{
+		stats.maxPolls = polls;
+	}
+}
+
+/** Notes that the main loop didn't find any data from the host
+ *
+ */
+void Stats_ReceiveIdle(void)
+{
+	if (!receiveIdle)
+	{
+		receiveIdleStart = Stats_Now();
+		receiveIdle = true;
+	}
+	else
+	{
+		// Keep the clock going while we wait
+		Stats_Now();
+	}
+}
+
+/** Notes that the main loop received data from the host
+ *
+ */
+void Stats_Received(void)
+{
+	if (receiveIdle)
+	{
+		Stats_Add(StatsTimerUSBRxWait, receiveIdleStart, 1);
+		receiveIdle = false;
+	}
+}
+
+/** Gets a copy of the statistics
+ *
+ * @param s Filled in with the statistics
+ */
+void Stats_Get(Stats *s)
+{
+	*s = stats;
+}
+
+/** Sets all of the statistics back to zero
+ *
+ */
+void Stats_Reset(void)
+{
+	memset(&stats, 0, sizeof(stats));
+	receiveIdle = false;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,117 @@
+/*
+ * stats.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: SIMM Programmer contributors
+ *
+ * Copyright (C) 2026 SIMM Programmer contributors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef STATS_H_
+#define STATS_H_
+
+#include "programmer_protocol.h"
+#include <stdint.h>
+
+/// Totals for one of the timers
+typedef struct StatsTimerData
+{
+	uint32_t count;
+	uint32_t totalUS;
+	uint32_t maxUS;
+} StatsTimerData;
+
+/// Everything returned by the GetStats command
+typedef struct Stats
+{
+	StatsTimerData timers[NumStatsTimers];
+	uint32_t totalPolls;
+	uint32_t maxPolls;
+} Stats;
+
+/// The statistics clock is also used for timestamping the event trace, timing
+/// the chips for the health map, and the self benchmark
+#if defined(STATS_ENABLED) || defined(TRACE_ENABLED) || defined(HEALTH_ENABLED) || \
+	defined(SELF_BENCHMARK_ENABLED)
+#define STATS_CLOCK_ENABLED
+#endif
+
+#ifdef STATS_CLOCK_ENABLED
+void Stats_Init(void);
+uint32_t Stats_Now(void);
+#endif
+
+#ifdef STATS_ENABLED
+
+void Stats_Add(ProgrammerStatsTimer timer, uint32_t startTime, uint32_t count);
+void Stats_AddPolls(uint32_t polls);
+void Stats_ReceiveIdle(void);
+void Stats_Received(void);
+void Stats_Get(Stats *stats);
+void Stats_Reset(void);
+
+// These macros are how the rest of the firmware collects statistics, so they
+// all disappear when statistics are turned off.
+
+/// Starts timing something, saving the start time in a new variable
+#define STATS_BEGIN(start)				uint32_t const start = Stats_Now()
+/// Adds the time since STATS_BEGIN to a timer
+#define STATS_END(timer, start)			Stats_Add(timer, start, 1)
+/// Adds the time since STATS_BEGIN to a timer, as count separate operations
+#define STATS_END_N(timer, start, n)	Stats_Add(timer, start, n)
+/// Adds a poll counter to the totals
+#define STATS_ADD_POLLS(polls)			Stats_AddPolls(polls)
+/// Tracks how long we wait for data from the host in the main loop
+#define STATS_RECEIVE_IDLE()			Stats_ReceiveIdle()
+#define STATS_RECEIVED()				Stats_Received()
+
+#else
+
+#define STATS_BEGIN(start)
+#define STATS_END(timer, start)
+#define STATS_END_N(timer, start, n)
+#define STATS_ADD_POLLS(polls)
+#define STATS_RECEIVED()
+
+#ifdef STATS_CLOCK_ENABLED
+// Everything else that uses the clock still needs it to keep up with the
+// timer while idle
+#define STATS_RECEIVE_IDLE()			Stats_Now()
+#else
+#define STATS_RECEIVE_IDLE()
+#endif
+
+#endif
+
+#ifdef STATS_CLOCK_ENABLED
+
+/// Declares a counter, and counts something with it
+#define STATS_COUNTER(counter)			uint32_t counter = 0
+#define STATS_COUNT(counter)			(counter)++
+/// Counts a poll. Also keeps the statistics clock from missing a timer
+/// rollover during a long wait.
+#define STATS_POLL(polls)				do { if (!(++(polls) & 0xFF)) Stats_Now(); } while (0)
+
+#else
+
+#define STATS_COUNTER(counter)
+#define STATS_COUNT(counter)
+#define STATS_POLL(polls)
+
+#endif
+
+#endif /* STATS_H_ */
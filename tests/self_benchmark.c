@@ -0,0 +1,211 @@
+/*
+ * self_benchmark.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: SIMM Programmer contributors
+ *
+ * Copyright (C) 2026 SIMM Programmer contributors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * -----------------------------------------------------------------------------
+ *
+ * Times the basic operations everything else is built out of, on the board
+ * itself: bus cycles, a 1 KB read (normal and in the background), a 1 KB USB
+ * transfer, and erasing and programming a scratch area the user picked. The
+ * results can be compared between boards, firmware builds and computers
+ * without needing a logic analyzer. The timing comes from the statistics
+ * clock (see stats.c).
+ */
+
+#include "self_benchmark.h"
+
+#ifdef SELF_BENCHMARK_ENABLED
+
+#include "../hal/parallel_bus.h"
+#include "../hal/usbcdc.h"
+#include "../stats.h"
+#include <string.h>
+
+/// How many times to repeat the quick tests. These are small enough that
+/// none of the tests comes close to a timer rollover on the AVR.
+#define BUS_CYCLE_ITERATIONS		1000UL
+#define READ_1K_ITERATIONS			16UL
+/// The number of 32-bit words in 1 KB of the SIMM
+#define WORDS_PER_KB				(1024UL / PARALLEL_FLASH_NUM_CHIPS)
+
+/// The read/reset command. Writing it is harmless, so it's what the write
+/// cycle test writes.
+#define READ_RESET_COMMAND			0xF0F0F0F0UL
+
+static bool SelfBenchmark_Flash(SelfBenchmarkResult results[NumSelfBenchmarkTests], SelfBenchmarkScratch const *scratch,
+		uint32_t *buf1, uint32_t *buf2);
+
+/** Runs the self benchmark
+ *
+ * @param results Filled in with the results of each test, or 0 iterations if it didn't run
+ * @param scratch Where the flash tests can erase and program
+ * @param buf1 A SELF_BENCHMARK_BUFFER_BYTES buffer to use
+ * @param buf2 Another SELF_BENCHMARK_BUFFER_BYTES buffer to use
+ * @return False if the scratch area couldn't be erased or programmed correctly
+ *
+ * The USB test sends SELF_BENCHMARK_USB_BYTES bytes of junk to the computer.
+ */
+bool SelfBenchmark_Run(SelfBenchmarkResult results[NumSelfBenchmarkTests], SelfBenchmarkScratch const *scratch,
+		uint32_t *buf1, uint32_t *buf2)
+{
+	uint32_t start;
+	memset(results, 0, NumSelfBenchmarkTests * sizeof(SelfBenchmarkResult));
+
+	start = Stats_Now();
+	for (uint32_t i = 0; i < BUS_CYCLE_ITERATIONS; i++)
+	{
+		ParallelBus_ReadCycle(0);
+	}
+	results[SelfBenchmarkReadCycle].totalUS = Stats_Now() - start;
+	results[SelfBenchmarkReadCycle].iterations = BUS_CYCLE_ITERATIONS;
+
+	start = Stats_Now();
+	for (uint32_t i = 0; i < BUS_CYCLE_ITERATIONS; i++)
+	{
+		ParallelBus_WriteCycle(0, READ_RESET_COMMAND);
+	}
+	results[SelfBenchmarkWriteCycle].totalUS = Stats_Now() - start;
+	results[SelfBenchmarkWriteCycle].iterations = BUS_CYCLE_ITERATIONS;
+
+	start = Stats_Now();
+	for (uint32_t i = 0; i < READ_1K_ITERATIONS; i++)
+	{
+		ParallelBus_Read(0, buf1, WORDS_PER_KB);
+	}
+	results[SelfBenchmarkRead1K].totalUS = Stats_Now() - start;
+	results[SelfBenchmarkRead1K].iterations = READ_1K_ITERATIONS;
+
+	start = Stats_Now();
+	for (uint32_t i = 0; i < READ_1K_ITERATIONS; i++)
+	{
+		ParallelBus_StartRead(0, buf2, WORDS_PER_KB);
+		ParallelBus_FinishRead();
+	}
+	results[SelfBenchmarkBackgroundRead1K].totalUS = Stats_Now() - start;
+	results[SelfBenchmarkBackgroundRead1K].iterations = READ_1K_ITERATIONS;
+
+	// Whatever was in the buffer will do. Make sure nothing else is waiting
+	// to go out first, and that it's all gone at the end.
+	uint8_t const *bytes = (uint8_t const *)buf1;
+	USBCDC_Flush();
+	start = Stats_Now();
+	for (uint32_t i = 0; i < SELF_BENCHMARK_USB_BYTES; i++)
+	{
+		USBCDC_SendByte(bytes[i & (SELF_BENCHMARK_BUFFER_BYTES - 1)]);
+	}
+	USBCDC_Flush();
+	results[SelfBenchmarkUSBSend1K].totalUS = Stats_Now() - start;
+	results[SelfBenchmarkUSBSend1K].iterations = SELF_BENCHMARK_USB_BYTES / 1024;
+
+	if (scratch->length == 0)
+	{
+		return true;
+	}
+	return SelfBenchmark_Flash(results, scratch, buf1, buf2);
+}
+
+/** Runs the flash tests in the scratch area
+ *
+ * @param results Filled in with the results of the flash tests
+ * @param scratch Where the flash tests can erase and program
+ * @param buf1 A SELF_BENCHMARK_BUFFER_BYTES buffer to use
+ * @param buf2 Another SELF_BENCHMARK_BUFFER_BYTES buffer to use
+ * @return False if the scratch area couldn't be erased or programmed correctly
+ */
+static bool SelfBenchmark_Flash(SelfBenchmarkResult results[NumSelfBenchmarkTests], SelfBenchmarkScratch const *scratch,
+		uint32_t *buf1, uint32_t *buf2)
+{
+	uint32_t start;
+
+	if (scratch->length < WORDS_PER_KB)
+	{
+		return false;
+	}
+
+	start = Stats_Now();
+	if (!ParallelFlash_EraseSectors(scratch->address, scratch->length, scratch->chipsMask,
+			scratch->numEraseSectorGroups, scratch->eraseSectorGroups))
+	{
+		return false;
+	}
+	results[SelfBenchmarkEraseScratch].totalUS = Stats_Now() - start;
+	results[SelfBenchmarkEraseScratch].iterations = 1;
+
+	// Alternate bits, so every bit gets programmed at some point
+	for (uint16_t i = 0; i < WORDS_PER_KB; i++)
+	{
+		buf1[i] = (i & 1) ? 0x55AA55AAUL : 0xAA55AA55UL;
+	}
+
+	uint8_t failed;
+	ParallelFlash_BeginWrite();
+	start = Stats_Now();
+	if (scratch->chipsMask == ALL_CHIPS)
+	{
+		failed = ParallelFlash_WriteAllChips(scratch->address, buf1, WORDS_PER_KB);
+	}
+	else
+	{
+		failed = ParallelFlash_WriteSomeChips(scratch->address, buf1, WORDS_PER_KB, scratch->chipsMask);
+	}
+	const uint32_t programUS = Stats_Now() - start;
+	ParallelFlash_EndWrite();
+
+	// A chip that gave up early would make programming look faster than it is
+	if (failed)
+	{
+		return false;
+	}
+	results[SelfBenchmarkProgram].totalUS = programUS;
+	results[SelfBenchmarkProgram].iterations = WORDS_PER_KB;
+
+	// Make sure it was really programmed, so nothing looks faster than it is
+	uint32_t laneMask = 0;
+	for (uint8_t chip = 0; chip < PARALLEL_FLASH_NUM_CHIPS; chip++)
+	{
+		if (scratch->chipsMask & (1 << chip))
+		{
+			laneMask |= 0xFFUL << (chip * 8);
+		}
+	}
+	ParallelFlash_Read(scratch->address, buf2, WORDS_PER_KB);
+	for (uint16_t i = 0; i < WORDS_PER_KB; i++)
+	{
+		if ((buf1[i] ^ buf2[i]) & laneMask)
+		{
+			return false;
+		}
+	}
+
+	// The background read has to get the same data, or it isn't safe to use
+	ParallelFlash_StartRead(scratch->address, buf2, WORDS_PER_KB);
+	ParallelFlash_FinishRead();
+	for (uint16_t i = 0; i < WORDS_PER_KB; i++)
+	{
+		if ((buf1[i] ^ buf2[i]) & laneMask)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+#endif
@@ -0,0 +1,58 @@
+/*
+ * self_benchmark.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: SIMM Programmer contributors
+ *
+ * Copyright (C) 2026 SIMM Programmer contributors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef TESTS_SELF_BENCHMARK_H_
+#define TESTS_SELF_BENCHMARK_H_
+
+#include "../drivers/parallel_flash.h"
+#include "../programmer_protocol.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/// The number of bytes the USB test sends to the computer
+#define SELF_BENCHMARK_USB_BYTES		4096UL
+/// The number of bytes each buffer passed to the self benchmark must hold
+#define SELF_BENCHMARK_BUFFER_BYTES		1024UL
+
+/// How long one of the tests took
+typedef struct SelfBenchmarkResult
+{
+	uint32_t iterations;
+	uint32_t totalUS;
+} SelfBenchmarkResult;
+
+/// Where the flash tests are allowed to erase and program
+typedef struct SelfBenchmarkScratch
+{
+	/// Start and length, in bytes of each chip. A length of 0 skips the flash tests.
+	uint32_t address;
+	uint32_t length;
+	uint8_t chipsMask;
+	uint8_t numEraseSectorGroups;
+	ParallelFlashEraseSectorGroup const *eraseSectorGroups;
+} SelfBenchmarkScratch;
+
+bool SelfBenchmark_Run(SelfBenchmarkResult results[NumSelfBenchmarkTests], SelfBenchmarkScratch const *scratch,
+		uint32_t *buf1, uint32_t *buf2);
+
+#endif /* TESTS_SELF_BENCHMARK_H_ */
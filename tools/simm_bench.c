@@ -0,0 +1,1803 @@
+/*
+ * simm_bench.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: SIMM Programmer contributors
+ *
+ * Copyright (C) 2026 SIMM Programmer contributors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * -----------------------------------------------------------------------------
+ *
+ * End-to-end throughput benchmark. Talks to the programmer over the same
+ * protocol the control software uses, runs the usual jobs (erase, write with
+ * and without verify, read back, partial erase, single-chip write) and prints
+ * how long each one took as JSON.
+ *
+ * It normally starts the simulated programmer itself, in which case it also
+ * reports what the simulation saw: bus cycles per byte, data bus direction
+ * changes, status polls and how much virtual time was spent waiting for the
+ * chips to program or erase. With --device it benchmarks a real programmer
+ * instead, and only the wall clock numbers and USB round trips are available.
+ * Either way, if the firmware was built with statistics (SIMM_STATS), the
+ * firmware's own timers are included for each phase too. If it was built with
+ * tracing (SIMM_TRACE), --trace saves its event trace of the whole run for
+ * simm_trace to decode. If it was built with the health map (SIMM_HEALTH),
+ * each chip's program and erase times over the run are included, along with
+ * which chip was the slowest and by how much.
+ *
+ * The write_pipelined and dump_pipelined phases do the same jobs as write and
+ * dump, but with the pipelined client library (simm_client.h), to show how
+ * much of the USB latency it hides.
+ *
+ * --self-benchmark runs the firmware's SelfBenchmark command instead, which
+ * times bus cycles, reads, USB transfers and flash operations on the board
+ * itself (SIMM_SELF_BENCHMARK).
+ *
+ * The simulator's counts don't depend on how fast the computer is, so they
+ * can be checked against a budgets file with --check-budgets. That runs every
+ * chip configuration listed in the file and fails if the flash driver ever
+ * needs more bus cycles than it used to for the same job.
+ */
+
+#include "../programmer_protocol.h"
+#include "../hal/host/flash_sim.h"
+#include "simm_client.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+/// Size of the chunks that the read/write protocol uses
+#define CHUNK_SIZE					1024
+/// The programmer's limit on how much it can read or write at once
+#define MAX_SIMM_SIZE				(8 * 1024UL * 1024UL)
+/// How long to wait for any reply. Chip erases on real 8 MB SIMMs are slow.
+#define REPLY_TIMEOUT_MS			180000
+/// Chips mask used by the single-chip write: IC4 only
+#define MASKED_CHIPS				0x01
+#define ALL_CHIPS					0x0F
+/// The most budgets a budgets file can have
+#define MAX_BUDGETS					256
+
+/// A connection to a programmer, real or simulated
+typedef struct BenchLink
+{
+	/// The serial port or socket
+	int fd;
+	/// The simulator's process ID, or 0 for a real programmer
+	pid_t simPid;
+	/// The simulator's statistics, or NULL for a real programmer
+	FlashSimStats const volatile *stats;
+	/// Number of times we've had to wait for a reply to something we sent
+	uint64_t roundTrips;
+	/// True if we've sent something since the last reply we read
+	bool sentSinceReply;
+	/// True if the firmware supports GetStats
+	bool firmwareStats;
+} BenchLink;
+
+/// The firmware's statistics, from GetStats
+typedef struct BenchFirmwareStats
+{
+	bool valid;
+	uint32_t count[NumStatsTimers];
+	uint32_t totalUS[NumStatsTimers];
+	uint32_t maxUS[NumStatsTimers];
+	uint32_t totalPolls;
+	uint32_t maxPolls;
+} BenchFirmwareStats;
+
+/// The firmware's per-chip health map, from GetHealthMap, in IC1-IC4 order
+typedef struct BenchHealth
+{
+	bool valid;
+	uint32_t programOps[4];
+	uint32_t programBytes[4];
+	uint32_t programTotalUS[4];
+	uint32_t programMaxUS[4];
+	uint32_t chipEraseUS[4];
+	uint16_t numSectors;
+	/// Sector erase times in units of 100 microseconds, 4 per sector
+	uint16_t *sectorErase;
+} BenchHealth;
+
+/// Everything measured about one phase of the benchmark
+typedef struct BenchPhase
+{
+	char const *name;
+	/// Bytes moved over USB, and bytes the flash chips actually touched
+	uint32_t bytes;
+	uint32_t flashBytes;
+	bool ok;
+	double wallS;
+	uint64_t roundTrips;
+	/// Simulator statistics over the phase
+	FlashSimStats sim;
+	/// Firmware statistics over the phase
+	BenchFirmwareStats firmware;
+} BenchPhase;
+
+/// One phase and the function that runs it
+typedef struct BenchPhaseDef
+{
+	char const *name;
+	bool (*run)(BenchLink *link, BenchPhase *phase);
+	/// Gets the programmer into the right state first, outside of the timing
+	bool (*setup)(BenchLink *link);
+} BenchPhaseDef;
+
+static bool Bench_Identify(BenchLink *link, BenchPhase *phase);
+static bool Bench_Erase(BenchLink *link, BenchPhase *phase);
+static bool Bench_Write(BenchLink *link, BenchPhase *phase);
+static bool Bench_Dump(BenchLink *link, BenchPhase *phase);
+static bool Bench_ErasePortion(BenchLink *link, BenchPhase *phase);
+static bool Bench_WriteVerify(BenchLink *link, BenchPhase *phase);
+static bool Bench_WriteMasked(BenchLink *link, BenchPhase *phase);
+static bool Bench_WritePipelined(BenchLink *link, BenchPhase *phase);
+static bool Bench_DumpPipelined(BenchLink *link, BenchPhase *phase);
+static bool Bench_SetupErased(BenchLink *link);
+static bool Bench_SetupMasked(BenchLink *link);
+
+/// Every phase, in the order they run
+static const BenchPhaseDef phaseDefs[] = {
+	{"identify", Bench_Identify, NULL},
+	{"erase", Bench_Erase, NULL},
+	{"write", Bench_Write, NULL},
+	{"dump", Bench_Dump, NULL},
+	{"erase_portion", Bench_ErasePortion, NULL},
+	{"write_verify", Bench_WriteVerify, Bench_SetupErased},
+	{"write_masked", Bench_WriteMasked, Bench_SetupMasked},
+	{"write_pipelined", Bench_WritePipelined, Bench_SetupErased},
+	{"dump_pipelined", Bench_DumpPipelined, NULL},
+};
+#define NUM_PHASES					(sizeof(phaseDefs)/sizeof(phaseDefs[0]))
+
+/// A limit on one of the simulator's counts for one phase
+typedef struct BenchBudget
+{
+	char chips[128];
+	char phase[32];
+	char metric[32];
+	double limit;
+	/// What was measured, and whether it's within the limit
+	double value;
+	bool measured;
+	bool ok;
+	/// True if the phase wasn't asked for
+	bool skipped;
+} BenchBudget;
+
+/// Names of the firmware's timers, in ProgrammerStatsTimer order
+static char const * const firmwareTimerNames[NumStatsTimers] = {
+	"bus_read", "program", "wait_for_completion", "erase_chips", "erase_sector",
+	"usb_tx_wait", "usb_rx_wait"
+};
+
+/// Names of the self benchmark tests, in ProgrammerSelfBenchmarkTest order
+static char const * const selfBenchmarkNames[NumSelfBenchmarkTests] = {
+	"read_cycle", "write_cycle", "read_1k", "usb_send_1k", "erase_scratch", "program",
+	"background_read_1k"
+};
+
+/// The image we write, and a buffer to read it back into
+static uint8_t *image;
+static uint8_t *readBack;
+static uint32_t imageSize = 2 * 1024UL * 1024UL;
+/// How much the erase_portion phase erases, from the start of the SIMM
+static uint32_t portionSize = 256 * 1024UL;
+/// The IDs found by the identify phase, in IC1-IC4 order
+static uint8_t chipIDs[8];
+/// The firmware's health map at the end of the run
+static BenchHealth health;
+
+/** Gets the time from a monotonic clock
+ *
+ * @return The time in seconds
+ */
+static double Bench_Seconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/** Sends data to the programmer
+ *
+ * @param link The programmer
+ * @param data The data to send
+ * @param len The number of bytes
+ * @return True on success, false on failure
+ */
+static bool Bench_Send(BenchLink *link, void const *data, size_t len)
+{
+	uint8_t const *p = data;
+	while (len)
+	{
+		ssize_t const written = write(link->fd, p, len);
+		if (written > 0)
+		{
+			p += written;
+			len -= (size_t)written;
+		}
+		else if (written < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		else
+		{
+			perror("Unable to write to programmer");
+			return false;
+		}
+	}
+
+	link->sentSinceReply = true;
+	return true;
+}
+
+/** Sends a single byte to the programmer
+ *
+ * @param link The programmer
+ * @param b The byte
+ * @return True on success, false on failure
+ */
+static bool Bench_SendByte(BenchLink *link, uint8_t b)
+{
+	return Bench_Send(link, &b, 1);
+}
+
+/** Sends a 32-bit little-endian value to the programmer
+ *
+ * @param link The programmer
+ * @param value The value
+ * @return True on success, false on failure
+ */
+static bool Bench_SendLong(BenchLink *link, uint32_t value)
+{
+	uint8_t const bytes[4] = {value, value >> 8, value >> 16, value >> 24};
+	return Bench_Send(link, bytes, sizeof(bytes));
+}
+
+/** Receives data from the programmer
+ *
+ * @param link The programmer
+ * @param data Buffer for the data
+ * @param len The number of bytes to wait for
+ * @return True on success, false on failure or timeout
+ */
+static bool Bench_Receive(BenchLink *link, void *data, size_t len)
+{
+	uint8_t *p = data;
+
+	// The first thing we read after sending something completes a round trip
+	if (link->sentSinceReply)
+	{
+		link->roundTrips++;
+		link->sentSinceReply = false;
+	}
+
+	while (len)
+	{
+		struct pollfd pfd = {link->fd, POLLIN, 0};
+		int const result = poll(&pfd, 1, REPLY_TIMEOUT_MS);
+		if (result == 0)
+		{
+			fprintf(stderr, "Timed out waiting for the programmer\n");
+			return false;
+		}
+		else if (result < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			perror("Unable to wait for programmer");
+			return false;
+		}
+
+		ssize_t const got = read(link->fd, p, len);
+		if (got > 0)
+		{
+			p += got;
+			len -= (size_t)got;
+		}
+		else if (got < 0 && (errno == EINTR || errno == EAGAIN))
+		{
+			continue;
+		}
+		else
+		{
+			fprintf(stderr, "Lost connection to programmer\n");
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/** Receives one byte from the programmer and checks that it's what we expect
+ *
+ * @param link The programmer
+ * @param expected The byte we should get
+ * @return True if we got it, false otherwise
+ */
+static bool Bench_Expect(BenchLink *link, uint8_t expected)
+{
+	uint8_t b;
+	if (!Bench_Receive(link, &b, 1))
+	{
+		return false;
+	}
+	if (b != expected)
+	{
+		fprintf(stderr, "Expected reply 0x%02X from programmer, got 0x%02X\n", expected, b);
+		return false;
+	}
+	return true;
+}
+
+/** Sends a command and waits for it to be accepted
+ *
+ * @param link The programmer
+ * @param command The command
+ * @return True if the programmer replied OK
+ */
+static bool Bench_Command(BenchLink *link, uint8_t command)
+{
+	return Bench_SendByte(link, command) &&
+		   Bench_Expect(link, CommandReplyOK);
+}
+
+/** Receives a 32-bit little-endian value from the programmer
+ *
+ * @param link The programmer
+ * @param value Filled in with the value
+ * @return True on success, false on failure
+ */
+static bool Bench_ReceiveLong(BenchLink *link, uint32_t *value)
+{
+	uint8_t bytes[4];
+	if (!Bench_Receive(link, bytes, sizeof(bytes)))
+	{
+		return false;
+	}
+	*value = bytes[0] | ((uint32_t)bytes[1] << 8) | ((uint32_t)bytes[2] << 16) | ((uint32_t)bytes[3] << 24);
+	return true;
+}
+
+/** Clears the firmware's statistics, and finds out if it has them
+ *
+ * @param link The programmer
+ * @return True on success, false on failure
+ */
+static bool Bench_ResetFirmwareStats(BenchLink *link)
+{
+	uint8_t reply;
+	if (!Bench_SendByte(link, ResetStats) ||
+		!Bench_Receive(link, &reply, 1))
+	{
+		return false;
+	}
+	link->firmwareStats = (reply == CommandReplyOK);
+	return reply == CommandReplyOK || reply == CommandReplyInvalid;
+}
+
+/** Gets the firmware's statistics
+ *
+ * @param link The programmer
+ * @param stats Filled in with the statistics
+ * @return True on success, false on failure
+ */
+static bool Bench_GetFirmwareStats(BenchLink *link, BenchFirmwareStats *stats)
+{
+	uint8_t numTimers;
+
+	if (!Bench_Command(link, GetStats) ||
+		!Bench_Receive(link, &numTimers, 1))
+	{
+		return false;
+	}
+
+	// Newer firmware might have more timers than we know about
+	for (uint8_t i = 0; i < numTimers; i++)
+	{
+		uint32_t count, totalUS, maxUS;
+		if (!Bench_ReceiveLong(link, &count) ||
+			!Bench_ReceiveLong(link, &totalUS) ||
+			!Bench_ReceiveLong(link, &maxUS))
+		{
+			return false;
+		}
+		if (i < NumStatsTimers)
+		{
+			stats->count[i] = count;
+			stats->totalUS[i] = totalUS;
+			stats->maxUS[i] = maxUS;
+		}
+	}
+
+	stats->valid = Bench_ReceiveLong(link, &stats->totalPolls) &&
+			Bench_ReceiveLong(link, &stats->maxPolls) &&
+			Bench_Expect(link, ProgrammerGetStatsDone);
+	return stats->valid;
+}
+
+/** Clears the firmware's event trace, if it has one
+ *
+ * @param link The programmer
+ * @return True on success, false on failure
+ */
+static bool Bench_ClearTrace(BenchLink *link)
+{
+	uint8_t reply;
+	if (!Bench_SendByte(link, ClearTrace) ||
+		!Bench_Receive(link, &reply, 1))
+	{
+		return false;
+	}
+	return reply == CommandReplyOK || reply == CommandReplyInvalid;
+}
+
+/** Gets the firmware's event trace and saves it in the format simm_trace reads
+ *
+ * @param link The programmer
+ * @param path The file to save it to
+ * @return True on success, false on failure
+ */
+static bool Bench_SaveTrace(BenchLink *link, char const *path)
+{
+	uint8_t reply;
+	uint32_t count, total;
+
+	if (!Bench_SendByte(link, GetTrace) ||
+		!Bench_Receive(link, &reply, 1))
+	{
+		return false;
+	}
+	if (reply != CommandReplyOK)
+	{
+		fprintf(stderr, "The firmware doesn't keep a trace. Build it with -DSIMM_TRACE=ON.\n");
+		return false;
+	}
+	if (!Bench_ReceiveLong(link, &count) ||
+		!Bench_ReceiveLong(link, &total))
+	{
+		return false;
+	}
+
+	size_t const len = 8 + (size_t)count * 8;
+	uint8_t *raw = malloc(len);
+	if (!raw)
+	{
+		return false;
+	}
+	uint8_t const header[8] = {count, count >> 8, count >> 16, count >> 24,
+							   total, total >> 8, total >> 16, total >> 24};
+	memcpy(raw, header, sizeof(header));
+	bool ok = Bench_Receive(link, raw + 8, len - 8) &&
+			  Bench_Expect(link, ProgrammerGetTraceDone);
+
+	if (ok)
+	{
+		FILE *f = fopen(path, "wb");
+		if (!f || fwrite(raw, 1, len, f) != len)
+		{
+			fprintf(stderr, "Unable to save the trace to %s\n", path);
+			ok = false;
+		}
+		if (f)
+		{
+			fclose(f);
+		}
+	}
+	free(raw);
+	return ok;
+}
+
+/** Clears the firmware's health map, if it has one
+ *
+ * @param link The programmer
+ * @return True on success, false on failure
+ */
+static bool Bench_ResetHealthMap(BenchLink *link)
+{
+	uint8_t reply;
+	if (!Bench_SendByte(link, ResetHealthMap) ||
+		!Bench_Receive(link, &reply, 1))
+	{
+		return false;
+	}
+	health.valid = (reply == CommandReplyOK);
+	return reply == CommandReplyOK || reply == CommandReplyInvalid;
+}
+
+/** Gets the firmware's health map
+ *
+ * @param link The programmer
+ * @return True on success, false on failure
+ */
+static bool Bench_GetHealthMap(BenchLink *link)
+{
+	uint8_t header[3];
+
+	health.valid = false;
+	if (!Bench_Command(link, GetHealthMap) ||
+		!Bench_Receive(link, header, sizeof(header)))
+	{
+		return false;
+	}
+
+	// Newer hardware might have a different number of chips
+	uint8_t const numChips = header[0];
+	for (uint8_t i = 0; i < numChips; i++)
+	{
+		uint32_t values[5];
+		for (int v = 0; v < 5; v++)
+		{
+			if (!Bench_ReceiveLong(link, &values[v]))
+			{
+				return false;
+			}
+		}
+		if (i < 4)
+		{
+			health.programOps[i] = values[0];
+			health.programBytes[i] = values[1];
+			health.programTotalUS[i] = values[2];
+			health.programMaxUS[i] = values[3];
+			health.chipEraseUS[i] = values[4];
+		}
+	}
+
+	health.numSectors = header[1] | (header[2] << 8);
+	free(health.sectorErase);
+	health.sectorErase = calloc(health.numSectors ? health.numSectors * 4 : 1, sizeof(uint16_t));
+	if (!health.sectorErase)
+	{
+		return false;
+	}
+	for (uint16_t s = 0; s < health.numSectors; s++)
+	{
+		for (uint8_t i = 0; i < numChips; i++)
+		{
+			uint8_t units[2];
+			if (!Bench_Receive(link, units, sizeof(units)))
+			{
+				return false;
+			}
+			if (i < 4)
+			{
+				health.sectorErase[s * 4 + i] = units[0] | (units[1] << 8);
+			}
+		}
+	}
+
+	health.valid = Bench_Expect(link, ProgrammerGetHealthMapDone);
+	return health.valid;
+}
+
+/** Runs the firmware's self benchmark and prints the results as JSON
+ *
+ * @param link The programmer
+ * @param out Where to print the results
+ * @param simulated True if the programmer is the simulator
+ * @param chips The simulated chips, or NULL
+ * @param scratchPos The start of the scratch area for the flash tests
+ * @param scratchLen The length of the scratch area, or 0 to skip the flash tests
+ * @return True on success, false on failure
+ */
+static bool Bench_SelfBenchmark(BenchLink *link, FILE *out, bool simulated, char const *chips,
+		uint32_t scratchPos, uint32_t scratchLen)
+{
+	uint8_t reply;
+	uint8_t usbData[4096];
+	uint8_t numTests;
+	uint32_t iterations[NumSelfBenchmarkTests] = {0};
+	uint32_t totalUS[NumSelfBenchmarkTests] = {0};
+
+	// The flash driver needs to know the chips to find the scratch area's sectors
+	if (!Bench_Identify(link, NULL) ||
+		!Bench_SendByte(link, SelfBenchmark) ||
+		!Bench_Receive(link, &reply, 1))
+	{
+		return false;
+	}
+	if (reply != CommandReplyOK)
+	{
+		fprintf(stderr, "The firmware doesn't have the self benchmark. Build it with -DSIMM_SELF_BENCHMARK=ON.\n");
+		return false;
+	}
+	if (!Bench_SendLong(link, scratchPos) ||
+		!Bench_SendLong(link, scratchLen) ||
+		!Bench_Receive(link, usbData, sizeof(usbData)) ||
+		!Bench_Receive(link, &numTests, 1))
+	{
+		return false;
+	}
+
+	// Newer firmware might have more tests than we know about
+	for (uint8_t i = 0; i < numTests; i++)
+	{
+		uint32_t count, us;
+		if (!Bench_ReceiveLong(link, &count) ||
+			!Bench_ReceiveLong(link, &us))
+		{
+			return false;
+		}
+		if (i < NumSelfBenchmarkTests)
+		{
+			iterations[i] = count;
+			totalUS[i] = us;
+		}
+	}
+	if (!Bench_Receive(link, &reply, 1))
+	{
+		return false;
+	}
+
+	fprintf(out, "{\n");
+	fprintf(out, "  \"target\": \"%s\",\n", simulated ? "sim" : "device");
+	if (chips)
+	{
+		fprintf(out, "  \"chips\": \"%s\",\n", chips);
+	}
+	fprintf(out, "  \"chip_ids\": [");
+	for (int i = 0; i < 4; i++)
+	{
+		fprintf(out, "%s\"%02X%02X\"", i ? ", " : "", chipIDs[2*i], chipIDs[2*i + 1]);
+	}
+	fprintf(out, "],\n");
+	fprintf(out, "  \"self_benchmark\": {\n");
+	for (int i = 0; i < NumSelfBenchmarkTests; i++)
+	{
+		if (iterations[i])
+		{
+			fprintf(out, "    \"%s\": {\"iterations\": %u, \"total_us\": %u, \"us_each\": %.3f},\n",
+					selfBenchmarkNames[i], iterations[i], totalUS[i], (double)totalUS[i] / iterations[i]);
+		}
+	}
+	fprintf(out, "    \"scratch_ok\": %s\n  }\n}", (reply == ProgrammerSelfBenchmarkDone) ? "true" : "false");
+
+	if (reply != ProgrammerSelfBenchmarkDone)
+	{
+		fprintf(stderr, "The scratch area couldn't be erased and programmed\n");
+		return false;
+	}
+	return true;
+}
+
+/** Sets which chips the following commands affect
+ *
+ * @param link The programmer
+ * @param mask The chips mask, bit 0 = IC4 through bit 3 = IC1
+ * @return True on success, false on failure
+ */
+static bool Bench_SetChipsMask(BenchLink *link, uint8_t mask)
+{
+	return Bench_Command(link, SetChipsMask) &&
+		   Bench_SendByte(link, mask) &&
+		   Bench_Expect(link, CommandReplyOK);
+}
+
+/** Writes the image to the SIMM
+ *
+ * @param link The programmer
+ * @param verify True if the programmer should verify while writing
+ * @return True on success, false on failure
+ */
+static bool Bench_WriteImage(BenchLink *link, bool verify)
+{
+	if (!Bench_Command(link, verify ? SetVerifyWhileWriting : SetNoVerifyWhileWriting) ||
+		!Bench_Command(link, WriteChips))
+	{
+		return false;
+	}
+
+	for (uint32_t pos = 0; pos < imageSize; pos += CHUNK_SIZE)
+	{
+		uint8_t reply;
+		if (!Bench_SendByte(link, ComputerWriteMore) ||
+			!Bench_Expect(link, ProgrammerWriteOK) ||
+			!Bench_Send(link, image + pos, CHUNK_SIZE) ||
+			!Bench_Receive(link, &reply, 1))
+		{
+			return false;
+		}
+
+		if (reply != ProgrammerWriteOK)
+		{
+			fprintf(stderr, "Write failed at 0x%X with reply 0x%02X\n", pos, reply);
+			// Get back to waiting for a command
+			Bench_SendByte(link, ComputerWriteCancel);
+			Bench_Expect(link, ProgrammerWriteConfirmCancel);
+			return false;
+		}
+	}
+
+	return Bench_SendByte(link, ComputerWriteFinish) &&
+		   Bench_Expect(link, ProgrammerWriteOK);
+}
+
+/** Reads the IDs of the chips
+ *
+ * @param link The programmer
+ * @param phase The phase being measured
+ * @return True on success, false on failure
+ */
+static bool Bench_Identify(BenchLink *link, BenchPhase *phase)
+{
+	(void)phase;
+	return Bench_Command(link, IdentifyChips) &&
+		   Bench_Receive(link, chipIDs, sizeof(chipIDs)) &&
+		   Bench_Expect(link, ProgrammerIdentifyDone);
+}
+
+/** Erases the whole SIMM
+ *
+ * @param link The programmer
+ * @param phase The phase being measured
+ * @return True on success, false on failure
+ */
+static bool Bench_Erase(BenchLink *link, BenchPhase *phase)
+{
+	(void)phase;
+	return Bench_Command(link, EraseChips);
+}
+
+/** Writes the image without verifying
+ *
+ * @param link The programmer
+ * @param phase The phase being measured
+ * @return True on success, false on failure
+ */
+static bool Bench_Write(BenchLink *link, BenchPhase *phase)
+{
+	phase->bytes = phase->flashBytes = imageSize;
+	return Bench_WriteImage(link, false);
+}
+
+/** Reads the image back and checks it
+ *
+ * @param link The programmer
+ * @param phase The phase being measured
+ * @return True if the read worked and matched the image, false otherwise
+ */
+static bool Bench_Dump(BenchLink *link, BenchPhase *phase)
+{
+	phase->bytes = phase->flashBytes = imageSize;
+	if (!Bench_Command(link, ReadChips) ||
+		!Bench_SendLong(link, imageSize) ||
+		!Bench_Expect(link, ProgrammerReadOK))
+	{
+		return false;
+	}
+
+	for (uint32_t pos = 0; pos < imageSize; pos += CHUNK_SIZE)
+	{
+		if (!Bench_Receive(link, readBack + pos, CHUNK_SIZE) ||
+			!Bench_SendByte(link, ComputerReadOK) ||
+			!Bench_Expect(link, (pos + CHUNK_SIZE < imageSize) ?
+					ProgrammerReadMoreData : ProgrammerReadFinished))
+		{
+			return false;
+		}
+	}
+
+	if (memcmp(image, readBack, imageSize))
+	{
+		fprintf(stderr, "Data read back doesn't match what was written\n");
+		return false;
+	}
+	return true;
+}
+
+/** Erases the start of the SIMM
+ *
+ * @param link The programmer
+ * @param phase The phase being measured
+ * @return True on success, false on failure
+ */
+static bool Bench_ErasePortion(BenchLink *link, BenchPhase *phase)
+{
+	phase->flashBytes = portionSize;
+	return Bench_Command(link, ErasePortion) &&
+		   Bench_SendLong(link, 0) &&
+		   Bench_SendLong(link, portionSize) &&
+		   Bench_Expect(link, ProgrammerErasePortionOK) &&
+		   Bench_Expect(link, ProgrammerErasePortionFinished);
+}
+
+/** Writes the image while verifying
+ *
+ * @param link The programmer
+ * @param phase The phase being measured
+ * @return True on success, false on failure
+ */
+static bool Bench_WriteVerify(BenchLink *link, BenchPhase *phase)
+{
+	phase->bytes = phase->flashBytes = imageSize;
+	return Bench_WriteImage(link, true);
+}
+
+/** Writes the image to only one chip, like when replacing a single bad chip
+ *
+ * @param link The programmer
+ * @param phase The phase being measured
+ * @return True on success, false on failure
+ */
+static bool Bench_WriteMasked(BenchLink *link, BenchPhase *phase)
+{
+	phase->bytes = imageSize;
+	phase->flashBytes = imageSize / 4;
+	bool const ok = Bench_WriteImage(link, true);
+	return Bench_SetChipsMask(link, ALL_CHIPS) && ok;
+}
+
+/** Saves the status of a request made with the pipelined client
+ *
+ * @param client The client
+ * @param request The request that finished
+ * @param context Where to save its status
+ */
+static void Bench_ClientDone(SIMMClient *client, SIMMClientRequest const *request, void *context)
+{
+	(void)client;
+	*(SIMMClientStatus *)context = request->status;
+}
+
+/** Writes the image without verifying, using the pipelined client
+ *
+ * @param link The programmer
+ * @param phase The phase being measured
+ * @return True on success, false on failure
+ */
+static bool Bench_WritePipelined(BenchLink *link, BenchPhase *phase)
+{
+	SIMMClientStatus verifyStatus = SIMMClientLinkError;
+	SIMMClientStatus writeStatus = SIMMClientLinkError;
+
+	phase->bytes = phase->flashBytes = imageSize;
+	SIMMClient *client = SIMMClient_Attach(link->fd);
+	if (!client)
+	{
+		return false;
+	}
+
+	bool const ok = SIMMClient_SetVerify(client, false, Bench_ClientDone, &verifyStatus) &&
+					SIMMClient_Write(client, 0, image, imageSize, Bench_ClientDone, &writeStatus) &&
+					SIMMClient_Wait(client);
+	link->roundTrips += SIMMClient_Stats(client)->stalls;
+	SIMMClient_Close(client);
+
+	if (ok && writeStatus != SIMMClientOK)
+	{
+		fprintf(stderr, "Pipelined write failed with status %d\n", writeStatus);
+	}
+	return ok && verifyStatus == SIMMClientOK && writeStatus == SIMMClientOK;
+}
+
+/** Reads the image back and checks it, using the pipelined client
+ *
+ * @param link The programmer
+ * @param phase The phase being measured
+ * @return True if the read worked and matched the image, false otherwise
+ */
+static bool Bench_DumpPipelined(BenchLink *link, BenchPhase *phase)
+{
+	SIMMClientStatus readStatus = SIMMClientLinkError;
+
+	phase->bytes = phase->flashBytes = imageSize;
+	memset(readBack, 0, imageSize);
+	SIMMClient *client = SIMMClient_Attach(link->fd);
+	if (!client)
+	{
+		return false;
+	}
+
+	bool const ok = SIMMClient_Read(client, 0, readBack, imageSize, Bench_ClientDone, &readStatus) &&
+					SIMMClient_Wait(client);
+	link->roundTrips += SIMMClient_Stats(client)->stalls;
+	SIMMClient_Close(client);
+
+	if (!ok || readStatus != SIMMClientOK)
+	{
+		return false;
+	}
+	if (memcmp(image, readBack, imageSize))
+	{
+		fprintf(stderr, "Data read back doesn't match what was written\n");
+		return false;
+	}
+	return true;
+}
+
+/** Erases the whole SIMM before a phase
+ *
+ * @param link The programmer
+ * @return True on success, false on failure
+ */
+static bool Bench_SetupErased(BenchLink *link)
+{
+	return Bench_Command(link, EraseChips);
+}
+
+/** Erases one chip and selects only it before a phase
+ *
+ * @param link The programmer
+ * @return True on success, false on failure
+ */
+static bool Bench_SetupMasked(BenchLink *link)
+{
+	return Bench_SetChipsMask(link, MASKED_CHIPS) &&
+		   Bench_Command(link, EraseChips);
+}
+
+/** Copies the simulator's statistics
+ *
+ * @param link The programmer
+ * @param stats Where to put the copy
+ */
+static void Bench_SnapshotStats(BenchLink const *link, FlashSimStats *stats)
+{
+	if (link->stats)
+	{
+		stats->timeNS = link->stats->timeNS;
+		stats->busyNS = link->stats->busyNS;
+		stats->readCycles = link->stats->readCycles;
+		stats->writeCycles = link->stats->writeCycles;
+		stats->statusReads = link->stats->statusReads;
+		stats->directionChanges = link->stats->directionChanges;
+	}
+	else
+	{
+		memset(stats, 0, sizeof(*stats));
+	}
+}
+
+/** Runs and measures one phase
+ *
+ * @param link The programmer
+ * @param def The phase to run
+ * @param phase Filled in with the measurements
+ * @return True if the phase succeeded
+ */
+static bool Bench_RunPhase(BenchLink *link, BenchPhaseDef const *def, BenchPhase *phase)
+{
+	FlashSimStats before;
+	FlashSimStats after;
+
+	memset(phase, 0, sizeof(*phase));
+	phase->name = def->name;
+	if (def->setup && !def->setup(link))
+	{
+		fprintf(stderr, "Unable to set up for %s\n", def->name);
+		return false;
+	}
+
+	if (link->firmwareStats && !Bench_ResetFirmwareStats(link))
+	{
+		return false;
+	}
+
+	uint64_t const roundTrips = link->roundTrips;
+	Bench_SnapshotStats(link, &before);
+	double const start = Bench_Seconds();
+	phase->ok = def->run(link, phase);
+	phase->wallS = Bench_Seconds() - start;
+	Bench_SnapshotStats(link, &after);
+	uint64_t const phaseRoundTrips = link->roundTrips - roundTrips;
+
+	if (phase->ok && link->firmwareStats && !Bench_GetFirmwareStats(link, &phase->firmware))
+	{
+		return false;
+	}
+
+	phase->roundTrips = phaseRoundTrips;
+	phase->sim.timeNS = after.timeNS - before.timeNS;
+	phase->sim.busyNS = after.busyNS - before.busyNS;
+	phase->sim.readCycles = after.readCycles - before.readCycles;
+	phase->sim.writeCycles = after.writeCycles - before.writeCycles;
+	phase->sim.statusReads = after.statusReads - before.statusReads;
+	phase->sim.directionChanges = after.directionChanges - before.directionChanges;
+	return phase->ok;
+}
+
+/** Starts the simulated programmer
+ *
+ * @param link Filled in with the connection to it
+ * @param simPath The simulator program, or NULL to look next to this program
+ * @param chips The simulated chips (see SIMM_SIM_CHIPS), or NULL for the default
+ * @return True on success, false on failure
+ */
+static bool Bench_StartSim(BenchLink *link, char const *simPath, char const *chips)
+{
+	char defaultPath[4096];
+	int sockets[2];
+
+	if (!simPath)
+	{
+		ssize_t const len = readlink("/proc/self/exe", defaultPath, sizeof(defaultPath) - 1);
+		if (len <= 0)
+		{
+			perror("Unable to find the simulator");
+			return false;
+		}
+		defaultPath[len] = '\0';
+		char *slash = strrchr(defaultPath, '/');
+		snprintf(slash + 1, sizeof(defaultPath) - (size_t)(slash + 1 - defaultPath), "SIMMProgrammer.elf");
+		simPath = defaultPath;
+	}
+
+	int const statsFd = memfd_create("simm-sim-stats", 0);
+	if (statsFd < 0 || ftruncate(statsFd, sizeof(FlashSimStats)) < 0)
+	{
+		perror("Unable to create shared statistics");
+		return false;
+	}
+	void *stats = mmap(NULL, sizeof(FlashSimStats), PROT_READ, MAP_SHARED, statsFd, 0);
+	if (stats == MAP_FAILED)
+	{
+		perror("Unable to map shared statistics");
+		return false;
+	}
+	link->stats = stats;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) < 0)
+	{
+		perror("Unable to create socket for simulator");
+		return false;
+	}
+
+	link->simPid = fork();
+	if (link->simPid < 0)
+	{
+		perror("Unable to start simulator");
+		return false;
+	}
+	else if (link->simPid == 0)
+	{
+		char fdString[16];
+		close(sockets[0]);
+		snprintf(fdString, sizeof(fdString), "%d", sockets[1]);
+		setenv("SIMM_SIM_FD", fdString, 1);
+		snprintf(fdString, sizeof(fdString), "%d", statsFd);
+		setenv("SIMM_SIM_STATS_FD", fdString, 1);
+		if (chips)
+		{
+			setenv("SIMM_SIM_CHIPS", chips, 1);
+		}
+		execl(simPath, simPath, (char *)NULL);
+		fprintf(stderr, "Unable to run %s: %s\n", simPath, strerror(errno));
+		_exit(1);
+	}
+
+	close(sockets[1]);
+	close(statsFd);
+	link->fd = sockets[0];
+	return true;
+}
+
+/** Opens a real programmer's serial port
+ *
+ * @param link Filled in with the connection to it
+ * @param device The serial port
+ * @return True on success, false on failure
+ */
+static bool Bench_OpenDevice(BenchLink *link, char const *device)
+{
+	struct termios tio;
+
+	link->fd = open(device, O_RDWR | O_NOCTTY);
+	if (link->fd < 0 || tcgetattr(link->fd, &tio) < 0)
+	{
+		fprintf(stderr, "Unable to open %s: %s\n", device, strerror(errno));
+		return false;
+	}
+	cfmakeraw(&tio);
+	tcsetattr(link->fd, TCSANOW, &tio);
+	tcflush(link->fd, TCIOFLUSH);
+
+	// Make sure the programmer isn't halfway through something
+	return Bench_Command(link, EnterWaitingMode);
+}
+
+/** Closes the connection, and waits for the simulator to exit if we started it
+ *
+ * @param link The programmer
+ */
+static void Bench_Close(BenchLink *link)
+{
+	close(link->fd);
+	if (link->simPid > 0)
+	{
+		waitpid(link->simPid, NULL, 0);
+		munmap((void *)link->stats, sizeof(FlashSimStats));
+		link->stats = NULL;
+	}
+}
+
+/** Fills the image with a test pattern
+ *
+ * @param pattern random, zeros, ones or ramp
+ * @param seed Seed for the random pattern
+ * @return True on success, false if the pattern is unknown
+ */
+static bool Bench_FillImage(char const *pattern, uint32_t seed)
+{
+	uint32_t x = seed ? seed : 1;
+	for (uint32_t i = 0; i < imageSize; i++)
+	{
+		if (!strcmp(pattern, "random"))
+		{
+			// xorshift32
+			x ^= x << 13;
+			x ^= x >> 17;
+			x ^= x << 5;
+			image[i] = (uint8_t)x;
+		}
+		else if (!strcmp(pattern, "zeros"))
+		{
+			image[i] = 0x00;
+		}
+		else if (!strcmp(pattern, "ones"))
+		{
+			image[i] = 0xFF;
+		}
+		else if (!strcmp(pattern, "ramp"))
+		{
+			image[i] = (uint8_t)i;
+		}
+		else
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/** Parses a size with an optional K or M suffix
+ *
+ * @param s The string
+ * @param size Filled in with the size in bytes
+ * @return True if it's valid, false otherwise
+ */
+static bool Bench_ParseSize(char const *s, uint32_t *size)
+{
+	char *end;
+	unsigned long value = strtoul(s, &end, 0);
+	if (*end == 'K' || *end == 'k')
+	{
+		value *= 1024UL;
+		end++;
+	}
+	else if (*end == 'M' || *end == 'm')
+	{
+		value *= 1024UL * 1024UL;
+		end++;
+	}
+	if (end == s || *end || value > MAX_SIMM_SIZE)
+	{
+		return false;
+	}
+	*size = (uint32_t)value;
+	return true;
+}
+
+/** Determines if a phase was asked for
+ *
+ * @param phaseList Comma-separated list of phases, or NULL for all of them
+ * @param name The phase
+ * @return True if the phase should run
+ */
+static bool Bench_PhaseWanted(char const *phaseList, char const *name)
+{
+	if (!phaseList)
+	{
+		return true;
+	}
+
+	size_t const len = strlen(name);
+	for (char const *p = strstr(phaseList, name); p; p = strstr(p + 1, name))
+	{
+		if ((p == phaseList || p[-1] == ',') && (p[len] == ',' || p[len] == '\0'))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+/** Runs every phase that was asked for, stopping at the first failure
+ *
+ * @param link The programmer
+ * @param phaseList Comma-separated list of phases, or NULL for all of them
+ * @param phases Filled in with the measurements
+ * @param numPhases Filled in with the number of phases that ran
+ * @return True if they all succeeded
+ */
+static bool Bench_RunPhases(BenchLink *link, char const *phaseList, BenchPhase *phases, uint32_t *numPhases)
+{
+	bool ok = true;
+
+	memset(chipIDs, 0, sizeof(chipIDs));
+	*numPhases = 0;
+	if (!Bench_ResetFirmwareStats(link) ||
+		!Bench_ResetHealthMap(link))
+	{
+		return false;
+	}
+
+	for (uint32_t i = 0; i < NUM_PHASES && ok; i++)
+	{
+		if (Bench_PhaseWanted(phaseList, phaseDefs[i].name))
+		{
+			ok = Bench_RunPhase(link, &phaseDefs[i], &phases[(*numPhases)++]);
+		}
+	}
+	if (ok && health.valid)
+	{
+		ok = Bench_GetHealthMap(link);
+	}
+	return ok;
+}
+
+/** Gets one of the simulator's counts for a phase
+ *
+ * @param phase The phase
+ * @param metric The count's name. Counts can have _per_byte added to the end
+ *               to divide them by the number of bytes the flash chips touched.
+ * @param value Filled in with the count
+ * @return True on success, false if the metric doesn't exist for this phase
+ */
+static bool Bench_Metric(BenchPhase const *phase, char const *metric, double *value)
+{
+	static const char perByte[] = "_per_byte";
+	char name[32];
+	size_t len = strlen(metric);
+	bool divide = false;
+
+	if (len > sizeof(perByte) - 1 && !strcmp(metric + len - (sizeof(perByte) - 1), perByte))
+	{
+		len -= sizeof(perByte) - 1;
+		divide = true;
+	}
+	if (len >= sizeof(name))
+	{
+		return false;
+	}
+	memcpy(name, metric, len);
+	name[len] = '\0';
+
+	if (!strcmp(name, "read_cycles")) *value = phase->sim.readCycles;
+	else if (!strcmp(name, "write_cycles")) *value = phase->sim.writeCycles;
+	else if (!strcmp(name, "bus_cycles")) *value = phase->sim.readCycles + phase->sim.writeCycles;
+	else if (!strcmp(name, "status_reads")) *value = phase->sim.statusReads;
+	else if (!strcmp(name, "direction_changes")) *value = phase->sim.directionChanges;
+	else if (!strcmp(name, "virtual_s") && !divide) *value = phase->sim.timeNS / 1e9;
+	else if (!strcmp(name, "flash_wait_s") && !divide) *value = phase->sim.busyNS / 1e9;
+	else return false;
+
+	if (divide)
+	{
+		if (!phase->flashBytes)
+		{
+			return false;
+		}
+		*value /= phase->flashBytes;
+	}
+	return true;
+}
+
+/** Loads a budgets file
+ *
+ * @param path The file
+ * @param budgets Filled in with the budgets
+ * @return The number of budgets, or -1 on error
+ *
+ * Each line is the simulated chips (like SIMM_SIM_CHIPS), a phase, a metric
+ * (see Bench_Metric) and the highest value allowed, separated by whitespace.
+ * Blank lines and lines starting with # are ignored.
+ */
+static int Bench_LoadBudgets(char const *path, BenchBudget *budgets)
+{
+	char line[256];
+	int numBudgets = 0;
+	int lineNum = 0;
+
+	FILE *f = fopen(path, "r");
+	if (!f)
+	{
+		fprintf(stderr, "Unable to open %s: %s\n", path, strerror(errno));
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), f))
+	{
+		BenchBudget *b = &budgets[numBudgets];
+		char extra;
+		lineNum++;
+
+		char const *p = line + strspn(line, " \t\r\n");
+		if (*p == '#' || *p == '\0')
+		{
+			continue;
+		}
+
+		memset(b, 0, sizeof(*b));
+		if (numBudgets >= MAX_BUDGETS ||
+			sscanf(p, "%127s %31s %31s %lf %c", b->chips, b->phase, b->metric, &b->limit, &extra) != 4)
+		{
+			fprintf(stderr, "%s:%d: expected chips, phase, metric and limit\n", path, lineNum);
+			fclose(f);
+			return -1;
+		}
+		numBudgets++;
+	}
+
+	fclose(f);
+	return numBudgets;
+}
+
+/** Checks the budgets for one chip configuration against what was measured
+ *
+ * @param budgets The budgets
+ * @param numBudgets The number of budgets
+ * @param chips The chip configuration that was measured
+ * @param phaseList The phases that were asked for, or NULL for all of them
+ * @param phases The measured phases
+ * @param numPhases The number of phases that ran
+ * @return True if everything was within budget
+ */
+static bool Bench_CheckBudgets(BenchBudget *budgets, int numBudgets, char const *chips,
+		char const *phaseList, BenchPhase const *phases, uint32_t numPhases)
+{
+	bool ok = true;
+
+	for (int i = 0; i < numBudgets; i++)
+	{
+		BenchBudget *b = &budgets[i];
+		b->skipped = !Bench_PhaseWanted(phaseList, b->phase);
+		if (strcmp(b->chips, chips) || b->skipped)
+		{
+			continue;
+		}
+
+		for (uint32_t j = 0; j < numPhases && !b->measured; j++)
+		{
+			if (!strcmp(phases[j].name, b->phase) && phases[j].ok)
+			{
+				b->measured = Bench_Metric(&phases[j], b->metric, &b->value);
+			}
+		}
+
+		b->ok = b->measured && b->value <= b->limit;
+		if (!b->measured)
+		{
+			fprintf(stderr, "%s %s: no %s measured\n", b->chips, b->phase, b->metric);
+		}
+		else if (!b->ok)
+		{
+			fprintf(stderr, "%s %s: %s is %.3f, over the budget of %.3f\n",
+					b->chips, b->phase, b->metric, b->value, b->limit);
+		}
+		ok = ok && b->ok;
+	}
+
+	return ok;
+}
+
+/** Prints the health map, and points out the slowest chip
+ *
+ * @param out Where to print it
+ */
+static void Bench_PrintHealthJSON(FILE *out)
+{
+	double programUSPerByte[4] = {0};
+	double sectorEraseMS[4] = {0};
+	double sectorEraseMaxMS[4] = {0};
+	uint32_t sectorsErased[4] = {0};
+
+	for (int i = 0; i < 4; i++)
+	{
+		if (health.programBytes[i])
+		{
+			programUSPerByte[i] = (double)health.programTotalUS[i] / health.programBytes[i];
+		}
+		for (uint16_t s = 0; s < health.numSectors; s++)
+		{
+			double const ms = health.sectorErase[s * 4 + i] / 10.0;
+			if (ms > 0)
+			{
+				sectorEraseMS[i] += ms;
+				sectorsErased[i]++;
+				if (ms > sectorEraseMaxMS[i])
+				{
+					sectorEraseMaxMS[i] = ms;
+				}
+			}
+		}
+		if (sectorsErased[i])
+		{
+			sectorEraseMS[i] /= sectorsErased[i];
+		}
+	}
+
+	fprintf(out, ",\n  \"health\": {\n    \"chips\": [\n");
+	for (int i = 0; i < 4; i++)
+	{
+		fprintf(out, "      {\"ic\": %d, \"program_ops\": %u, \"program_bytes\": %u, "
+				"\"program_us_per_byte\": %.3f, \"program_max_us\": %u, \"chip_erase_ms\": %.3f, "
+				"\"sectors_erased\": %u, \"sector_erase_avg_ms\": %.1f, \"sector_erase_max_ms\": %.1f}%s\n",
+				i + 1, health.programOps[i], health.programBytes[i], programUSPerByte[i],
+				health.programMaxUS[i], health.chipEraseUS[i] / 1000.0, sectorsErased[i],
+				sectorEraseMS[i], sectorEraseMaxMS[i], (i < 3) ? "," : "");
+	}
+	fprintf(out, "    ]");
+
+	// One slow chip holds up all the others, so point out the slowest chip
+	// and how much slower it is than the fastest one
+	double const *metrics[2] = {programUSPerByte, sectorEraseMS};
+	char const * const names[2] = {"program", "sector_erase"};
+	for (int m = 0; m < 2; m++)
+	{
+		int slowest = -1;
+		int fastest = -1;
+		for (int i = 0; i < 4; i++)
+		{
+			if (metrics[m][i] > 0)
+			{
+				if (slowest < 0 || metrics[m][i] > metrics[m][slowest])
+				{
+					slowest = i;
+				}
+				if (fastest < 0 || metrics[m][i] < metrics[m][fastest])
+				{
+					fastest = i;
+				}
+			}
+		}
+		if (slowest >= 0)
+		{
+			fprintf(out, ",\n    \"slowest_%s_ic\": %d, \"%s_spread\": %.3f",
+					names[m], slowest + 1, names[m], metrics[m][slowest] / metrics[m][fastest]);
+		}
+	}
+
+	fprintf(out, ",\n    \"sector_erase_ms\": [");
+	bool first = true;
+	for (uint16_t s = 0; s < health.numSectors; s++)
+	{
+		uint16_t const *t = &health.sectorErase[s * 4];
+		if (t[0] || t[1] || t[2] || t[3])
+		{
+			fprintf(out, "%s\n      {\"sector\": %u, \"ms\": [%.1f, %.1f, %.1f, %.1f]}", first ? "" : ",",
+					s, t[0] / 10.0, t[1] / 10.0, t[2] / 10.0, t[3] / 10.0);
+			first = false;
+		}
+	}
+	fprintf(out, "%s]\n  }", first ? "" : "\n    ");
+}
+
+/** Prints the results of a run as JSON
+ *
+ * @param out Where to print them
+ * @param simulated True if the results came from the simulator
+ * @param chips The simulated chips, or NULL for the default or a real programmer
+ * @param pattern The name of the test pattern
+ * @param phases The measured phases
+ * @param numPhases The number of phases that ran
+ * @param budgets The budgets to print the results of, or NULL
+ * @param numBudgets The number of budgets
+ */
+static void Bench_PrintJSON(FILE *out, bool simulated, char const *chips, char const *pattern,
+		BenchPhase const *phases, uint32_t numPhases, BenchBudget const *budgets, int numBudgets)
+{
+	fprintf(out, "{\n");
+	fprintf(out, "  \"target\": \"%s\",\n", simulated ? "sim" : "device");
+	if (chips)
+	{
+		fprintf(out, "  \"chips\": \"%s\",\n", chips);
+	}
+	fprintf(out, "  \"size\": %u,\n", imageSize);
+	fprintf(out, "  \"pattern\": \"%s\",\n", pattern);
+	fprintf(out, "  \"chip_ids\": [");
+	for (int i = 0; i < 4; i++)
+	{
+		fprintf(out, "%s\"%02X%02X\"", i ? ", " : "", chipIDs[2*i], chipIDs[2*i + 1]);
+	}
+	fprintf(out, "],\n");
+	fprintf(out, "  \"phases\": [\n");
+	for (uint32_t i = 0; i < numPhases; i++)
+	{
+		BenchPhase const *p = &phases[i];
+		fprintf(out, "    {\"name\": \"%s\", \"ok\": %s, \"bytes\": %u, \"wall_s\": %.6f, "
+				"\"mb_per_s\": %.3f, \"round_trips\": %llu",
+				p->name, p->ok ? "true" : "false", p->bytes, p->wallS,
+				(p->bytes && p->wallS > 0) ? p->bytes / p->wallS / 1e6 : 0.0,
+				(unsigned long long)p->roundTrips);
+		if (simulated)
+		{
+			uint64_t const cycles = p->sim.readCycles + p->sim.writeCycles;
+			fprintf(out, ", \"sim\": {\"virtual_s\": %.6f, \"flash_wait_s\": %.6f, "
+					"\"read_cycles\": %llu, \"write_cycles\": %llu, \"status_reads\": %llu, "
+					"\"direction_changes\": %llu, \"bus_cycles_per_byte\": %.3f}",
+					p->sim.timeNS / 1e9, p->sim.busyNS / 1e9,
+					(unsigned long long)p->sim.readCycles, (unsigned long long)p->sim.writeCycles,
+					(unsigned long long)p->sim.statusReads, (unsigned long long)p->sim.directionChanges,
+					p->flashBytes ? (double)cycles / p->flashBytes : 0.0);
+		}
+		if (p->firmware.valid)
+		{
+			fprintf(out, ", \"firmware\": {");
+			for (int t = 0; t < NumStatsTimers; t++)
+			{
+				fprintf(out, "\"%s\": {\"count\": %u, \"total_us\": %u, \"max_us\": %u}, ",
+						firmwareTimerNames[t], p->firmware.count[t], p->firmware.totalUS[t], p->firmware.maxUS[t]);
+			}
+			fprintf(out, "\"polls\": %u, \"max_polls\": %u}", p->firmware.totalPolls, p->firmware.maxPolls);
+		}
+		fprintf(out, "}%s\n", (i + 1 < numPhases) ? "," : "");
+	}
+	fprintf(out, "  ]");
+
+	if (budgets)
+	{
+		bool first = true;
+		fprintf(out, ",\n  \"budgets\": [\n");
+		for (int i = 0; i < numBudgets; i++)
+		{
+			BenchBudget const *b = &budgets[i];
+			if (chips && !strcmp(b->chips, chips) && !b->skipped)
+			{
+				fprintf(out, "%s    {\"phase\": \"%s\", \"metric\": \"%s\", \"value\": %.3f, "
+						"\"limit\": %.3f, \"ok\": %s}", first ? "" : ",\n",
+						b->phase, b->metric, b->value, b->limit, b->ok ? "true" : "false");
+				first = false;
+			}
+		}
+		fprintf(out, "\n  ]");
+	}
+	if (health.valid)
+	{
+		Bench_PrintHealthJSON(out);
+	}
+	fprintf(out, "\n}");
+}
+
+/** Prints how to use the benchmark
+ *
+ * @param name The program's name
+ */
+static void Bench_Usage(char const *name)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  --device PATH    benchmark a real programmer on this serial port\n"
+		"  --sim PATH       simulator to run (default: SIMMProgrammer.elf next to this program)\n"
+		"  --chips CHIPS    simulated chips, like SIMM_SIM_CHIPS\n"
+		"  --size SIZE      bytes to write and read, multiple of 1K (default 2M)\n"
+		"  --portion SIZE   bytes for the erase_portion phase (default 256K)\n"
+		"  --pattern NAME   random, zeros, ones or ramp (default random)\n"
+		"  --seed N         seed for the random pattern (default 1)\n"
+		"  --phases LIST    comma-separated phases to run (default all):\n"
+		"                   identify,erase,write,dump,erase_portion,write_verify,write_masked,\n"
+		"                   write_pipelined,dump_pipelined\n"
+		"  --check-budgets FILE\n"
+		"                   run every chip configuration in FILE on the simulator,\n"
+		"                   and fail if any count is over its budget\n"
+		"  --output FILE    write the JSON here instead of stdout\n"
+		"  --trace FILE     save the firmware's event trace of the run here\n"
+		"  --self-benchmark run the firmware's own benchmark instead\n"
+		"  --scratch POS,LEN\n"
+		"                   area of the SIMM the self benchmark can erase and program\n"
+		"                   (default: skip its flash tests)\n",
+		name);
+}
+
+int main(int argc, char *argv[])
+{
+	static const struct option options[] = {
+		{"device", required_argument, NULL, 'd'},
+		{"sim", required_argument, NULL, 's'},
+		{"chips", required_argument, NULL, 'c'},
+		{"size", required_argument, NULL, 'z'},
+		{"portion", required_argument, NULL, 'p'},
+		{"pattern", required_argument, NULL, 't'},
+		{"seed", required_argument, NULL, 'r'},
+		{"phases", required_argument, NULL, 'f'},
+		{"check-budgets", required_argument, NULL, 'b'},
+		{"output", required_argument, NULL, 'o'},
+		{"trace", required_argument, NULL, 'T'},
+		{"self-benchmark", no_argument, NULL, 'S'},
+		{"scratch", required_argument, NULL, 'x'},
+		{"help", no_argument, NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+	static BenchBudget budgets[MAX_BUDGETS];
+	char const *device = NULL;
+	char const *simPath = NULL;
+	char const *chips = NULL;
+	char const *pattern = "random";
+	char const *phaseList = NULL;
+	char const *budgetsPath = NULL;
+	char const *outputPath = NULL;
+	char const *tracePath = NULL;
+	bool selfBenchmark = false;
+	uint32_t scratchPos = 0;
+	uint32_t scratchLen = 0;
+	uint32_t seed = 1;
+	int opt;
+
+	while ((opt = getopt_long(argc, argv, "h", options, NULL)) != -1)
+	{
+		switch (opt)
+		{
+		case 'd': device = optarg; break;
+		case 's': simPath = optarg; break;
+		case 'c': chips = optarg; break;
+		case 't': pattern = optarg; break;
+		case 'r': seed = (uint32_t)strtoul(optarg, NULL, 0); break;
+		case 'f': phaseList = optarg; break;
+		case 'b': budgetsPath = optarg; break;
+		case 'o': outputPath = optarg; break;
+		case 'T': tracePath = optarg; break;
+		case 'S': selfBenchmark = true; break;
+		case 'x':
+		{
+			char *comma = strchr(optarg, ',');
+			if (!comma || (*comma = '\0', !Bench_ParseSize(optarg, &scratchPos)) ||
+				!Bench_ParseSize(comma + 1, &scratchLen))
+			{
+				fprintf(stderr, "Invalid scratch area: %s\n", optarg);
+				return 1;
+			}
+			break;
+		}
+		case 'z':
+			if (!Bench_ParseSize(optarg, &imageSize) || !imageSize || (imageSize % CHUNK_SIZE))
+			{
+				fprintf(stderr, "Invalid size: %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'p':
+			if (!Bench_ParseSize(optarg, &portionSize) || !portionSize)
+			{
+				fprintf(stderr, "Invalid erase portion size: %s\n", optarg);
+				return 1;
+			}
+			break;
+		default:
+			Bench_Usage(argv[0]);
+			return (opt == 'h') ? 0 : 1;
+		}
+	}
+
+	// Budgets only make sense for the simulator, and each one says which
+	// chips it's for
+	int numBudgets = 0;
+	if (budgetsPath)
+	{
+		if (device || chips || tracePath || selfBenchmark)
+		{
+			fprintf(stderr, "--check-budgets runs the simulator with the chips in the budgets file\n");
+			return 1;
+		}
+		if ((numBudgets = Bench_LoadBudgets(budgetsPath, budgets)) < 0)
+		{
+			return 1;
+		}
+	}
+
+	image = malloc(imageSize);
+	readBack = malloc(imageSize);
+	if (!image || !readBack || !Bench_FillImage(pattern, seed))
+	{
+		fprintf(stderr, "Unable to create %s test image\n", pattern);
+		return 1;
+	}
+
+	FILE *out = stdout;
+	if (outputPath && !(out = fopen(outputPath, "w")))
+	{
+		fprintf(stderr, "Unable to open %s: %s\n", outputPath, strerror(errno));
+		return 1;
+	}
+
+	BenchPhase phases[NUM_PHASES];
+	uint32_t numPhases;
+	bool ok = true;
+	if (selfBenchmark)
+	{
+		BenchLink link = {-1, 0, NULL, 0, false, false};
+		if (device ? !Bench_OpenDevice(&link, device) : !Bench_StartSim(&link, simPath, chips))
+		{
+			return 1;
+		}
+		ok = Bench_SelfBenchmark(&link, out, !device, chips, scratchPos, scratchLen);
+		Bench_Close(&link);
+	}
+	else if (!budgetsPath)
+	{
+		BenchLink link = {-1, 0, NULL, 0, false, false};
+		if (device ? !Bench_OpenDevice(&link, device) : !Bench_StartSim(&link, simPath, chips))
+		{
+			return 1;
+		}
+
+		if (tracePath && !Bench_ClearTrace(&link))
+		{
+			return 1;
+		}
+		ok = Bench_RunPhases(&link, phaseList, phases, &numPhases);
+		if (tracePath)
+		{
+			ok = Bench_SaveTrace(&link, tracePath) && ok;
+		}
+		Bench_Close(&link);
+		Bench_PrintJSON(out, !device, chips, pattern, phases, numPhases, NULL, 0);
+	}
+	else
+	{
+		// Run each chip configuration in the file once, in the order they
+		// first appear
+		fprintf(out, "{\n\"runs\": [\n");
+		for (int i = 0; i < numBudgets; i++)
+		{
+			bool seen = false;
+			for (int j = 0; j < i && !seen; j++)
+			{
+				seen = !strcmp(budgets[i].chips, budgets[j].chips);
+			}
+			if (seen)
+			{
+				continue;
+			}
+
+			BenchLink link = {-1, 0, NULL, 0, false, false};
+			if (!Bench_StartSim(&link, simPath, budgets[i].chips))
+			{
+				return 1;
+			}
+			bool const runOK = Bench_RunPhases(&link, phaseList, phases, &numPhases);
+			Bench_Close(&link);
+			bool const budgetsOK = Bench_CheckBudgets(budgets, numBudgets, budgets[i].chips,
+					phaseList, phases, numPhases);
+			ok = ok && runOK && budgetsOK;
+
+			fprintf(out, "%s", i ? ",\n" : "");
+			Bench_PrintJSON(out, true, budgets[i].chips, pattern, phases, numPhases, budgets, numBudgets);
+		}
+		fprintf(out, "\n],\n\"budgets_ok\": %s\n}", ok ? "true" : "false");
+	}
+
+	fprintf(out, "\n");
+	if (out != stdout)
+	{
+		fclose(out);
+	}
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,1171 @@
+/*
+ * simm_client.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: SIMM Programmer contributors
+ *
+ * Copyright (C) 2026 SIMM Programmer contributors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * -----------------------------------------------------------------------------
+ *
+ * The protocol was designed to go one step at a time, so the computer can only
+ * send ahead when it knows how the programmer will reply. If the programmer
+ * replies differently, everything we sent ahead gets treated as commands, so
+ * this is careful about it:
+ *
+ * - Parameters are sent along with their command. Every firmware version
+ *   knows the commands that take parameters, and the parameters are checked
+ *   here first, so the programmer always accepts them.
+ * - Read acknowledgments are sent ahead, up to the window size, so the
+ *   programmer always has the next chunk's request waiting. We know exactly
+ *   how many chunks there are.
+ * - Write chunks are sent ahead the same way, but only after the programmer
+ *   has been told not to verify, because a verify error ends the write early.
+ *   Otherwise only one chunk is in flight, but the ComputerWriteMore and the
+ *   data still go together, which saves a round trip per chunk.
+ *
+ * Each request waits for the one before it to finish before it starts.
+ */
+
+#include "simm_client.h"
+#include "../programmer_protocol.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+/// Size of the chunks of data in reads and writes
+#define CHUNK_SIZE					1024
+/// The most a SIMM can hold
+#define MAX_SIMM_SIZE				(8 * 1024UL * 1024UL)
+/// How long to wait for the programmer to reply, by default
+#define DEFAULT_REPLY_TIMEOUT_MS	180000
+/// Room for everything we might send ahead: a full window of write chunks,
+/// plus a command with its parameters
+#define OUT_BUFFER_SIZE				((SIMM_CLIENT_MAX_WINDOW + 1) * (CHUNK_SIZE + 1) + 256)
+/// Most bytes to read at once
+#define IN_BUFFER_SIZE				4096
+
+/// A connection to a programmer
+struct SIMMClient
+{
+	int fd;
+	/// The file descriptor's flags before we made it non-blocking
+	int savedFlags;
+	/// True if we opened the file descriptor, so we close it too
+	bool ownsFD;
+	/// True after a link error; nothing more can be done
+	bool failed;
+	/// True while we're waiting for a reply with nothing to send
+	bool stalled;
+	/// True once the programmer has been told not to verify while writing
+	bool verifyOff;
+	uint32_t window;
+	int replyTimeoutMS;
+	/// Put in front of error messages, or NULL
+	char const *name;
+	/// When we last sent or received something
+	uint64_t lastActivityUS;
+	/// Queued requests, oldest (the one that's running) first
+	SIMMClientRequest *head;
+	SIMMClientRequest *tail;
+	/// Bytes waiting to be sent
+	uint8_t out[OUT_BUFFER_SIZE];
+	size_t outStart;
+	size_t outEnd;
+	SIMMClientTimingHook hook;
+	void *hookContext;
+	SIMMClientStats stats;
+};
+
+/** Gets the time from a monotonic clock
+ *
+ * @return The time in microseconds
+ */
+static uint64_t SIMMClient_Now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+/** Tells the timing hook about something
+ *
+ * @param client The client
+ * @param event What happened
+ * @param request The request it happened to, or NULL
+ */
+static void SIMMClient_Hook(SIMMClient *client, SIMMClientTimingEvent event, SIMMClientRequest const *request)
+{
+	if (client->hook)
+	{
+		client->hook(client, event, request, SIMMClient_Now(), client->hookContext);
+	}
+}
+
+/** Queues bytes to be sent, if there's room
+ *
+ * @param client The client
+ * @param data The bytes
+ * @param len The number of bytes
+ * @return True if they were queued, false if there isn't room yet
+ */
+static bool SIMMClient_QueueBytes(SIMMClient *client, void const *data, size_t len)
+{
+	if (OUT_BUFFER_SIZE - client->outEnd < len && client->outStart > 0)
+	{
+		memmove(client->out, client->out + client->outStart, client->outEnd - client->outStart);
+		client->outEnd -= client->outStart;
+		client->outStart = 0;
+	}
+	if (OUT_BUFFER_SIZE - client->outEnd < len)
+	{
+		return false;
+	}
+
+	memcpy(client->out + client->outEnd, data, len);
+	client->outEnd += len;
+	return true;
+}
+
+/** Stores a 32-bit little-endian value in a buffer
+ *
+ * @param p The buffer
+ * @param value The value
+ * @return The position after it
+ */
+static uint8_t *SIMMClient_PutLong(uint8_t *p, uint32_t value)
+{
+	for (int i = 0; i < 4; i++)
+	{
+		*p++ = (uint8_t)(value >> (8 * i));
+	}
+	return p;
+}
+
+/** Finishes the running request and calls its callback
+ *
+ * @param client The client
+ * @param status How it turned out
+ */
+static void SIMMClient_Finish(SIMMClient *client, SIMMClientStatus status)
+{
+	SIMMClientRequest *req = client->head;
+
+	client->head = req->next;
+	if (!client->head)
+	{
+		client->tail = NULL;
+	}
+
+	req->status = status;
+	req->doneUS = SIMMClient_Now();
+	if (!req->startUS)
+	{
+		req->startUS = req->doneUS;
+	}
+	if (req->type == SIMMClientSetVerify && status == SIMMClientOK)
+	{
+		client->verifyOff = !req->setting;
+	}
+
+	SIMMClient_Hook(client, SIMMClientRequestDone, req);
+	if (req->callback)
+	{
+		req->callback(client, req, req->context);
+	}
+	free(req);
+}
+
+/** Gives up on everything after a link error
+ *
+ * @param client The client
+ * @param why What went wrong
+ */
+static void SIMMClient_Fail(SIMMClient *client, char const *why)
+{
+	if (!client->failed && why)
+	{
+		if (client->name)
+		{
+			fprintf(stderr, "%s: ", client->name);
+		}
+		fprintf(stderr, "%s\n", why);
+	}
+	client->failed = true;
+	client->outStart = client->outEnd = 0;
+	while (client->head)
+	{
+		SIMMClient_Finish(client, SIMMClientLinkError);
+	}
+}
+
+/** Finishes the running request early because of the programmer's reply
+ *
+ * If we already sent more of the request, the programmer will treat it as
+ * commands, so there's no way to go on after that.
+ *
+ * @param client The client
+ * @param status How it turned out
+ * @param sentAhead True if more of the request was already sent
+ */
+static void SIMMClient_FinishEarly(SIMMClient *client, SIMMClientStatus status, bool sentAhead)
+{
+	SIMMClient_Finish(client, status);
+	if (sentAhead)
+	{
+		SIMMClient_Fail(client, "The programmer stopped a request that was already sent ahead");
+	}
+}
+
+/** Converts the programmer's reply to a command into a status
+ *
+ * @param reply The reply
+ * @return The status
+ */
+static SIMMClientStatus SIMMClient_ReplyStatus(uint8_t reply)
+{
+	switch (reply)
+	{
+	case CommandReplyOK: return SIMMClientOK;
+	case CommandReplyError: return SIMMClientError;
+	case CommandReplyInvalid: return SIMMClientInvalid;
+	default: return SIMMClientLinkError;
+	}
+}
+
+/** Queues as much of the running request as can safely be sent
+ *
+ * @param client The client
+ * @param req The running request
+ */
+static void SIMMClient_Stage(SIMMClient *client, SIMMClientRequest *req)
+{
+	uint32_t const chunks = req->length / CHUNK_SIZE;
+
+	if (!req->commandStarted)
+	{
+		uint8_t buf[2 + 8 + 8 * SIMM_CLIENT_MAX_SECTOR_GROUPS + 4];
+		uint8_t *p = buf;
+
+		switch (req->type)
+		{
+		case SIMMClientEnterWaitingMode: *p++ = EnterWaitingMode; break;
+		case SIMMClientElectricalTest: *p++ = DoElectricalTest; break;
+		case SIMMClientIdentify: *p++ = IdentifyChips; break;
+		case SIMMClientEraseChips: *p++ = EraseChips; break;
+		case SIMMClientGetFirmwareVersion: *p++ = GetFirmwareVersion; break;
+		case SIMMClientSetSIMMType:
+			*p++ = req->setting ? SetSIMMTypeLarger : SetSIMMTypePLCC32_2MB;
+			break;
+		case SIMMClientSetVerify:
+			*p++ = req->setting ? SetVerifyWhileWriting : SetNoVerifyWhileWriting;
+			break;
+		case SIMMClientSetChipsMask:
+			*p++ = SetChipsMask;
+			*p++ = req->setting;
+			break;
+		case SIMMClientErasePortion:
+			*p++ = ErasePortion;
+			p = SIMMClient_PutLong(p, req->address);
+			p = SIMMClient_PutLong(p, req->length);
+			break;
+		case SIMMClientSetSectorLayout:
+			*p++ = SetSectorLayout;
+			for (uint32_t i = 0; i < req->numGroups; i++)
+			{
+				p = SIMMClient_PutLong(p, req->layout[i][0]);
+				p = SIMMClient_PutLong(p, req->layout[i][1]);
+			}
+			p = SIMMClient_PutLong(p, 0);
+			break;
+		case SIMMClientWrite:
+			*p++ = WriteChipsAt;
+			p = SIMMClient_PutLong(p, req->address);
+			break;
+		case SIMMClientRead:
+			*p++ = ReadChipsAt;
+			p = SIMMClient_PutLong(p, req->address);
+			p = SIMMClient_PutLong(p, req->length);
+			break;
+		}
+
+		if (!SIMMClient_QueueBytes(client, buf, (size_t)(p - buf)))
+		{
+			return;
+		}
+		req->commandStarted = true;
+		req->startUS = SIMMClient_Now();
+		SIMMClient_Hook(client, SIMMClientRequestStarted, req);
+
+		// The read command asks for the first chunk
+		if (req->type == SIMMClientRead)
+		{
+			req->chunksStarted = 1;
+			SIMMClient_Hook(client, SIMMClientChunkStarted, req);
+		}
+	}
+
+	if (req->type == SIMMClientWrite)
+	{
+		uint32_t const window = client->verifyOff ? client->window : 1;
+		while (req->chunksStarted < chunks && req->chunksStarted - req->chunksDone < window &&
+			   OUT_BUFFER_SIZE - (client->outEnd - client->outStart) >= CHUNK_SIZE + 1)
+		{
+			uint8_t const more = ComputerWriteMore;
+			SIMMClient_QueueBytes(client, &more, 1);
+			SIMMClient_QueueBytes(client, req->writeData + req->chunksStarted * CHUNK_SIZE, CHUNK_SIZE);
+			req->chunksStarted++;
+			SIMMClient_Hook(client, SIMMClientChunkStarted, req);
+		}
+
+		uint8_t const finish = ComputerWriteFinish;
+		if (!req->finishStarted && req->chunksStarted == chunks && chunks - req->chunksDone < window &&
+			SIMMClient_QueueBytes(client, &finish, 1))
+		{
+			req->finishStarted = true;
+		}
+	}
+	else if (req->type == SIMMClientRead)
+	{
+		// Each acknowledgment asks for the next chunk, and the last one asks
+		// for ProgrammerReadFinished
+		uint8_t const ack = ComputerReadOK;
+		while (req->chunksStarted < chunks && req->chunksStarted - req->chunksDone < client->window &&
+			   SIMMClient_QueueBytes(client, &ack, 1))
+		{
+			req->chunksStarted++;
+			SIMMClient_Hook(client, SIMMClientChunkStarted, req);
+		}
+		if (!req->finishStarted && req->chunksStarted == chunks && chunks - req->chunksDone < client->window &&
+			SIMMClient_QueueBytes(client, &ack, 1))
+		{
+			req->finishStarted = true;
+		}
+	}
+}
+
+/** Counts how many parts of a request the programmer is working on or has
+ *  waiting for it
+ *
+ * @param req The running request
+ * @return The number of chunks in flight, or 1 for requests without chunks
+ */
+static uint32_t SIMMClient_InFlight(SIMMClientRequest const *req)
+{
+	if (req->type == SIMMClientWrite || req->type == SIMMClientRead)
+	{
+		return req->chunksStarted - req->chunksDone + (req->finishStarted ? 1 : 0);
+	}
+	return 1;
+}
+
+/** Handles bytes from the programmer for the running request
+ *
+ * @param client The client
+ * @param req The running request
+ * @param data The bytes
+ * @param len The number of bytes
+ * @return The number of bytes used. If it's less than len, the request is
+ *         finished and the rest belongs to the next one.
+ */
+static size_t SIMMClient_Receive(SIMMClient *client, SIMMClientRequest *req, uint8_t const *data, size_t len)
+{
+	uint32_t const chunks = req->length / CHUNK_SIZE;
+	size_t used = 0;
+
+	while (used < len)
+	{
+		// Bulk data: chip IDs, firmware version and read chunks
+		uint8_t *dest = NULL;
+		uint32_t need = 0;
+		if (req->step == 1 && req->type == SIMMClientIdentify)
+		{
+			dest = req->chipIDs;
+			need = sizeof(req->chipIDs);
+		}
+		else if (req->step == 1 && req->type == SIMMClientGetFirmwareVersion)
+		{
+			dest = req->version;
+			need = sizeof(req->version);
+		}
+		else if (req->step == 2 && req->type == SIMMClientRead)
+		{
+			dest = req->readData + req->chunksDone * CHUNK_SIZE;
+			need = CHUNK_SIZE;
+		}
+		if (dest)
+		{
+			size_t const n = (need - req->received < len - used) ? need - req->received : len - used;
+			memcpy(dest + req->received, data + used, n);
+			used += n;
+			req->received += (uint32_t)n;
+			if (req->received == need)
+			{
+				req->received = 0;
+				req->step++;
+				if (req->type == SIMMClientRead)
+				{
+					req->chunksDone++;
+					SIMMClient_Hook(client, SIMMClientChunkDone, req);
+				}
+			}
+			continue;
+		}
+
+		uint8_t const b = data[used++];
+
+		// Every command is acknowledged first
+		if (req->step == 0)
+		{
+			SIMMClientStatus const status = SIMMClient_ReplyStatus(b);
+			bool const sentAhead = req->type == SIMMClientWrite || req->type == SIMMClientRead ||
+					req->type == SIMMClientSetChipsMask || req->type == SIMMClientErasePortion ||
+					req->type == SIMMClientSetSectorLayout;
+			if (status != SIMMClientOK)
+			{
+				SIMMClient_FinishEarly(client, status, sentAhead);
+				return used;
+			}
+			req->step = 1;
+			switch (req->type)
+			{
+			case SIMMClientEnterWaitingMode:
+			case SIMMClientEraseChips:
+			case SIMMClientSetSIMMType:
+			case SIMMClientSetVerify:
+				SIMMClient_Finish(client, SIMMClientOK);
+				return used;
+			default:
+				break;
+			}
+			continue;
+		}
+
+		switch (req->type)
+		{
+		case SIMMClientIdentify:
+		case SIMMClientGetFirmwareVersion:
+			// Step 2: the end of the reply. Both Done values are 0.
+			if (b != ProgrammerIdentifyDone)
+			{
+				SIMMClient_Fail(client, "Unexpected reply from the programmer");
+				return len;
+			}
+			SIMMClient_Finish(client, SIMMClientOK);
+			return used;
+
+		case SIMMClientSetChipsMask:
+		case SIMMClientSetSectorLayout:
+			SIMMClient_Finish(client, SIMMClient_ReplyStatus(b));
+			return used;
+
+		case SIMMClientErasePortion:
+			if (req->step == 1 && b == ProgrammerErasePortionOK)
+			{
+				req->step = 2;
+				continue;
+			}
+			SIMMClient_Finish(client, (b == ProgrammerErasePortionFinished && req->step == 2) ?
+					SIMMClientOK : SIMMClientError);
+			return used;
+
+		case SIMMClientElectricalTest:
+			// Step 1: a failure or the end, steps 2-3: the failed pins
+			if (req->step == 1)
+			{
+				if (b == ProgrammerElectricalTestDone)
+				{
+					SIMMClient_Finish(client, SIMMClientOK);
+					return used;
+				}
+				req->step = 2;
+			}
+			else
+			{
+				if (req->numFailures < SIMM_CLIENT_MAX_FAILURES)
+				{
+					req->failures[req->numFailures][req->step - 2] = b;
+				}
+				if (++req->step == 4)
+				{
+					req->numFailures++;
+					req->step = 1;
+				}
+			}
+			continue;
+
+		case SIMMClientWrite:
+			// Step 1: reply to the address, step 2: reply to
+			// ComputerWriteMore, step 3: reply to a chunk, step 4: reply
+			// to ComputerWriteFinish
+			if (req->step == 3 && (b & ProgrammerWriteVerificationError))
+			{
+				req->verifyErrorMask = b & ~ProgrammerWriteVerificationError;
+				SIMMClient_FinishEarly(client, SIMMClientVerifyError,
+						req->chunksStarted > req->chunksDone + 1 || req->finishStarted);
+				return used;
+			}
+			if (b != ProgrammerWriteOK)
+			{
+				SIMMClient_FinishEarly(client, SIMMClientError, true);
+				return used;
+			}
+			if (req->step == 3)
+			{
+				req->chunksDone++;
+				SIMMClient_Hook(client, SIMMClientChunkDone, req);
+			}
+			if (req->step == 4)
+			{
+				SIMMClient_Finish(client, SIMMClientOK);
+				return used;
+			}
+			req->step = (req->step == 2) ? 3 : ((req->chunksDone < chunks) ? 2 : 4);
+			continue;
+
+		case SIMMClientRead:
+			// Step 1: reply to the address and length, step 3: what comes
+			// after each chunk
+			if (req->step == 1)
+			{
+				if (b != ProgrammerReadOK)
+				{
+					SIMMClient_FinishEarly(client, SIMMClientError, true);
+					return used;
+				}
+			}
+			else if (req->chunksDone == chunks && b == ProgrammerReadFinished)
+			{
+				SIMMClient_Finish(client, SIMMClientOK);
+				return used;
+			}
+			else if (req->chunksDone == chunks || b != ProgrammerReadMoreData)
+			{
+				SIMMClient_Fail(client, "Unexpected reply from the programmer");
+				return len;
+			}
+			req->step = 2;
+			continue;
+
+		default:
+			SIMMClient_Fail(client, "Unexpected reply from the programmer");
+			return len;
+		}
+	}
+
+	return used;
+}
+
+/** Starts using a serial port or socket that's already open
+ *
+ * @param fd The file descriptor. It's made non-blocking until the client is
+ *           closed, but it isn't closed.
+ * @return The client, or NULL if out of memory
+ */
+SIMMClient *SIMMClient_Attach(int fd)
+{
+	SIMMClient *client = calloc(1, sizeof(SIMMClient));
+	if (!client)
+	{
+		return NULL;
+	}
+
+	client->fd = fd;
+	client->savedFlags = fcntl(fd, F_GETFL);
+	fcntl(fd, F_SETFL, client->savedFlags | O_NONBLOCK);
+	client->window = SIMM_CLIENT_DEFAULT_WINDOW;
+	client->replyTimeoutMS = DEFAULT_REPLY_TIMEOUT_MS;
+	return client;
+}
+
+/** Opens a programmer's serial port
+ *
+ * The programmer might be in the middle of something if another program was
+ * using it, so the first request should usually be EnterWaitingMode.
+ *
+ * @param device The serial port
+ * @return The client, or NULL on failure
+ */
+SIMMClient *SIMMClient_Open(char const *device)
+{
+	struct termios tio;
+
+	int const fd = open(device, O_RDWR | O_NOCTTY);
+	if (fd < 0 || tcgetattr(fd, &tio) < 0)
+	{
+		fprintf(stderr, "Unable to open %s: %s\n", device, strerror(errno));
+		if (fd >= 0)
+		{
+			close(fd);
+		}
+		return NULL;
+	}
+	cfmakeraw(&tio);
+	tcsetattr(fd, TCSANOW, &tio);
+	tcflush(fd, TCIOFLUSH);
+
+	SIMMClient *client = SIMMClient_Attach(fd);
+	if (!client)
+	{
+		close(fd);
+		return NULL;
+	}
+	client->ownsFD = true;
+	return client;
+}
+
+/** Closes a client. Requests that haven't finished get SIMMClientLinkError.
+ *
+ * @param client The client
+ */
+void SIMMClient_Close(SIMMClient *client)
+{
+	SIMMClient_Fail(client, NULL);
+	if (client->ownsFD)
+	{
+		close(client->fd);
+	}
+	else
+	{
+		fcntl(client->fd, F_SETFL, client->savedFlags);
+	}
+	free(client);
+}
+
+/** Gets the file descriptor to wait on in an event loop
+ *
+ * @param client The client
+ * @return The file descriptor
+ */
+int SIMMClient_FD(SIMMClient const *client)
+{
+	return client->fd;
+}
+
+/** Sets how many chunks of a read or write can be in flight at once
+ *
+ * @param client The client
+ * @param chunks The number of chunks, from 1 to SIMM_CLIENT_MAX_WINDOW
+ */
+void SIMMClient_SetWindow(SIMMClient *client, uint32_t chunks)
+{
+	client->window = (chunks < 1) ? 1 : (chunks > SIMM_CLIENT_MAX_WINDOW) ? SIMM_CLIENT_MAX_WINDOW : chunks;
+}
+
+/** Sets a function to call with timing information
+ *
+ * @param client The client
+ * @param hook The function, or NULL for none
+ * @param context Passed to the function
+ */
+void SIMMClient_SetTimingHook(SIMMClient *client, SIMMClientTimingHook hook, void *context)
+{
+	client->hook = hook;
+	client->hookContext = context;
+}
+
+/** Sets how long to wait for the programmer before giving up
+ *
+ * @param client The client
+ * @param timeoutMS The time in milliseconds
+ */
+void SIMMClient_SetReplyTimeout(SIMMClient *client, int timeoutMS)
+{
+	client->replyTimeoutMS = timeoutMS;
+}
+
+/** Sets a name to put in front of the client's error messages, for programs
+ *  that talk to more than one programmer
+ *
+ * @param client The client
+ * @param name The name, which must stay valid until the client is closed, or NULL
+ */
+void SIMMClient_SetName(SIMMClient *client, char const *name)
+{
+	client->name = name;
+}
+
+/** Gets the client's running totals
+ *
+ * @param client The client
+ * @return The totals
+ */
+SIMMClientStats const *SIMMClient_Stats(SIMMClient const *client)
+{
+	return &client->stats;
+}
+
+/** Adds a request to the queue
+ *
+ * @param client The client
+ * @param type The kind of request
+ * @param callback Called when it's done, or NULL
+ * @param context Passed to the callback
+ * @return The request, or NULL if the client has failed or out of memory
+ */
+static SIMMClientRequest *SIMMClient_NewRequest(SIMMClient *client, SIMMClientRequestType type,
+		SIMMClientCallback callback, void *context)
+{
+	if (client->failed)
+	{
+		return NULL;
+	}
+
+	SIMMClientRequest *req = calloc(1, sizeof(SIMMClientRequest));
+	if (!req)
+	{
+		return NULL;
+	}
+	req->type = type;
+	req->callback = callback;
+	req->context = context;
+	req->queuedUS = SIMMClient_Now();
+
+	if (client->tail)
+	{
+		client->tail->next = req;
+	}
+	else
+	{
+		client->head = req;
+		// Don't count the time spent idle as waiting for a reply
+		client->lastActivityUS = req->queuedUS;
+	}
+	client->tail = req;
+	client->stats.requests++;
+	return req;
+}
+
+/** Checks that an area of the SIMM can be read or written in chunks
+ *
+ * @param address The start of the area, in bytes
+ * @param length The length of the area, in bytes
+ * @return True if it's OK
+ */
+static bool SIMMClient_ValidArea(uint32_t address, uint32_t length)
+{
+	return (address % CHUNK_SIZE) == 0 && (length % CHUNK_SIZE) == 0 &&
+		   address < MAX_SIMM_SIZE && length <= MAX_SIMM_SIZE - address;
+}
+
+/** Queues an EnterWaitingMode command, which cancels anything in progress
+ *
+ * @param client The client
+ * @param callback Called when it's done, or NULL
+ * @param context Passed to the callback
+ * @return True if it was queued
+ */
+bool SIMMClient_EnterWaitingMode(SIMMClient *client, SIMMClientCallback callback, void *context)
+{
+	return SIMMClient_NewRequest(client, SIMMClientEnterWaitingMode, callback, context) != NULL;
+}
+
+/** Queues an electrical test. The failures are in the request's results.
+ *
+ * @param client The client
+ * @param callback Called when it's done, or NULL
+ * @param context Passed to the callback
+ * @return True if it was queued
+ */
+bool SIMMClient_ElectricalTest(SIMMClient *client, SIMMClientCallback callback, void *context)
+{
+	return SIMMClient_NewRequest(client, SIMMClientElectricalTest, callback, context) != NULL;
+}
+
+/** Queues a request for the chip IDs. They're in the request's results.
+ *
+ * @param client The client
+ * @param callback Called when it's done, or NULL
+ * @param context Passed to the callback
+ * @return True if it was queued
+ */
+bool SIMMClient_Identify(SIMMClient *client, SIMMClientCallback callback, void *context)
+{
+	return SIMMClient_NewRequest(client, SIMMClientIdentify, callback, context) != NULL;
+}
+
+/** Queues an erase of the whole SIMM (only the chips in the chip mask)
+ *
+ * @param client The client
+ * @param callback Called when it's done, or NULL
+ * @param context Passed to the callback
+ * @return True if it was queued
+ */
+bool SIMMClient_EraseChips(SIMMClient *client, SIMMClientCallback callback, void *context)
+{
+	return SIMMClient_NewRequest(client, SIMMClientEraseChips, callback, context) != NULL;
+}
+
+/** Queues an erase of part of the SIMM
+ *
+ * @param client The client
+ * @param address The start of the area, in bytes. Must be on a sector boundary.
+ * @param length The length of the area, in bytes. Must be a whole number of sectors.
+ * @param callback Called when it's done, or NULL
+ * @param context Passed to the callback
+ * @return True if it was queued
+ */
+bool SIMMClient_ErasePortion(SIMMClient *client, uint32_t address, uint32_t length,
+		SIMMClientCallback callback, void *context)
+{
+	// The programmer replies with an error if it doesn't line up with the
+	// sectors, but these would make it give up before it even starts
+	if ((address % 4) || (length % 4) || address > MAX_SIMM_SIZE || length > MAX_SIMM_SIZE - address)
+	{
+		return false;
+	}
+
+	SIMMClientRequest *req = SIMMClient_NewRequest(client, SIMMClientErasePortion, callback, context);
+	if (req)
+	{
+		req->address = address;
+		req->length = length;
+	}
+	return req != NULL;
+}
+
+/** Queues a write to the SIMM
+ *
+ * @param client The client
+ * @param address Where to start writing, in bytes. Must be a multiple of 1024.
+ * @param data The data, which must stay valid until the write is done
+ * @param length The length of the data. Must be a multiple of 1024.
+ * @param callback Called when it's done, or NULL
+ * @param context Passed to the callback
+ * @return True if it was queued
+ */
+bool SIMMClient_Write(SIMMClient *client, uint32_t address, uint8_t const *data, uint32_t length,
+		SIMMClientCallback callback, void *context)
+{
+	if (!SIMMClient_ValidArea(address, length))
+	{
+		return false;
+	}
+
+	SIMMClientRequest *req = SIMMClient_NewRequest(client, SIMMClientWrite, callback, context);
+	if (req)
+	{
+		req->address = address;
+		req->length = length;
+		req->writeData = data;
+	}
+	return req != NULL;
+}
+
+/** Queues a read from the SIMM
+ *
+ * @param client The client
+ * @param address Where to start reading, in bytes. Must be a multiple of 1024.
+ * @param data Where to put the data
+ * @param length How much to read. Must be a multiple of 1024, and not 0.
+ * @param callback Called when it's done, or NULL
+ * @param context Passed to the callback
+ * @return True if it was queued
+ */
+bool SIMMClient_Read(SIMMClient *client, uint32_t address, uint8_t *data, uint32_t length,
+		SIMMClientCallback callback, void *context)
+{
+	if (!length || !SIMMClient_ValidArea(address, length))
+	{
+		return false;
+	}
+
+	SIMMClientRequest *req = SIMMClient_NewRequest(client, SIMMClientRead, callback, context);
+	if (req)
+	{
+		req->address = address;
+		req->length = length;
+		req->readData = data;
+	}
+	return req != NULL;
+}
+
+/** Queues a request to tell the programmer what size of SIMM it has
+ *
+ * @param client The client
+ * @param larger False for a 2 MB (or smaller) PLCC SIMM, true for larger ones
+ * @param callback Called when it's done, or NULL
+ * @param context Passed to the callback
+ * @return True if it was queued
+ */
+bool SIMMClient_SetSIMMType(SIMMClient *client, bool larger, SIMMClientCallback callback, void *context)
+{
+	SIMMClientRequest *req = SIMMClient_NewRequest(client, SIMMClientSetSIMMType, callback, context);
+	if (req)
+	{
+		req->setting = larger;
+	}
+	return req != NULL;
+}
+
+/** Queues a request to turn verifying while writing on or off
+ *
+ * Writes after this is turned off can keep several chunks in flight.
+ *
+ * @param client The client
+ * @param verify True to verify while writing
+ * @param callback Called when it's done, or NULL
+ * @param context Passed to the callback
+ * @return True if it was queued
+ */
+bool SIMMClient_SetVerify(SIMMClient *client, bool verify, SIMMClientCallback callback, void *context)
+{
+	SIMMClientRequest *req = SIMMClient_NewRequest(client, SIMMClientSetVerify, callback, context);
+	if (req)
+	{
+		req->setting = verify;
+	}
+	return req != NULL;
+}
+
+/** Queues a request to pick which chips to write and erase
+ *
+ * @param client The client
+ * @param mask The chips (bit 0 = IC4 ... bit 3 = IC1)
+ * @param callback Called when it's done, or NULL
+ * @param context Passed to the callback
+ * @return True if it was queued
+ */
+bool SIMMClient_SetChipsMask(SIMMClient *client, uint8_t mask, SIMMClientCallback callback, void *context)
+{
+	if (mask > 0x0F)
+	{
+		return false;
+	}
+
+	SIMMClientRequest *req = SIMMClient_NewRequest(client, SIMMClientSetChipsMask, callback, context);
+	if (req)
+	{
+		req->setting = mask;
+	}
+	return req != NULL;
+}
+
+/** Queues a request to tell the programmer the chips' sector layout
+ *
+ * @param client The client
+ * @param counts The number of sectors in each group
+ * @param sizes The size of the sectors in each group, in bytes per chip
+ * @param numGroups The number of groups, up to SIMM_CLIENT_MAX_SECTOR_GROUPS
+ * @param callback Called when it's done, or NULL
+ * @param context Passed to the callback
+ * @return True if it was queued
+ */
+bool SIMMClient_SetSectorLayout(SIMMClient *client, uint32_t const *counts, uint32_t const *sizes,
+		uint32_t numGroups, SIMMClientCallback callback, void *context)
+{
+	if (numGroups > SIMM_CLIENT_MAX_SECTOR_GROUPS)
+	{
+		return false;
+	}
+	for (uint32_t i = 0; i < numGroups; i++)
+	{
+		// A count of 0 would end the list early
+		if (!counts[i])
+		{
+			return false;
+		}
+	}
+
+	SIMMClientRequest *req = SIMMClient_NewRequest(client, SIMMClientSetSectorLayout, callback, context);
+	if (req)
+	{
+		for (uint32_t i = 0; i < numGroups; i++)
+		{
+			req->layout[i][0] = counts[i];
+			req->layout[i][1] = sizes[i];
+		}
+		req->numGroups = numGroups;
+	}
+	return req != NULL;
+}
+
+/** Queues a request for the firmware version. It's in the request's results.
+ *
+ * @param client The client
+ * @param callback Called when it's done, or NULL
+ * @param context Passed to the callback
+ * @return True if it was queued
+ */
+bool SIMMClient_GetFirmwareVersion(SIMMClient *client, SIMMClientCallback callback, void *context)
+{
+	return SIMMClient_NewRequest(client, SIMMClientGetFirmwareVersion, callback, context) != NULL;
+}
+
+/** Checks whether any requests haven't finished yet
+ *
+ * @param client The client
+ * @return True if there are requests left
+ */
+bool SIMMClient_Busy(SIMMClient const *client)
+{
+	return client->head != NULL;
+}
+
+/** Gets ready to wait on SIMMClient_FD() along with other file descriptors
+ *
+ * Anything the running request is ready to send is queued first, so an event
+ * loop can call this after queueing new requests and then wait with poll().
+ *
+ * @param client The client
+ * @return The poll() events to wait for, or 0 if there's nothing to do
+ */
+short SIMMClient_PollEvents(SIMMClient *client)
+{
+	if (client->failed)
+	{
+		return 0;
+	}
+	if (client->head)
+	{
+		SIMMClient_Stage(client, client->head);
+	}
+
+	short events = client->head ? POLLIN : 0;
+	if (client->outEnd > client->outStart)
+	{
+		events |= POLLOUT;
+	}
+	return events;
+}
+
+/** Sends and receives whatever it can, and calls the callbacks of any
+ *  requests that finish
+ *
+ * @param client The client
+ * @param timeoutMS Most time to wait for something to happen, or -1 to wait
+ *                  until something does
+ * @return True, or false if there was a link error
+ */
+bool SIMMClient_Process(SIMMClient *client, int timeoutMS)
+{
+	uint8_t in[IN_BUFFER_SIZE];
+
+	if (client->failed)
+	{
+		return false;
+	}
+	if (client->head)
+	{
+		SIMMClient_Stage(client, client->head);
+	}
+
+	bool const sending = client->outEnd > client->outStart;
+	if (!client->head && !sending)
+	{
+		return true;
+	}
+	// If the programmer has more to work on after what we're waiting for,
+	// it isn't sitting idle while the reply comes back to us
+	if (!sending && !client->stalled && SIMMClient_InFlight(client->head) <= 1)
+	{
+		client->stalled = true;
+		client->stats.stalls++;
+		SIMMClient_Hook(client, SIMMClientStalled, client->head);
+	}
+
+	struct pollfd pfd = {client->fd, POLLIN | (sending ? POLLOUT : 0), 0};
+	int const result = poll(&pfd, 1, timeoutMS);
+	if (result < 0 && errno != EINTR)
+	{
+		SIMMClient_Fail(client, "Unable to wait for programmer");
+		return false;
+	}
+	else if (result <= 0)
+	{
+		if (SIMMClient_Now() - client->lastActivityUS >= (uint64_t)client->replyTimeoutMS * 1000)
+		{
+			SIMMClient_Fail(client, "Timed out waiting for the programmer");
+			return false;
+		}
+		return true;
+	}
+
+	if (pfd.revents & POLLOUT)
+	{
+		ssize_t const written = write(client->fd, client->out + client->outStart, client->outEnd - client->outStart);
+		if (written > 0)
+		{
+			client->outStart += (size_t)written;
+			if (client->outStart == client->outEnd)
+			{
+				client->outStart = client->outEnd = 0;
+			}
+			client->stats.bytesSent += (uint64_t)written;
+			client->lastActivityUS = SIMMClient_Now();
+		}
+		else if (written < 0 && errno != EAGAIN && errno != EINTR)
+		{
+			SIMMClient_Fail(client, "Unable to write to programmer");
+			return false;
+		}
+	}
+
+	if (pfd.revents & (POLLIN | POLLHUP | POLLERR))
+	{
+		ssize_t const got = read(client->fd, in, sizeof(in));
+		if (got < 0 && (errno == EAGAIN || errno == EINTR))
+		{
+			return true;
+		}
+		else if (got <= 0)
+		{
+			SIMMClient_Fail(client, "Lost connection to programmer");
+			return false;
+		}
+
+		client->stats.bytesReceived += (uint64_t)got;
+		client->lastActivityUS = SIMMClient_Now();
+		client->stalled = false;
+
+		size_t used = 0;
+		while (used < (size_t)got && !client->failed)
+		{
+			if (!client->head || !client->head->commandStarted)
+			{
+				SIMMClient_Fail(client, "The programmer sent something we didn't ask for");
+				break;
+			}
+			used += SIMMClient_Receive(client, client->head, in + used, (size_t)got - used);
+		}
+	}
+
+	return !client->failed;
+}
+
+/** Runs every queued request to completion
+ *
+ * @param client The client
+ * @return True if they all ran (they might still have failed; check each
+ *         one's status), or false if there was a link error
+ */
+bool SIMMClient_Wait(SIMMClient *client)
+{
+	while (SIMMClient_Busy(client))
+	{
+		if (!SIMMClient_Process(client, client->replyTimeoutMS))
+		{
+			return false;
+		}
+	}
+	return !client->failed;
+}
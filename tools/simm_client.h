@@ -0,0 +1,201 @@
+/*
+ * simm_client.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: SIMM Programmer contributors
+ *
+ * Copyright (C) 2026 SIMM Programmer contributors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * -----------------------------------------------------------------------------
+ *
+ * Asynchronous client for the programmer protocol (see programmer_protocol.h)
+ * for host programs. Requests are queued and run in order, and each one calls
+ * a completion callback when it's done. Reads and writes are pipelined: the
+ * next chunks are sent while the programmer is still working on the current
+ * one, so the time USB takes to get a reply back to us is hidden.
+ *
+ * Nothing happens in the background. The program calls SIMMClient_Process()
+ * from its own event loop when SIMMClient_FD() is ready for the events
+ * SIMMClient_PollEvents() asks for (or just calls SIMMClient_Wait() to run
+ * everything that's queued), and the callbacks are called from there.
+ */
+
+#ifndef TOOLS_SIMM_CLIENT_H_
+#define TOOLS_SIMM_CLIENT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/// Default number of chunks to keep in flight during reads and writes
+#define SIMM_CLIENT_DEFAULT_WINDOW	8
+/// Most chunks that can be in flight during reads and writes
+#define SIMM_CLIENT_MAX_WINDOW		32
+
+/// A connection to a programmer
+typedef struct SIMMClient SIMMClient;
+/// A queued request
+typedef struct SIMMClientRequest SIMMClientRequest;
+
+/// The kinds of requests
+typedef enum SIMMClientRequestType
+{
+	SIMMClientEnterWaitingMode = 0,
+	SIMMClientElectricalTest,
+	SIMMClientIdentify,
+	SIMMClientEraseChips,
+	SIMMClientErasePortion,
+	SIMMClientWrite,
+	SIMMClientRead,
+	SIMMClientSetSIMMType,
+	SIMMClientSetVerify,
+	SIMMClientSetChipsMask,
+	SIMMClientSetSectorLayout,
+	SIMMClientGetFirmwareVersion
+} SIMMClientRequestType;
+
+/// How a request turned out
+typedef enum SIMMClientStatus
+{
+	SIMMClientOK = 0,
+	/// The programmer replied with an error
+	SIMMClientError,
+	/// The programmer doesn't know the command
+	SIMMClientInvalid,
+	/// Verifying a write failed; verifyErrorMask says which chips failed
+	SIMMClientVerifyError,
+	/// The connection was lost, timed out or got out of step with the
+	/// programmer. Nothing else can be done with the client after this.
+	SIMMClientLinkError
+} SIMMClientStatus;
+
+/// Things a timing hook is told about
+typedef enum SIMMClientTimingEvent
+{
+	/// The first byte of a request was queued to be sent
+	SIMMClientRequestStarted = 0,
+	/// A chunk of a read or write was requested or queued to be sent
+	SIMMClientChunkStarted,
+	/// The programmer finished a chunk of a read or write
+	SIMMClientChunkDone,
+	/// A request is done, just before its callback is called
+	SIMMClientRequestDone,
+	/// We have to wait for a reply, and the programmer will have nothing to
+	/// do until we get it and send something else
+	SIMMClientStalled
+} SIMMClientTimingEvent;
+
+/// Called when a request is done
+typedef void (*SIMMClientCallback)(SIMMClient *client, SIMMClientRequest const *request, void *context);
+/// Called with timing information as requests run
+typedef void (*SIMMClientTimingHook)(SIMMClient *client, SIMMClientTimingEvent event,
+		SIMMClientRequest const *request, uint64_t timeUS, void *context);
+
+/// Most sector groups SetSectorLayout can send, which is all the firmware keeps
+#define SIMM_CLIENT_MAX_SECTOR_GROUPS	10
+/// Most electrical test failures that are kept in a request
+#define SIMM_CLIENT_MAX_FAILURES	32
+
+/// A request and its results. Everything after the results is private.
+struct SIMMClientRequest
+{
+	SIMMClientRequestType type;
+	SIMMClientStatus status;
+	/// Position and length of a read, write or partial erase, in bytes
+	uint32_t address;
+	uint32_t length;
+	/// Data to write, which must stay valid until the write is done
+	uint8_t const *writeData;
+	/// Where to put the data that is read
+	uint8_t *readData;
+	/// The setting for SetSIMMType (true = larger), SetVerify and SetChipsMask
+	uint8_t setting;
+	/// Results of Identify (manufacturer and device ID of IC1-IC4)
+	uint8_t chipIDs[8];
+	/// Results of GetFirmwareVersion (major, minor, revision, prerelease)
+	uint8_t version[4];
+	/// Results of an electrical test: pairs of shorted pin indexes. numFailures
+	/// keeps counting if there are more than fit.
+	uint8_t failures[SIMM_CLIENT_MAX_FAILURES][2];
+	uint32_t numFailures;
+	/// Chips that failed verification, as reported by the programmer
+	uint8_t verifyErrorMask;
+	/// Number of chunks of a read or write the programmer has finished
+	uint32_t chunksDone;
+	/// When the request was queued, started and finished, in microseconds
+	uint64_t queuedUS;
+	uint64_t startUS;
+	uint64_t doneUS;
+
+	SIMMClientCallback callback;
+	void *context;
+	/// Sector layout to send: count and size of each group
+	uint32_t layout[SIMM_CLIENT_MAX_SECTOR_GROUPS][2];
+	uint32_t numGroups;
+	/// How far sending has gotten
+	uint32_t chunksStarted;
+	bool commandStarted;
+	bool finishStarted;
+	/// How far receiving has gotten
+	uint8_t step;
+	uint32_t received;
+	SIMMClientRequest *next;
+};
+
+/// Running totals for a client
+typedef struct SIMMClientStats
+{
+	uint64_t requests;
+	uint64_t bytesSent;
+	uint64_t bytesReceived;
+	/// Times we had to wait for a reply with nothing else in flight, which
+	/// are the round trips that weren't hidden
+	uint64_t stalls;
+} SIMMClientStats;
+
+SIMMClient *SIMMClient_Open(char const *device);
+SIMMClient *SIMMClient_Attach(int fd);
+void SIMMClient_Close(SIMMClient *client);
+int SIMMClient_FD(SIMMClient const *client);
+
+void SIMMClient_SetWindow(SIMMClient *client, uint32_t chunks);
+void SIMMClient_SetTimingHook(SIMMClient *client, SIMMClientTimingHook hook, void *context);
+void SIMMClient_SetReplyTimeout(SIMMClient *client, int timeoutMS);
+void SIMMClient_SetName(SIMMClient *client, char const *name);
+SIMMClientStats const *SIMMClient_Stats(SIMMClient const *client);
+
+bool SIMMClient_EnterWaitingMode(SIMMClient *client, SIMMClientCallback callback, void *context);
+bool SIMMClient_ElectricalTest(SIMMClient *client, SIMMClientCallback callback, void *context);
+bool SIMMClient_Identify(SIMMClient *client, SIMMClientCallback callback, void *context);
+bool SIMMClient_EraseChips(SIMMClient *client, SIMMClientCallback callback, void *context);
+bool SIMMClient_ErasePortion(SIMMClient *client, uint32_t address, uint32_t length,
+		SIMMClientCallback callback, void *context);
+bool SIMMClient_Write(SIMMClient *client, uint32_t address, uint8_t const *data, uint32_t length,
+		SIMMClientCallback callback, void *context);
+bool SIMMClient_Read(SIMMClient *client, uint32_t address, uint8_t *data, uint32_t length,
+		SIMMClientCallback callback, void *context);
+bool SIMMClient_SetSIMMType(SIMMClient *client, bool larger, SIMMClientCallback callback, void *context);
+bool SIMMClient_SetVerify(SIMMClient *client, bool verify, SIMMClientCallback callback, void *context);
+bool SIMMClient_SetChipsMask(SIMMClient *client, uint8_t mask, SIMMClientCallback callback, void *context);
+bool SIMMClient_SetSectorLayout(SIMMClient *client, uint32_t const *counts, uint32_t const *sizes,
+		uint32_t numGroups, SIMMClientCallback callback, void *context);
+bool SIMMClient_GetFirmwareVersion(SIMMClient *client, SIMMClientCallback callback, void *context);
+
+bool SIMMClient_Busy(SIMMClient const *client);
+short SIMMClient_PollEvents(SIMMClient *client);
+bool SIMMClient_Process(SIMMClient *client, int timeoutMS);
+bool SIMMClient_Wait(SIMMClient *client);
+
+#endif /* TOOLS_SIMM_CLIENT_H_ */
@@ -0,0 +1,534 @@
+/*
+ * simm_driver_test.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: SIMM Programmer contributors
+ *
+ * Copyright (C) 2026 SIMM Programmer contributors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * -----------------------------------------------------------------------------
+ *
+ * Tests for the flash driver, run against the simulated chips and bus from
+ * hal/host. The driver is called directly instead of through the programmer
+ * protocol, so each test can look at exactly what the driver worked out about
+ * the chips and what it did to them. The sector maps the tests expect are
+ * copied from the chips' datasheets, not from the driver's chip table.
+ *
+ * With no arguments every test runs; otherwise only the named ones do. The
+ * exit status is nonzero if any check failed.
+ */
+
+#include "../drivers/parallel_flash.h"
+#include "../hal/parallel_bus.h"
+#include "../hal/host/flash_sim.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/// Shorthand for the number of elements in an array
+#define NUM_ELEMENTS(a)				(sizeof(a)/sizeof((a)[0]))
+
+/// Checks a condition, and reports it if it's false
+#define CHECK(cond)					DriverTest_Check((cond), #cond, __FILE__, __LINE__)
+
+/// A test, run by name
+typedef struct DriverTest
+{
+	char const *name;
+	void (*run)(void);
+} DriverTest;
+
+/// Am29LV160DB and M29F160FB in 8-bit mode: bottom boot block
+static const ParallelFlashEraseSectorGroup bottomBootSectors[] = {
+	{1, 16*1024UL}, {2, 8*1024UL}, {1, 32*1024UL}, {31, 64*1024UL}
+};
+
+/// Am29LV160DT and M29F160FT in 8-bit mode: top boot block
+static const ParallelFlashEraseSectorGroup topBootSectors[] = {
+	{31, 64*1024UL}, {1, 32*1024UL}, {2, 8*1024UL}, {1, 16*1024UL}
+};
+
+/// SST39SF040: uniform 4 KB sectors
+static const ParallelFlashEraseSectorGroup sst39sf040Sectors[] = {
+	{128, 4*1024UL}
+};
+
+/// S29GL032N model 04: uniform 64 KB sectors
+static const ParallelFlashEraseSectorGroup s29gl032nSectors[] = {
+	{64, 64*1024UL}
+};
+
+/// The S29GL032N's write buffer size in bytes
+#define S29GL032N_WRITE_BUFFER_SIZE	32
+
+/// The number of checks that failed
+static int failures;
+
+/** Reports a check that failed
+ *
+ * @param ok The result of the check
+ * @param what The check, as written in the test
+ * @param file The file the check is in
+ * @param line The line the check is on
+ * @return ok
+ */
+static bool DriverTest_Check(bool ok, char const *what, char const *file, int line)
+{
+	if (!ok)
+	{
+		fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what);
+		failures++;
+	}
+	return ok;
+}
+
+/** Sets up the simulated chips and identifies them
+ *
+ * @param config The simulated chips, like SIMM_SIM_CHIPS
+ * @param ids Filled in with the IDs of the chips, in IC1-IC4 order
+ * @return True if the simulation was set up
+ */
+static bool DriverTest_Setup(char const *config, ParallelFlashChipID ids[PARALLEL_FLASH_NUM_CHIPS])
+{
+	if (!CHECK(FlashSim_Init(config)))
+	{
+		return false;
+	}
+	ParallelBus_Init();
+	ParallelFlash_SetChipType(ParallelFlash_SST39SF040_x4);
+	ParallelFlash_IdentifyChips(ids);
+	return true;
+}
+
+/** Checks that the driver came up with the right sector map for a chip
+ *
+ * @param chip The chip, 0 = IC1
+ * @param expected The sector map from the chip's datasheet
+ * @param numExpected The number of groups in the sector map
+ */
+static void DriverTest_CheckSectors(uint8_t chip, ParallelFlashEraseSectorGroup const *expected, uint8_t numExpected)
+{
+	ParallelFlashChipInfo const *info = ParallelFlash_ChipInfo(chip);
+	if (!CHECK(info != NULL) ||
+		!CHECK(info->numEraseSectorGroups == numExpected))
+	{
+		return;
+	}
+
+	for (uint8_t i = 0; i < numExpected; i++)
+	{
+		if (!CHECK(info->eraseSectorGroups[i].count == expected[i].count) ||
+			!CHECK(info->eraseSectorGroups[i].size == expected[i].size))
+		{
+			fprintf(stderr, "  chip %u group %u is %u x %u bytes\n", chip, i,
+					(unsigned)info->eraseSectorGroups[i].count, (unsigned)info->eraseSectorGroups[i].size);
+		}
+	}
+}
+
+/** A bottom boot block chip that's only described by CFI gets its datasheet sector map
+ *
+ */
+static void DriverTest_CFIBottomBoot(void)
+{
+	ParallelFlashChipID ids[PARALLEL_FLASH_NUM_CHIPS];
+	if (!DriverTest_Setup("am29lv160db", ids))
+	{
+		return;
+	}
+
+	for (uint8_t i = 0; i < PARALLEL_FLASH_NUM_CHIPS; i++)
+	{
+		CHECK(ids[i].manufacturer == 0x01 && ids[i].device == 0x49);
+		DriverTest_CheckSectors(i, bottomBootSectors, NUM_ELEMENTS(bottomBootSectors));
+		ParallelFlashChipInfo const *info = ParallelFlash_ChipInfo(i);
+		if (info)
+		{
+			CHECK(info->multiSectorErase);
+			CHECK(info->writeBufferSize == 0);
+		}
+	}
+}
+
+/** A top boot block chip lists its CFI regions bottom up; the driver has to flip them
+ *
+ */
+static void DriverTest_CFITopBoot(void)
+{
+	ParallelFlashChipID ids[PARALLEL_FLASH_NUM_CHIPS];
+	if (!DriverTest_Setup("am29lv160dt", ids))
+	{
+		return;
+	}
+
+	for (uint8_t i = 0; i < PARALLEL_FLASH_NUM_CHIPS; i++)
+	{
+		CHECK(ids[i].manufacturer == 0x01 && ids[i].device == 0xC4);
+		DriverTest_CheckSectors(i, topBootSectors, NUM_ELEMENTS(topBootSectors));
+	}
+
+	// The boot sectors really are at the top: 0x1FA000 starts an 8 KB sector
+	// there, but it would be in the middle of a 64 KB one at the bottom.
+	static uint32_t data[16];
+	static uint32_t readback[16];
+	for (uint8_t i = 0; i < NUM_ELEMENTS(data); i++)
+	{
+		data[i] = 0x12345678UL * (i + 1);
+	}
+	ParallelFlash_WriteAllChips(0x1F9FF8UL, data, NUM_ELEMENTS(data));
+	CHECK(ParallelFlash_EraseSectors(0x1FA000UL, 0x2000UL, ALL_CHIPS, 0, NULL));
+	ParallelFlash_Read(0x1F9FF8UL, readback, NUM_ELEMENTS(readback));
+	CHECK(!memcmp(readback, data, sizeof(data) / 2));
+	for (uint8_t i = NUM_ELEMENTS(readback) / 2; i < NUM_ELEMENTS(readback); i++)
+	{
+		CHECK(readback[i] == 0xFFFFFFFFUL);
+	}
+	CHECK(!ParallelFlash_EraseSectors(0x1EA000UL, 0x2000UL, ALL_CHIPS, 0, NULL));
+}
+
+/** Known, CFI and missing chips on one SIMM each end up with their own info
+ *
+ */
+static void DriverTest_CFIMixed(void)
+{
+	ParallelFlashChipID ids[PARALLEL_FLASH_NUM_CHIPS];
+	if (!DriverTest_Setup("am29lv160dt,sst39sf040,m29f160fb,none", ids))
+	{
+		return;
+	}
+
+	DriverTest_CheckSectors(0, topBootSectors, NUM_ELEMENTS(topBootSectors));
+	DriverTest_CheckSectors(1, sst39sf040Sectors, NUM_ELEMENTS(sst39sf040Sectors));
+	DriverTest_CheckSectors(2, bottomBootSectors, NUM_ELEMENTS(bottomBootSectors));
+	CHECK(ParallelFlash_ChipInfo(3) == NULL);
+}
+
+/** Identified chips use their own sector map, the host's map is for the rest, and the two have to agree
+ *
+ */
+static void DriverTest_SectorLayout(void)
+{
+	ParallelFlashChipID ids[PARALLEL_FLASH_NUM_CHIPS];
+	if (!DriverTest_Setup("m29f160fb,none,none,none", ids))
+	{
+		return;
+	}
+
+	// 32 KB at 0x10000 is a whole sector in the host's map, but only half
+	// of the M29F160FB's 64 KB sector there
+	static const ParallelFlashEraseSectorGroup hostSectors[] = {{64, 32*1024UL}};
+	CHECK(ParallelFlash_EraseSectors(0x10000UL, 0x8000UL, IC2 | IC3 | IC4,
+			NUM_ELEMENTS(hostSectors), hostSectors));
+	CHECK(!ParallelFlash_EraseSectors(0x10000UL, 0x8000UL, IC1,
+			NUM_ELEMENTS(hostSectors), hostSectors));
+	CHECK(!ParallelFlash_EraseSectors(0x10000UL, 0x8000UL, ALL_CHIPS,
+			NUM_ELEMENTS(hostSectors), hostSectors));
+	CHECK(ParallelFlash_EraseSectors(0x10000UL, 0x10000UL, ALL_CHIPS,
+			NUM_ELEMENTS(hostSectors), hostSectors));
+
+	// A whole M29F160FB sector is only part of a sector in this map, so the
+	// host would be expecting something other than what the chip erases
+	static const ParallelFlashEraseSectorGroup bigHostSectors[] = {{16, 128*1024UL}};
+	CHECK(!ParallelFlash_EraseSectors(0x10000UL, 0x10000UL, IC1,
+			NUM_ELEMENTS(bigHostSectors), bigHostSectors));
+	CHECK(ParallelFlash_EraseSectors(0x20000UL, 0x20000UL, IC1,
+			NUM_ELEMENTS(bigHostSectors), bigHostSectors));
+}
+
+/** Fills a buffer with a pattern that's different in every byte
+ *
+ * @param buf The buffer
+ * @param len The number of words in the buffer
+ */
+static void DriverTest_Pattern(uint32_t *buf, uint16_t len)
+{
+	for (uint16_t i = 0; i < len; i++)
+	{
+		buf[i] = 0x01020304UL * (i + 1) ^ 0xA5C3965AUL;
+	}
+}
+
+/** Writes a buffer with the write buffer, checks what failed and reads it back
+ *
+ * @param address The address to write to
+ * @param data The data to write
+ * @param len The number of words to write
+ * @return The mask of chips that reported a program failure
+ */
+static uint8_t DriverTest_WriteBuffered(uint32_t address, uint32_t const *data, uint16_t len)
+{
+	ParallelFlash_BeginWrite();
+	uint8_t const failed = ParallelFlash_WriteAllChips(address, data, len);
+	ParallelFlash_EndWrite();
+	return failed;
+}
+
+/** A chip with a write buffer programs through it, a page at a time
+ *
+ */
+static void DriverTest_BufferedWrite(void)
+{
+	ParallelFlashChipID ids[PARALLEL_FLASH_NUM_CHIPS];
+	if (!DriverTest_Setup("s29gl032n", ids))
+	{
+		return;
+	}
+
+	for (uint8_t i = 0; i < PARALLEL_FLASH_NUM_CHIPS; i++)
+	{
+		CHECK(ids[i].manufacturer == 0x01 && ids[i].device == 0x7E);
+		DriverTest_CheckSectors(i, s29gl032nSectors, NUM_ELEMENTS(s29gl032nSectors));
+		ParallelFlashChipInfo const *info = ParallelFlash_ChipInfo(i);
+		if (info)
+		{
+			CHECK(info->writeBufferSize == S29GL032N_WRITE_BUFFER_SIZE);
+		}
+	}
+
+	// Starting halfway into a page splits this into a half page, a full page
+	// and a half page. Each one is unlock, write to buffer, count, the data
+	// and program confirm.
+	static uint32_t data[2 * S29GL032N_WRITE_BUFFER_SIZE];
+	static uint32_t readback[2 * S29GL032N_WRITE_BUFFER_SIZE];
+	uint32_t const address = 0x10000UL + S29GL032N_WRITE_BUFFER_SIZE / 2;
+	DriverTest_Pattern(data, NUM_ELEMENTS(data));
+	uint64_t const writeCycles = FlashSim_Stats()->writeCycles;
+	CHECK(DriverTest_WriteBuffered(address, data, NUM_ELEMENTS(data)) == 0);
+	CHECK(FlashSim_Stats()->writeCycles - writeCycles == 3 * 5 + NUM_ELEMENTS(data));
+
+	ParallelFlash_Read(address, readback, NUM_ELEMENTS(readback));
+	CHECK(!memcmp(readback, data, sizeof(data)));
+}
+
+/** A chip that aborts a buffered write is reported and reset, and works again afterward
+ *
+ */
+static void DriverTest_BufferedAbort(void)
+{
+	ParallelFlashChipID ids[PARALLEL_FLASH_NUM_CHIPS];
+	if (!DriverTest_Setup("s29gl032n", ids))
+	{
+		return;
+	}
+
+	static uint32_t data[2 * S29GL032N_WRITE_BUFFER_SIZE];
+	static uint32_t readback[2 * S29GL032N_WRITE_BUFFER_SIZE];
+	DriverTest_Pattern(data, NUM_ELEMENTS(data));
+
+	// IC3 is on lane 1. The other chips program the first page before the
+	// driver gives up on the rest, but IC3 doesn't program anything.
+	FlashSim_InjectFault(1, FlashSimFaultBufferAbort);
+	CHECK(DriverTest_WriteBuffered(0x20000UL, data, NUM_ELEMENTS(data)) == IC3);
+	ParallelFlash_Read(0x20000UL, readback, NUM_ELEMENTS(readback));
+	for (uint8_t i = 0; i < S29GL032N_WRITE_BUFFER_SIZE; i++)
+	{
+		CHECK((readback[i] & 0x0000FF00UL) == 0x0000FF00UL);
+		CHECK((readback[i] & 0xFFFF00FFUL) == (data[i] & 0xFFFF00FFUL));
+	}
+
+	// After the abort reset, trying again works
+	CHECK(DriverTest_WriteBuffered(0x20000UL, data, NUM_ELEMENTS(data)) == 0);
+	ParallelFlash_Read(0x20000UL, readback, NUM_ELEMENTS(readback));
+	CHECK(!memcmp(readback, data, sizeof(data)));
+
+	// Writing only some chips reports failures the same way
+	FlashSim_InjectFault(0, FlashSimFaultBufferAbort);
+	CHECK(ParallelFlash_WriteSomeChips(0x30000UL, data, NUM_ELEMENTS(data), IC3 | IC4) == IC4);
+}
+
+/** A chip that times out during a buffered write is reported and reset
+ *
+ */
+static void DriverTest_BufferedTimeout(void)
+{
+	ParallelFlashChipID ids[PARALLEL_FLASH_NUM_CHIPS];
+	if (!DriverTest_Setup("s29gl032n", ids))
+	{
+		return;
+	}
+
+	static uint32_t data[2 * S29GL032N_WRITE_BUFFER_SIZE];
+	static uint32_t readback[2 * S29GL032N_WRITE_BUFFER_SIZE];
+	DriverTest_Pattern(data, NUM_ELEMENTS(data));
+
+	// IC1 is on lane 3
+	FlashSim_InjectFault(3, FlashSimFaultProgramTimeout);
+	CHECK(DriverTest_WriteBuffered(0x20000UL, data, NUM_ELEMENTS(data)) == IC1);
+	CHECK(DriverTest_WriteBuffered(0x20000UL, data, NUM_ELEMENTS(data)) == 0);
+	ParallelFlash_Read(0x20000UL, readback, NUM_ELEMENTS(readback));
+	CHECK(!memcmp(readback, data, sizeof(data)));
+}
+
+/** Setting the chip type forgets the identified chips, so a swapped SIMM uses the host's choice
+ *
+ */
+static void DriverTest_SetChipTypeAfterIdentify(void)
+{
+	ParallelFlashChipID ids[PARALLEL_FLASH_NUM_CHIPS];
+	if (!DriverTest_Setup("sst39sf040", ids))
+	{
+		return;
+	}
+	CHECK(ParallelFlash_ChipInfo(0) != NULL);
+
+	// Swap in a SIMM that needs the other unlock scheme, and tell the driver
+	static uint32_t data[16];
+	static uint32_t readback[16];
+	DriverTest_Pattern(data, NUM_ELEMENTS(data));
+	CHECK(FlashSim_Init("m29f160fb"));
+	ParallelFlash_SetChipType(ParallelFlash_M29F160FB5AN6E2_x4);
+	CHECK(ParallelFlash_ChipType() == ParallelFlash_M29F160FB5AN6E2_x4);
+	for (uint8_t i = 0; i < PARALLEL_FLASH_NUM_CHIPS; i++)
+	{
+		CHECK(ParallelFlash_ChipInfo(i) == NULL);
+	}
+
+	// The M29F160FBs only accept their own unlock addresses, so this only
+	// works if the SST39SF040s' scheme was dropped
+	ParallelFlash_BeginWrite();
+	CHECK(ParallelFlash_WriteAllChips(0x1000UL, data, NUM_ELEMENTS(data)) == 0);
+	ParallelFlash_EndWrite();
+	ParallelFlash_Read(0x1000UL, readback, NUM_ELEMENTS(readback));
+	CHECK(!memcmp(readback, data, sizeof(data)));
+}
+
+/// The number of chunks, and words per chunk, written by the unlock bypass test
+#define BYPASS_CHUNKS				8
+#define BYPASS_CHUNK_WORDS			16
+
+/** Writes chunks of data with unlock bypass, and counts the write cycles
+ *
+ * @param address The address to write the first chunk to
+ * @param data The data to write, BYPASS_CHUNKS chunks of BYPASS_CHUNK_WORDS
+ * @param session True to write all of the chunks in one write session
+ * @param verify True to read back each chunk after writing it
+ * @return The number of write cycles it took
+ */
+static uint64_t DriverTest_WriteBypassChunks(uint32_t address, uint32_t const *data, bool session, bool verify)
+{
+	static uint32_t readback[BYPASS_CHUNK_WORDS];
+	uint64_t const writeCycles = FlashSim_Stats()->writeCycles;
+
+	if (session)
+	{
+		ParallelFlash_BeginWrite();
+	}
+	for (uint8_t i = 0; i < BYPASS_CHUNKS; i++)
+	{
+		uint32_t const chunkAddress = address + i * BYPASS_CHUNK_WORDS;
+		uint32_t const *chunk = data + i * BYPASS_CHUNK_WORDS;
+		ParallelFlash_WriteAllChips(chunkAddress, chunk, BYPASS_CHUNK_WORDS);
+		if (verify)
+		{
+			ParallelFlash_Read(chunkAddress, readback, BYPASS_CHUNK_WORDS);
+			CHECK(!memcmp(readback, chunk, sizeof(readback)));
+		}
+	}
+	if (session)
+	{
+		ParallelFlash_EndWrite();
+	}
+
+	return FlashSim_Stats()->writeCycles - writeCycles;
+}
+
+/** A write session saves entering and leaving unlock bypass for every chunk,
+ *  unless the chunks are read back in between
+ *
+ */
+static void DriverTest_UnlockBypassSession(void)
+{
+	ParallelFlashChipID ids[PARALLEL_FLASH_NUM_CHIPS];
+	if (!DriverTest_Setup("m29f160fb", ids))
+	{
+		return;
+	}
+
+	static uint32_t data[BYPASS_CHUNKS * BYPASS_CHUNK_WORDS];
+	static uint32_t readback[BYPASS_CHUNKS * BYPASS_CHUNK_WORDS];
+	DriverTest_Pattern(data, NUM_ELEMENTS(data));
+
+	// Each byte is 0xA0 and the data. Each chunk also enters unlock bypass
+	// (unlock and 0x20) and leaves it (0x90, 0x00), unless a session keeps
+	// the chips in it from the first chunk to the last.
+	uint64_t const perChunk = 3 + 2 * BYPASS_CHUNK_WORDS + 2;
+	uint64_t const alone = DriverTest_WriteBypassChunks(0x10000UL, data, false, false);
+	uint64_t const session = DriverTest_WriteBypassChunks(0x20000UL, data, true, false);
+	uint64_t const verified = DriverTest_WriteBypassChunks(0x30000UL, data, true, true);
+	CHECK(alone == BYPASS_CHUNKS * perChunk);
+	CHECK(session == alone - 5 * (BYPASS_CHUNKS - 1));
+	CHECK(verified == alone);
+
+	for (uint32_t address = 0x10000UL; address <= 0x30000UL; address += 0x10000UL)
+	{
+		ParallelFlash_Read(address, readback, NUM_ELEMENTS(readback));
+		CHECK(!memcmp(readback, data, sizeof(data)));
+	}
+}
+
+/// Every test, in the order they run
+static const DriverTest tests[] = {
+	{"cfi_bottom_boot", DriverTest_CFIBottomBoot},
+	{"cfi_top_boot", DriverTest_CFITopBoot},
+	{"cfi_mixed", DriverTest_CFIMixed},
+	{"sector_layout", DriverTest_SectorLayout},
+	{"buffered_write", DriverTest_BufferedWrite},
+	{"buffered_abort", DriverTest_BufferedAbort},
+	{"buffered_timeout", DriverTest_BufferedTimeout},
+	{"unlock_bypass_session", DriverTest_UnlockBypassSession},
+	{"set_chip_type_after_identify", DriverTest_SetChipTypeAfterIdentify},
+};
+
+/** Runs the tests
+ *
+ * @param argc The number of arguments
+ * @param argv The names of the tests to run, or none to run all of them
+ * @return 0 if every check passed
+ */
+int main(int argc, char *argv[])
+{
+	for (int i = 1; i < argc; i++)
+	{
+		bool found = false;
+		for (size_t j = 0; j < NUM_ELEMENTS(tests); j++)
+		{
+			found = found || !strcmp(argv[i], tests[j].name);
+		}
+		if (!found)
+		{
+			fprintf(stderr, "Unknown test: %s\n", argv[i]);
+			return 2;
+		}
+	}
+
+	for (size_t j = 0; j < NUM_ELEMENTS(tests); j++)
+	{
+		bool run = (argc == 1);
+		for (int i = 1; i < argc; i++)
+		{
+			run = run || !strcmp(argv[i], tests[j].name);
+		}
+		if (run)
+		{
+			int const failuresBefore = failures;
+			tests[j].run();
+			printf("%s: %s\n", tests[j].name, (failures == failuresBefore) ? "ok" : "FAILED");
+		}
+	}
+
+	return failures ? 1 : 0;
+}
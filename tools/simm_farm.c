@@ -0,0 +1,938 @@
+/*
+ * simm_farm.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: SIMM Programmer contributors
+ *
+ * Copyright (C) 2026 SIMM Programmer contributors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * -----------------------------------------------------------------------------
+ *
+ * Flashes the same image onto SIMMs in a lot of programmers at once, for
+ * production runs.
+ *
+ * Every programmer that's found (by default, every /dev/ttyACM* port that
+ * answers like a programmer) gets a worker that takes it through a job:
+ *   probe  - EnterWaitingMode, GetFirmwareVersion and IdentifyChips
+ *   erase  - erase the whole SIMM
+ *   write  - write the image, pipelined, without verifying while writing
+ *   verify - read the SIMM back and check it against the image
+ * The workers all run from one event loop, and each one drives its programmer
+ * through the pipelined client (simm_client.h). Nothing ever waits on one
+ * programmer, so a SIMM that takes a long time to erase only holds up itself.
+ *
+ * The image is loaded once and shared by all of the workers. When it's
+ * loaded, a CRC-32 is worked out for each chip's share of every block of it.
+ * A block is BLOCK_SIZE_PER_CHIP bytes of each chip, which lines up with the
+ * sectors of every chip the programmer knows about. What's read back is
+ * checked the same way, so a bad SIMM is reported by chip and block.
+ *
+ * --sims N runs N copies of the simulator instead of using real programmers,
+ * for trying it out. --watch keeps going after the programmers that are there
+ * at the start are done, and runs a job on each programmer that's plugged in
+ * after that, until it's stopped with Ctrl-C.
+ */
+
+#include "simm_client.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <glob.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/// Size of the chunks of data in reads and writes
+#define CHUNK_SIZE					1024
+/// The most a SIMM can hold
+#define MAX_SIMM_SIZE				(8 * 1024UL * 1024UL)
+/// Number of chips on a SIMM
+#define NUM_CHIPS					4
+/// Bytes of each chip covered by one checksum. Every sector of every chip
+/// the programmer supports is a multiple of this.
+#define BLOCK_SIZE_PER_CHIP			4096
+/// Bytes of the SIMM covered by one block of checksums
+#define BLOCK_SIZE					(BLOCK_SIZE_PER_CHIP * NUM_CHIPS)
+/// How long to wait for something that might not be a programmer to answer
+#define PROBE_TIMEOUT_MS			2000
+/// How long to wait for a programmer to reply once we know it is one
+#define REPLY_TIMEOUT_MS			180000
+/// How long to wait for something to happen before checking on everything
+#define LOOP_TIMEOUT_MS				100
+/// How often to look for new programmers with --watch
+#define SCAN_INTERVAL_US			2000000
+/// Most --chips options
+#define MAX_CHIPS_OPTIONS			16
+
+/// The steps of a job, in order
+typedef enum FarmStep
+{
+	FarmProbe = 0,
+	FarmErase,
+	FarmWrite,
+	FarmVerify,
+	FarmNumSteps
+} FarmStep;
+
+/// Names of the steps, for printing
+static char const *const stepNames[FarmNumSteps] = {"probe", "erase", "write", "verify"};
+
+/// How a worker's job is going
+typedef enum FarmState
+{
+	FarmRunning = 0,
+	/// The job is over, but the programmer hasn't been closed yet
+	FarmFinishing,
+	FarmDone
+} FarmState;
+
+/// The image, shared by every worker
+typedef struct FarmImage
+{
+	/// The image, padded with 0xFF to a whole number of chunks
+	uint8_t *data;
+	uint32_t size;
+	/// CRC-32 of each chip's share of each block, in byte lane order
+	/// (lane 0 = IC4), block by block
+	uint32_t *crcs;
+	uint32_t numBlocks;
+} FarmImage;
+
+/// A programmer and the job running on it
+typedef struct FarmWorker
+{
+	/// The serial port, or a name for a simulator
+	char name[64];
+	SIMMClient *client;
+	/// The simulator's socket and process ID, or -1 and 0 for a real programmer
+	int simFd;
+	pid_t simPid;
+	FarmState state;
+	FarmStep step;
+	/// Requests of the current step that haven't finished yet
+	uint32_t pending;
+	bool failed;
+	/// True if it never answered like a programmer, so it isn't counted
+	bool notProgrammer;
+	/// True once a --watch scan doesn't find the serial port any more
+	bool gone;
+	char error[256];
+	uint8_t chipIDs[8];
+	uint8_t version[4];
+	uint8_t *readBack;
+	/// When the job and the current step started, and how long each step took
+	uint64_t startUS;
+	uint64_t stepStartUS;
+	uint64_t doneUS;
+	uint64_t stepUS[FarmNumSteps];
+} FarmWorker;
+
+static FarmImage image;
+static FarmWorker **workers;
+static uint32_t numWorkers;
+static uint32_t window = SIMM_CLIENT_DEFAULT_WINDOW;
+static bool verifyAfterWrite = true;
+static uint32_t crcTable[256];
+static volatile sig_atomic_t stopRequested;
+
+static void Farm_StartStep(FarmWorker *worker, FarmStep step);
+
+/** Gets the time from a monotonic clock
+ *
+ * @return The time in microseconds
+ */
+static uint64_t Farm_Now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000ULL + (uint64_t)ts.tv_nsec / 1000ULL;
+}
+
+/** Fills in the CRC-32 lookup table
+ */
+static void Farm_InitCRC(void)
+{
+	for (uint32_t i = 0; i < 256; i++)
+	{
+		uint32_t crc = i;
+		for (int bit = 0; bit < 8; bit++)
+		{
+			crc = (crc & 1) ? ((crc >> 1) ^ 0xEDB88320UL) : (crc >> 1);
+		}
+		crcTable[i] = crc;
+	}
+}
+
+/** Works out the CRC-32 of each chip's share of a block of SIMM data
+ *
+ * @param data The start of the block
+ * @param len The length of the block, a multiple of NUM_CHIPS
+ * @param crcs Filled in with the CRC of each byte lane
+ */
+static void Farm_BlockCRCs(uint8_t const *data, uint32_t len, uint32_t crcs[NUM_CHIPS])
+{
+	uint32_t crc[NUM_CHIPS] = {0xFFFFFFFFUL, 0xFFFFFFFFUL, 0xFFFFFFFFUL, 0xFFFFFFFFUL};
+
+	for (uint32_t i = 0; i < len; i += NUM_CHIPS)
+	{
+		for (int lane = 0; lane < NUM_CHIPS; lane++)
+		{
+			crc[lane] = crcTable[(crc[lane] ^ data[i + lane]) & 0xFF] ^ (crc[lane] >> 8);
+		}
+	}
+	for (int lane = 0; lane < NUM_CHIPS; lane++)
+	{
+		crcs[lane] = ~crc[lane];
+	}
+}
+
+/** Loads the image and works out its checksums
+ *
+ * @param path The image file
+ * @return True on success, false on failure
+ */
+static bool Farm_LoadImage(char const *path)
+{
+	FILE *f = fopen(path, "rb");
+	if (!f)
+	{
+		fprintf(stderr, "Unable to open %s: %s\n", path, strerror(errno));
+		return false;
+	}
+
+	image.data = malloc(MAX_SIMM_SIZE + 1);
+	if (!image.data)
+	{
+		fclose(f);
+		return false;
+	}
+	size_t const len = fread(image.data, 1, MAX_SIMM_SIZE + 1, f);
+	bool const readError = ferror(f);
+	fclose(f);
+	if (readError || len == 0 || len > MAX_SIMM_SIZE)
+	{
+		fprintf(stderr, "%s: %s\n", path, readError ? "unable to read image" :
+				len ? "image is bigger than a SIMM can hold" : "image is empty");
+		return false;
+	}
+
+	// Reads and writes go a chunk at a time, and 0xFF is what an erased
+	// chip has in it anyway
+	image.size = (uint32_t)((len + CHUNK_SIZE - 1) / CHUNK_SIZE * CHUNK_SIZE);
+	memset(image.data + len, 0xFF, image.size - len);
+
+	image.numBlocks = (image.size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+	image.crcs = malloc(image.numBlocks * NUM_CHIPS * sizeof(uint32_t));
+	if (!image.crcs)
+	{
+		return false;
+	}
+	for (uint32_t block = 0; block < image.numBlocks; block++)
+	{
+		uint32_t const start = block * BLOCK_SIZE;
+		uint32_t const blockLen = (image.size - start < BLOCK_SIZE) ? image.size - start : BLOCK_SIZE;
+		Farm_BlockCRCs(image.data + start, blockLen, &image.crcs[block * NUM_CHIPS]);
+	}
+	return true;
+}
+
+/** Checks what was read back from a SIMM against the image
+ *
+ * @param worker The worker, whose error is filled in if it doesn't match
+ * @return True if it matched
+ */
+static bool Farm_CheckReadBack(FarmWorker *worker)
+{
+	uint32_t badBlocks[NUM_CHIPS] = {0};
+	uint32_t firstBad[NUM_CHIPS] = {0};
+
+	for (uint32_t block = 0; block < image.numBlocks; block++)
+	{
+		uint32_t crcs[NUM_CHIPS];
+		uint32_t const start = block * BLOCK_SIZE;
+		uint32_t const blockLen = (image.size - start < BLOCK_SIZE) ? image.size - start : BLOCK_SIZE;
+		Farm_BlockCRCs(worker->readBack + start, blockLen, crcs);
+		for (int lane = 0; lane < NUM_CHIPS; lane++)
+		{
+			if (crcs[lane] != image.crcs[block * NUM_CHIPS + lane] && badBlocks[lane]++ == 0)
+			{
+				firstBad[lane] = start;
+			}
+		}
+	}
+
+	size_t used = 0;
+	for (int ic = 1; ic <= NUM_CHIPS; ic++)
+	{
+		int const lane = NUM_CHIPS - ic;
+		if (badBlocks[lane] && used < sizeof(worker->error))
+		{
+			used += (size_t)snprintf(worker->error + used, sizeof(worker->error) - used,
+					"%sIC%d doesn't match in %u of %u blocks (first at 0x%06X)",
+					used ? ", " : "", ic, badBlocks[lane], image.numBlocks, firstBad[lane]);
+		}
+	}
+	return used == 0;
+}
+
+/** Prints how a worker's job turned out
+ *
+ * @param worker The worker
+ */
+static void Farm_PrintResult(FarmWorker const *worker)
+{
+	double const totalS = (double)(worker->doneUS - worker->startUS) / 1e6;
+
+	if (worker->notProgrammer)
+	{
+		printf("%s: skipped, it didn't answer like a programmer (%s)\n", worker->name, worker->error);
+		return;
+	}
+	if (worker->failed)
+	{
+		printf("%s: FAILED in %.1f s during %s: %s\n", worker->name, totalS,
+				stepNames[worker->step], worker->error);
+		return;
+	}
+
+	double const writeS = (double)worker->stepUS[FarmWrite] / 1e6;
+	printf("%s: OK in %.1f s (", worker->name, totalS);
+	for (int step = 0; step < FarmNumSteps; step++)
+	{
+		if (step != FarmVerify || verifyAfterWrite)
+		{
+			printf("%s%s %.1f s", step ? ", " : "", stepNames[step], (double)worker->stepUS[step] / 1e6);
+		}
+	}
+	printf("), wrote %u KB at %.1f KB/s, chips", image.size / 1024,
+			writeS > 0 ? (double)image.size / 1024.0 / writeS : 0.0);
+	for (int i = 0; i < NUM_CHIPS; i++)
+	{
+		printf(" %02X%02X", worker->chipIDs[2*i], worker->chipIDs[2*i + 1]);
+	}
+	printf(", firmware %u.%u.%u\n", worker->version[0], worker->version[1], worker->version[2]);
+	fflush(stdout);
+}
+
+/** Ends a worker's job once the last request of a step is done. The client
+ *  is closed later by the event loop, because we're inside its callback.
+ *
+ * @param worker The worker
+ */
+static void Farm_EndJob(FarmWorker *worker)
+{
+	worker->doneUS = Farm_Now();
+	worker->stepUS[worker->step] = worker->doneUS - worker->stepStartUS;
+	worker->state = FarmFinishing;
+	Farm_PrintResult(worker);
+}
+
+/** Records that a worker's job failed, keeping the first reason
+ *
+ * @param worker The worker
+ * @param why What went wrong
+ */
+static void Farm_Fail(FarmWorker *worker, char const *why)
+{
+	if (!worker->failed)
+	{
+		worker->failed = true;
+		worker->notProgrammer = (worker->step == FarmProbe);
+		snprintf(worker->error, sizeof(worker->error), "%s", why);
+	}
+}
+
+/** Called when each request of a job is done
+ *
+ * @param client The client
+ * @param request The request
+ * @param context The worker
+ */
+static void Farm_RequestDone(SIMMClient *client, SIMMClientRequest const *request, void *context)
+{
+	FarmWorker *worker = context;
+	(void)client;
+
+	// Closing the client after the job ended finishes anything left over
+	if (worker->state != FarmRunning)
+	{
+		return;
+	}
+
+	switch (request->status)
+	{
+	case SIMMClientOK:
+		break;
+	case SIMMClientError:
+		Farm_Fail(worker, "the programmer reported an error");
+		break;
+	case SIMMClientInvalid:
+		Farm_Fail(worker, "the programmer doesn't know the command");
+		break;
+	case SIMMClientVerifyError:
+		Farm_Fail(worker, "verifying failed");
+		break;
+	case SIMMClientLinkError:
+		Farm_Fail(worker, "lost contact with the programmer");
+		break;
+	}
+
+	if (request->status == SIMMClientOK)
+	{
+		if (request->type == SIMMClientGetFirmwareVersion)
+		{
+			memcpy(worker->version, request->version, sizeof(worker->version));
+		}
+		else if (request->type == SIMMClientIdentify)
+		{
+			memcpy(worker->chipIDs, request->chipIDs, sizeof(worker->chipIDs));
+		}
+		else if (request->type == SIMMClientRead && !Farm_CheckReadBack(worker))
+		{
+			worker->failed = true;
+		}
+	}
+
+	if (--worker->pending > 0)
+	{
+		return;
+	}
+	if (worker->failed || worker->step == FarmVerify ||
+		(worker->step == FarmWrite && !verifyAfterWrite))
+	{
+		Farm_EndJob(worker);
+	}
+	else
+	{
+		Farm_StartStep(worker, worker->step + 1);
+	}
+}
+
+/** Counts a request towards the ones a step is waiting for
+ *
+ * @param worker The worker
+ * @param queued True if the request was queued
+ * @return queued
+ */
+static bool Farm_Queued(FarmWorker *worker, bool queued)
+{
+	if (queued)
+	{
+		worker->pending++;
+	}
+	return queued;
+}
+
+/** Queues the requests for a step of a worker's job
+ *
+ * @param worker The worker
+ * @param step The step
+ */
+static void Farm_StartStep(FarmWorker *worker, FarmStep step)
+{
+	SIMMClient *const client = worker->client;
+	uint64_t const now = Farm_Now();
+	bool ok = false;
+
+	if (step != FarmProbe)
+	{
+		worker->stepUS[worker->step] = now - worker->stepStartUS;
+	}
+	worker->step = step;
+	worker->stepStartUS = now;
+
+	worker->pending = 0;
+	switch (step)
+	{
+	case FarmProbe:
+		SIMMClient_SetReplyTimeout(client, PROBE_TIMEOUT_MS);
+		ok = Farm_Queued(worker, SIMMClient_EnterWaitingMode(client, Farm_RequestDone, worker)) &&
+			 Farm_Queued(worker, SIMMClient_GetFirmwareVersion(client, Farm_RequestDone, worker)) &&
+			 Farm_Queued(worker, SIMMClient_Identify(client, Farm_RequestDone, worker));
+		break;
+	case FarmErase:
+		// Identifying the chips set the programmer up for them, so there's
+		// no need to tell it what kind of SIMM this is
+		SIMMClient_SetReplyTimeout(client, REPLY_TIMEOUT_MS);
+		ok = Farm_Queued(worker, SIMMClient_EraseChips(client, Farm_RequestDone, worker));
+		break;
+	case FarmWrite:
+		ok = Farm_Queued(worker, SIMMClient_SetVerify(client, false, Farm_RequestDone, worker)) &&
+			 Farm_Queued(worker, SIMMClient_Write(client, 0, image.data, image.size, Farm_RequestDone, worker));
+		break;
+	case FarmVerify:
+		worker->readBack = malloc(image.size);
+		ok = worker->readBack &&
+			 Farm_Queued(worker, SIMMClient_Read(client, 0, worker->readBack, image.size, Farm_RequestDone, worker));
+		break;
+	case FarmNumSteps:
+		break;
+	}
+
+	if (!ok)
+	{
+		// If some of the step's requests were queued, the job ends when the
+		// last of them is done
+		Farm_Fail(worker, "out of memory");
+		if (worker->pending == 0)
+		{
+			Farm_EndJob(worker);
+		}
+	}
+}
+
+/** Starts a simulated programmer
+ *
+ * @param worker The worker to attach it to
+ * @param simPath The simulator to run, or NULL to find it next to us
+ * @param chips The chips to simulate, or NULL for the default
+ * @return True on success, false on failure
+ */
+static bool Farm_StartSim(FarmWorker *worker, char const *simPath, char const *chips)
+{
+	char defaultPath[4096];
+	int sockets[2];
+
+	if (!simPath)
+	{
+		ssize_t const len = readlink("/proc/self/exe", defaultPath, sizeof(defaultPath) - 1);
+		if (len <= 0)
+		{
+			perror("Unable to find the simulator");
+			return false;
+		}
+		defaultPath[len] = '\0';
+		char *slash = strrchr(defaultPath, '/');
+		snprintf(slash + 1, sizeof(defaultPath) - (size_t)(slash + 1 - defaultPath), "SIMMProgrammer.elf");
+		simPath = defaultPath;
+	}
+
+	// Other simulators mustn't inherit our end of this one's socket, or it
+	// won't see it close when we're done with it
+	if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sockets) < 0)
+	{
+		perror("Unable to create socket for simulator");
+		return false;
+	}
+
+	worker->simPid = fork();
+	if (worker->simPid < 0)
+	{
+		perror("Unable to start simulator");
+		worker->simPid = 0;
+		close(sockets[0]);
+		close(sockets[1]);
+		return false;
+	}
+	else if (worker->simPid == 0)
+	{
+		char fdString[16];
+		fcntl(sockets[1], F_SETFD, 0);
+		snprintf(fdString, sizeof(fdString), "%d", sockets[1]);
+		setenv("SIMM_SIM_FD", fdString, 1);
+		if (chips)
+		{
+			setenv("SIMM_SIM_CHIPS", chips, 1);
+		}
+		execl(simPath, simPath, (char *)NULL);
+		fprintf(stderr, "Unable to run %s: %s\n", simPath, strerror(errno));
+		_exit(1);
+	}
+
+	close(sockets[1]);
+	worker->simFd = sockets[0];
+	worker->client = SIMMClient_Attach(worker->simFd);
+	return worker->client != NULL;
+}
+
+/** Adds a worker and starts its job
+ *
+ * @param name The serial port, or a name for a simulator
+ * @param simPath The simulator to run, or NULL for a real programmer
+ * @param chips The chips to simulate, or NULL for the default
+ * @param isSim True to start a simulator instead of opening the serial port
+ * @return True if the job started, false on failure
+ */
+static bool Farm_AddWorker(char const *name, bool isSim, char const *simPath, char const *chips)
+{
+	FarmWorker **more = realloc(workers, (numWorkers + 1) * sizeof(FarmWorker *));
+	if (!more)
+	{
+		return false;
+	}
+	workers = more;
+
+	FarmWorker *worker = calloc(1, sizeof(FarmWorker));
+	if (!worker)
+	{
+		return false;
+	}
+	snprintf(worker->name, sizeof(worker->name), "%s", name);
+	worker->simFd = -1;
+	worker->startUS = Farm_Now();
+	workers[numWorkers++] = worker;
+
+	if (isSim ? !Farm_StartSim(worker, simPath, chips) : !(worker->client = SIMMClient_Open(name)))
+	{
+		Farm_Fail(worker, "unable to open it");
+		Farm_EndJob(worker);
+		return false;
+	}
+	SIMMClient_SetName(worker->client, worker->name);
+	SIMMClient_SetWindow(worker->client, window);
+	Farm_StartStep(worker, FarmProbe);
+	return true;
+}
+
+/** Closes a worker's programmer once its job is over
+ *
+ * @param worker The worker
+ */
+static void Farm_CloseWorker(FarmWorker *worker)
+{
+	if (worker->client)
+	{
+		SIMMClient_Close(worker->client);
+		worker->client = NULL;
+	}
+	if (worker->simFd >= 0)
+	{
+		// The simulator quits when its socket is closed
+		close(worker->simFd);
+		worker->simFd = -1;
+	}
+	if (worker->simPid > 0)
+	{
+		waitpid(worker->simPid, NULL, 0);
+		worker->simPid = 0;
+	}
+	free(worker->readBack);
+	worker->readBack = NULL;
+	worker->state = FarmDone;
+}
+
+/** Looks for programmers and starts a job on each one that's new
+ *
+ * A serial port that already had a job only gets another one after it has
+ * disappeared and come back, which is what happens when a programmer is
+ * unplugged and plugged back in with a new SIMM.
+ *
+ * @param pattern Serial ports to look for, as a glob pattern
+ */
+static void Farm_Scan(char const *pattern)
+{
+	glob_t found;
+
+	if (glob(pattern, 0, NULL, &found) != 0)
+	{
+		found.gl_pathc = 0;
+		found.gl_pathv = NULL;
+	}
+
+	for (uint32_t i = 0; i < numWorkers; i++)
+	{
+		if (workers[i]->simFd >= 0 || workers[i]->state != FarmDone)
+		{
+			continue;
+		}
+		workers[i]->gone = true;
+		for (size_t j = 0; j < found.gl_pathc; j++)
+		{
+			if (strcmp(workers[i]->name, found.gl_pathv[j]) == 0)
+			{
+				workers[i]->gone = false;
+			}
+		}
+	}
+
+	for (size_t j = 0; j < found.gl_pathc; j++)
+	{
+		bool known = false;
+		for (uint32_t i = 0; i < numWorkers && !known; i++)
+		{
+			known = !workers[i]->gone && strcmp(workers[i]->name, found.gl_pathv[j]) == 0;
+		}
+		if (!known)
+		{
+			Farm_AddWorker(found.gl_pathv[j], false, NULL, NULL);
+		}
+	}
+
+	if (found.gl_pathv)
+	{
+		globfree(&found);
+	}
+}
+
+/** Runs every worker's job until they're all done
+ *
+ * @param pattern Serial ports to keep looking for, or NULL to stop once the
+ *                jobs that are running are done
+ * @param busyUS Filled in with how long at least one job was running
+ */
+static void Farm_Run(char const *pattern, uint64_t *busyUS)
+{
+	struct pollfd *pfds = NULL;
+	uint32_t pfdsSize = 0;
+	uint64_t lastScanUS = Farm_Now();
+	uint64_t lastUS = lastScanUS;
+
+	*busyUS = 0;
+	while (!stopRequested)
+	{
+		uint64_t const now = Farm_Now();
+		uint32_t running = 0;
+		for (uint32_t i = 0; i < numWorkers; i++)
+		{
+			running += (workers[i]->state != FarmDone);
+		}
+		if (running)
+		{
+			*busyUS += now - lastUS;
+		}
+		lastUS = now;
+
+		if (pattern && now - lastScanUS >= SCAN_INTERVAL_US)
+		{
+			Farm_Scan(pattern);
+			lastScanUS = now;
+			continue;
+		}
+		if (!running && !pattern)
+		{
+			break;
+		}
+
+		if (pfdsSize < numWorkers)
+		{
+			struct pollfd *more = realloc(pfds, numWorkers * sizeof(struct pollfd));
+			if (!more)
+			{
+				break;
+			}
+			pfds = more;
+			pfdsSize = numWorkers;
+		}
+		for (uint32_t i = 0; i < numWorkers; i++)
+		{
+			bool const active = workers[i]->state == FarmRunning;
+			pfds[i].fd = active ? SIMMClient_FD(workers[i]->client) : -1;
+			pfds[i].events = active ? SIMMClient_PollEvents(workers[i]->client) : 0;
+			pfds[i].revents = 0;
+		}
+		if (poll(pfds, numWorkers, LOOP_TIMEOUT_MS) < 0 && errno != EINTR)
+		{
+			perror("Unable to wait for the programmers");
+			break;
+		}
+
+		// Every client gets a turn, even if its file descriptor isn't
+		// ready, so it can notice when the programmer stops answering
+		for (uint32_t i = 0; i < numWorkers; i++)
+		{
+			if (workers[i]->state == FarmRunning)
+			{
+				SIMMClient_Process(workers[i]->client, 0);
+			}
+			if (workers[i]->state == FarmFinishing)
+			{
+				Farm_CloseWorker(workers[i]);
+			}
+		}
+	}
+
+	// Anything still running was interrupted
+	for (uint32_t i = 0; i < numWorkers; i++)
+	{
+		if (workers[i]->state == FarmRunning)
+		{
+			if (!workers[i]->failed)
+			{
+				Farm_Fail(workers[i], "stopped");
+				workers[i]->notProgrammer = false;
+			}
+			Farm_EndJob(workers[i]);
+		}
+		if (workers[i]->state == FarmFinishing)
+		{
+			Farm_CloseWorker(workers[i]);
+		}
+	}
+	free(pfds);
+}
+
+/** Handles Ctrl-C
+ *
+ * @param sig The signal
+ */
+static void Farm_Stop(int sig)
+{
+	(void)sig;
+	stopRequested = 1;
+}
+
+/** Prints usage information
+ *
+ * @param name The program's name
+ */
+static void Farm_Usage(char const *name)
+{
+	fprintf(stderr,
+		"Usage: %s [options] IMAGE\n"
+		"  --devices PATTERN  programmers to use (default: /dev/ttyACM*)\n"
+		"  --watch            keep going, and flash programmers as they're plugged in\n"
+		"  --sims N           use N simulated programmers instead\n"
+		"  --sim PATH         simulator to run (default: SIMMProgrammer.elf next to this program)\n"
+		"  --chips CHIPS      simulated chips, like SIMM_SIM_CHIPS. Give it more than once\n"
+		"                     to put different chips in each simulator.\n"
+		"  --window N         chunks to keep in flight during reads and writes (default: %d)\n"
+		"  --no-verify        don't read the SIMMs back after writing them\n",
+		name, SIMM_CLIENT_DEFAULT_WINDOW);
+}
+
+int main(int argc, char *argv[])
+{
+	static const struct option options[] = {
+		{"devices", required_argument, NULL, 'd'},
+		{"watch", no_argument, NULL, 'w'},
+		{"sims", required_argument, NULL, 'n'},
+		{"sim", required_argument, NULL, 's'},
+		{"chips", required_argument, NULL, 'c'},
+		{"window", required_argument, NULL, 'W'},
+		{"no-verify", no_argument, NULL, 'v'},
+		{"help", no_argument, NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+	char const *pattern = "/dev/ttyACM*";
+	char const *simPath = NULL;
+	char const *chips[MAX_CHIPS_OPTIONS];
+	uint32_t numChips = 0;
+	uint32_t numSims = 0;
+	bool watch = false;
+	int opt;
+
+	while ((opt = getopt_long(argc, argv, "h", options, NULL)) != -1)
+	{
+		switch (opt)
+		{
+		case 'd': pattern = optarg; break;
+		case 'w': watch = true; break;
+		case 's': simPath = optarg; break;
+		case 'v': verifyAfterWrite = false; break;
+		case 'n':
+			numSims = (uint32_t)strtoul(optarg, NULL, 0);
+			break;
+		case 'W':
+			window = (uint32_t)strtoul(optarg, NULL, 0);
+			break;
+		case 'c':
+			if (numChips < MAX_CHIPS_OPTIONS)
+			{
+				chips[numChips++] = optarg;
+			}
+			break;
+		default:
+			Farm_Usage(argv[0]);
+			return (opt == 'h') ? 0 : 1;
+		}
+	}
+	if (optind != argc - 1 || (numSims && watch) || (!numSims && (simPath || numChips)))
+	{
+		Farm_Usage(argv[0]);
+		return 1;
+	}
+
+	Farm_InitCRC();
+	if (!Farm_LoadImage(argv[optind]))
+	{
+		return 1;
+	}
+
+	// A programmer going away shouldn't take us with it
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = SIG_IGN;
+	sigaction(SIGPIPE, &sa, NULL);
+	sa.sa_handler = Farm_Stop;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	if (numSims)
+	{
+		for (uint32_t i = 0; i < numSims; i++)
+		{
+			char name[16];
+			snprintf(name, sizeof(name), "sim%u", i + 1);
+			Farm_AddWorker(name, true, simPath, numChips ? chips[i < numChips ? i : numChips - 1] : NULL);
+		}
+	}
+	else
+	{
+		Farm_Scan(pattern);
+	}
+	if (!numWorkers && !watch)
+	{
+		fprintf(stderr, "No programmers found at %s\n", pattern);
+		return 1;
+	}
+
+	uint64_t busyUS;
+	Farm_Run(watch ? pattern : NULL, &busyUS);
+
+	uint32_t ok = 0;
+	uint32_t failed = 0;
+	uint64_t jobUS = 0;
+	for (uint32_t i = 0; i < numWorkers; i++)
+	{
+		if (!workers[i]->notProgrammer)
+		{
+			if (workers[i]->failed)
+			{
+				failed++;
+			}
+			else
+			{
+				ok++;
+			}
+			jobUS += workers[i]->doneUS - workers[i]->startUS;
+		}
+	}
+
+	// How much faster this was than running the jobs one after another
+	double const busyS = (double)busyUS / 1e6;
+	double const bytes = (double)image.size * ok;
+	printf("%u SIMMs flashed, %u failed; %.1f MB in %.1f s, %.1f KB/s overall, %.1f programmers busy on average\n",
+			ok, failed, bytes / (1024.0 * 1024.0), busyS,
+			busyS > 0 ? bytes / 1024.0 / busyS : 0.0,
+			busyUS ? (double)jobUS / (double)busyUS : 0.0);
+
+	for (uint32_t i = 0; i < numWorkers; i++)
+	{
+		free(workers[i]);
+	}
+	free(workers);
+	free(image.crcs);
+	free(image.data);
+	return (failed || !ok) ? 1 : 0;
+}
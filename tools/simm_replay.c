@@ -0,0 +1,1172 @@
+/*
+ * simm_replay.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: SIMM Programmer contributors
+ *
+ * Copyright (C) 2026 SIMM Programmer contributors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * -----------------------------------------------------------------------------
+ *
+ * Records and replays sessions between the control software and the
+ * programmer, so a real programming job can be repeated as a benchmark.
+ *
+ * --record makes a virtual serial port for the control software to open, and
+ * passes everything through to a real programmer (--device) or the simulator,
+ * saving every byte in both directions with a timestamp.
+ *
+ * --replay sends what the computer sent in a capture to a programmer or the
+ * simulator again, one exchange at a time. An exchange is what the computer
+ * sent in one go, followed by everything the programmer sent back before the
+ * computer sent something else. Each reply is checked against the recorded
+ * one, and the time from the end of what was sent to the end of the reply is
+ * compared too. Exchanges are grouped into phases by the command they belong
+ * to, which is worked out by following the protocol the same way the firmware
+ * does. Replies that contain timing data (GetStats, GetTrace, GetHealthMap and
+ * SelfBenchmark) can't be expected to match, so only their first byte is
+ * checked. --save records the replay too, so it can be used as the baseline
+ * for the next firmware version.
+ *
+ * The simulator's times come from its virtual clock, so they only include the
+ * time spent on the bus and waiting for the chips, and they don't depend on
+ * how fast the computer is. A real programmer's times come from the wall clock,
+ * so the two can't be compared with each other.
+ *
+ * A capture file starts with the 8 bytes "SIMMCAP1" and a byte that says
+ * which clock it used (0 = wall clock, 1 = the simulator's virtual clock).
+ * Then there's a record for each time data went one way or the other:
+ *   8-byte little endian timestamp in microseconds
+ *   4-byte little endian length
+ *   1-byte direction (0 = computer to programmer, 1 = programmer to computer)
+ *   the data
+ */
+
+#include "../programmer_protocol.h"
+#include "../hal/host/flash_sim.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+/// The first 8 bytes of a capture file
+#define CAPTURE_MAGIC				"SIMMCAP1"
+/// Size of the header before each record's data
+#define RECORD_HEADER_SIZE			13
+/// Size of the chunks of data in reads and writes
+#define CHUNK_SIZE					1024
+/// How long to wait for the programmer to reply
+#define REPLY_TIMEOUT_MS			180000
+/// How long to wait for more of a reply whose length can change
+#define QUIET_TIMEOUT_MS			200
+/// Most bytes to pass through at once when recording
+#define PASS_THROUGH_SIZE			4096
+/// Most mismatched replies to print
+#define MAX_MISMATCHES_SHOWN		10
+
+/// Which way the data in a record went
+typedef enum ReplayDirection
+{
+	ReplayToProgrammer = 0,
+	ReplayFromProgrammer
+} ReplayDirection;
+
+/// Which clock a capture's timestamps came from
+typedef enum ReplayClock
+{
+	ReplayWallClock = 0,
+	ReplaySimClock
+} ReplayClock;
+
+/// A connection to a programmer, real or simulated
+typedef struct ReplayLink
+{
+	/// The serial port or socket
+	int fd;
+	/// The simulator's process ID, or 0 for a real programmer
+	pid_t simPid;
+	/// The simulator's statistics, or NULL for a real programmer
+	FlashSimStats const volatile *stats;
+} ReplayLink;
+
+/// One exchange from a capture
+typedef struct ReplayExchange
+{
+	/// What the computer sent
+	uint8_t *sent;
+	size_t sentLen;
+	/// What the programmer sent back
+	uint8_t *reply;
+	size_t replyLen;
+	/// Time from the end of what was sent to the end of the reply
+	uint64_t latencyUS;
+	/// The command this exchange is part of, or -1 if it isn't known
+	int command;
+	/// True if the command started in this exchange
+	bool startsPhase;
+} ReplayExchange;
+
+/// A whole capture, split up into exchanges
+typedef struct ReplayCapture
+{
+	ReplayClock clock;
+	uint32_t count;
+	ReplayExchange *exchanges;
+} ReplayCapture;
+
+/// Where the phase finder is in the protocol
+typedef enum ReplayWalkState
+{
+	WalkCommand = 0,
+	WalkParams,
+	WalkReadAck,
+	WalkWriteRequest,
+	WalkWriteData,
+	WalkSectorLayout
+} ReplayWalkState;
+
+/// Names of the commands, in ProgrammerCommand order
+static char const * const commandNames[] = {
+	"EnterWaitingMode",
+	"DoElectricalTest",
+	"IdentifyChips",
+	"ReadByte",
+	"ReadChips",
+	"EraseChips",
+	"WriteChips",
+	"GetBootloaderState",
+	"EnterBootloader",
+	"EnterProgrammer",
+	"BootloaderEraseAndWriteProgram",
+	"SetSIMMTypePLCC32_2MB",
+	"SetSIMMTypeLarger",
+	"SetVerifyWhileWriting",
+	"SetNoVerifyWhileWriting",
+	"ErasePortion",
+	"WriteChipsAt",
+	"ReadChipsAt",
+	"SetChipsMask",
+	"SetSectorLayout",
+	"GetFirmwareVersion",
+	"GetStats",
+	"ResetStats",
+	"GetTrace",
+	"ClearTrace",
+	"GetHealthMap",
+	"ResetHealthMap",
+	"SelfBenchmark",
+};
+
+/// Set by the signal handler to stop recording
+static volatile sig_atomic_t stopRecording = 0;
+/// The wall clock when we started, so timestamps start near zero
+static uint64_t startUS;
+
+/** Gets the name of a command
+ *
+ * @param command The command, or -1 if it isn't known
+ * @return Its name
+ */
+static char const *Replay_CommandName(int command)
+{
+	if (command < 0)
+	{
+		return "(before first command)";
+	}
+	if ((size_t)command < sizeof(commandNames)/sizeof(commandNames[0]))
+	{
+		return commandNames[command];
+	}
+	return "(unknown command)";
+}
+
+/** Gets the current time of the clock used for a connection
+ *
+ * @param link The programmer
+ * @return The time in microseconds
+ */
+static uint64_t Replay_Now(ReplayLink const *link)
+{
+	if (link->stats)
+	{
+		return link->stats->timeNS / 1000;
+	}
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000 - startUS;
+}
+
+/** Writes a little-endian value to a file
+ *
+ * @param f The file
+ * @param value The value
+ * @param size Number of bytes to write
+ * @return True on success, false on failure
+ */
+static bool Replay_WriteValue(FILE *f, uint64_t value, int size)
+{
+	for (int i = 0; i < size; i++)
+	{
+		if (fputc((uint8_t)(value >> (8 * i)), f) == EOF)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/** Starts a capture file
+ *
+ * @param path The file
+ * @param clock The clock its timestamps come from
+ * @return The file, or NULL on failure
+ */
+static FILE *Replay_CreateCapture(char const *path, ReplayClock clock)
+{
+	FILE *f = fopen(path, "wb");
+	if (!f || fwrite(CAPTURE_MAGIC, 1, 8, f) != 8 || fputc(clock, f) == EOF)
+	{
+		fprintf(stderr, "Unable to create %s: %s\n", path, strerror(errno));
+		if (f)
+		{
+			fclose(f);
+		}
+		return NULL;
+	}
+	return f;
+}
+
+/** Adds a record to a capture file
+ *
+ * @param f The file
+ * @param timeUS When the data went by
+ * @param direction Which way it went
+ * @param data The data
+ * @param len The number of bytes
+ * @return True on success, false on failure
+ */
+static bool Replay_WriteRecord(FILE *f, uint64_t timeUS, ReplayDirection direction, void const *data, size_t len)
+{
+	if (!Replay_WriteValue(f, timeUS, 8) ||
+		!Replay_WriteValue(f, len, 4) ||
+		fputc(direction, f) == EOF ||
+		fwrite(data, 1, len, f) != len)
+	{
+		perror("Unable to write to capture");
+		return false;
+	}
+	return true;
+}
+
+/** Appends data to a growing buffer
+ *
+ * @param buf The buffer
+ * @param len Its length, which is updated
+ * @param data The data to add
+ * @param dataLen The number of bytes to add
+ * @return True on success, false if out of memory
+ */
+static bool Replay_Append(uint8_t **buf, size_t *len, void const *data, size_t dataLen)
+{
+	uint8_t *bigger = realloc(*buf, *len + dataLen);
+	if (!bigger)
+	{
+		return false;
+	}
+	memcpy(bigger + *len, data, dataLen);
+	*buf = bigger;
+	*len += dataLen;
+	return true;
+}
+
+/** Reads a capture file and splits it up into exchanges
+ *
+ * @param path The file
+ * @param capture Filled in with the capture
+ * @return True on success, false on failure
+ */
+static bool Replay_LoadCapture(char const *path, ReplayCapture *capture)
+{
+	uint8_t header[9];
+	uint8_t *data = NULL;
+	uint32_t capacity = 0;
+	uint64_t sentUS = 0;
+	bool ok = false;
+
+	memset(capture, 0, sizeof(*capture));
+	FILE *f = fopen(path, "rb");
+	if (!f)
+	{
+		fprintf(stderr, "Unable to open %s: %s\n", path, strerror(errno));
+		return false;
+	}
+	if (fread(header, 1, sizeof(header), f) != sizeof(header) || memcmp(header, CAPTURE_MAGIC, 8))
+	{
+		fprintf(stderr, "%s isn't a capture\n", path);
+		goto done;
+	}
+	capture->clock = (ReplayClock)header[8];
+
+	uint8_t record[RECORD_HEADER_SIZE];
+	size_t got;
+	while ((got = fread(record, 1, sizeof(record), f)) == sizeof(record))
+	{
+		uint64_t timeUS = 0;
+		uint32_t len = 0;
+		for (int i = 7; i >= 0; i--)
+		{
+			timeUS = (timeUS << 8) | record[i];
+		}
+		for (int i = 11; i >= 8; i--)
+		{
+			len = (len << 8) | record[i];
+		}
+		ReplayDirection const direction = (ReplayDirection)record[12];
+
+		free(data);
+		if (!(data = malloc(len ? len : 1)) || fread(data, 1, len, f) != len)
+		{
+			fprintf(stderr, "%s is cut off\n", path);
+			goto done;
+		}
+
+		// Sending something after a reply starts the next exchange
+		ReplayExchange *e = capture->count ? &capture->exchanges[capture->count - 1] : NULL;
+		if (!e || (direction == ReplayToProgrammer && e->replyLen))
+		{
+			if (capture->count == capacity)
+			{
+				capacity = capacity ? capacity * 2 : 256;
+				ReplayExchange *bigger = realloc(capture->exchanges, capacity * sizeof(ReplayExchange));
+				if (!bigger)
+				{
+					goto done;
+				}
+				capture->exchanges = bigger;
+			}
+			e = &capture->exchanges[capture->count++];
+			memset(e, 0, sizeof(*e));
+			e->command = -1;
+		}
+
+		if (direction == ReplayToProgrammer)
+		{
+			ok = Replay_Append(&e->sent, &e->sentLen, data, len);
+			sentUS = timeUS;
+		}
+		else
+		{
+			ok = Replay_Append(&e->reply, &e->replyLen, data, len);
+			e->latencyUS = (timeUS > sentUS) ? timeUS - sentUS : 0;
+		}
+		if (!ok)
+		{
+			goto done;
+		}
+	}
+	ok = (got == 0);
+	if (!ok)
+	{
+		fprintf(stderr, "%s is cut off\n", path);
+	}
+
+done:
+	free(data);
+	fclose(f);
+	return ok;
+}
+
+/** Works out which command each exchange is part of
+ *
+ * This follows the computer's side of the protocol like the firmware does.
+ * Whether a read or write keeps going depends on the programmer's replies,
+ * so the first byte of the reply to each exchange is checked too.
+ *
+ * @param capture The capture
+ */
+static void Replay_FindPhases(ReplayCapture *capture)
+{
+	ReplayWalkState state = WalkCommand;
+	ReplayWalkState afterParams = WalkCommand;
+	uint32_t remaining = 0;
+	uint32_t layoutValue = 0;
+	bool layoutSize = false;
+	int command = -1;
+
+	for (uint32_t i = 0; i < capture->count; i++)
+	{
+		ReplayExchange *e = &capture->exchanges[i];
+		// The reply byte that means the command is still going, or -1 if
+		// the last byte sent doesn't depend on a reply
+		int keepGoingReply = -1;
+
+		for (size_t j = 0; j < e->sentLen; j++)
+		{
+			uint8_t const b = e->sent[j];
+			keepGoingReply = -1;
+			switch (state)
+			{
+			case WalkCommand:
+				command = b;
+				e->startsPhase = true;
+				remaining = 0;
+				switch (b)
+				{
+				case ReadChips:
+					remaining = 4;
+					afterParams = WalkReadAck;
+					break;
+				case ReadChipsAt:
+					remaining = 8;
+					afterParams = WalkReadAck;
+					break;
+				case WriteChips:
+					state = WalkWriteRequest;
+					keepGoingReply = CommandReplyOK;
+					break;
+				case WriteChipsAt:
+					remaining = 4;
+					afterParams = WalkWriteRequest;
+					break;
+				case ErasePortion:
+				case SelfBenchmark:
+					remaining = 8;
+					afterParams = WalkCommand;
+					break;
+				case SetChipsMask:
+					remaining = 1;
+					afterParams = WalkCommand;
+					break;
+				case SetSectorLayout:
+					state = WalkSectorLayout;
+					layoutValue = 0;
+					layoutSize = false;
+					remaining = 4;
+					break;
+				}
+				if (remaining && state == WalkCommand)
+				{
+					state = WalkParams;
+					keepGoingReply = CommandReplyOK;
+				}
+				break;
+			case WalkParams:
+				if (--remaining == 0)
+				{
+					state = afterParams;
+					if (afterParams == WalkReadAck)
+					{
+						keepGoingReply = ProgrammerReadOK;
+					}
+					else if (afterParams == WalkWriteRequest)
+					{
+						keepGoingReply = ProgrammerWriteOK;
+					}
+				}
+				break;
+			case WalkReadAck:
+				if (b == ComputerReadOK)
+				{
+					keepGoingReply = ProgrammerReadMoreData;
+				}
+				else
+				{
+					state = WalkCommand;
+				}
+				break;
+			case WalkWriteRequest:
+				if (b == ComputerWriteMore)
+				{
+					state = WalkWriteData;
+					remaining = CHUNK_SIZE;
+					keepGoingReply = ProgrammerWriteOK;
+				}
+				else
+				{
+					state = WalkCommand;
+				}
+				break;
+			case WalkWriteData:
+				if (--remaining == 0)
+				{
+					state = WalkWriteRequest;
+					keepGoingReply = ProgrammerWriteOK;
+				}
+				break;
+			case WalkSectorLayout:
+				// Pairs of 4-byte sector counts and sizes, ending with a count of 0
+				layoutValue |= (uint32_t)b << (8 * (4 - remaining));
+				if (--remaining == 0)
+				{
+					if (!layoutSize && layoutValue == 0)
+					{
+						state = WalkCommand;
+					}
+					layoutSize = !layoutSize;
+					layoutValue = 0;
+					remaining = 4;
+				}
+				break;
+			}
+		}
+
+		// If the computer waited for a reply before going on, the reply
+		// tells us whether the command is still going. If it didn't wait,
+		// it must have assumed everything was fine.
+		if (keepGoingReply >= 0 && e->replyLen && e->reply[0] != keepGoingReply)
+		{
+			state = WalkCommand;
+		}
+
+		e->command = command;
+	}
+}
+
+/** Checks whether a command's reply has timing data in it
+ *
+ * @param command The command
+ * @return True if the reply is expected to change from run to run
+ */
+static bool Replay_HasTimingData(int command)
+{
+	return command == GetStats || command == GetTrace ||
+		   command == GetHealthMap || command == SelfBenchmark;
+}
+
+/** Starts the simulated programmer
+ *
+ * @param link Filled in with the connection to it
+ * @param simPath The simulator program, or NULL to look next to this program
+ * @param chips The simulated chips (see SIMM_SIM_CHIPS), or NULL for the default
+ * @return True on success, false on failure
+ */
+static bool Replay_StartSim(ReplayLink *link, char const *simPath, char const *chips)
+{
+	char defaultPath[4096];
+	int sockets[2];
+
+	if (!simPath)
+	{
+		ssize_t const len = readlink("/proc/self/exe", defaultPath, sizeof(defaultPath) - 1);
+		if (len <= 0)
+		{
+			perror("Unable to find the simulator");
+			return false;
+		}
+		defaultPath[len] = '\0';
+		char *slash = strrchr(defaultPath, '/');
+		snprintf(slash + 1, sizeof(defaultPath) - (size_t)(slash + 1 - defaultPath), "SIMMProgrammer.elf");
+		simPath = defaultPath;
+	}
+
+	// The simulator's statistics have its virtual clock in them
+	int const statsFd = memfd_create("simm-sim-stats", 0);
+	if (statsFd < 0 || ftruncate(statsFd, sizeof(FlashSimStats)) < 0)
+	{
+		perror("Unable to create shared statistics");
+		return false;
+	}
+	void *stats = mmap(NULL, sizeof(FlashSimStats), PROT_READ, MAP_SHARED, statsFd, 0);
+	if (stats == MAP_FAILED)
+	{
+		perror("Unable to map shared statistics");
+		return false;
+	}
+	link->stats = stats;
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) < 0)
+	{
+		perror("Unable to create socket for simulator");
+		return false;
+	}
+
+	link->simPid = fork();
+	if (link->simPid < 0)
+	{
+		perror("Unable to start simulator");
+		return false;
+	}
+	else if (link->simPid == 0)
+	{
+		char fdString[16];
+		close(sockets[0]);
+		snprintf(fdString, sizeof(fdString), "%d", sockets[1]);
+		setenv("SIMM_SIM_FD", fdString, 1);
+		snprintf(fdString, sizeof(fdString), "%d", statsFd);
+		setenv("SIMM_SIM_STATS_FD", fdString, 1);
+		if (chips)
+		{
+			setenv("SIMM_SIM_CHIPS", chips, 1);
+		}
+		execl(simPath, simPath, (char *)NULL);
+		fprintf(stderr, "Unable to run %s: %s\n", simPath, strerror(errno));
+		_exit(1);
+	}
+
+	close(sockets[1]);
+	close(statsFd);
+	link->fd = sockets[0];
+	return true;
+}
+
+/** Opens a real programmer's serial port
+ *
+ * @param link Filled in with the connection to it
+ * @param device The serial port
+ * @return True on success, false on failure
+ */
+static bool Replay_OpenDevice(ReplayLink *link, char const *device)
+{
+	struct termios tio;
+
+	link->fd = open(device, O_RDWR | O_NOCTTY);
+	if (link->fd < 0 || tcgetattr(link->fd, &tio) < 0)
+	{
+		fprintf(stderr, "Unable to open %s: %s\n", device, strerror(errno));
+		return false;
+	}
+	cfmakeraw(&tio);
+	tcsetattr(link->fd, TCSANOW, &tio);
+	tcflush(link->fd, TCIOFLUSH);
+	return true;
+}
+
+/** Closes the connection, and waits for the simulator to exit if we started it
+ *
+ * @param link The programmer
+ */
+static void Replay_Close(ReplayLink *link)
+{
+	close(link->fd);
+	if (link->simPid > 0)
+	{
+		waitpid(link->simPid, NULL, 0);
+		munmap((void *)link->stats, sizeof(FlashSimStats));
+		link->stats = NULL;
+	}
+}
+
+/** Sends data to a file descriptor, waiting for room if necessary
+ *
+ * @param fd The file descriptor
+ * @param data The data
+ * @param len The number of bytes
+ * @return True on success, false on failure
+ */
+static bool Replay_Send(int fd, void const *data, size_t len)
+{
+	uint8_t const *p = data;
+	while (len)
+	{
+		ssize_t const written = write(fd, p, len);
+		if (written > 0)
+		{
+			p += written;
+			len -= (size_t)written;
+		}
+		else if (written < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		else
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/** Handles Ctrl-C while recording
+ *
+ * @param sig The signal
+ */
+static void Replay_StopSignal(int sig)
+{
+	(void)sig;
+	stopRecording = 1;
+}
+
+/** Passes a session between the control software and a programmer through a
+ *  virtual serial port, and records it
+ *
+ * @param link The programmer
+ * @param capturePath Where to save the capture
+ * @param linkPath Where to make a symlink to the virtual serial port, or NULL
+ * @return True on success, false on failure
+ */
+static bool Replay_Record(ReplayLink *link, char const *capturePath, char const *linkPath)
+{
+	uint8_t buf[PASS_THROUGH_SIZE];
+	uint64_t bytes[2] = {0, 0};
+	bool ok = true;
+
+	int const ptyFd = posix_openpt(O_RDWR | O_NOCTTY);
+	if (ptyFd < 0 || grantpt(ptyFd) < 0 || unlockpt(ptyFd) < 0)
+	{
+		perror("Unable to create virtual serial port");
+		return false;
+	}
+
+	// Keep our own handle to the other end, so the control software can close
+	// and reopen it without hanging it up. Make it raw, like a real CDC device.
+	char const *name = ptsname(ptyFd);
+	struct termios tio;
+	int const slaveFd = open(name, O_RDWR | O_NOCTTY);
+	if (slaveFd < 0 || tcgetattr(slaveFd, &tio) < 0)
+	{
+		perror("Unable to open virtual serial port");
+		close(ptyFd);
+		return false;
+	}
+	cfmakeraw(&tio);
+	tcsetattr(slaveFd, TCSANOW, &tio);
+	if (linkPath)
+	{
+		unlink(linkPath);
+		if (symlink(name, linkPath) < 0)
+		{
+			perror("Unable to link to virtual serial port");
+		}
+	}
+
+	FILE *capture = Replay_CreateCapture(capturePath, link->stats ? ReplaySimClock : ReplayWallClock);
+	if (!capture)
+	{
+		close(slaveFd);
+		close(ptyFd);
+		return false;
+	}
+
+	// Don't restart poll() after Ctrl-C, so we notice right away
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = Replay_StopSignal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	fprintf(stderr, "Recording to %s. Point the control software at %s, and press Ctrl-C when it's done.\n",
+			capturePath, name);
+
+	while (ok && !stopRecording)
+	{
+		struct pollfd pfds[2] = {{ptyFd, POLLIN, 0}, {link->fd, POLLIN, 0}};
+		if (poll(pfds, 2, -1) < 0)
+		{
+			ok = (errno == EINTR);
+			continue;
+		}
+
+		for (int i = 0; i < 2 && ok; i++)
+		{
+			if (!(pfds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+			{
+				continue;
+			}
+
+			ssize_t const len = read(pfds[i].fd, buf, sizeof(buf));
+			if (len < 0 && (errno == EINTR || errno == EAGAIN))
+			{
+				continue;
+			}
+			else if (len <= 0)
+			{
+				fprintf(stderr, "Lost connection to %s\n", i ? "programmer" : "control software");
+				ok = false;
+				break;
+			}
+
+			// Timestamp it before passing it on, since the simulator's clock
+			// will move as soon as it has something to do
+			ReplayDirection const direction = i ? ReplayFromProgrammer : ReplayToProgrammer;
+			ok = Replay_WriteRecord(capture, Replay_Now(link), direction, buf, (size_t)len) &&
+				 Replay_Send(i ? ptyFd : link->fd, buf, (size_t)len);
+			bytes[i] += (uint64_t)len;
+		}
+	}
+
+	if (fclose(capture) != 0)
+	{
+		perror("Unable to save capture");
+		ok = false;
+	}
+	if (linkPath)
+	{
+		unlink(linkPath);
+	}
+	close(slaveFd);
+	close(ptyFd);
+
+	fprintf(stderr, "Recorded %llu bytes to the programmer and %llu bytes from it\n",
+			(unsigned long long)bytes[0], (unsigned long long)bytes[1]);
+	return ok;
+}
+
+/** Receives a reply from the programmer
+ *
+ * @param link The programmer
+ * @param buf Buffer for the reply, which grows if necessary
+ * @param capacity The buffer's size, which is updated
+ * @param expected The length of the recorded reply
+ * @param variable True if the reply can be a different length, in which case
+ *                 we stop once the programmer has been quiet for a bit
+ * @return The number of bytes received, which is less than expected if the
+ *         programmer stopped replying
+ */
+static size_t Replay_Receive(ReplayLink *link, uint8_t **buf, size_t *capacity, size_t expected, bool variable)
+{
+	size_t got = 0;
+
+	while (variable || got < expected)
+	{
+		if (got == *capacity)
+		{
+			size_t const bigger = *capacity ? *capacity * 2 : 65536;
+			uint8_t *p = realloc(*buf, bigger);
+			if (!p)
+			{
+				break;
+			}
+			*buf = p;
+			*capacity = bigger;
+		}
+
+		// Only wait a little while for more of a variable reply, once it has
+		// started (or if nothing came back when it was recorded)
+		int const timeout = (variable && (got || !expected)) ? QUIET_TIMEOUT_MS : REPLY_TIMEOUT_MS;
+		struct pollfd pfd = {link->fd, POLLIN, 0};
+		int const result = poll(&pfd, 1, timeout);
+		if (result < 0 && errno == EINTR)
+		{
+			continue;
+		}
+		else if (result <= 0)
+		{
+			break;
+		}
+
+		ssize_t const len = read(link->fd, *buf + got, *capacity - got);
+		if (len > 0)
+		{
+			got += (size_t)len;
+		}
+		else if (len < 0 && (errno == EINTR || errno == EAGAIN))
+		{
+			continue;
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	return got;
+}
+
+/** Replays a capture and compares the results
+ *
+ * @param link The programmer
+ * @param capture The capture
+ * @param latencyUS Filled in with each exchange's latency during the replay
+ * @param savePath Where to record the replay, or NULL
+ * @return The number of exchanges that got a different reply, or -1 if the
+ *         replay couldn't finish
+ */
+static int Replay_Run(ReplayLink *link, ReplayCapture const *capture, uint64_t *latencyUS, char const *savePath)
+{
+	uint8_t *reply = NULL;
+	size_t capacity = 0;
+	int mismatches = 0;
+	FILE *save = NULL;
+
+	if (savePath && !(save = Replay_CreateCapture(savePath, link->stats ? ReplaySimClock : ReplayWallClock)))
+	{
+		return -1;
+	}
+
+	// Make sure a real programmer isn't halfway through something. The
+	// simulator always starts out waiting for a command.
+	if (!link->stats)
+	{
+		uint8_t const command = EnterWaitingMode;
+		size_t const got = Replay_Send(link->fd, &command, 1) ?
+				Replay_Receive(link, &reply, &capacity, 1, false) : 0;
+		if (got != 1 || reply[0] != CommandReplyOK)
+		{
+			fprintf(stderr, "The programmer didn't reply to EnterWaitingMode\n");
+			mismatches = -1;
+		}
+	}
+
+	for (uint32_t i = 0; i < capture->count && mismatches >= 0; i++)
+	{
+		ReplayExchange const *e = &capture->exchanges[i];
+		bool const variable = Replay_HasTimingData(e->command);
+
+		uint64_t const sentUS = Replay_Now(link);
+		if (e->sentLen && !Replay_Send(link->fd, e->sent, e->sentLen))
+		{
+			perror("Unable to write to programmer");
+			mismatches = -1;
+			break;
+		}
+		size_t const got = Replay_Receive(link, &reply, &capacity, e->replyLen, variable);
+		uint64_t const replyUS = Replay_Now(link);
+		latencyUS[i] = got ? replyUS - sentUS : 0;
+
+		if (save && ((e->sentLen && !Replay_WriteRecord(save, sentUS, ReplayToProgrammer, e->sent, e->sentLen)) ||
+					 (got && !Replay_WriteRecord(save, replyUS, ReplayFromProgrammer, reply, got))))
+		{
+			mismatches = -1;
+			break;
+		}
+
+		// Timing data can't match, but the first byte still says whether
+		// the command worked
+		size_t const compareLen = variable ? (e->replyLen ? 1 : 0) : e->replyLen;
+		size_t diff = 0;
+		while (diff < compareLen && diff < got && reply[diff] == e->reply[diff])
+		{
+			diff++;
+		}
+		if (diff < compareLen)
+		{
+			if (mismatches < MAX_MISMATCHES_SHOWN)
+			{
+				printf("Exchange %u (%s): ", i, Replay_CommandName(e->command));
+				if (diff < got)
+				{
+					printf("reply byte %zu was 0x%02X, expected 0x%02X\n", diff, reply[diff], e->reply[diff]);
+				}
+				else
+				{
+					printf("got %zu of %zu reply bytes\n", got, e->replyLen);
+				}
+			}
+			mismatches++;
+
+			// If the programmer stopped replying, we can't go on
+			if (got < compareLen)
+			{
+				fprintf(stderr, "The programmer stopped replying, so the replay can't go on\n");
+				mismatches = -1;
+			}
+		}
+	}
+
+	if (save && fclose(save) != 0)
+	{
+		perror("Unable to save replay");
+		mismatches = -1;
+	}
+	free(reply);
+	return mismatches;
+}
+
+/** Prints how long each phase took when it was recorded and replayed
+ *
+ * @param out Where to print it
+ * @param capture The capture
+ * @param latencyUS Each exchange's latency during the replay
+ * @param change Filled in with the change in total latency, as a fraction
+ */
+static void Replay_PrintPhases(FILE *out, ReplayCapture const *capture, uint64_t const *latencyUS, double *change)
+{
+	uint64_t totalRecorded = 0;
+	uint64_t totalReplayed = 0;
+
+	fprintf(out, "%-32s %9s %13s %13s %9s\n", "phase", "exchanges", "recorded ms", "replayed ms", "change");
+	for (uint32_t i = 0; i < capture->count; )
+	{
+		uint64_t recorded = 0;
+		uint64_t replayed = 0;
+		uint32_t j = i;
+		do
+		{
+			recorded += capture->exchanges[j].latencyUS;
+			replayed += latencyUS[j];
+			j++;
+		} while (j < capture->count && !capture->exchanges[j].startsPhase);
+
+		fprintf(out, "%-32s %9u %13.3f %13.3f ", Replay_CommandName(capture->exchanges[i].command),
+				j - i, recorded / 1000.0, replayed / 1000.0);
+		if (recorded)
+		{
+			fprintf(out, "%+8.1f%%\n", 100.0 * ((double)replayed - recorded) / recorded);
+		}
+		else
+		{
+			fprintf(out, "%9s\n", "-");
+		}
+		totalRecorded += recorded;
+		totalReplayed += replayed;
+		i = j;
+	}
+
+	*change = totalRecorded ? ((double)totalReplayed - totalRecorded) / totalRecorded : 0;
+	fprintf(out, "%-32s %9u %13.3f %13.3f %+8.1f%%\n", "total", capture->count,
+			totalRecorded / 1000.0, totalReplayed / 1000.0, 100.0 * *change);
+}
+
+/** Prints usage information
+ *
+ * @param name The program's name
+ */
+static void Replay_Usage(char const *name)
+{
+	fprintf(stderr,
+		"Usage: %s --record FILE | --replay FILE [options]\n"
+		"  --record FILE    record a session through a virtual serial port to FILE\n"
+		"  --link PATH      also make a symlink to the virtual serial port here\n"
+		"  --replay FILE    replay the session in FILE and compare the replies and timing\n"
+		"  --save FILE      record the replay to FILE, to compare against later\n"
+		"  --max-slowdown PERCENT\n"
+		"                   fail if the replay took this much longer than the recording\n"
+		"  --device PATH    use a real programmer on this serial port\n"
+		"  --sim PATH       simulator to run (default: SIMMProgrammer.elf next to this program)\n"
+		"  --chips CHIPS    simulated chips, like SIMM_SIM_CHIPS\n",
+		name);
+}
+
+int main(int argc, char *argv[])
+{
+	static const struct option options[] = {
+		{"record", required_argument, NULL, 'r'},
+		{"link", required_argument, NULL, 'l'},
+		{"replay", required_argument, NULL, 'p'},
+		{"save", required_argument, NULL, 'o'},
+		{"max-slowdown", required_argument, NULL, 'm'},
+		{"device", required_argument, NULL, 'd'},
+		{"sim", required_argument, NULL, 's'},
+		{"chips", required_argument, NULL, 'c'},
+		{"help", no_argument, NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+	char const *recordPath = NULL;
+	char const *linkPath = NULL;
+	char const *replayPath = NULL;
+	char const *savePath = NULL;
+	char const *device = NULL;
+	char const *simPath = NULL;
+	char const *chips = NULL;
+	double maxSlowdown = -1;
+	int opt;
+
+	while ((opt = getopt_long(argc, argv, "h", options, NULL)) != -1)
+	{
+		switch (opt)
+		{
+		case 'r': recordPath = optarg; break;
+		case 'l': linkPath = optarg; break;
+		case 'p': replayPath = optarg; break;
+		case 'o': savePath = optarg; break;
+		case 'd': device = optarg; break;
+		case 's': simPath = optarg; break;
+		case 'c': chips = optarg; break;
+		case 'm':
+			maxSlowdown = strtod(optarg, NULL) / 100.0;
+			break;
+		default:
+			Replay_Usage(argv[0]);
+			return (opt == 'h') ? 0 : 1;
+		}
+	}
+	if (!recordPath == !replayPath || (recordPath && (savePath || maxSlowdown >= 0)) ||
+		(replayPath && linkPath) || (device && (simPath || chips)))
+	{
+		Replay_Usage(argv[0]);
+		return 1;
+	}
+
+	ReplayCapture capture;
+	if (replayPath)
+	{
+		if (!Replay_LoadCapture(replayPath, &capture))
+		{
+			return 1;
+		}
+		Replay_FindPhases(&capture);
+	}
+
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	startUS = (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+
+	ReplayLink link = {-1, 0, NULL};
+	if (device ? !Replay_OpenDevice(&link, device) : !Replay_StartSim(&link, simPath, chips))
+	{
+		return 1;
+	}
+
+	bool ok;
+	if (recordPath)
+	{
+		ok = Replay_Record(&link, recordPath, linkPath);
+		Replay_Close(&link);
+		return ok ? 0 : 1;
+	}
+
+	uint64_t *latencyUS = calloc(capture.count ? capture.count : 1, sizeof(uint64_t));
+	if (!latencyUS)
+	{
+		return 1;
+	}
+	ReplayClock const clock = link.stats ? ReplaySimClock : ReplayWallClock;
+	int const mismatches = Replay_Run(&link, &capture, latencyUS, savePath);
+	Replay_Close(&link);
+	if (mismatches < 0)
+	{
+		return 1;
+	}
+
+	double change;
+	printf("%s: %u exchanges replayed on %s, %s\n", replayPath, capture.count,
+			device ? device : "the simulator",
+			mismatches ? "some replies didn't match" : "all replies matched");
+	Replay_PrintPhases(stdout, &capture, latencyUS, &change);
+	ok = (mismatches == 0);
+	if (capture.clock != clock)
+	{
+		printf("The capture was recorded with the %s, so the times can't be compared\n",
+				capture.clock == ReplaySimClock ? "simulator's virtual clock" : "wall clock");
+	}
+	else if (maxSlowdown >= 0 && change > maxSlowdown)
+	{
+		printf("The replay was %.1f%% slower than the recording, more than the %.1f%% allowed\n",
+				100.0 * change, 100.0 * maxSlowdown);
+		ok = false;
+	}
+
+	for (uint32_t i = 0; i < capture.count; i++)
+	{
+		free(capture.exchanges[i].sent);
+		free(capture.exchanges[i].reply);
+	}
+	free(capture.exchanges);
+	free(latencyUS);
+	return ok ? 0 : 1;
+}
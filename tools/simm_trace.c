@@ -0,0 +1,654 @@
+/*
+ * simm_trace.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: SIMM Programmer contributors
+ *
+ * Copyright (C) 2026 SIMM Programmer contributors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * -----------------------------------------------------------------------------
+ *
+ * Decodes the firmware's event trace (see GetTrace in programmer_protocol.h)
+ * into a timeline. The trace can come straight from a programmer with
+ * --device, or from a file saved earlier with --save or by simm_bench --trace.
+ * A saved trace is exactly what GetTrace sends between CommandReplyOK and
+ * ProgrammerGetTraceDone: the event count, the total, then 8 bytes per event.
+ *
+ * Each event is printed with its time since the first event and since the
+ * previous event. End events also show how long it's been since the matching
+ * start event. A summary at the end points out the slowest operations and the
+ * longest gap where nothing happened.
+ */
+
+#include "../programmer_protocol.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+/// Size of each event in a trace
+#define EVENT_SIZE					8
+/// How long to wait for the programmer to reply
+#define REPLY_TIMEOUT_MS			5000
+
+/// A decoded event
+typedef struct TraceToolEvent
+{
+	/// Time since the first event in the trace, with timer wraparound undone
+	uint64_t timeUS;
+	uint8_t event;
+	uint8_t arg8;
+	uint16_t arg16;
+} TraceToolEvent;
+
+/// A whole trace
+typedef struct TraceToolTrace
+{
+	uint32_t count;
+	uint32_t total;
+	TraceToolEvent *events;
+} TraceToolTrace;
+
+/// The kinds of operations that have a start event and an end event
+typedef enum TraceToolSpan
+{
+	SpanCommand = 0,
+	SpanProgram,
+	SpanEraseChips,
+	SpanEraseSector,
+	NumSpans
+} TraceToolSpan;
+
+/// The slowest one of each kind of operation
+typedef struct TraceToolSlowest
+{
+	uint32_t count;
+	uint64_t totalUS;
+	uint64_t maxUS;
+	/// The start event of the slowest one
+	TraceToolEvent const *maxStart;
+} TraceToolSlowest;
+
+/// Names of the events, in ProgrammerTraceEvent order
+static char const * const eventNames[NumTraceEvents] = {
+	"CommandStart",
+	"CommandEnd",
+	"ChunkReceived",
+	"ProgramStart",
+	"ProgramEnd",
+	"EraseChipsStart",
+	"EraseChipsEnd",
+	"EraseSectorStart",
+	"EraseSectorEnd",
+	"USBPacketIn",
+	"USBPacketOut",
+	"VerifyFailure",
+};
+
+/// Names of the commands, in ProgrammerCommand order
+static char const * const commandNames[] = {
+	"EnterWaitingMode",
+	"DoElectricalTest",
+	"IdentifyChips",
+	"ReadByte",
+	"ReadChips",
+	"EraseChips",
+	"WriteChips",
+	"GetBootloaderState",
+	"EnterBootloader",
+	"EnterProgrammer",
+	"BootloaderEraseAndWriteProgram",
+	"SetSIMMTypePLCC32_2MB",
+	"SetSIMMTypeLarger",
+	"SetVerifyWhileWriting",
+	"SetNoVerifyWhileWriting",
+	"ErasePortion",
+	"WriteChipsAt",
+	"ReadChipsAt",
+	"SetChipsMask",
+	"SetSectorLayout",
+	"GetFirmwareVersion",
+	"GetStats",
+	"ResetStats",
+	"GetTrace",
+	"ClearTrace",
+};
+
+/// Names of the spans, for the summary
+static char const * const spanNames[NumSpans] = {
+	"command",
+	"program",
+	"erase chips",
+	"erase sectors",
+};
+
+/** Figures out which kind of operation an event starts or ends
+ *
+ * @param event The event
+ * @param isEnd Filled in with true if it's an end event
+ * @return The span, or NumSpans if the event isn't a start or end
+ */
+static TraceToolSpan TraceTool_SpanForEvent(uint8_t event, bool *isEnd)
+{
+	*isEnd = false;
+	switch (event)
+	{
+	case TraceCommandEnd: *isEnd = true; // fall through
+	case TraceCommandStart: return SpanCommand;
+	case TraceProgramEnd: *isEnd = true; // fall through
+	case TraceProgramStart: return SpanProgram;
+	case TraceEraseChipsEnd: *isEnd = true; // fall through
+	case TraceEraseChipsStart: return SpanEraseChips;
+	case TraceEraseSectorEnd: *isEnd = true; // fall through
+	case TraceEraseSectorStart: return SpanEraseSector;
+	default: return NumSpans;
+	}
+}
+
+/** Gets a 32-bit little-endian value out of a buffer
+ *
+ * @param p The buffer
+ * @return The value
+ */
+static uint32_t TraceTool_Long(uint8_t const *p)
+{
+	return p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+/** Decodes a raw trace
+ *
+ * @param raw The raw trace, as sent by GetTrace
+ * @param len The length of the raw trace
+ * @param trace Filled in with the decoded trace
+ * @return True on success, false if the trace is malformed
+ */
+static bool TraceTool_Decode(uint8_t const *raw, size_t len, TraceToolTrace *trace)
+{
+	if (len < 8)
+	{
+		fprintf(stderr, "Trace is too short\n");
+		return false;
+	}
+	trace->count = TraceTool_Long(raw);
+	trace->total = TraceTool_Long(raw + 4);
+	if (len != 8 + (size_t)trace->count * EVENT_SIZE)
+	{
+		fprintf(stderr, "Trace should have %u events, but it's %zu bytes long\n", trace->count, len);
+		return false;
+	}
+
+	trace->events = calloc(trace->count ? trace->count : 1, sizeof(TraceToolEvent));
+	if (!trace->events)
+	{
+		return false;
+	}
+
+	// The firmware's clock is 32 bits and wraps around, but events are in
+	// order, so just add up the differences
+	uint64_t time = 0;
+	uint32_t lastUS = 0;
+	for (uint32_t i = 0; i < trace->count; i++)
+	{
+		uint8_t const *p = raw + 8 + i * EVENT_SIZE;
+		uint32_t const us = TraceTool_Long(p);
+		if (i > 0)
+		{
+			time += (uint32_t)(us - lastUS);
+		}
+		lastUS = us;
+		trace->events[i].timeUS = time;
+		trace->events[i].event = p[4];
+		trace->events[i].arg8 = p[5];
+		trace->events[i].arg16 = p[6] | (p[7] << 8);
+	}
+
+	return true;
+}
+
+/** Reads a whole file
+ *
+ * @param f The file
+ * @param len Filled in with its length
+ * @return The contents, or NULL on failure
+ */
+static uint8_t *TraceTool_ReadFile(FILE *f, size_t *len)
+{
+	size_t size = 0;
+	size_t capacity = 65536;
+	uint8_t *buf = malloc(capacity);
+	size_t got;
+
+	while (buf && (got = fread(buf + size, 1, capacity - size, f)) > 0)
+	{
+		size += got;
+		if (size == capacity)
+		{
+			uint8_t *bigger = realloc(buf, capacity * 2);
+			if (!bigger)
+			{
+				free(buf);
+				return NULL;
+			}
+			buf = bigger;
+			capacity *= 2;
+		}
+	}
+
+	*len = size;
+	return buf;
+}
+
+/** Receives data from the programmer
+ *
+ * @param fd The programmer
+ * @param data Buffer for the data
+ * @param len The number of bytes to wait for
+ * @return True on success, false on failure or timeout
+ */
+static bool TraceTool_Receive(int fd, void *data, size_t len)
+{
+	uint8_t *p = data;
+	while (len)
+	{
+		struct pollfd pfd = {fd, POLLIN, 0};
+		int const result = poll(&pfd, 1, REPLY_TIMEOUT_MS);
+		if (result == 0)
+		{
+			fprintf(stderr, "Timed out waiting for the programmer\n");
+			return false;
+		}
+		else if (result < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+			perror("Unable to wait for programmer");
+			return false;
+		}
+
+		ssize_t const got = read(fd, p, len);
+		if (got > 0)
+		{
+			p += got;
+			len -= (size_t)got;
+		}
+		else if (got < 0 && (errno == EINTR || errno == EAGAIN))
+		{
+			continue;
+		}
+		else
+		{
+			fprintf(stderr, "Lost connection to programmer\n");
+			return false;
+		}
+	}
+	return true;
+}
+
+/** Sends a command to the programmer and gets its reply
+ *
+ * @param fd The programmer
+ * @param command The command
+ * @param reply Filled in with the reply
+ * @return True on success, false on failure
+ */
+static bool TraceTool_Command(int fd, uint8_t command, uint8_t *reply)
+{
+	if (write(fd, &command, 1) != 1)
+	{
+		perror("Unable to write to programmer");
+		return false;
+	}
+	return TraceTool_Receive(fd, reply, 1);
+}
+
+/** Gets the trace from a programmer
+ *
+ * @param device The programmer's serial port
+ * @param clear True to clear the trace afterward
+ * @param len Filled in with the length of the raw trace
+ * @return The raw trace, or NULL on failure
+ */
+static uint8_t *TraceTool_Fetch(char const *device, bool clear, size_t *len)
+{
+	struct termios tio;
+	uint8_t reply;
+	uint8_t *raw = NULL;
+
+	int const fd = open(device, O_RDWR | O_NOCTTY);
+	if (fd < 0 || tcgetattr(fd, &tio) < 0)
+	{
+		fprintf(stderr, "Unable to open %s: %s\n", device, strerror(errno));
+		return NULL;
+	}
+	cfmakeraw(&tio);
+	tcsetattr(fd, TCSANOW, &tio);
+	tcflush(fd, TCIOFLUSH);
+
+	if (!TraceTool_Command(fd, EnterWaitingMode, &reply) || reply != CommandReplyOK ||
+		!TraceTool_Command(fd, GetTrace, &reply))
+	{
+		goto done;
+	}
+	if (reply != CommandReplyOK)
+	{
+		fprintf(stderr, "The firmware doesn't keep a trace. Build it with -DSIMM_TRACE=ON.\n");
+		goto done;
+	}
+
+	uint8_t header[8];
+	if (!TraceTool_Receive(fd, header, sizeof(header)))
+	{
+		goto done;
+	}
+	*len = sizeof(header) + (size_t)TraceTool_Long(header) * EVENT_SIZE;
+	if (!(raw = malloc(*len)))
+	{
+		goto done;
+	}
+	memcpy(raw, header, sizeof(header));
+	if (!TraceTool_Receive(fd, raw + sizeof(header), *len - sizeof(header)) ||
+		!TraceTool_Receive(fd, &reply, 1) || reply != ProgrammerGetTraceDone)
+	{
+		fprintf(stderr, "Didn't get the whole trace\n");
+		free(raw);
+		raw = NULL;
+		goto done;
+	}
+
+	if (clear && (!TraceTool_Command(fd, ClearTrace, &reply) || reply != CommandReplyOK))
+	{
+		fprintf(stderr, "Unable to clear the trace\n");
+	}
+
+done:
+	close(fd);
+	return raw;
+}
+
+/** Prints the arguments of an event in a readable way
+ *
+ * @param out Where to print them
+ * @param e The event
+ */
+static void TraceTool_PrintArgs(FILE *out, TraceToolEvent const *e)
+{
+	switch (e->event)
+	{
+	case TraceCommandStart:
+	case TraceCommandEnd:
+		if (e->arg8 < sizeof(commandNames) / sizeof(commandNames[0]))
+		{
+			fprintf(out, "%s", commandNames[e->arg8]);
+		}
+		else
+		{
+			fprintf(out, "command %u", e->arg8);
+		}
+		break;
+	case TraceChunkReceived:
+		fprintf(out, "chunk %u", e->arg16);
+		break;
+	case TraceProgramStart:
+	case TraceEraseSectorStart:
+		fprintf(out, "chips 0x%X, address 0x%06X", e->arg8, (unsigned)e->arg16 << 8);
+		break;
+	case TraceEraseSectorEnd:
+		fprintf(out, "chips 0x%X, %u sector%s", e->arg8, e->arg16, e->arg16 == 1 ? "" : "s");
+		break;
+	case TraceProgramEnd:
+	case TraceEraseChipsStart:
+	case TraceEraseChipsEnd:
+		fprintf(out, "chips 0x%X", e->arg8);
+		break;
+	case TraceUSBPacketIn:
+	case TraceUSBPacketOut:
+		fprintf(out, "%u bytes", e->arg16);
+		break;
+	case TraceVerifyFailure:
+		fprintf(out, "bad chips 0x%X, chunk %u", e->arg8, e->arg16);
+		break;
+	default:
+		fprintf(out, "0x%02X 0x%04X", e->arg8, e->arg16);
+		break;
+	}
+}
+
+/** Prints the timeline and the summary
+ *
+ * @param out Where to print them
+ * @param trace The trace
+ * @param showPackets True to include each USB packet in the timeline
+ */
+static void TraceTool_Print(FILE *out, TraceToolTrace const *trace, bool showPackets)
+{
+	TraceToolEvent const *starts[NumSpans] = {NULL};
+	TraceToolSlowest slowest[NumSpans];
+	uint32_t eventCounts[NumTraceEvents + 1] = {0};
+	uint64_t longestGap = 0;
+	TraceToolEvent const *longestGapEnd = NULL;
+	TraceToolEvent const *prevPrinted = NULL;
+
+	memset(slowest, 0, sizeof(slowest));
+
+	if (trace->total > trace->count)
+	{
+		fprintf(out, "%u older events were overwritten before the trace was read\n\n",
+				trace->total - trace->count);
+	}
+	fprintf(out, "%12s %12s  %-16s\n", "time (ms)", "delta (us)", "event");
+
+	for (uint32_t i = 0; i < trace->count; i++)
+	{
+		TraceToolEvent const *e = &trace->events[i];
+		eventCounts[e->event < NumTraceEvents ? e->event : NumTraceEvents]++;
+
+		if (i > 0 && e->timeUS - e[-1].timeUS > longestGap)
+		{
+			longestGap = e->timeUS - e[-1].timeUS;
+			longestGapEnd = e;
+		}
+
+		// Match up starts and ends
+		bool isEnd;
+		TraceToolSpan const span = TraceTool_SpanForEvent(e->event, &isEnd);
+		uint64_t duration = 0;
+		bool hasDuration = false;
+		if (span != NumSpans)
+		{
+			if (!isEnd)
+			{
+				starts[span] = e;
+			}
+			else if (starts[span])
+			{
+				duration = e->timeUS - starts[span]->timeUS;
+				hasDuration = true;
+				slowest[span].count++;
+				slowest[span].totalUS += duration;
+				if (duration >= slowest[span].maxUS)
+				{
+					slowest[span].maxUS = duration;
+					slowest[span].maxStart = starts[span];
+				}
+				starts[span] = NULL;
+			}
+		}
+
+		if (!showPackets && (e->event == TraceUSBPacketIn || e->event == TraceUSBPacketOut))
+		{
+			continue;
+		}
+
+		uint64_t const delta = prevPrinted ? e->timeUS - prevPrinted->timeUS : 0;
+		prevPrinted = e;
+		fprintf(out, "%12.3f %+12lld  %-16s  ", e->timeUS / 1000.0, (long long)delta,
+				e->event < NumTraceEvents ? eventNames[e->event] : "Unknown");
+		TraceTool_PrintArgs(out, e);
+		if (hasDuration)
+		{
+			fprintf(out, "  (took %.3f ms)", duration / 1000.0);
+		}
+		fprintf(out, "\n");
+	}
+
+	fprintf(out, "\nSummary:\n");
+	if (trace->count)
+	{
+		fprintf(out, "  %u events over %.3f ms\n", trace->count,
+				trace->events[trace->count - 1].timeUS / 1000.0);
+	}
+	for (int i = 0; i < NumTraceEvents; i++)
+	{
+		if (eventCounts[i])
+		{
+			fprintf(out, "  %-16s %u\n", eventNames[i], eventCounts[i]);
+		}
+	}
+	if (eventCounts[NumTraceEvents])
+	{
+		fprintf(out, "  %-16s %u\n", "Unknown", eventCounts[NumTraceEvents]);
+	}
+	for (int i = 0; i < NumSpans; i++)
+	{
+		if (!slowest[i].count)
+		{
+			continue;
+		}
+		fprintf(out, "  %s: %u, %.3f ms total, %.3f ms average, slowest %.3f ms at %.3f ms (",
+				spanNames[i], slowest[i].count, slowest[i].totalUS / 1000.0,
+				slowest[i].totalUS / 1000.0 / slowest[i].count, slowest[i].maxUS / 1000.0,
+				slowest[i].maxStart->timeUS / 1000.0);
+		TraceTool_PrintArgs(out, slowest[i].maxStart);
+		fprintf(out, ")\n");
+	}
+	if (longestGapEnd)
+	{
+		fprintf(out, "  longest gap: %.3f ms, before %s at %.3f ms\n", longestGap / 1000.0,
+				longestGapEnd->event < NumTraceEvents ? eventNames[longestGapEnd->event] : "Unknown",
+				longestGapEnd->timeUS / 1000.0);
+	}
+}
+
+/** Prints how to use the decoder
+ *
+ * @param name The program's name
+ */
+static void TraceTool_Usage(char const *name)
+{
+	fprintf(stderr,
+		"Usage: %s [options]\n"
+		"  --device PATH    get the trace from the programmer on this serial port\n"
+		"  --file PATH      decode a saved trace (default: read it from stdin)\n"
+		"  --save PATH      save the raw trace from --device here\n"
+		"  --clear          clear the programmer's trace after getting it\n"
+		"  --packets        include every USB packet in the timeline\n",
+		name);
+}
+
+int main(int argc, char *argv[])
+{
+	static const struct option options[] = {
+		{"device", required_argument, NULL, 'd'},
+		{"file", required_argument, NULL, 'f'},
+		{"save", required_argument, NULL, 's'},
+		{"clear", no_argument, NULL, 'c'},
+		{"packets", no_argument, NULL, 'p'},
+		{"help", no_argument, NULL, 'h'},
+		{NULL, 0, NULL, 0}
+	};
+	char const *device = NULL;
+	char const *filePath = NULL;
+	char const *savePath = NULL;
+	bool clear = false;
+	bool showPackets = false;
+	int opt;
+
+	while ((opt = getopt_long(argc, argv, "h", options, NULL)) != -1)
+	{
+		switch (opt)
+		{
+		case 'd': device = optarg; break;
+		case 'f': filePath = optarg; break;
+		case 's': savePath = optarg; break;
+		case 'c': clear = true; break;
+		case 'p': showPackets = true; break;
+		default:
+			TraceTool_Usage(argv[0]);
+			return (opt == 'h') ? 0 : 1;
+		}
+	}
+	if ((device && filePath) || ((savePath || clear) && !device))
+	{
+		TraceTool_Usage(argv[0]);
+		return 1;
+	}
+
+	size_t len = 0;
+	uint8_t *raw;
+	if (device)
+	{
+		raw = TraceTool_Fetch(device, clear, &len);
+	}
+	else
+	{
+		FILE *f = filePath ? fopen(filePath, "rb") : stdin;
+		if (!f)
+		{
+			fprintf(stderr, "Unable to open %s: %s\n", filePath, strerror(errno));
+			return 1;
+		}
+		raw = TraceTool_ReadFile(f, &len);
+		if (f != stdin)
+		{
+			fclose(f);
+		}
+	}
+	if (!raw)
+	{
+		return 1;
+	}
+
+	if (savePath)
+	{
+		FILE *f = fopen(savePath, "wb");
+		if (!f || fwrite(raw, 1, len, f) != len)
+		{
+			fprintf(stderr, "Unable to save the trace to %s\n", savePath);
+			return 1;
+		}
+		fclose(f);
+	}
+
+	TraceToolTrace trace;
+	if (!TraceTool_Decode(raw, len, &trace))
+	{
+		return 1;
+	}
+	TraceTool_Print(stdout, &trace, showPackets);
+
+	free(trace.events);
+	free(raw);
+	return 0;
+}
@@ -0,0 +1,59 @@
+# Host tools for working with the programmer and the simulator, and their tests
+enable_testing()
+
+# Pipelined client library for the programmer protocol
+add_library(simm_client STATIC tools/simm_client.c)
+target_compile_options(simm_client PRIVATE -Wall -O2)
+target_compile_definitions(simm_client PRIVATE _GNU_SOURCE)
+set_property(TARGET simm_client PROPERTY C_STANDARD 99)
+
+# End-to-end throughput benchmark
+add_executable(simm_bench tools/simm_bench.c)
+target_compile_options(simm_bench PRIVATE -Wall -O2)
+target_compile_definitions(simm_bench PRIVATE _GNU_SOURCE)
+target_link_libraries(simm_bench PRIVATE simm_client)
+set_property(TARGET simm_bench PROPERTY C_STANDARD 99)
+
+# Event trace decoder
+add_executable(simm_trace tools/simm_trace.c)
+target_compile_options(simm_trace PRIVATE -Wall -O2)
+target_compile_definitions(simm_trace PRIVATE _GNU_SOURCE)
+set_property(TARGET simm_trace PROPERTY C_STANDARD 99)
+
+# Session capture and replay
+add_executable(simm_replay tools/simm_replay.c)
+target_compile_options(simm_replay PRIVATE -Wall -O2)
+target_compile_definitions(simm_replay PRIVATE _GNU_SOURCE)
+set_property(TARGET simm_replay PROPERTY C_STANDARD 99)
+
+# Parallel production flashing on many programmers
+add_executable(simm_farm tools/simm_farm.c)
+target_compile_options(simm_farm PRIVATE -Wall -O2)
+target_compile_definitions(simm_farm PRIVATE _GNU_SOURCE)
+target_link_libraries(simm_farm PRIVATE simm_client)
+set_property(TARGET simm_farm PROPERTY C_STANDARD 99)
+
+# Flash driver tests against the simulated chips
+add_executable(simm_driver_test
+	tools/simm_driver_test.c
+	drivers/parallel_flash.c
+	drivers/parallel_flash_cfi.c
+	drivers/parallel_flash_chips.c
+	hal/host/flash_sim.c
+	hal/host/parallel_bus.c
+)
+target_include_directories(simm_driver_test PRIVATE hal/host)
+target_compile_options(simm_driver_test PRIVATE -Wall -O2)
+target_compile_definitions(simm_driver_test PRIVATE _GNU_SOURCE)
+set_property(TARGET simm_driver_test PROPERTY C_STANDARD 99)
+foreach(test cfi_bottom_boot cfi_top_boot cfi_mixed sector_layout buffered_write buffered_abort buffered_timeout
+		unlock_bypass_session set_chip_type_after_identify)
+	add_test(NAME driver_${test} COMMAND simm_driver_test ${test})
+endforeach()
+
+# Bus cycle budgets, run against the simulator firmware. Every chip
+# configuration goes through the whole benchmark, so this takes a while.
+add_test(NAME bus_budgets
+	COMMAND simm_bench --sim $<TARGET_FILE:SIMMProgrammer.elf>
+		--check-budgets ${CMAKE_CURRENT_SOURCE_DIR}/tools/bus_budgets.txt)
+set_tests_properties(bus_budgets PROPERTIES TIMEOUT 600)
@@ -0,0 +1,121 @@
+/*
+ * trace.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: SIMM Programmer contributors
+ *
+ * Copyright (C) 2026 SIMM Programmer contributors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * -----------------------------------------------------------------------------
+ *
+ * Event trace for the GetTrace command. The most recent events are kept in a
+ * ring buffer, timestamped with the statistics clock, so the host can see
+ * what the firmware was doing and when after a slow or failed job.
+ */
+
+#include "trace.h"
+
+#ifdef TRACE_ENABLED
+
+#include "stats.h"
+#include "hardware.h"
+#include "util.h"
+
+/// How many events we keep. Boards that are short on RAM can pick a smaller
+/// number in their hardware.h. It has to be a power of 2.
+#ifndef TRACE_NUM_EVENTS
+#define TRACE_NUM_EVENTS			512
+#endif
+#if ((TRACE_NUM_EVENTS & (TRACE_NUM_EVENTS - 1)) != 0)
+#error The number of trace events should be a power of 2
+#endif
+
+/// The ring buffer of events
+static TraceEvent events[TRACE_NUM_EVENTS];
+/// The number of events recorded since the trace was cleared
+static uint32_t total;
+/// True if we shouldn't record anything right now
+static bool paused;
+
+/** Records an event in the trace, overwriting the oldest one if it's full
+ *
+ * @param event The event
+ * @param arg8 The 8-bit argument of the event
+ * @param arg16 The 16-bit argument of the event
+ */
+RAMFUNC void Trace_Add(ProgrammerTraceEvent event, uint8_t arg8, uint16_t arg16)
+{
+	if (paused)
+	{
+		return;
+	}
+
+	TraceEvent *e = &events[total & (TRACE_NUM_EVENTS - 1)];
+	e->timeUS = Stats_Now();
+	e->event = (uint8_t)event;
+	e->arg8 = arg8;
+	e->arg16 = arg16;
+	total++;
+}
+
+/** Gets the number of events recorded since the trace was cleared
+ *
+ * @return The number of events, including ones that have been overwritten
+ */
+uint32_t Trace_Total(void)
+{
+	return total;
+}
+
+/** Gets the number of events currently in the trace
+ *
+ * @return The number of events that Trace_Get can return
+ */
+uint32_t Trace_Count(void)
+{
+	return total < TRACE_NUM_EVENTS ? total : TRACE_NUM_EVENTS;
+}
+
+/** Gets an event from the trace
+ *
+ * @param index The index of the event, where 0 is the oldest one still in the trace
+ * @param event Filled in with the event
+ */
+void Trace_Get(uint32_t index, TraceEvent *event)
+{
+	uint32_t const oldest = total - Trace_Count();
+	*event = events[(oldest + index) & (TRACE_NUM_EVENTS - 1)];
+}
+
+/** Stops or restarts recording events, so the trace can be sent without
+ *  filling it up with events about sending it
+ *
+ * @param pause True to stop recording, false to start again
+ */
+void Trace_Pause(bool pause)
+{
+	paused = pause;
+}
+
+/** Empties the trace
+ *
+ */
+void Trace_Clear(void)
+{
+	total = 0;
+}
+
+#endif
@@ -0,0 +1,58 @@
+/*
+ * trace.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: SIMM Programmer contributors
+ *
+ * Copyright (C) 2026 SIMM Programmer contributors
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include "programmer_protocol.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/// One event in the trace, in the same layout that GetTrace sends it
+typedef struct TraceEvent
+{
+	uint32_t timeUS;
+	uint8_t event;
+	uint8_t arg8;
+	uint16_t arg16;
+} TraceEvent;
+
+#ifdef TRACE_ENABLED
+
+void Trace_Add(ProgrammerTraceEvent event, uint8_t arg8, uint16_t arg16);
+uint32_t Trace_Total(void);
+uint32_t Trace_Count(void);
+void Trace_Get(uint32_t index, TraceEvent *event);
+void Trace_Pause(bool pause);
+void Trace_Clear(void);
+
+/// Records an event in the trace. Disappears when tracing is turned off.
+#define TRACE(event, arg8, arg16)		Trace_Add(event, arg8, arg16)
+
+#else
+
+#define TRACE(event, arg8, arg16)
+
+#endif
+
+#endif /* TRACE_H_ */
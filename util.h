@@ -27,4 +27,12 @@
 /// Macro so we don't have to repeat this monstrosity multiple times
 #define ALWAYS_INLINE			__attribute__ ((__always_inline__)) inline
 
+/// Runs a hot function from RAM instead of flash, if the build enabled it.
+/// Only makes sense on architectures that can execute code out of RAM.
+#ifdef RAMFUNC_ENABLED
+#define RAMFUNC					__attribute__ ((__section__(".ramfunc"), __noinline__))
+#else
+#define RAMFUNC
+#endif
+
 #endif /* UTIL_H_ */